@@ -0,0 +1,77 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+#include "standin.h"
+#include "resolw/resolw_addr.h"
+
+using namespace resolw_bench;
+
+/**
+ * Dual-stack lookups against a loopback server that answers after 1 ms:
+ * both families at once through resolw_addr_resolve(), and the AAAA-then-A
+ * pair over the same transport that callers used to send themselves.
+ */
+
+namespace {
+
+const char kZone[] =
+    "$TTL 300\n"
+    "@ SOA ns hostmaster 1 3600 600 86400 60\n"
+    "  NS ns\n"
+    "ns A 127.0.0.1\n"
+    "www A 192.0.2.1\n"
+    "    A 192.0.2.2\n"
+    "    AAAA 2001:db8::1\n"
+    "    AAAA 2001:db8::2\n";
+
+void point_at_standin(_res_state& rs) {
+    static const StandIn& instance = []() -> const StandIn& {
+        Behavior slow;
+        slow.delay_ms = 1;
+        return shared_standin(kZone, "example.com", {slow});
+    }();
+    res_ninit(&rs);
+    point_at(&rs, instance);
+}
+
+} // anonymous
+
+RESOLW_BENCH("addr/dual_parallel") {
+    _res_state rs;
+    point_at_standin(rs);
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        resolw_addr addrs[8];
+        ops += resolw_addr_resolve(&rs, "www.example.com", AF_UNSPEC, addrs, 8) == 4;
+        keep(addrs[0]);
+    }
+    return ops;
+}
+
+RESOLW_BENCH("addr/dual_sequential") {
+    _res_state rs;
+    point_at_standin(rs);
+    size_t ops = 0;
+    u_char query[512], answer[512];
+    for(size_t i = 0; i < iters; ++i) {
+        int got = 0;
+        for(int type : {T_AAAA, T_A}) {
+            int qlen = res_nmkquery(&rs, QUERY, "www.example.com", C_IN, type, nullptr, 0, nullptr, query, sizeof(query));
+            got += res_nsend(&rs, query, qlen, answer, sizeof(answer)) > 0;
+        }
+        ops += got == 2;
+    }
+    return ops;
+}
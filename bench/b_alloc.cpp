@@ -0,0 +1,141 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+#include "standin.h"
+
+#include <netdb.h>
+#include <cstdio>
+#include <cstdlib>
+
+/**
+ * The steady-state query path must not allocate: the only heap blocks a
+ * query may leave behind are the ones handed to the caller. These cases
+ * count the calling thread's malloc() calls around each batch and abort
+ * if that promise is broken, so `resolw_bench -f alloc/` doubles as the
+ * check. Counting interposes malloc() and friends, which needs glibc and
+ * no sanitizer; the WinDNS backend is left out because the records it
+ * gets back are allocated by the (emulated) system resolver.
+ */
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && defined(RESOLW_BACKEND_NATIVE)
+#define RESOLW_BENCH_ALLOC 1
+#endif
+
+#ifdef RESOLW_BENCH_ALLOC
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+}
+
+namespace {
+
+thread_local size_t _allocations; // initial-exec TLS in the executable; touching it never allocates
+
+} // anonymous
+
+extern "C" {
+
+void* malloc(size_t size) {
+    ++_allocations;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    ++_allocations;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    ++_allocations;
+    return __libc_realloc(ptr, size);
+}
+
+}
+
+using namespace resolw_bench;
+
+namespace {
+
+const char kZone[] =
+    "$TTL 300\n"
+    "@ SOA ns hostmaster 1 3600 600 86400 60\n"
+    "  NS ns\n"
+    "ns A 127.0.0.1\n"
+    "www A 192.0.2.1\n"
+    "    A 192.0.2.2\n"
+    "    AAAA 2001:db8::1\n"
+    "mailhost A 192.0.2.25\n"; // longer than a short-string buffer once qualified
+
+void point_at_standin(res_state rs) {
+    static const StandIn& instance = shared_standin(kZone, "example.com");
+    point_at(rs, instance);
+}
+
+/* Runs `op` once to warm up, then `iters` times; aborts unless exactly `per_op` blocks were allocated each time. */
+template<class Op>
+size_t counted(const char* what, size_t iters, size_t per_op, Op op) {
+    op();
+    size_t before = _allocations;
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        ops += op();
+    }
+    size_t extra = _allocations - before - iters * per_op;
+    if(extra) {
+        fprintf(stderr, "%s: %zu allocations in %zu calls, expected %zu per call\n", what,
+                _allocations - before, iters, per_op);
+        abort();
+    }
+    return ops;
+}
+
+} // anonymous
+
+RESOLW_BENCH("alloc/res_nquery") {
+    _res_state rs;
+    res_ninit(&rs);
+    point_at_standin(&rs);
+    u_char answer[4096];
+    return counted("res_nquery", iters, 0, [&] {
+        return res_nquery(&rs, "www.example.com", C_IN, T_A, answer, sizeof(answer)) > 0;
+    });
+}
+
+RESOLW_BENCH("alloc/res_nquerydomain") {
+    _res_state rs;
+    res_ninit(&rs);
+    point_at_standin(&rs);
+    u_char answer[4096];
+    return counted("res_nquerydomain", iters, 0, [&] {
+        return res_nquerydomain(&rs, "mailhost", "example.com", C_IN, T_A, answer, sizeof(answer)) > 0;
+    });
+}
+
+RESOLW_BENCH("alloc/getrrsetbyname") {
+    point_at_standin(&_res); // getrrsetbyname() uses the implied state
+    // what the caller owns: the rrsetinfo with its name, the rdata block and the signature block
+    return counted("getrrsetbyname", iters, 3, [] {
+        struct rrsetinfo* rrset = nullptr;
+        int rv = getrrsetbyname("www.example.com", C_IN, T_A, 0, &rrset);
+        freerrset(rrset);
+        return rv == ERRSET_SUCCESS;
+    });
+}
+
+#endif /* RESOLW_BENCH_ALLOC */
@@ -0,0 +1,63 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+#include "sts.h"
+#include "trc.h"
+
+#include <cstring>
+
+using namespace resolw_bench;
+using namespace resolw_impl;
+
+RESOLW_BENCH("core/res_randomid") {
+    int prev = resolw_randomid_mode(RESOLW_RANDOMID_STREAM);
+    for(size_t i = 0; i < iters; ++i) keep(res_randomid());
+    resolw_randomid_mode(prev);
+    return iters;
+}
+
+RESOLW_BENCH("core/res_randomid_permute") {
+    int prev = resolw_randomid_mode(RESOLW_RANDOMID_PERMUTE);
+    for(size_t i = 0; i < iters; ++i) keep(res_randomid());
+    resolw_randomid_mode(prev);
+    return iters;
+}
+
+/* Everything res_nsend() records for one successful exchange. */
+RESOLW_BENCH("core/stats_exchange") {
+    sockaddr_in ns;
+    memset(&ns, 0, sizeof(ns));
+    ns.sin_family = AF_INET;
+    ns.sin_port = htons(53);
+    ns.sin_addr.s_addr = htonl(0x7f000001);
+    for(size_t i = 0; i < iters; ++i) {
+        StatsServer* s = stats_server(reinterpret_cast<sockaddr*>(&ns));
+        stats_query(s);
+        stats_response(s, 1000 + (i & 0xffff) * 64, false);
+        stats_rcode(0);
+    }
+    return iters;
+}
+
+/* The cost of the trace hook points of one res_nsend() call with nobody subscribed. */
+RESOLW_BENCH("core/trace_unsubscribed") {
+    for(size_t i = 0; i < iters; ++i) {
+        TraceScope trace("www.example.com", T_A, i);
+        trace.event(RESOLW_TRACE_SERVER_SEND, nullptr, 0, -1, i);
+        trace.event(RESOLW_TRACE_RESPONSE, nullptr, 0, 0, i);
+        trace.complete(64, 0);
+    }
+    return iters;
+}
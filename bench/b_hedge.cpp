@@ -0,0 +1,97 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+#include "standin.h"
+
+#include "net.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * res_nsend() to a loopback server with a bimodal latency (2% of its
+ * replies take 20 ms longer), with a fast one second in the list. "off"
+ * waits for the first server; "on" hedges at its p95 latency with a
+ * budget of 5% extra queries. The first, untimed call of each makes a
+ * separate pass of 1000 queries and reports its p50, p99 and the share
+ * of queries sent to the second server.
+ */
+
+using namespace resolw_bench;
+using namespace resolw_impl;
+
+namespace {
+
+const char kZone[] =
+    "$TTL 300\n"
+    "@ SOA ns hostmaster 1 3600 600 86400 60\n"
+    "  NS ns\n"
+    "ns A 127.0.0.1\n"
+    "www A 192.0.2.1\n";
+
+const StandIn& standin() {
+    static const StandIn& instance = []() -> const StandIn& {
+        Behavior bimodal;
+        bimodal.slow = 0.02;
+        bimodal.slow_ms = 20;
+        return shared_standin(kZone, "example.com", {bimodal, Behavior()});
+    }();
+    return instance;
+}
+
+constexpr size_t kReportQueries = 1000;
+
+/* Sends `count` queries, noting each one's latency in `latency` if not null; returns how many were answered. */
+size_t ask(res_state rs, size_t count, uint64_t* latency) {
+    u_char query[512], answer[512];
+    const int qlen = res_nmkquery(rs, QUERY, "www.example.com", C_IN, T_A, nullptr, 0, nullptr, query, sizeof(query));
+    size_t ok = 0;
+    for(size_t i = 0; i < count; ++i) {
+        const uint64_t start = monotonic_ns();
+        ok += res_nsend(rs, query, qlen, answer, sizeof(answer)) > 0;
+        if(latency) latency[i] = monotonic_ns() - start;
+    }
+    return ok;
+}
+
+size_t exchange(size_t iters, bool hedge, const char* name) {
+    const StandIn& server = standin();
+    resolw_hedge_config(hedge ? 95 : 0, 50);
+    _res_state rs;
+    res_ninit(&rs);
+    server.configure(&rs);
+    static std::vector<std::string> reported;
+    if(std::find(reported.begin(), reported.end(), name) == reported.end()) {
+        reported.push_back(name);
+        std::vector<uint64_t> latency(kReportQueries);
+        const uint64_t seconds = server.counters(1).queries;
+        ask(&rs, kReportQueries, latency.data());
+        const uint64_t extra = server.counters(1).queries - seconds;
+        std::sort(latency.begin(), latency.end());
+        fprintf(stderr, "hedge/%s: %zu queries, p50 %.0f us, p99 %.0f us, %.1f%% sent to the second server\n", name,
+                kReportQueries, latency[kReportQueries / 2] / 1e3, latency[kReportQueries * 99 / 100] / 1e3,
+                extra * 100.0 / kReportQueries);
+    }
+    const size_t ok = ask(&rs, iters, nullptr);
+    resolw_hedge_config(0, 50);
+    return ok;
+}
+
+} // anonymous
+
+RESOLW_BENCH("hedge/off") { return exchange(iters, false, "off"); }
+RESOLW_BENCH("hedge/on") { return exchange(iters, true, "on"); }
@@ -0,0 +1,121 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+#include "corpus.h"
+#include "msg.h"
+
+#include <cstring>
+
+using namespace resolw_bench;
+using namespace resolw_impl;
+
+namespace {
+
+/**
+ * What a typical consumer does with an answer: walk every section, expand
+ * owner names and embedded target names, and touch TXT strings.
+ * Returns the number of records visited.
+ */
+int walk(const Message& m) {
+    const u_char* msg = m.bytes.data();
+    const u_char* eom = msg + m.bytes.size();
+    const u_char* cp = msg + kHdrSize;
+    char name[MAXDNAME];
+    for(unsigned q = rd16(msg + kHdrQdCount); q; --q) {
+        int n = msg_skip_name(cp, eom);
+        if(n < 0) return -1;
+        cp += n + 4;
+    }
+    int rrs = rd16(msg + kHdrAnCount) + rd16(msg + kHdrNsCount) + rd16(msg + kHdrArCount);
+    for(int i = 0; i < rrs; ++i) {
+        int n = msg_expand_name(msg, eom, cp, name, sizeof(name));
+        if(n < 0 || cp + n + 10 > eom) return -1;
+        cp += n;
+        unsigned type = rd16(cp);
+        unsigned rdlen = rd16(cp + 8);
+        cp += 10;
+        const u_char* rd = cp;
+        if(rd + rdlen > eom) return -1;
+        switch(type) {
+            case T_CNAME:
+            case T_NS:
+            case T_PTR:
+                msg_expand_name(msg, eom, rd, name, sizeof(name));
+                break;
+            case T_SRV:
+                msg_expand_name(msg, eom, rd + 6, name, sizeof(name));
+                break;
+            case T_RRSIG:
+                msg_expand_name(msg, eom, rd + 18, name, sizeof(name));
+                break;
+            case T_TXT:
+                for(const u_char* s = rd; s < rd + rdlen; s += *s + 1) keep(*s);
+                break;
+        }
+        keep(name[0]);
+        cp += rdlen;
+    }
+    return rrs;
+}
+
+size_t bench_walk(size_t iters, int kind) {
+    const Message& m = corpus_message(kind);
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        int n = walk(m);
+        keep(n);
+        ops += n > 0 ? n : 0;
+    }
+    return ops;
+}
+
+} // anonymous
+
+RESOLW_BENCH("msgs/res_nmkquery") {
+    const auto& names = corpus_names();
+    _res_state rs;
+    memset(&rs, 0, sizeof(rs));
+    rs.options = RES_INIT | RES_DEFAULT;
+    u_char buf[512];
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        for(const auto& n : names) {
+            keep(res_nmkquery(&rs, kOpQuery, n.c_str(), C_IN, T_A, nullptr, 0, nullptr, buf, sizeof(buf)));
+        }
+        ops += names.size();
+    }
+    return ops;
+}
+
+RESOLW_BENCH("msgs/parse_compressed") { return bench_walk(iters, kMsgCompressed); }
+RESOLW_BENCH("msgs/parse_txt") { return bench_walk(iters, kMsgTxt); }
+RESOLW_BENCH("msgs/parse_rrsig") { return bench_walk(iters, kMsgRrsig); }
+
+RESOLW_BENCH("msgs/msg_is_reply_to") {
+    const Message& m = corpus_message(kMsgCompressed);
+    // the matching query is the reply's header and question without QR
+    std::vector<u_char> query(m.bytes.begin(), m.bytes.begin() + kHdrSize);
+    const u_char* q = m.bytes.data() + kHdrSize;
+    int qlen = msg_skip_name(q, m.bytes.data() + m.bytes.size()) + 4;
+    query.insert(query.end(), q, q + qlen);
+    wr16(&query[kHdrFlags], kFlagRD);
+    wr16(&query[kHdrAnCount], 0);
+    wr16(&query[kHdrNsCount], 0);
+    wr16(&query[kHdrArCount], 0);
+    for(size_t i = 0; i < iters; ++i) {
+        keep(msg_is_reply_to(query.data(), query.size(), m.bytes.data(), m.bytes.size()));
+    }
+    return iters;
+}
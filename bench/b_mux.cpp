@@ -0,0 +1,180 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+#include "standin.h"
+
+#include "inf.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * The in-flight table of the shared UDP sockets from 1 to 64 threads,
+ * each keeping 8 queries in flight: one op enters a query and takes the
+ * answer of the oldest one. "mutex_map" is the same with one mutex over
+ * an unordered_map. "reject" looks up answers with IDs nothing is
+ * waiting for. The mux/ cases send res_nsend() queries to a loopback
+ * server from that many threads: on a pooled socket per exchange
+ * ("leased"), on 2 shared sockets, or through one dedicated I/O thread
+ * ("io"). The first pass of 1000 queries or more of each reports the
+ * process CPU time per query, the loopback server's share included.
+ */
+
+using namespace resolw_bench;
+using namespace resolw_impl;
+
+namespace {
+
+constexpr unsigned kDepth = 8;
+constexpr unsigned kPort = 53;
+
+/* Runs `body(thread, iters)` on `threads` threads, splitting `iters` between them; sums what they return. */
+template<class F>
+size_t on_threads(unsigned threads, size_t iters, F body) {
+    std::atomic<size_t> ops{0};
+    std::vector<std::thread> pool;
+    for(unsigned t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t] { ops += body(t, iters / threads + (t < iters % threads)); });
+    }
+    for(std::thread& th : pool) th.join();
+    return ops;
+}
+
+InflightTable<unsigned>& table() {
+    static InflightTable<unsigned>* instance = new InflightTable<unsigned>; // large; never torn down
+    return *instance;
+}
+
+/* Thread `t`'s `i`th key: distinct from every other key in flight. */
+uint64_t key_of(unsigned t, size_t i) {
+    return inflight_key(3 + t % 4, (unsigned) (i * 64 + t), kPort);
+}
+
+size_t striped(unsigned threads, size_t iters) {
+    InflightTable<unsigned>& inflight = table();
+    return on_threads(threads, iters, [&](unsigned t, size_t n) {
+        unsigned values[kDepth];
+        size_t ops = 0;
+        for(size_t i = 0; i < n + kDepth; ++i) {
+            if(i >= kDepth) ops += inflight.take(key_of(t, i - kDepth), [](unsigned*) { return true; }) != nullptr;
+            if(i < n) inflight.insert(key_of(t, i), &values[i % kDepth]);
+        }
+        return ops;
+    });
+}
+
+size_t mutex_map(unsigned threads, size_t iters) {
+    std::mutex mtx;
+    std::unordered_map<uint64_t, unsigned*> inflight;
+    return on_threads(threads, iters, [&](unsigned t, size_t n) {
+        unsigned values[kDepth];
+        size_t ops = 0;
+        for(size_t i = 0; i < n + kDepth; ++i) {
+            if(i >= kDepth) {
+                std::lock_guard<std::mutex> lock(mtx);
+                ops += inflight.erase(key_of(t, i - kDepth));
+            }
+            if(i < n) {
+                std::lock_guard<std::mutex> lock(mtx);
+                inflight.emplace(key_of(t, i), &values[i % kDepth]);
+            }
+        }
+        return ops;
+    });
+}
+
+const char kZone[] =
+    "$TTL 300\n"
+    "@ SOA ns hostmaster 1 3600 600 86400 60\n"
+    "  NS ns\n"
+    "ns A 127.0.0.1\n"
+    "www A 192.0.2.1\n";
+
+const StandIn& standin() {
+    static const StandIn& instance = shared_standin(kZone, "example.com");
+    return instance;
+}
+
+enum Mode { kLeased, kShared, kIoThread };
+
+size_t exchange(unsigned threads, size_t iters, Mode mode, const char* name) {
+    const StandIn& server = standin();
+    resolw_sockpool_share(mode == kShared ? 2 : 0);
+    resolw_sockpool_threads(mode == kIoThread ? 1 : 0);
+    const std::clock_t cpu = std::clock();
+    const size_t ops = on_threads(threads, iters, [&](unsigned, size_t n) {
+        _res_state rs;
+        res_ninit(&rs);
+        server.configure(&rs);
+        rs.retry = 1;
+        u_char query[512], answer[512];
+        const int qlen = res_nmkquery(&rs, QUERY, "www.example.com", C_IN, T_A, nullptr, 0, nullptr, query, sizeof(query));
+        size_t ok = 0;
+        for(size_t i = 0; i < n; ++i) ok += res_nsend(&rs, query, qlen, answer, sizeof(answer)) > 0;
+        return ok;
+    });
+    const double cpu_ns = (double) (std::clock() - cpu) * 1e9 / CLOCKS_PER_SEC;
+    resolw_sockpool_share(0);
+    resolw_sockpool_threads(0);
+    static std::vector<std::string> reported;
+    if(iters >= 1000 && std::find(reported.begin(), reported.end(), name) == reported.end()) {
+        reported.push_back(name);
+        fprintf(stderr, "mux/%s: %zu queries, %.1f us CPU per query\n", name, ops, cpu_ns / 1000 / (ops ? ops : 1));
+    }
+    return ops;
+}
+
+} // anonymous
+
+RESOLW_BENCH("inflight/striped_t1") { return striped(1, iters); }
+RESOLW_BENCH("inflight/striped_t2") { return striped(2, iters); }
+RESOLW_BENCH("inflight/striped_t4") { return striped(4, iters); }
+RESOLW_BENCH("inflight/striped_t8") { return striped(8, iters); }
+RESOLW_BENCH("inflight/striped_t16") { return striped(16, iters); }
+RESOLW_BENCH("inflight/striped_t32") { return striped(32, iters); }
+RESOLW_BENCH("inflight/striped_t64") { return striped(64, iters); }
+RESOLW_BENCH("inflight/mutex_map_t1") { return mutex_map(1, iters); }
+RESOLW_BENCH("inflight/mutex_map_t8") { return mutex_map(8, iters); }
+RESOLW_BENCH("inflight/mutex_map_t64") { return mutex_map(64, iters); }
+
+RESOLW_BENCH("inflight/reject") {
+    InflightTable<unsigned>& inflight = table();
+    unsigned value;
+    for(unsigned i = 0; i < 1000; ++i) inflight.insert(inflight_key(3, i, kPort), &value); // IDs 0-999 in flight
+    size_t rejected = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        const uint64_t key = inflight_key(3, 1000 + i % 60000, kPort);
+        rejected += !inflight.take(key, [](unsigned*) { return true; });
+    }
+    for(unsigned i = 0; i < 1000; ++i) inflight.remove(inflight_key(3, i, kPort), &value);
+    return rejected;
+}
+
+RESOLW_BENCH("mux/leased_t1") { return exchange(1, iters, kLeased, "leased_t1"); }
+RESOLW_BENCH("mux/leased_t8") { return exchange(8, iters, kLeased, "leased_t8"); }
+RESOLW_BENCH("mux/leased_t64") { return exchange(64, iters, kLeased, "leased_t64"); }
+RESOLW_BENCH("mux/shared_t1") { return exchange(1, iters, kShared, "shared_t1"); }
+RESOLW_BENCH("mux/shared_t8") { return exchange(8, iters, kShared, "shared_t8"); }
+RESOLW_BENCH("mux/shared_t64") { return exchange(64, iters, kShared, "shared_t64"); }
+RESOLW_BENCH("mux/io_t1") { return exchange(1, iters, kIoThread, "io_t1"); }
+RESOLW_BENCH("mux/io_t8") { return exchange(8, iters, kIoThread, "io_t8"); }
+RESOLW_BENCH("mux/io_t64") { return exchange(64, iters, kIoThread, "io_t64"); }
@@ -0,0 +1,184 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+#include "corpus.h"
+#include "idn.h"
+#include "msg.h"
+
+using namespace resolw_bench;
+
+namespace {
+
+/* The corpus with every eighth name under a U-label, as in a mostly local, partly international workload. */
+const std::vector<std::string>& mixed_names() {
+    static const std::vector<std::string> instance = [] {
+        static const char* const ulabels[] = {
+            "b\xc3\xbc" "cher", "m\xc3\xbcnchen", "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xbc\xd0\xb5\xd1\x80",
+            "\xe4\xbe\x8b\xe3\x81\x88", "\xce\xb5\xce\xbb\xce\xbb\xce\xac\xce\xb4\xce\xb1",
+        };
+        std::vector<std::string> names = corpus_names();
+        for(size_t i = 0; i < names.size(); i += 8) {
+            names[i] = std::string(ulabels[i / 8 % 5]) + "." + names[i];
+        }
+        return names;
+    }();
+    return instance;
+}
+
+size_t to_ascii(size_t iters, const std::vector<std::string>& names) {
+    char ace[MAXDNAME + 1];
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        for(const auto& n : names) {
+            keep(resolw_impl::name_to_ascii(n.c_str(), ace, sizeof(ace)));
+        }
+        ops += names.size();
+    }
+    return ops;
+}
+
+} // anonymous
+
+RESOLW_BENCH("names/idna_ascii") { return to_ascii(iters, corpus_names()); }
+RESOLW_BENCH("names/idna_mixed") { return to_ascii(iters, mixed_names()); }
+
+RESOLW_BENCH("names/msg_pack_name") {
+    const auto& names = corpus_names();
+    u_char wire[256];
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        for(const auto& n : names) {
+            keep(resolw_impl::msg_pack_name(n.c_str(), wire, sizeof(wire)));
+        }
+        ops += names.size();
+    }
+    return ops;
+}
+
+#ifdef __BSD_VISIBLE
+
+namespace {
+
+constexpr int kNamesPerMsg = 16; // names sharing one compression dictionary
+
+/* Corpus names dn_comp()ressed into message-sized buffers, as a parser would see them. */
+struct PackedNames {
+    std::vector<std::vector<u_char> > msgs;
+    std::vector<std::vector<int> > offsets;
+
+    PackedNames() {
+        const auto& names = corpus_names();
+        for(size_t i = 0; i < names.size(); i += kNamesPerMsg) {
+            std::vector<u_char> msg(kHdrBytes + kNamesPerMsg * 256);
+            std::vector<int> offs;
+            u_char* dnptrs[kNamesPerMsg * 8 + 2] = { msg.data(), nullptr };
+            u_char** lastdnptr = dnptrs + sizeof(dnptrs) / sizeof(*dnptrs);
+            u_char* cp = msg.data() + kHdrBytes;
+            for(size_t j = i; j < names.size() && j < i + kNamesPerMsg; ++j) {
+                int n = dn_comp(names[j].c_str(), cp, msg.data() + msg.size() - cp, dnptrs, lastdnptr);
+                if(n < 0) continue;
+                offs.push_back(cp - msg.data());
+                cp += n;
+            }
+            msg.resize(cp - msg.data());
+            msgs.push_back(msg);
+            offsets.push_back(offs);
+        }
+    }
+
+    static constexpr int kHdrBytes = 12;
+};
+
+const PackedNames& packed() {
+    static const PackedNames instance;
+    return instance;
+}
+
+} // anonymous
+
+RESOLW_BENCH("names/dn_comp") {
+    const auto& names = corpus_names();
+    u_char msg[12 + kNamesPerMsg * 256];
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        for(size_t j = 0; j < names.size(); j += kNamesPerMsg) {
+            u_char* dnptrs[kNamesPerMsg * 8 + 2] = { msg, nullptr };
+            u_char** lastdnptr = dnptrs + sizeof(dnptrs) / sizeof(*dnptrs);
+            u_char* cp = msg + 12;
+            for(size_t k = j; k < names.size() && k < j + kNamesPerMsg; ++k) {
+                int n = dn_comp(names[k].c_str(), cp, msg + sizeof(msg) - cp, dnptrs, lastdnptr);
+                if(n > 0) cp += n;
+            }
+            keep(cp);
+        }
+        ops += names.size();
+    }
+    return ops;
+}
+
+RESOLW_BENCH("names/dn_expand") {
+    const PackedNames& p = packed();
+    char out[MAXDNAME];
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        for(size_t m = 0; m < p.msgs.size(); ++m) {
+            const u_char* msg = p.msgs[m].data();
+            const u_char* eom = msg + p.msgs[m].size();
+            for(int off : p.offsets[m]) {
+                keep(dn_expand(msg, eom, msg + off, out, sizeof(out)));
+            }
+            ops += p.offsets[m].size();
+        }
+    }
+    return ops;
+}
+
+RESOLW_BENCH("names/dn_skipname") {
+    const PackedNames& p = packed();
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        for(size_t m = 0; m < p.msgs.size(); ++m) {
+            const u_char* msg = p.msgs[m].data();
+            const u_char* eom = msg + p.msgs[m].size();
+            for(int off : p.offsets[m]) {
+                keep(dn_skipname(msg + off, eom));
+            }
+            ops += p.offsets[m].size();
+        }
+    }
+    return ops;
+}
+
+RESOLW_BENCH("names/res_hnok") {
+    const auto& names = corpus_names();
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        for(const auto& n : names) keep(res_hnok(n.c_str()));
+        ops += names.size();
+    }
+    return ops;
+}
+
+RESOLW_BENCH("names/res_dnok") {
+    const auto& names = corpus_names();
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        for(const auto& n : names) keep(res_dnok(n.c_str()));
+        ops += names.size();
+    }
+    return ops;
+}
+
+#endif /* __BSD_VISIBLE */
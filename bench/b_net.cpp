@@ -0,0 +1,63 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+#include "standin.h"
+
+#include <cstring>
+
+using namespace resolw_bench;
+
+namespace {
+
+const char kZone[] =
+    "$TTL 300\n"
+    "@ SOA ns hostmaster 1 3600 600 86400 60\n"
+    "  NS ns\n"
+    "ns A 127.0.0.1\n"
+    "www A 192.0.2.1\n"
+    "    A 192.0.2.2\n"
+    "    AAAA 2001:db8::1\n";
+
+enum { kPlain, kTruncating, kServers };
+
+/* Loopback servers shared by all network cases; started on first use. */
+const StandIn& standin() {
+    static const StandIn& instance = []() -> const StandIn& {
+        Behavior plain, truncating; // kPlain, kTruncating
+        truncating.truncate = 1;
+        return shared_standin(kZone, "example.com", {plain, truncating});
+    }();
+    return instance;
+}
+
+size_t exchange(size_t iters, int server, u_long options) {
+    _res_state rs;
+    res_ninit(&rs);
+    rs.options |= options;
+    point_at(&rs, standin(), server);
+    u_char query[512], answer[4096];
+    int qlen = res_nmkquery(&rs, QUERY, "www.example.com", C_IN, T_A, nullptr, 0, nullptr, query, sizeof(query));
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        ops += res_nsend(&rs, query, qlen, answer, sizeof(answer)) > 0;
+    }
+    return ops;
+}
+
+} // anonymous
+
+RESOLW_BENCH("net/res_nsend_udp") { return exchange(iters, kPlain, 0); }
+RESOLW_BENCH("net/res_nsend_tcp") { return exchange(iters, kPlain, RES_USEVC); }
+RESOLW_BENCH("net/res_nsend_tc_fallback") { return exchange(iters, kTruncating, 0); }
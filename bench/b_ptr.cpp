@@ -0,0 +1,157 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+#include "standin.h"
+#include "resolw/resolw_ptr.h"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace resolw_bench;
+
+/**
+ * Reverse names from tables against the snprintf() formatting callers do
+ * by hand, and reverse lookups of 256 addresses (a quarter of them
+ * repeated) against a loopback server: in one batch, and one at a time.
+ * One op is one address.
+ */
+
+namespace {
+
+constexpr size_t kAddrs = 256;
+
+/* Seeded addresses of both families. */
+struct Addrs {
+    u_char v4[kAddrs][4];
+    u_char v6[kAddrs][16];
+
+    Addrs() {
+        std::mt19937 rng(42);
+        for(size_t i = 0; i < kAddrs; ++i) {
+            for(u_char& b : v4[i]) b = rng();
+            for(u_char& b : v6[i]) b = rng();
+        }
+    }
+};
+
+const Addrs& addrs() {
+    static Addrs instance;
+    return instance;
+}
+
+size_t names_table(size_t iters, int family) {
+    const Addrs& a = addrs();
+    char name[RESOLW_PTR_NAMELEN];
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        for(size_t k = 0; k < kAddrs; ++k) {
+            ops += resolw_ptr_name(family, family == AF_INET ? (const void*) a.v4[k] : a.v6[k], name, sizeof(name)) > 0;
+            keep(name);
+        }
+    }
+    return ops;
+}
+
+int snprintf_name(int family, const u_char* p, char* name, size_t len) {
+    if(family == AF_INET) {
+        return snprintf(name, len, "%u.%u.%u.%u.in-addr.arpa", p[3], p[2], p[1], p[0]);
+    }
+    int n = 0;
+    for(int i = 15; i >= 0; --i) {
+        n += snprintf(name + n, len - n, "%x.%x.", p[i] & 0xf, p[i] >> 4);
+    }
+    return n + snprintf(name + n, len - n, "ip6.arpa");
+}
+
+size_t names_snprintf(size_t iters, int family) {
+    const Addrs& a = addrs();
+    char name[RESOLW_PTR_NAMELEN];
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        for(size_t k = 0; k < kAddrs; ++k) {
+            ops += snprintf_name(family, family == AF_INET ? a.v4[k] : a.v6[k], name, sizeof(name)) > 0;
+            keep(name);
+        }
+    }
+    return ops;
+}
+
+/* 192.0.2.0/24, every address with a name. */
+void point_at_standin(_res_state& rs) {
+    static const StandIn& instance = []() -> const StandIn& {
+        std::string text = "$TTL 300\n@ SOA ns.example.com. hostmaster.example.com. 1 3600 600 86400 60\n";
+        text += "  NS ns.example.com.\n";
+        for(int i = 0; i < 256; ++i) {
+            text += std::to_string(i) + " PTR host" + std::to_string(i) + ".example.com.\n";
+        }
+        return shared_standin(text, "2.0.192.in-addr.arpa");
+    }();
+    res_ninit(&rs);
+    point_at(&rs, instance);
+}
+
+/* 256 addresses in 192.0.2.0/24, 64 of them seen before. */
+const std::vector<u_char>& lookups() {
+    static const std::vector<u_char> packed = [] {
+        std::vector<u_char> v;
+        std::mt19937 rng(7);
+        for(size_t i = 0; i < kAddrs; ++i) {
+            u_char last = i % 4 == 3 ? v[(rng() % i) * 4 + 3] : (u_char) rng();
+            v.insert(v.end(), {192, 0, 2, last});
+        }
+        return v;
+    }();
+    return packed;
+}
+
+} // anonymous
+
+RESOLW_BENCH("ptr/name_v4_table") { return names_table(iters, AF_INET); }
+RESOLW_BENCH("ptr/name_v4_snprintf") { return names_snprintf(iters, AF_INET); }
+RESOLW_BENCH("ptr/name_v6_table") { return names_table(iters, AF_INET6); }
+RESOLW_BENCH("ptr/name_v6_snprintf") { return names_snprintf(iters, AF_INET6); }
+
+RESOLW_BENCH("ptr/batch") {
+    _res_state rs;
+    point_at_standin(rs);
+    const std::vector<u_char>& packed = lookups();
+    std::vector<resolw_ptr> results(kAddrs);
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        int n = resolw_ptr_batch(&rs, AF_INET, packed.data(), kAddrs, results.data(), 0);
+        ops += n > 0 ? n : 0;
+    }
+    return ops;
+}
+
+RESOLW_BENCH("ptr/one_by_one") {
+    _res_state rs;
+    point_at_standin(rs);
+    const std::vector<u_char>& packed = lookups();
+    u_char query[512], answer[512];
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        for(size_t k = 0; k < kAddrs; ++k) {
+            char name[RESOLW_PTR_NAMELEN];
+            snprintf_name(AF_INET, &packed[k * 4], name, sizeof(name));
+            int qlen = res_nmkquery(&rs, QUERY, name, C_IN, T_PTR, nullptr, 0, nullptr, query, sizeof(query));
+            ops += res_nsend(&rs, query, qlen, answer, sizeof(answer)) > 0;
+        }
+    }
+    return ops;
+}
@@ -0,0 +1,140 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+#include "corpus.h"
+#include "msg.h"
+#include "resolw/resolw_rdata.h"
+
+using namespace resolw_bench;
+using namespace resolw_impl;
+
+namespace {
+
+/* An HTTPS RRset of the shape CDNs publish: alpn, port, ipv4hint, ech and ipv6hint on every record. */
+const Message& https_message() {
+    static const Message instance = [] {
+        MsgWriter w(0x4567, kFlagQR | kFlagRD | kFlagRA);
+        w.question("www.example.com", kTypeHttps, C_IN);
+        for(int i = 0; i < 16; ++i) {
+            std::vector<u_char> rd = { 0, (u_char) (1 + i % 4), 0 }; // priority, target "."
+            auto param = [&rd](unsigned key, const std::vector<u_char>& value) {
+                rd.push_back(key >> 8); rd.push_back(key);
+                rd.push_back(value.size() >> 8); rd.push_back(value.size());
+                rd.insert(rd.end(), value.begin(), value.end());
+            };
+            param(1, { 2, 'h', '2', 2, 'h', '3' }); // alpn
+            param(3, { 0x01, 0xbb }); // port 443
+            param(4, { 192, 0, 2, (u_char) i, 192, 0, 2, (u_char) (i + 16) }); // ipv4hint
+            param(5, std::vector<u_char>(64 + i, 0xec)); // ech
+            std::vector<u_char> v6(32, 0);
+            v6[0] = 0x20; v6[1] = 0x01; v6[2] = 0x0d; v6[3] = 0xb8; v6[15] = i; v6[31] = i + 16;
+            param(6, v6); // ipv6hint
+            w.rr(0, "www.example.com", kTypeHttps, 300, rd);
+        }
+        return Message{ w.bytes(), w.count() };
+    }();
+    return instance;
+}
+
+/* Makes the `type` view of every record of that type in `m`; returns the records viewed. */
+template<class View>
+size_t view_all(const Message& m, unsigned type, View view) {
+    resolw_msg_iter it;
+    resolw_rr rr;
+    size_t n = 0;
+    resolw_msg_iter_init(&it, m.bytes.data(), m.bytes.size());
+    while(resolw_msg_iter_next(&it, &rr) > 0) {
+        if(rr.type != type) continue;
+        view(rr.rdata);
+        ++n;
+    }
+    return n;
+}
+
+} // anonymous
+
+RESOLW_BENCH("rdata/msg_iter") {
+    const Message& m = corpus_message(kMsgCompressed);
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        resolw_msg_iter it;
+        resolw_rr rr;
+        resolw_msg_iter_init(&it, m.bytes.data(), m.bytes.size());
+        while(resolw_msg_iter_next(&it, &rr) > 0) {
+            keep(rr.ttl);
+            ++ops;
+        }
+    }
+    return ops;
+}
+
+RESOLW_BENCH("rdata/srv_view") {
+    const Message& m = corpus_message(kMsgCompressed);
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        ops += view_all(m, T_SRV, [](const resolw_rdata& rd) {
+            resolw_srv srv;
+            keep(resolw_srv_view(&rd, &srv));
+            keep(srv.port);
+        });
+    }
+    return ops;
+}
+
+RESOLW_BENCH("rdata/srv_view_text") {
+    const Message& m = corpus_message(kMsgCompressed);
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        ops += view_all(m, T_SRV, [](const resolw_rdata& rd) {
+            resolw_srv srv;
+            char target[MAXDNAME + 1];
+            if(!resolw_srv_view(&rd, &srv)) keep(resolw_name_text(&srv.target, target, sizeof(target)));
+        });
+    }
+    return ops;
+}
+
+RESOLW_BENCH("rdata/txt_iterate") {
+    const Message& m = corpus_message(kMsgTxt);
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        ops += view_all(m, T_TXT, [](const resolw_rdata& rd) {
+            resolw_iter txt;
+            const u_char* str;
+            size_t len, total = 0;
+            if(resolw_txt_view(&rd, &txt)) return;
+            while(resolw_txt_next(&txt, &str, &len)) total += len;
+            keep(total);
+        });
+    }
+    return ops;
+}
+
+RESOLW_BENCH("rdata/svcb_iterate") {
+    const Message& m = https_message();
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        ops += view_all(m, kTypeHttps, [](const resolw_rdata& rd) {
+            resolw_svcb svcb;
+            uint16_t key;
+            const u_char* value;
+            size_t len, total = 0;
+            if(resolw_svcb_view(&rd, &svcb)) return;
+            while(resolw_svcb_next(&svcb.params, &key, &value, &len)) total += key + len;
+            keep(total);
+        });
+    }
+    return ops;
+}
@@ -0,0 +1,435 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+/**
+ * One RRSIG check per op for each algorithm in common use, and a signed
+ * SSHFP lookup two zone cuts below a trust anchor: "cold" with the key
+ * and signature caches emptied before every lookup (four exchanges and
+ * four public-key operations), "warm" with them filled (one exchange and
+ * none). The loopback zone is signed here, with keys made up per run.
+ */
+
+#ifdef RESOLW_HAVE_DNSSEC
+
+#include "standin.h"
+#include "msg.h"
+#include "sec.h"
+#include "resolw/resolw_dnssec.h"
+
+#include <openssl/core_names.h>
+#include <openssl/ec.h>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace resolw_bench;
+using namespace resolw_impl;
+
+namespace {
+
+typedef std::vector<u_char> Bytes;
+
+/* A key pair with its DNSKEY rdata, signing the way RRSIGs spell signatures. */
+struct Signer {
+    unsigned alg;
+    EVP_PKEY* pkey; // never freed: lives as long as the cases
+    Bytes dnskey;
+
+    Signer(unsigned alg, unsigned flags = 257) : alg(alg), pkey(generate(alg)), dnskey(4) {
+        wr16(&dnskey[0], flags);
+        dnskey[2] = 3;
+        dnskey[3] = alg;
+        Bytes pub = public_key();
+        dnskey.insert(dnskey.end(), pub.begin(), pub.end());
+    }
+
+    static EVP_PKEY* generate(unsigned alg) {
+        EVP_PKEY* key = nullptr;
+        switch(alg) {
+            case kAlgRsaSha256: key = EVP_PKEY_Q_keygen(nullptr, nullptr, "RSA", (size_t) 2048); break;
+            case kAlgEcdsaP256: key = EVP_PKEY_Q_keygen(nullptr, nullptr, "EC", "P-256"); break;
+            case kAlgEcdsaP384: key = EVP_PKEY_Q_keygen(nullptr, nullptr, "EC", "P-384"); break;
+            case kAlgEd25519: key = EVP_PKEY_Q_keygen(nullptr, nullptr, "ED25519"); break;
+        }
+        if(!key) {
+            fprintf(stderr, "bench: cannot generate a key for algorithm %u\n", alg);
+            abort();
+        }
+        return key;
+    }
+
+    Bytes public_key() const {
+        Bytes out;
+        if(alg == kAlgRsaSha256) { // RFC 3110
+            BIGNUM *n = nullptr, *e = nullptr;
+            EVP_PKEY_get_bn_param(pkey, OSSL_PKEY_PARAM_RSA_N, &n);
+            EVP_PKEY_get_bn_param(pkey, OSSL_PKEY_PARAM_RSA_E, &e);
+            out.push_back(BN_num_bytes(e));
+            out.resize(1 + BN_num_bytes(e) + BN_num_bytes(n));
+            BN_bn2bin(e, &out[1]);
+            BN_bn2bin(n, &out[1 + BN_num_bytes(e)]);
+            BN_free(n);
+            BN_free(e);
+        } else if(alg == kAlgEd25519) {
+            size_t len = 32;
+            out.resize(len);
+            EVP_PKEY_get_raw_public_key(pkey, out.data(), &len);
+        } else { // the uncompressed point without its 0x04
+            u_char point[1 + 96];
+            size_t len = 0;
+            EVP_PKEY_get_octet_string_param(pkey, OSSL_PKEY_PARAM_PUB_KEY, point, sizeof(point), &len);
+            out.assign(point + 1, point + len);
+        }
+        return out;
+    }
+
+    Bytes sign(const Bytes& data) const {
+        const EVP_MD* md = alg == kAlgEd25519 ? nullptr : alg == kAlgEcdsaP384 ? EVP_sha384() : EVP_sha256();
+        EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+        size_t len = 0;
+        Bytes sig;
+        if(EVP_DigestSignInit(ctx, nullptr, md, nullptr, pkey) == 1
+                && EVP_DigestSign(ctx, nullptr, &len, data.data(), data.size()) == 1) {
+            sig.resize(len);
+            EVP_DigestSign(ctx, sig.data(), &len, data.data(), data.size());
+            sig.resize(len);
+        }
+        EVP_MD_CTX_free(ctx);
+        if(alg == kAlgEcdsaP256 || alg == kAlgEcdsaP384) { // DER to r || s (RFC 6605)
+            const size_t half = alg == kAlgEcdsaP256 ? 32 : 48;
+            const u_char* p = sig.data();
+            ECDSA_SIG* es = d2i_ECDSA_SIG(nullptr, &p, sig.size());
+            sig.assign(2 * half, 0);
+            BN_bn2binpad(ECDSA_SIG_get0_r(es), &sig[0], half);
+            BN_bn2binpad(ECDSA_SIG_get0_s(es), &sig[half], half);
+            ECDSA_SIG_free(es);
+        }
+        return sig;
+    }
+
+    unsigned tag() const { // RFC 4034 appendix B
+        uint32_t ac = 0;
+        for(size_t i = 0; i < dnskey.size(); ++i) ac += i & 1 ? dnskey[i] : dnskey[i] << 8;
+        return (ac + (ac >> 16)) & 0xffff;
+    }
+};
+
+/* A signature over 256 random bytes. */
+struct Signed {
+    unsigned alg;
+    Bytes data, sig;
+    EVP_PKEY* pub; // as the validator sees it
+
+    explicit Signed(unsigned alg) : alg(alg), data(256) {
+        std::mt19937 rng(5);
+        for(u_char& b : data) b = rng();
+        const Signer key(alg, 256);
+        sig = key.sign(data);
+        pub = dnssec_parse_key(alg, &key.dnskey[4], key.dnskey.size() - 4);
+    }
+};
+
+// made before main(), so that key generation stays out of the first timed round
+const Signed rsasha256(kAlgRsaSha256), ecdsap256(kAlgEcdsaP256), ecdsap384(kAlgEcdsaP384), ed25519(kAlgEd25519);
+
+size_t verify(size_t iters, const Signed& s) {
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        ops += dnssec_verify(s.pub, s.alg, s.data.data(), s.data.size(), s.sig.data(), s.sig.size());
+    }
+    return ops;
+}
+
+} // anonymous
+
+RESOLW_BENCH("sec/verify_rsasha256") { return verify(iters, rsasha256); }
+RESOLW_BENCH("sec/verify_ecdsap256") { return verify(iters, ecdsap256); }
+RESOLW_BENCH("sec/verify_ecdsap384") { return verify(iters, ecdsap384); }
+RESOLW_BENCH("sec/verify_ed25519") { return verify(iters, ed25519); }
+
+#ifdef RESOLW_BACKEND_NATIVE
+
+namespace {
+
+Bytes wire(const char* name) {
+    u_char buf[MAXCDNAME];
+    int n = msg_pack_name(name, buf, sizeof(buf));
+    return Bytes(buf, buf + (n > 0 ? n : 0));
+}
+
+void append(Bytes& to, const Bytes& what) { to.insert(to.end(), what.begin(), what.end()); }
+
+/* The RRSIG rdata over a one-record RRset; owners are lowercase, so the record is already canonical. */
+Bytes rrsig(const Signer& key, const char* owner, unsigned type, uint32_t ttl, const Bytes& rdata, const char* signer) {
+    const Bytes name = wire(owner);
+    int labels = 0;
+    for(size_t i = 0; name[i]; i += name[i] + 1) ++labels;
+    const uint32_t now = (uint32_t) time(nullptr);
+    Bytes out(18);
+    wr16(&out[0], type);
+    out[2] = key.alg;
+    out[3] = labels;
+    wr32(&out[4], ttl);
+    wr32(&out[8], now + 30 * 86400);
+    wr32(&out[12], now - 3600);
+    wr16(&out[16], key.tag());
+    append(out, wire(signer));
+    Bytes data = out;
+    append(data, name);
+    u_char fixed[10];
+    wr16(fixed, type);
+    wr16(fixed + 2, C_IN);
+    wr32(fixed + 4, ttl);
+    wr16(fixed + 8, rdata.size());
+    data.insert(data.end(), fixed, fixed + sizeof(fixed));
+    append(data, rdata);
+    append(out, key.sign(data));
+    return out;
+}
+
+/* Makes `dnskey` the only trust anchor, unless it already is. */
+void trust(const char* owner, const Bytes& dnskey) {
+    static Bytes current;
+    if(current != dnskey) {
+        resolw_dnssec_clear_anchors();
+        resolw_dnssec_add_anchor(owner, T_DNSKEY, dnskey.data(), dnskey.size());
+        current = dnskey;
+    }
+}
+
+/* ".", "test." and "host.test." in one loopback zone, with the root key as the only anchor. */
+void point_at_signed_standin() {
+    static Zone zone;
+    static const StandIn& instance = []() -> const StandIn& {
+        parse_zone(zone, "$TTL 300\n@ SOA ns.test. hostmaster.test. 1 3600 600 86400 60\n  NS ns.test.\n", ".");
+        const Signer root(kAlgEcdsaP256), test(kAlgEcdsaP256);
+        Bytes ds(4);
+        wr16(&ds[0], test.tag());
+        ds[2] = test.alg;
+        ds[3] = 2; // SHA-256
+        Bytes hashed = wire("test.");
+        append(hashed, test.dnskey);
+        u_char digest[32];
+        EVP_Digest(hashed.data(), hashed.size(), digest, nullptr, EVP_sha256(), nullptr);
+        ds.insert(ds.end(), digest, digest + sizeof(digest));
+        Bytes sshfp = {1, 2}; // RSA, SHA-256
+        for(int i = 0; i < 32; ++i) sshfp.push_back(i);
+
+        zone.add(".", T_DNSKEY, 3600, root.dnskey);
+        zone.add(".", T_RRSIG, 3600, rrsig(root, ".", T_DNSKEY, 3600, root.dnskey, "."));
+        zone.add("test.", T_DS, 3600, ds);
+        zone.add("test.", T_RRSIG, 3600, rrsig(root, "test.", T_DS, 3600, ds, "."));
+        zone.add("test.", T_DNSKEY, 3600, test.dnskey);
+        zone.add("test.", T_RRSIG, 3600, rrsig(test, "test.", T_DNSKEY, 3600, test.dnskey, "test."));
+        zone.add("host.test.", kTypeSshfp, 300, sshfp);
+        zone.add("host.test.", T_RRSIG, 300, rrsig(test, "host.test.", kTypeSshfp, 300, sshfp, "test."));
+        resolw_dnssec_clear_anchors(); // the real root's keys would not sign this root
+        resolw_dnssec_add_anchor(".", T_DNSKEY, root.dnskey.data(), root.dnskey.size());
+        return shared_standin(zone);
+    }();
+    point_at(&_res, instance); // the calling thread's implied state
+}
+
+size_t validate(size_t iters, bool flush) {
+    point_at_signed_standin();
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        if(flush) resolw_dnssec_flush();
+        struct rrsetinfo* rr = nullptr;
+        if(getrrsetbyname("host.test", C_IN, kTypeSshfp, 0, &rr) == ERRSET_SUCCESS) {
+            ops += !!(rr->rri_flags & RRSET_VALIDATED);
+            freerrset(rr);
+        }
+    }
+    return ops;
+}
+
+/* RFC 4034 §4.1.2, for types below 256. */
+Bytes type_bitmap(std::initializer_list<unsigned> types) {
+    Bytes out = {0, 0};
+    for(unsigned t : types) {
+        if(out.size() < 2 + t / 8 + 1) out.resize(2 + t / 8 + 1);
+        out[2 + t / 8] |= 0x80 >> (t % 8);
+    }
+    out[1] = out.size() - 2;
+    return out;
+}
+
+constexpr int kHosts = 200;
+constexpr uint32_t kNegativeTtl = 3600;
+
+/**
+ * "test." with `kHosts` hosts, signed with NSEC or with NSEC3 (one extra
+ * iteration, salted), and its own key as the anchor.
+ */
+const StandIn& negative_standin(bool nsec3, Bytes& anchor) {
+    static Zone zones[2];
+    static Bytes anchors[2];
+    static const StandIn* instances[2];
+    Zone& zone = zones[nsec3];
+    if(!instances[nsec3]) {
+        parse_zone(zone, "$TTL 3600\n@ SOA ns.test. hostmaster.test. 1 3600 600 86400 3600\n  NS ns.test.\n", "test");
+        const Signer key(kAlgEcdsaP256);
+        auto signed_add = [&](const char* owner, unsigned type, const Bytes& rdata) {
+            zone.add(owner, type, kNegativeTtl, rdata);
+            zone.add(owner, T_RRSIG, kNegativeTtl, rrsig(key, owner, type, kNegativeTtl, rdata, "test."));
+        };
+        Bytes soa = wire("ns.test.");
+        append(soa, wire("hostmaster.test."));
+        for(uint32_t v : {1u, 3600u, 600u, 86400u, kNegativeTtl}) {
+            soa.resize(soa.size() + 4);
+            wr32(&soa[soa.size() - 4], v);
+        }
+        zone.add("test.", T_RRSIG, kNegativeTtl, rrsig(key, "test.", T_SOA, kNegativeTtl, soa, "test."));
+        signed_add("test.", T_DNSKEY, key.dnskey);
+        std::vector<std::string> names = {"test."}; // in canonical order
+        for(int i = 0; i < kHosts; ++i) {
+            char host[16];
+            snprintf(host, sizeof(host), "h%03d.test.", i);
+            names.push_back(host);
+            signed_add(host, T_A, {192, 0, 2, (u_char) i});
+        }
+        if(!nsec3) {
+            for(size_t i = 0; i < names.size(); ++i) {
+                Bytes rdata = wire(names[(i + 1) % names.size()].c_str());
+                append(rdata, i ? type_bitmap({T_A, T_RRSIG, T_NSEC}) : type_bitmap({T_NS, T_SOA, T_RRSIG, T_NSEC, T_DNSKEY}));
+                signed_add(names[i].c_str(), T_NSEC, rdata);
+            }
+        } else {
+            const Bytes salt = {0xab, 0xcd};
+            std::vector<std::pair<Bytes, size_t> > chain; // hash, index into `names`
+            for(size_t i = 0; i < names.size(); ++i) {
+                Bytes h = wire(names[i].c_str());
+                for(int round = 0; round < 2; ++round) { // the initial hash and one iteration
+                    append(h, salt);
+                    u_char digest[20];
+                    EVP_Digest(h.data(), h.size(), digest, nullptr, EVP_sha1(), nullptr);
+                    h.assign(digest, digest + sizeof(digest));
+                }
+                chain.emplace_back(h, i);
+            }
+            std::sort(chain.begin(), chain.end());
+            for(size_t i = 0; i < chain.size(); ++i) {
+                const u_char fixed[] = {1, 0, 0, 1, (u_char) salt.size()}; // SHA-1, no opt-out, 1 iteration
+                Bytes rdata;
+                rdata.reserve(64); // not grown from five bytes, which GCC 12 -O2 misreads as an overflow
+                rdata.assign(fixed, fixed + sizeof(fixed));
+                append(rdata, salt);
+                rdata.push_back(20);
+                append(rdata, chain[(i + 1) % chain.size()].first);
+                append(rdata, chain[i].second ? type_bitmap({T_A, T_RRSIG}) : type_bitmap({T_NS, T_SOA, T_RRSIG, T_DNSKEY, 51}));
+                std::string owner;
+                const char* digits = "0123456789abcdefghijklmnopqrstuv"; // base32hex
+                for(size_t bit = 0; bit < 160; bit += 5) {
+                    const Bytes& h = chain[i].first;
+                    unsigned v = (h[bit / 8] << 8 | (bit / 8 + 1 < 20 ? h[bit / 8 + 1] : 0)) >> (11 - bit % 8) & 31;
+                    owner += digits[v];
+                }
+                signed_add((owner + ".test.").c_str(), T_NSEC3, rdata);
+            }
+        }
+        anchors[nsec3] = key.dnskey;
+        instances[nsec3] = &shared_standin(zone);
+    }
+    anchor = anchors[nsec3];
+    return *instances[nsec3];
+}
+
+struct Lookup {
+    std::string name;
+    unsigned type;
+};
+
+/**
+ * What a mail server asks of one domain: 30% addresses of hosts that exist,
+ * 30% types they lack (TLSA, MX, AAAA), 40% names that do not exist: stray
+ * hosts and the TLSA names under existing ones.
+ */
+const std::vector<Lookup>& mail_trace() {
+    static const std::vector<Lookup> trace = [] {
+        std::vector<Lookup> t;
+        std::mt19937 rng(25);
+        char name[64];
+        for(int i = 0; i < 4000; ++i) {
+            const unsigned host = rng() % kHosts, roll = rng() % 10;
+            if(roll < 3) {
+                snprintf(name, sizeof(name), "h%03u.test", host);
+                t.push_back({name, T_A});
+            } else if(roll < 6) {
+                snprintf(name, sizeof(name), "h%03u.test", host);
+                const unsigned missing[] = {kTypeTlsa, T_MX, T_AAAA};
+                t.push_back({name, missing[roll - 3]});
+            } else if(roll < 8) {
+                snprintf(name, sizeof(name), "x%05u.test", (unsigned) (rng() % 100000));
+                t.push_back({name, T_A});
+            } else {
+                snprintf(name, sizeof(name), "_25._tcp.h%03u.test", host);
+                t.push_back({name, kTypeTlsa});
+            }
+        }
+        return t;
+    }();
+    return trace;
+}
+
+/* Replays the trace from empty caches; one op is one lookup answered as the zone says. */
+size_t replay(size_t iters, bool nsec3, bool aggressive) {
+    Bytes anchor;
+    const StandIn& standin = negative_standin(nsec3, anchor);
+    trust("test.", anchor);
+    _res.nsaddr_list[0] = standin.address(0);
+    _res.nscount = 1;
+    _res.retry = 1;
+    resolw_dnssec_set_aggressive(aggressive);
+    const std::vector<Lookup>& trace = mail_trace();
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        resolw_dnssec_flush();
+        const uint64_t before = standin.counters(0).queries;
+        for(const Lookup& l : trace) {
+            struct rrsetinfo* rr = nullptr;
+            int rv = getrrsetbyname(l.name.c_str(), C_IN, l.type, 0, &rr);
+            bool exists = l.name[0] == 'h';
+            ops += rv == (!exists ? ERRSET_NONAME : l.type == T_A ? ERRSET_SUCCESS : ERRSET_NODATA);
+            if(!rv) freerrset(rr);
+        }
+        static bool reported[2][2];
+        if(!reported[nsec3][aggressive]) {
+            reported[nsec3][aggressive] = true;
+            fprintf(stderr, "sec/replay_%s: %llu upstream queries for %zu lookups\n",
+                    !aggressive ? "plain" : nsec3 ? "nsec3" : "nsec",
+                    (unsigned long long) (standin.counters(0).queries - before), trace.size());
+        }
+    }
+    resolw_dnssec_set_aggressive(true);
+    return ops;
+}
+
+} // anonymous
+
+RESOLW_BENCH("sec/validate_cold") { return validate(iters, true); }
+RESOLW_BENCH("sec/validate_warm") { return validate(iters, false); }
+RESOLW_BENCH("sec/replay_nsec") { return replay(iters, false, true); }
+RESOLW_BENCH("sec/replay_nsec3") { return replay(iters, true, true); }
+RESOLW_BENCH("sec/replay_plain") { return replay(iters, false, false); }
+
+#endif // RESOLW_BACKEND_NATIVE
+
+#endif // RESOLW_HAVE_DNSSEC
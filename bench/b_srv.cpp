@@ -0,0 +1,71 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+#include "standin.h"
+#include "resolw/resolw_srv.h"
+
+/**
+ * resolw_srv_resolve() against a loopback server that puts the targets'
+ * addresses into the additional section: "miss" flushes the cache first
+ * and so costs one exchange, "hit" is the steady state. The WinDNS
+ * backend is left out: the servers it asks are not the resolver state's.
+ */
+
+#ifdef RESOLW_BACKEND_NATIVE
+
+using namespace resolw_bench;
+
+namespace {
+
+const char kZone[] =
+    "$TTL 300\n"
+    "@ SOA ns hostmaster 1 3600 600 86400 60\n"
+    "  NS ns\n"
+    "ns A 127.0.0.1\n"
+    "_sip._udp SRV 10 60 5060 sip1\n"
+    "          SRV 10 40 5060 sip2\n"
+    "          SRV 20 0 5060 sip3\n"
+    "sip1 A 192.0.2.61\n"
+    "     AAAA 2001:db8::61\n"
+    "sip2 A 192.0.2.62\n"
+    "sip3 A 192.0.2.63\n";
+
+void point_at_standin() {
+    static const StandIn& instance = shared_standin(kZone, "example.com");
+    point_at(&_res, instance); // the calling thread's implied state
+}
+
+size_t resolve(size_t iters, bool flush) {
+    point_at_standin();
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        if(flush) resolw_srv_flush();
+        const resolw_srv_list* list;
+        if(resolw_srv_resolve("_sip._udp.example.com", AF_UNSPEC, &list) == ERRSET_SUCCESS) {
+            keep(list->endpoints[0]);
+            ops += list->count == 4;
+            resolw_srv_free(list);
+        }
+    }
+    resolw_srv_flush();
+    return ops;
+}
+
+} // anonymous
+
+RESOLW_BENCH("srv/resolve_miss") { return resolve(iters, true); }
+RESOLW_BENCH("srv/resolve_hit") { return resolve(iters, false); }
+
+#endif // RESOLW_BACKEND_NATIVE
@@ -0,0 +1,159 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "tmr.h"
+
+#include <cstdio>
+#include <map>
+#include <random>
+#include <vector>
+
+/**
+ * The timing wheel with 100k timers armed at once, their deadlines
+ * spread over 5 seconds of a synthetic clock, against a std::multimap
+ * ordered by deadline (what a poll loop would use otherwise). One op is
+ * one timer armed and cancelled ("arm_cancel"), armed again while armed
+ * ("rearm", as a retransmission does), or armed and fired ("expire",
+ * with the clock going forward 1 ms at a time). The first pass of
+ * "expire" reports how many fired, how many early, and the latest.
+ */
+
+using namespace resolw_bench;
+using namespace resolw_impl;
+
+namespace {
+
+constexpr size_t kTimers = 100000;
+constexpr uint64_t kOrigin = 1000000000;
+constexpr uint64_t kSpread = 5000000000; // ns
+constexpr uint64_t kMs = 1000000;
+
+const std::vector<uint64_t>& deadlines() {
+    static std::vector<uint64_t> all = [] {
+        std::mt19937_64 rng(42);
+        std::vector<uint64_t> v(kTimers * 2); // the second half for rearming
+        for(uint64_t& d : v) d = kOrigin + 1 + rng() % kSpread;
+        return v;
+    }();
+    return all;
+}
+
+struct Entry : Timer {
+    uint64_t deadline_ns;
+};
+
+typedef std::multimap<uint64_t, size_t> Queue;
+
+} // anonymous
+
+RESOLW_BENCH("timer/arm_cancel") {
+    const std::vector<uint64_t>& d = deadlines();
+    std::vector<Entry> timers(kTimers);
+    for(size_t i = 0; i < iters; ++i) {
+        TimerWheel wheel(kOrigin);
+        for(size_t t = 0; t < kTimers; ++t) wheel.arm(&timers[t], d[t]);
+        keep(wheel.size());
+        for(size_t t = 0; t < kTimers; ++t) wheel.cancel(&timers[t]);
+    }
+    return iters * kTimers;
+}
+
+RESOLW_BENCH("timer/arm_cancel_multimap") {
+    const std::vector<uint64_t>& d = deadlines();
+    std::vector<Queue::iterator> handles(kTimers);
+    for(size_t i = 0; i < iters; ++i) {
+        Queue queue;
+        for(size_t t = 0; t < kTimers; ++t) handles[t] = queue.emplace(d[t], t);
+        keep(queue.size());
+        for(size_t t = 0; t < kTimers; ++t) queue.erase(handles[t]);
+    }
+    return iters * kTimers;
+}
+
+RESOLW_BENCH("timer/rearm") {
+    const std::vector<uint64_t>& d = deadlines();
+    std::vector<Entry> timers(kTimers);
+    TimerWheel wheel(kOrigin);
+    for(size_t t = 0; t < kTimers; ++t) wheel.arm(&timers[t], d[t]);
+    for(size_t i = 0; i < iters; ++i) {
+        const size_t shift = i % 2 ? 0 : kTimers;
+        for(size_t t = 0; t < kTimers; ++t) wheel.arm(&timers[t], d[t + shift]);
+    }
+    keep(wheel.size());
+    return iters * kTimers;
+}
+
+RESOLW_BENCH("timer/rearm_multimap") {
+    const std::vector<uint64_t>& d = deadlines();
+    std::vector<Queue::iterator> handles(kTimers);
+    Queue queue;
+    for(size_t t = 0; t < kTimers; ++t) handles[t] = queue.emplace(d[t], t);
+    for(size_t i = 0; i < iters; ++i) {
+        const size_t shift = i % 2 ? 0 : kTimers;
+        for(size_t t = 0; t < kTimers; ++t) {
+            queue.erase(handles[t]);
+            handles[t] = queue.emplace(d[t + shift], t);
+        }
+    }
+    keep(queue.size());
+    return iters * kTimers;
+}
+
+RESOLW_BENCH("timer/expire") {
+    const std::vector<uint64_t>& d = deadlines();
+    std::vector<Entry> timers(kTimers);
+    size_t fired = 0, early = 0;
+    uint64_t latest = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        TimerWheel wheel(kOrigin);
+        for(size_t t = 0; t < kTimers; ++t) {
+            timers[t].deadline_ns = d[t];
+            wheel.arm(&timers[t], d[t]);
+        }
+        for(uint64_t now = kOrigin; wheel.size(); now += kMs) {
+            while(Timer* t = wheel.expire(now)) {
+                const Entry& e = static_cast<Entry&>(*t);
+                ++fired;
+                early += now < e.deadline_ns;
+                if(now >= e.deadline_ns) latest = std::max(latest, now - e.deadline_ns);
+            }
+        }
+    }
+    static bool reported;
+    if(!reported) {
+        reported = true;
+        fprintf(stderr, "timer/expire: %zu of %zu fired, %zu early, at most %llu us late\n", fired, iters * kTimers,
+                early, (unsigned long long) (latest / 1000));
+    }
+    return fired;
+}
+
+RESOLW_BENCH("timer/expire_multimap") {
+    const std::vector<uint64_t>& d = deadlines();
+    size_t fired = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        Queue queue;
+        for(size_t t = 0; t < kTimers; ++t) queue.emplace(d[t], t);
+        for(uint64_t now = kOrigin; !queue.empty(); now += kMs) {
+            while(!queue.empty() && queue.begin()->first <= now) {
+                keep(queue.begin()->second);
+                queue.erase(queue.begin());
+                ++fired;
+            }
+        }
+    }
+    return fired;
+}
@@ -0,0 +1,136 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+#include "standin.h"
+
+#ifdef RESOLW_HAVE_DOT
+
+#include "msg.h"
+#include "net.h"
+#include "trc.h"
+#include "resolw/resolw_tls.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+/**
+ * DNS over TLS to a loopback server with a self-signed certificate,
+ * authenticated by name (the strict profile). One op is one answered
+ * query. "fresh" makes a full handshake for every query, "resumed" a
+ * new connection that resumes the session, "pooled" keeps the
+ * connection, and "pipelined" sends batches of 64 queries on it. The
+ * first pass of each case reports the handshakes it made.
+ */
+
+using namespace resolw_bench;
+using namespace resolw_impl;
+
+namespace {
+
+constexpr unsigned kBatch = 64;
+
+const char kZone[] =
+    "$TTL 300\n"
+    "@ SOA ns hostmaster 1 3600 600 86400 60\n"
+    "  NS ns\n"
+    "ns A 127.0.0.1\n"
+    "www A 192.0.2.1\n"
+    "    A 192.0.2.2\n"
+    "    AAAA 2001:db8::1\n";
+
+const StandIn& standin() {
+    static const StandIn& instance = []() -> const StandIn& {
+        Behavior tls;
+        tls.tls = true;
+        const StandIn& s = shared_standin(kZone, "example.com", {tls});
+        const std::string pem = StandIn::certificate();
+        if(resolw_tls_add_trust(pem.data(), pem.size()) != 1
+           || resolw_tls_add_server(reinterpret_cast<const sockaddr*>(&s.address(0)), StandIn::kTlsName)) {
+            fprintf(stderr, "bench: cannot trust the loopback TLS server\n");
+            abort();
+        }
+        return s;
+    }();
+    return instance;
+}
+
+void report(const char* name, const resolw_tls_stats& before, size_t ops) {
+    static std::vector<std::string> reported;
+    for(const std::string& r : reported) {
+        if(r == name) return;
+    }
+    reported.push_back(name);
+    resolw_tls_stats after;
+    resolw_tls_stats_read(&after);
+    fprintf(stderr, "tls/%s: %zu queries, %llu full handshakes, %llu resumed, %llu on a kept connection\n", name, ops,
+            (unsigned long long) (after.handshakes - before.handshakes),
+            (unsigned long long) (after.resumptions - before.resumptions),
+            (unsigned long long) (after.reuses - before.reuses));
+}
+
+/* `flush`: -1 keeps connections, 0 closes them before each query, 1 also forgets the session. */
+size_t exchange(size_t iters, int flush, const char* name) {
+    _res_state rs;
+    res_ninit(&rs);
+    standin().configure(&rs);
+    rs.retry = 1;
+    u_char query[512], answer[4096];
+    int qlen = res_nmkquery(&rs, QUERY, "www.example.com", C_IN, T_A, nullptr, 0, nullptr, query, sizeof(query));
+    resolw_tls_stats before;
+    resolw_tls_stats_read(&before);
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        if(flush >= 0) resolw_tls_flush(flush);
+        ops += res_nsend(&rs, query, qlen, answer, sizeof(answer)) > 0;
+    }
+    report(name, before, ops);
+    return ops;
+}
+
+} // anonymous
+
+RESOLW_BENCH("tls/fresh") { return exchange(iters, 1, "fresh"); }
+RESOLW_BENCH("tls/resumed") { return exchange(iters, 0, "resumed"); }
+RESOLW_BENCH("tls/pooled") { return exchange(iters, -1, "pooled"); }
+
+RESOLW_BENCH("tls/pipelined") {
+    _res_state rs;
+    res_ninit(&rs);
+    standin().configure(&rs);
+    rs.retry = 1;
+    std::vector<u_char> queries(kBatch * 512), answers(kBatch * 512);
+    Exchange ex[kBatch];
+    for(unsigned i = 0; i < kBatch; ++i) {
+        ex[i].msg = &queries[i * 512];
+        ex[i].msglen = res_nmkquery(&rs, QUERY, "www.example.com", C_IN, i % 2 ? T_AAAA : T_A, nullptr, 0, nullptr,
+                                    &queries[i * 512], 512);
+        ex[i].answer = &answers[i * 512];
+        ex[i].anslen = 512;
+    }
+    resolw_tls_stats before;
+    resolw_tls_stats_read(&before);
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        TraceScope trace("www.example.com", T_A, 0);
+        nsend_batch(&rs, ex, kBatch, kBatch, trace);
+        for(const Exchange& e : ex) ops += e.n > 0;
+    }
+    report("pipelined", before, ops);
+    return ops;
+}
+
+#endif /* RESOLW_HAVE_DOT */
@@ -0,0 +1,177 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+#include "msg.h"
+#include "resolw/resolw_update.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+/**
+ * UPDATE records per second, for a change set of 1000 records (SRV, TXT
+ * and CNAME additions, and A deletions) under one service zone: "build"
+ * collects them, "pack_udp" and "pack_tcp" pack the set into 512 and
+ * 65535 byte messages, and "single" makes one res_mkquery() message per
+ * record, the newrr way. The first pass of each packing case reports the
+ * message count and size. Only the TCP case checks a prerequisite, since
+ * an update that has one cannot be split.
+ */
+
+using namespace resolw_bench;
+using namespace resolw_impl;
+
+namespace {
+
+constexpr int kChanges = 1000;
+
+struct Change {
+    char name[64];
+    unsigned type;
+    bool add;
+    u_char rdata[64];
+    int rdlen;
+};
+
+const std::vector<Change>& change_set() {
+    static const std::vector<Change> changes = [] {
+        std::vector<Change> set(kChanges);
+        for(int i = 0; i < kChanges; ++i) {
+            Change& c = set[i];
+            char target[64];
+            snprintf(target, sizeof(target), "node-%02d.svc.example.com", i % 50);
+            c.add = true;
+            switch(i % 4) {
+                case 0: // SRV rdata: priority, weight, port, then the target, never compressed
+                    snprintf(c.name, sizeof(c.name), "i%04d._http._tcp.svc.example.com", i);
+                    c.type = T_SRV;
+                    wr16(c.rdata, 0);
+                    wr16(c.rdata + 2, 0);
+                    wr16(c.rdata + 4, 8080);
+                    c.rdlen = 6 + msg_pack_name(target, c.rdata + 6, sizeof(c.rdata) - 6);
+                    break;
+                case 1:
+                    snprintf(c.name, sizeof(c.name), "i%04d._http._tcp.svc.example.com", i - 1);
+                    c.type = T_TXT;
+                    c.rdlen = 1 + snprintf(reinterpret_cast<char*>(c.rdata + 1), sizeof(c.rdata) - 1, "path=/v1");
+                    c.rdata[0] = c.rdlen - 1;
+                    break;
+                case 2:
+                    snprintf(c.name, sizeof(c.name), "alias-%04d.svc.example.com", i);
+                    c.type = T_CNAME;
+                    c.rdlen = msg_pack_name(target, c.rdata, sizeof(c.rdata));
+                    break;
+                default:
+                    snprintf(c.name, sizeof(c.name), "%s", target);
+                    c.type = T_A;
+                    c.add = false;
+                    c.rdata[0] = 192, c.rdata[1] = 0, c.rdata[2] = 2, c.rdata[3] = i % 250;
+                    c.rdlen = 4;
+                    break;
+            }
+        }
+        return set;
+    }();
+    return changes;
+}
+
+/* The change set in a builder, which checks that "_http._tcp" exists if `guarded`. */
+resolw_update* build(bool guarded) {
+    resolw_update* upd = resolw_update_new("svc.example.com", C_IN);
+    if(!upd || (guarded && resolw_update_require(upd, RESOLW_UPDATE_YXDOMAIN, "_http._tcp.svc.example.com", T_ANY, nullptr, 0))) {
+        fprintf(stderr, "bench: cannot set up an UPDATE\n");
+        abort();
+    }
+    for(const Change& c : change_set()) {
+        int rv = c.add ? resolw_update_add(upd, c.name, c.type, 300, c.rdata, c.rdlen)
+                       : resolw_update_delete(upd, c.name, c.type, c.rdata, c.rdlen);
+        if(rv) {
+            fprintf(stderr, "bench: cannot add %s to an UPDATE\n", c.name);
+            abort();
+        }
+    }
+    return upd;
+}
+
+size_t pack(size_t iters, int size, const char* name) {
+    static resolw_update* const builders[2] = {build(false), build(true)}; // never freed
+    resolw_update* upd = builders[size > 512];
+    _res_state rs;
+    res_ninit(&rs);
+    std::vector<u_char> buf(size);
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        resolw_update_rewind(upd);
+        size_t messages = 0, bytes = 0;
+        int len;
+        while((len = resolw_update_pack(upd, &rs, buf.data(), size)) > 0) {
+            ops += rd16(buf.data() + kHdrNsCount);
+            ++messages;
+            bytes += len;
+        }
+        keep(buf[kHdrSize]);
+        static bool reported[2];
+        if(!reported[size > 512]) {
+            reported[size > 512] = true;
+            fprintf(stderr, "update/%s: %d changes in %zu messages, %zu bytes\n", name, kChanges, messages, bytes);
+        }
+    }
+    return ops;
+}
+
+} // anonymous
+
+RESOLW_BENCH("update/build") {
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        resolw_update* upd = build(true);
+        resolw_update_free(upd);
+        ops += kChanges;
+    }
+    return ops;
+}
+
+RESOLW_BENCH("update/pack_udp") { return pack(iters, 512, "pack_udp"); }
+RESOLW_BENCH("update/pack_tcp") { return pack(iters, 65535, "pack_tcp"); }
+
+RESOLW_BENCH("update/single") {
+    const std::vector<Change>& changes = change_set();
+    _res_state rs;
+    res_ninit(&rs);
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        size_t bytes = 0;
+        for(const Change& c : changes) {
+            u_char rr[MAXCDNAME + 10 + sizeof(c.rdata)];
+            int n = msg_pack_name(c.name, rr, MAXCDNAME);
+            wr16(rr + n, c.type);
+            wr16(rr + n + 2, c.add ? C_IN : 254); // class NONE deletes the one record
+            wr32(rr + n + 4, c.add ? 300 : 0);
+            wr16(rr + n + 8, c.rdlen);
+            memcpy(rr + n + 10, c.rdata, c.rdlen);
+            u_char buf[512];
+            int len = res_nmkquery(&rs, kOpUpdate, "svc.example.com", C_IN, T_SOA, nullptr, 0, rr, buf, sizeof(buf));
+            ops += len > 0;
+            bytes += len;
+        }
+        static bool reported;
+        if(!reported) {
+            reported = true;
+            fprintf(stderr, "update/single: %d changes in %d messages, %zu bytes\n", kChanges, kChanges, bytes);
+        }
+    }
+    return ops;
+}
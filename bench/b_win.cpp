@@ -0,0 +1,128 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#ifdef RESOLW_WINSHIM
+#include "corpus.h"
+#include "msg.h"
+#include "standin.h"
+
+#include <netdb.h>
+#include <resolw_winshim.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace resolw_bench;
+
+/**
+ * The WinDNS code paths (dns.cpp, ndb.cpp) over the emulated WinDNS: no
+ * sockets, so what is measured is query construction, DNS_RECORD list
+ * building and the library's own conversions on top of it.
+ */
+
+namespace {
+
+const char kZone[] =
+    "$TTL 300\n"
+    "@ SOA ns hostmaster 1 3600 600 86400 60\n"
+    "  NS ns\n"
+    "ns A 127.0.0.1\n"
+    "www A 192.0.2.1\n"
+    "    A 192.0.2.2\n"
+    "    AAAA 2001:db8::1\n"
+    "alias CNAME www\n"
+    "_ldap._tcp SRV 0 100 389 ns\n";
+
+const Zone& zone() {
+    static Zone instance;
+    static bool loaded = [] {
+        std::string error;
+        if(!instance.parse(kZone, "example.com", error)) {
+            fprintf(stderr, "bench zone: %s\n", error.c_str());
+            abort();
+        }
+        return true;
+    }();
+    (void) loaded;
+    return instance;
+}
+
+int from_zone(const u_char* query, int qlen, u_char* reply, int replen, int udp, void* ctx) {
+    return static_cast<const Zone*>(ctx)->answer(query, qlen, reply, replen, udp);
+}
+
+/* Replies with a canned corpus message under the query's ID. */
+int from_corpus(const u_char* query, int qlen, u_char* reply, int replen, int udp, void* ctx) {
+    (void) udp;
+    const Message& msg = corpus_message(static_cast<int>(reinterpret_cast<intptr_t>(ctx)));
+    if(qlen < 2 || (int) msg.bytes.size() > replen) return -1;
+    memcpy(reply, msg.bytes.data(), msg.bytes.size());
+    memcpy(reply, query, 2); // ID
+    return msg.bytes.size();
+}
+
+void use_zone() { resolw_winshim_set_resolver(from_zone, const_cast<Zone*>(&zone())); }
+
+void use_corpus(int kind) { resolw_winshim_set_resolver(from_corpus, reinterpret_cast<void*>(static_cast<intptr_t>(kind))); }
+
+size_t rrsets(size_t iters, const char* name, unsigned type) {
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        struct rrsetinfo* rr = nullptr;
+        if(getrrsetbyname(name, C_IN, type, 0, &rr) == ERRSET_SUCCESS) {
+            ops += rr->rri_nrdatas > 0;
+            freerrset(rr);
+        }
+    }
+    return ops;
+}
+
+size_t queries(size_t iters, const char* name, unsigned type) {
+    _res_state rs;
+    res_ninit(&rs);
+    u_char answer[16384];
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        int n = res_nquery(&rs, name, C_IN, type, answer, sizeof(answer));
+        keep(answer);
+        ops += n > 0;
+    }
+    return ops;
+}
+
+} // anonymous
+
+RESOLW_BENCH("win/getrrsetbyname") { use_zone(); return rrsets(iters, "alias.example.com", T_A); }
+
+RESOLW_BENCH("win/getrrsetbyname_legacy") {
+    use_zone();
+    resolw_winshim_set_version(6, 1); // Windows 7: DnsQuery_UTF8() rather than DnsQueryEx()
+    size_t ops = rrsets(iters, "alias.example.com", T_A);
+    resolw_winshim_set_version(10, 0);
+    return ops;
+}
+
+RESOLW_BENCH("win/getrrsetbyname_rrsig") { use_corpus(kMsgRrsig); return rrsets(iters, "www.example.com", T_A); }
+
+RESOLW_BENCH("win/res_nquery") { use_zone(); return queries(iters, "_ldap._tcp.example.com", T_SRV); }
+
+RESOLW_BENCH("win/res_nquery_compressed") {
+    use_corpus(kMsgCompressed);
+    return queries(iters, "_sip._tcp.dc1.prod.internal.example.org", T_SRV);
+}
+
+#endif /* RESOLW_WINSHIM */
@@ -0,0 +1,146 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+#include "standin.h"
+#include "resolw/resolw_xfr.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+/**
+ * Zone transfers from a loopback server of a zone with a million records.
+ * "axfr" takes the whole zone; "ixfr" the last 100 versions, of 20
+ * deletions and 20 additions each, applied to a record count as they
+ * come. One op is one record handed out. The first pass of each case
+ * checks the outcome and reports how far the RSS, sampled as the events
+ * come, rose above where it started, which with the zone already in
+ * memory is what the transfer itself costs.
+ */
+
+using namespace resolw_bench;
+
+namespace {
+
+constexpr int kRecords = 1000000;
+constexpr int kVersions = 100;
+constexpr int kChangesPerVersion = 20; // of each kind
+
+std::vector<u_char> a_rdata(uint32_t i) {
+    return { 10, u_char(i >> 16), u_char(i >> 8), u_char(i) };
+}
+
+const StandIn& standin() {
+    static Zone zone;
+    static const StandIn& instance = []() -> const StandIn& {
+        parse_zone(zone, "$TTL 3600\n@ SOA ns hostmaster 1 3600 600 86400 60\n  NS ns\nns A 127.0.0.1\n",
+                   "big.example");
+        const std::vector<u_char> mx = { 0, 10, 4, 'm', 'a', 'i', 'l', 3, 'b', 'i', 'g', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0 };
+        const std::vector<u_char> aaaa = { 0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+        for(int i = zone.size(); i < kRecords; ++i) {
+            char owner[64];
+            snprintf(owner, sizeof(owner), "h%07d.big.example", i / 2);
+            switch(i % 4) {
+                case 2: zone.add(owner, T_AAAA, 3600, aaaa); break;
+                case 3: zone.add(owner, T_MX, 3600, mx); break;
+                default: zone.add(owner, T_A, 3600, a_rdata(i));
+            }
+        }
+        // each version moves 20 addresses to new names
+        for(int v = 0; v < kVersions; ++v) {
+            std::vector<Zone::Change> changes;
+            for(int k = 0; k < kChangesPerVersion; ++k) {
+                char owner[64];
+                const int i = (v * kChangesPerVersion + k) * 4 + 4; // an A record of the bulk above
+                snprintf(owner, sizeof(owner), "h%07d.big.example", i / 2);
+                changes.push_back({ owner, false, T_A, 3600, a_rdata(i) });
+                snprintf(owner, sizeof(owner), "moved-%d-%d.big.example", v, k);
+                changes.push_back({ owner, true, T_A, 3600, a_rdata(i) });
+            }
+            zone.commit(2 + v, changes);
+        }
+        return shared_standin(zone);
+    }();
+    return instance;
+}
+
+/* The current RSS; ru_maxrss would be the high-water mark, which loading the zone has long since set. */
+long rss_kib() {
+#ifdef __linux__
+    FILE* f = fopen("/proc/self/statm", "r");
+    long size = 0, resident = 0;
+    if(!f) return 0;
+    if(fscanf(f, "%ld %ld", &size, &resident) != 2) resident = 0;
+    fclose(f);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+    return 0;
+#endif
+}
+
+constexpr size_t kRssEvery = 16384; // events between samples
+
+size_t transfer(size_t iters, unsigned type) {
+    _res_state rs;
+    res_ninit(&rs);
+    standin().configure(&rs);
+    size_t ops = 0;
+    for(size_t i = 0; i < iters; ++i) {
+        const long rss_before = rss_kib();
+        long rss_peak = rss_before;
+        resolw_xfr* xfr = resolw_xfr_open(&rs, "big.example", C_IN, type, 1, nullptr);
+        if(!xfr) {
+            fprintf(stderr, "bench: transfer failed to start: %s\n", strerror(errno));
+            abort();
+        }
+        resolw_xfr_event ev;
+        long records = 0, commits = 0;
+        uint32_t serial = 0;
+        int rv;
+        while((rv = resolw_xfr_next(xfr, &ev)) > 0) {
+            if(ev.what == RESOLW_XFR_COMMIT) {
+                ++commits;
+                serial = ev.serial;
+                continue;
+            }
+            records += ev.what == RESOLW_XFR_ADD ? 1 : -1;
+            keep(ev.rr.ttl);
+            if(++ops % kRssEvery == 0) rss_peak = std::max(rss_peak, rss_kib());
+        }
+        const int style = resolw_xfr_style(xfr);
+        resolw_xfr_close(xfr);
+        static bool reported[2];
+        if(!reported[type == T_IXFR]) {
+            reported[type == T_IXFR] = true;
+            const bool ok = rv == 0 && serial == 1 + kVersions
+                         && (type == T_AXFR ? style == RESOLW_XFR_FULL && records == kRecords && commits == 1
+                                            : style == RESOLW_XFR_INCREMENTAL && records == 0 && commits == kVersions);
+            fprintf(stderr, "xfr/%s: %s, %zu events, peak RSS +%ld KiB\n", type == T_AXFR ? "axfr" : "ixfr",
+                    ok ? "complete" : "WRONG", ops, std::max(rss_peak, rss_kib()) - rss_before);
+        }
+    }
+    return ops;
+}
+
+} // anonymous
+
+RESOLW_BENCH("xfr/axfr") { return transfer(iters, T_AXFR); }
+RESOLW_BENCH("xfr/ixfr") { return transfer(iters, T_IXFR); }
@@ -0,0 +1,108 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * Usage: resolw_bench [-f substring] [-t min_ms] [-r rounds] [-l label] [-h]
+ *
+ * Prints one JSON object per line, e.g.
+ *   {"label":"abc123","bench":"names/dn_expand","ops":1048576,"ns_per_op":41.7,"ops_per_sec":23980815}
+ * so that runs from two commits can be joined on "bench" and compared.
+ */
+
+namespace resolw_bench {
+
+namespace {
+
+Case* _cases = nullptr;
+
+double run_round(const Case& c, size_t iters, size_t& ops) {
+    auto start = std::chrono::steady_clock::now();
+    ops = c.fn(iters);
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count();
+}
+
+void usage(const char* argv0) {
+    std::fprintf(stderr, "usage: %s [-f substring] [-t min_ms] [-r rounds] [-l label]\n", argv0);
+}
+
+} // anonymous
+
+Registrar::Registrar(Case* c) {
+    c->next = _cases;
+    _cases = c;
+}
+
+} // resolw_bench
+
+int main(int argc, char** argv) {
+    using namespace resolw_bench;
+    const char* filter = nullptr;
+    const char* label = "";
+    double min_ns = 200e6;
+    int rounds = 3;
+    for(int i = 1; i < argc; ++i) {
+        if(!strcmp(argv[i], "-f") && i + 1 < argc) {
+            filter = argv[++i];
+        } else if(!strcmp(argv[i], "-t") && i + 1 < argc) {
+            min_ns = atof(argv[++i]) * 1e6;
+        } else if(!strcmp(argv[i], "-r") && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if(!strcmp(argv[i], "-l") && i + 1 < argc) {
+            label = argv[++i];
+        } else {
+            usage(argv[0]);
+            return !strcmp(argv[i], "-h") ? 0 : 1;
+        }
+    }
+    if(rounds < 1) rounds = 1;
+
+    // registration order is reverse declaration order; reverse it back
+    Case* ordered = nullptr;
+    for(Case* c = _cases; c; ) {
+        Case* next = c->next;
+        c->next = ordered;
+        ordered = c;
+        c = next;
+    }
+
+    for(Case* c = ordered; c; c = c->next) {
+        if(filter && !strstr(c->name, filter)) continue;
+        size_t iters = 1, ops = 0;
+        c->fn(iters); // warms caches and does the case's setup, untimed
+        double ns = run_round(*c, iters, ops);
+        while(ns < min_ns / rounds && iters < (size_t(1) << 40)) {
+            iters *= ns > 0 ? std::max<size_t>(2, std::min<double>(100, min_ns / rounds / ns)) : 100;
+            ns = run_round(*c, iters, ops);
+        }
+        double best = ns / (ops ? ops : 1);
+        for(int r = 1; r < rounds; ++r) {
+            ns = run_round(*c, iters, ops);
+            double per_op = ns / (ops ? ops : 1);
+            if(per_op < best) best = per_op;
+        }
+        std::printf("{\"label\":\"%s\",\"bench\":\"%s\",\"ops\":%zu,\"ns_per_op\":%.2f,\"ops_per_sec\":%.0f}\n",
+                    label, c->name, ops, best, best > 0 ? 1e9 / best : 0.0);
+        std::fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,45 @@
+#ifndef _BENCH_BENCH_H_
+#define _BENCH_BENCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A deliberately small harness: each case is a function that performs
+// `iters` rounds of work and returns how many operations that was. The
+// driver calls it once untimed, for whatever it sets up on first use,
+// grows `iters` until a round takes long enough to time reliably, then
+// reports the best of several rounds.
+
+namespace resolw_bench {
+
+typedef size_t (*BenchFn)(size_t iters);
+
+struct Case {
+    const char* name; // "group/case"
+    BenchFn fn;
+    Case* next;
+};
+
+struct Registrar {
+    Registrar(Case* c);
+};
+
+/* Keeps `v` (and whatever computed it) alive in the eyes of the optimizer. */
+template<class T>
+inline void keep(const T& v) {
+    asm volatile("" : : "g"(&v) : "memory");
+}
+
+} // resolw_bench
+
+#define RESOLW_BENCH_CAT2(a, b) a##b
+#define RESOLW_BENCH_CAT(a, b) RESOLW_BENCH_CAT2(a, b)
+
+/* Defines and registers a case: `RESOLW_BENCH("names/dn_expand") { ...; return ops; }` */
+#define RESOLW_BENCH(name) \
+    static size_t RESOLW_BENCH_CAT(bench_fn_, __LINE__)(size_t iters); \
+    static resolw_bench::Case RESOLW_BENCH_CAT(bench_case_, __LINE__) = { name, RESOLW_BENCH_CAT(bench_fn_, __LINE__), nullptr }; \
+    static resolw_bench::Registrar RESOLW_BENCH_CAT(bench_reg_, __LINE__)(&RESOLW_BENCH_CAT(bench_case_, __LINE__)); \
+    static size_t RESOLW_BENCH_CAT(bench_fn_, __LINE__)(size_t iters)
+
+#endif /* _BENCH_BENCH_H_ */
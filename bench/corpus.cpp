@@ -0,0 +1,240 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "corpus.h"
+#include "msg.h"
+
+#include <cstdio>
+#include <random>
+
+namespace resolw_bench {
+
+using namespace resolw_impl;
+
+namespace {
+
+constexpr int kNames = 4096;
+constexpr unsigned kSeed = 20230213; // any constant; results must be comparable across runs
+
+const char* const kZones[] = {
+    "example.com", "corp.example.net", "dc1.prod.internal.example.org", "cdn.example-cloud.io",
+    "svc.cluster.local", "mail.protection.outlook.example", "us-east-1.compute.example.com",
+};
+
+const char* const kWords[] = {
+    "www", "api", "mail", "smtp", "edge", "auth", "login", "static", "img", "cache", "db", "replica",
+    "ingest", "metrics", "search", "payments", "gateway", "internal", "staging", "canary",
+};
+
+std::string random_label(std::mt19937& rng, int len) {
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789-";
+    std::string s;
+    for(int i = 0; i < len; ++i) {
+        char c = alphabet[rng() % (i && i + 1 < len ? 37 : 36)]; // no leading/trailing hyphen
+        s.push_back(c);
+    }
+    return s;
+}
+
+std::string make_name(std::mt19937& rng) {
+    const char* zone = kZones[rng() % (sizeof(kZones) / sizeof(*kZones))];
+    std::string name;
+    unsigned shape = rng() % 100;
+    if(shape < 60) {
+        // www.example.com
+        name = kWords[rng() % (sizeof(kWords) / sizeof(*kWords))];
+    } else if(shape < 85) {
+        // _service._tcp.host-12.region.zone
+        name = "_" + std::string(kWords[rng() % 8]) + "._tcp.host-" + std::to_string(rng() % 1000) + "." + random_label(rng, 6);
+    } else if(shape < 95) {
+        // hashed CDN-style labels
+        name = random_label(rng, 32) + "." + random_label(rng, 16);
+    } else {
+        // maximal labels: pushes a name towards the 253-character limit
+        name = random_label(rng, 63) + "." + random_label(rng, 63) + "." + random_label(rng, 40);
+    }
+    name += ".";
+    name += zone;
+    if(name.size() > 253) name.resize(253);
+    while(!name.empty() && (name.back() == '.' || name.back() == '-')) name.pop_back();
+    return name;
+}
+
+std::vector<u_char> be16(unsigned v) { return { (u_char) (v >> 8), (u_char) v }; }
+
+void append(std::vector<u_char>& to, const std::vector<u_char>& what) { to.insert(to.end(), what.begin(), what.end()); }
+
+Message build_compressed() {
+    MsgWriter w(0x1234, kFlagQR | kFlagRD | kFlagRA);
+    w.question("_sip._tcp.dc1.prod.internal.example.org", T_SRV, C_IN);
+    for(int i = 0; i < 24; ++i) {
+        char target[96];
+        snprintf(target, sizeof(target), "sip-%02d.dc1.prod.internal.example.org", i);
+        std::vector<u_char> rd = be16(10 + i % 3);
+        append(rd, be16(100 - i));
+        append(rd, be16(5060));
+        w.rr(0, "_sip._tcp.dc1.prod.internal.example.org", T_SRV, 300, rd, target);
+    }
+    for(int i = 0; i < 4; ++i) {
+        char ns[64];
+        snprintf(ns, sizeof(ns), "ns%d.internal.example.org", i + 1);
+        w.rr(1, "prod.internal.example.org", T_NS, 86400, {}, ns);
+    }
+    for(int i = 0; i < 24; ++i) {
+        char host[96];
+        snprintf(host, sizeof(host), "sip-%02d.dc1.prod.internal.example.org", i);
+        w.rr(2, host, T_A, 300, { 10, 1, (u_char) (i / 8), (u_char) (i * 7) });
+    }
+    for(int i = 0; i < 8; ++i) {
+        char host[96], canon[96];
+        snprintf(host, sizeof(host), "alias-%d.dc1.prod.internal.example.org", i);
+        snprintf(canon, sizeof(canon), "sip-%02d.dc1.prod.internal.example.org", i);
+        w.rr(2, host, T_CNAME, 300, {}, canon);
+    }
+    return { w.bytes(), w.count() };
+}
+
+Message build_txt() {
+    std::mt19937 rng(kSeed + 1);
+    MsgWriter w(0x2345, kFlagQR | kFlagRD | kFlagRA);
+    w.question("example.com", T_TXT, C_IN);
+    for(int i = 0; i < 40; ++i) {
+        std::vector<u_char> rd;
+        int strings = 1 + i % 3;
+        for(int s = 0; s < strings; ++s) {
+            int len = (i % 5 == 0) ? 255 : 40 + rng() % 120; // DKIM keys max out a string
+            rd.push_back(len);
+            std::string text = random_label(rng, len);
+            rd.insert(rd.end(), text.begin(), text.end());
+        }
+        w.rr(0, "example.com", T_TXT, 3600, rd);
+    }
+    return { w.bytes(), w.count() };
+}
+
+Message build_rrsig() {
+    std::mt19937 rng(kSeed + 2);
+    MsgWriter w(0x3456, kFlagQR | kFlagRD | kFlagRA | kFlagAD);
+    w.question("www.example.com", T_A, C_IN);
+    for(int i = 0; i < 4; ++i) {
+        w.rr(0, "www.example.com", T_A, 300, { 192, 0, 2, (u_char) (10 + i) });
+    }
+    for(int i = 0; i < 8; ++i) {
+        std::vector<u_char> rd = be16(T_A);
+        rd.push_back(8); // RSASHA256
+        rd.push_back(3); // labels
+        append(rd, { 0, 0, 1, 44 }); // original TTL 300
+        append(rd, { 0x65, 0x00, 0x00, 0x00 }); // expiration
+        append(rd, { 0x64, 0x00, 0x00, 0x00 }); // inception
+        append(rd, be16(10000 + i)); // key tag
+        u_char signer[] = { 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0 }; // never compressed
+        rd.insert(rd.end(), signer, signer + sizeof(signer));
+        for(int b = 0; b < 256; ++b) rd.push_back(rng());
+        w.rr(0, "www.example.com", T_RRSIG, 300, rd);
+    }
+    for(int i = 0; i < 3; ++i) {
+        std::vector<u_char> rd = be16(i ? 256 : 257);
+        rd.push_back(3);
+        rd.push_back(8);
+        for(int b = 0; b < 260; ++b) rd.push_back(rng());
+        w.rr(2, "example.com", T_DNSKEY, 3600, rd);
+    }
+    return { w.bytes(), w.count() };
+}
+
+} // anonymous
+
+MsgWriter::MsgWriter(unsigned id, unsigned flags) : out_(kHdrSize, 0), count_(0) {
+    wr16(&out_[kHdrId], id);
+    wr16(&out_[kHdrFlags], flags);
+}
+
+void MsgWriter::name(const char* text, bool compress) {
+    u_char wire[256];
+    int len = msg_pack_name(text, wire, sizeof(wire));
+    if(len <= 0) return;
+    for(int pos = 0; wire[pos]; pos += wire[pos] + 1) {
+        std::string suffix(reinterpret_cast<char*>(wire + pos), len - pos);
+        for(auto& c : suffix) c = tolower(c);
+        if(compress) {
+            for(const auto& known : suffixes_) {
+                if(known.first == suffix) {
+                    out_.push_back(0xc0 | (known.second >> 8));
+                    out_.push_back(known.second);
+                    return;
+                }
+            }
+        }
+        if(out_.size() < 0x3fff) {
+            suffixes_.emplace_back(suffix, (int) out_.size());
+        }
+        out_.insert(out_.end(), wire + pos, wire + pos + wire[pos] + 1);
+    }
+    out_.push_back(0);
+}
+
+void MsgWriter::question(const char* qname, unsigned type, unsigned cls) {
+    name(qname, true);
+    append(out_, be16(type));
+    append(out_, be16(cls));
+    wr16(&out_[kHdrQdCount], rd16(&out_[kHdrQdCount]) + 1);
+}
+
+void MsgWriter::rr(int section, const char* owner, unsigned type, unsigned ttl,
+                   const std::vector<u_char>& rdata, const char* rdname) {
+    name(owner, true);
+    append(out_, be16(type));
+    append(out_, be16(C_IN));
+    append(out_, { (u_char) (ttl >> 24), (u_char) (ttl >> 16), (u_char) (ttl >> 8), (u_char) ttl });
+    size_t rdlen_at = out_.size();
+    append(out_, be16(0));
+    append(out_, rdata);
+    if(rdname) {
+        name(rdname, true);
+    }
+    wr16(&out_[rdlen_at], out_.size() - rdlen_at - 2);
+    int counter = kHdrAnCount + 2 * section;
+    wr16(&out_[counter], rd16(&out_[counter]) + 1);
+    ++count_;
+}
+
+const std::vector<std::string>& corpus_names() {
+    static const std::vector<std::string> names = [] {
+        std::mt19937 rng(kSeed);
+        std::vector<std::string> v;
+        for(int i = 0; i < kNames; ++i) v.push_back(make_name(rng));
+        return v;
+    }();
+    return names;
+}
+
+const std::vector<std::vector<u_char> >& corpus_wire_names() {
+    static const std::vector<std::vector<u_char> > wire = [] {
+        std::vector<std::vector<u_char> > v;
+        for(const auto& n : corpus_names()) {
+            u_char buf[256];
+            int len = msg_pack_name(n.c_str(), buf, sizeof(buf));
+            v.emplace_back(buf, buf + (len > 0 ? len : 0));
+        }
+        return v;
+    }();
+    return wire;
+}
+
+const Message& corpus_message(int kind) {
+    static const Message messages[kMsgKinds] = { build_compressed(), build_txt(), build_rrsig() };
+    return messages[kind];
+}
+
+} // resolw_bench
@@ -0,0 +1,57 @@
+#ifndef _BENCH_CORPUS_H_
+#define _BENCH_CORPUS_H_
+
+#include "resolv.h"
+#include <string>
+#include <vector>
+
+// Deterministic workloads shaped after production traffic: mostly short
+// host names with a tail of deep service names and maximal labels, and
+// responses that stress compression and large RRsets.
+
+namespace resolw_bench {
+
+/* Presentation-form names (no trailing dot). */
+const std::vector<std::string>& corpus_names();
+
+/* The same names, encoded as uncompressed wire labels. */
+const std::vector<std::vector<u_char> >& corpus_wire_names();
+
+enum {
+    kMsgCompressed, // ~60 SRV/CNAME/A records under a few zones; most names are pointers
+    kMsgTxt, // a 40-record TXT RRset of multi-string records (SPF/DKIM style), ~12 KB
+    kMsgRrsig, // an A RRset signed by 8 RRSIGs with 256-byte signatures, plus DNSKEYs
+    kMsgKinds,
+};
+
+struct Message {
+    std::vector<u_char> bytes;
+    int rrs; // records in all sections
+};
+
+const Message& corpus_message(int kind);
+
+/**
+ * Minimal response writer with suffix compression, used to build the
+ * corpus messages (and reusable by other benchmarks that need replies).
+ */
+class MsgWriter {
+public:
+    MsgWriter(unsigned id, unsigned flags);
+    void question(const char* name, unsigned type, unsigned cls);
+    /* Appends a record; `rdata` is raw, `rdname` (if any) is appended compressed after it. */
+    void rr(int section, const char* owner, unsigned type, unsigned ttl,
+            const std::vector<u_char>& rdata, const char* rdname = nullptr);
+    std::vector<u_char>& bytes() { return out_; }
+    int count() const { return count_; }
+
+private:
+    void name(const char* text, bool compress);
+    std::vector<u_char> out_;
+    std::vector<std::pair<std::string, int> > suffixes_; // lowercased wire suffix -> offset
+    int count_;
+};
+
+} // resolw_bench
+
+#endif /* _BENCH_CORPUS_H_ */
@@ -0,0 +1,1460 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "standin.h"
+#include "msg.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
+
+#ifdef RESOLW_HAVE_DNSSEC
+#include "resolw/resolw_tsig.h"
+#include <openssl/evp.h>
+#endif
+
+#ifdef RESOLW_HAVE_DOT
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#endif
+
+namespace resolw_bench {
+
+using namespace resolw_impl;
+
+namespace {
+
+// Types by number, as the `nameser.h` variants spell them differently.
+enum {
+    kTypeA = 1, kTypeNS = 2, kTypeCNAME = 5, kTypeSOA = 6, kTypePTR = 12, kTypeMX = 15, kTypeTXT = 16,
+    kTypeAAAA = 28, kTypeSRV = 33, kTypeOPT = 41, kTypeRRSIG = 46, kTypeNSEC = 47, kTypeNSEC3 = 50, kTypeIXFR = 251, kTypeAXFR = 252,
+    kTypeANY = 255,
+};
+
+constexpr unsigned kClassIN = 1;
+constexpr unsigned kRcodeNotAuth = 9;
+constexpr int kEdnsPayload = 1232; // what we advertise back
+constexpr int kMaxChase = 8; // CNAME hops
+
+const struct { const char* name; unsigned type; } kTypes[] = {
+    { "A", kTypeA }, { "NS", kTypeNS }, { "CNAME", kTypeCNAME }, { "SOA", kTypeSOA }, { "PTR", kTypePTR },
+    { "MX", kTypeMX }, { "TXT", kTypeTXT }, { "AAAA", kTypeAAAA }, { "SRV", kTypeSRV }, { "RRSIG", kTypeRRSIG },
+};
+
+struct Token {
+    std::string text;
+    bool quoted;
+};
+
+struct Line {
+    std::vector<Token> tokens;
+    bool blank_owner; // the line started with whitespace
+    int lineno;
+};
+
+/* Splits master file text into logical lines, joining parenthesized continuations. */
+bool tokenize(const std::string& text, std::vector<Line>& lines, std::string& error) {
+    Line cur = { {}, false, 1 };
+    int lineno = 1, depth = 0;
+    bool at_start = true;
+    for(size_t i = 0; i < text.size(); ) {
+        char c = text[i];
+        if(c == '\n') {
+            ++lineno;
+            ++i;
+            if(!depth) {
+                if(!cur.tokens.empty()) lines.push_back(cur);
+                cur = { {}, false, lineno };
+                at_start = true;
+            }
+            continue;
+        }
+        if(c == ' ' || c == '\t' || c == '\r') {
+            if(at_start && !depth) cur.blank_owner = true;
+            at_start = false;
+            ++i;
+            continue;
+        }
+        at_start = false;
+        if(c == ';') {
+            while(i < text.size() && text[i] != '\n') ++i;
+        } else if(c == '(') {
+            ++depth;
+            ++i;
+        } else if(c == ')') {
+            if(!depth--) {
+                error = "line " + std::to_string(lineno) + ": unbalanced ')'";
+                return false;
+            }
+            ++i;
+        } else if(c == '"') {
+            std::string s;
+            for(++i; i < text.size() && text[i] != '"'; ++i) {
+                if(text[i] == '\\' && i + 1 < text.size()) s.push_back(text[i++]);
+                s.push_back(text[i]);
+            }
+            if(i++ >= text.size()) {
+                error = "line " + std::to_string(lineno) + ": unterminated string";
+                return false;
+            }
+            cur.tokens.push_back({ s, true });
+        } else {
+            std::string s;
+            for(; i < text.size() && !strchr(" \t\r\n;()\"", text[i]); ++i) {
+                if(text[i] == '\\' && i + 1 < text.size()) s.push_back(text[i++]);
+                s.push_back(text[i]);
+            }
+            cur.tokens.push_back({ s, false });
+        }
+    }
+    if(depth) {
+        error = "unbalanced '('";
+        return false;
+    }
+    if(!cur.tokens.empty()) lines.push_back(cur);
+    return true;
+}
+
+/* Decodes `\X` and `\DDD` escapes of a character-string. */
+std::string unescape(const std::string& s) {
+    std::string out;
+    for(size_t i = 0; i < s.size(); ++i) {
+        if(s[i] == '\\' && i + 3 < s.size() && isdigit((u_char) s[i + 1]) && isdigit((u_char) s[i + 2]) && isdigit((u_char) s[i + 3])) {
+            out.push_back((char) atoi(s.substr(i + 1, 3).c_str()));
+            i += 3;
+        } else if(s[i] == '\\' && i + 1 < s.size()) {
+            out.push_back(s[++i]);
+        } else {
+            out.push_back(s[i]);
+        }
+    }
+    return out;
+}
+
+bool ends_with_dot(const std::string& name) {
+    size_t n = name.size();
+    if(!n || name[n - 1] != '.') return false;
+    size_t slashes = 0;
+    while(slashes + 1 < n && name[n - 2 - slashes] == '\\') ++slashes;
+    return !(slashes & 1);
+}
+
+std::string absolute(const std::string& name, const std::string& origin) {
+    if(name == "@") return origin;
+    if(ends_with_dot(name)) return name;
+    return origin == "." ? name + "." : name + "." + origin;
+}
+
+bool pack(const std::string& name, std::vector<u_char>& out) {
+    u_char wire[256];
+    int n = msg_pack_name(name.c_str(), wire, sizeof(wire));
+    if(n <= 0) return false;
+    out.insert(out.end(), wire, wire + n);
+    return true;
+}
+
+void put16(std::vector<u_char>& out, unsigned v) {
+    out.push_back(v >> 8);
+    out.push_back(v);
+}
+
+void put32(std::vector<u_char>& out, uint32_t v) {
+    put16(out, v >> 16);
+    put16(out, v & 0xffff);
+}
+
+bool parse_u32(const std::string& s, uint32_t& v) {
+    char* end;
+    unsigned long long n = strtoull(s.c_str(), &end, 10);
+    if(s.empty() || *end || n > 0xffffffffull) return false;
+    v = n;
+    return true;
+}
+
+/* TTLs may use BIND's unit suffixes: 1h30m, 2d, 1w. */
+bool parse_ttl(const std::string& s, uint32_t& ttl) {
+    if(s.empty() || !isdigit((u_char) s[0])) return false;
+    uint64_t total = 0, cur = 0;
+    for(char c : s) {
+        if(isdigit((u_char) c)) {
+            cur = cur * 10 + (c - '0');
+            continue;
+        }
+        unsigned mult;
+        switch(tolower(c)) {
+            case 's': mult = 1; break;
+            case 'm': mult = 60; break;
+            case 'h': mult = 3600; break;
+            case 'd': mult = 86400; break;
+            case 'w': mult = 604800; break;
+            default: return false;
+        }
+        total += cur * mult;
+        cur = 0;
+    }
+    total += cur;
+    if(total > 0x7fffffff) return false;
+    ttl = total;
+    return true;
+}
+
+int parse_type(const std::string& s) {
+    for(const auto& t : kTypes) {
+        if(!strcasecmp(s.c_str(), t.name)) return t.type;
+    }
+    if(!strncasecmp(s.c_str(), "TYPE", 4) && s.size() > 4) { // RFC 3597
+        uint32_t v;
+        if(parse_u32(s.substr(4), v) && v && v <= 0xffff) return v;
+    }
+    return -1;
+}
+
+bool parse_hex(const std::string& s, std::vector<u_char>& out) {
+    if(s.size() & 1) return false;
+    for(size_t i = 0; i < s.size(); i += 2) {
+        if(!isxdigit((u_char) s[i]) || !isxdigit((u_char) s[i + 1])) return false;
+        out.push_back(strtoul(s.substr(i, 2).c_str(), nullptr, 16));
+    }
+    return true;
+}
+
+/* Record data in presentation format -> uncompressed wire format. */
+bool parse_rdata(unsigned type, const std::vector<Token>& t, size_t i, const std::string& origin,
+                 std::vector<u_char>& rd) {
+    const size_t n = t.size() - i;
+    if(n >= 1 && !t[i].quoted && t[i].text == "\\#") {
+        uint32_t len;
+        if(n < 2 || !parse_u32(t[i + 1].text, len)) return false;
+        for(size_t k = i + 2; k < t.size(); ++k) {
+            if(!parse_hex(t[k].text, rd)) return false;
+        }
+        return rd.size() == len;
+    }
+    uint32_t v[5];
+    switch(type) {
+        case kTypeA:
+        case kTypeAAAA: {
+            u_char addr[16];
+            int family = type == kTypeA ? AF_INET : AF_INET6;
+            if(n != 1 || inet_pton(family, t[i].text.c_str(), addr) != 1) return false;
+            rd.insert(rd.end(), addr, addr + (type == kTypeA ? 4 : 16));
+            return true;
+        }
+        case kTypeNS:
+        case kTypeCNAME:
+        case kTypePTR:
+            return n == 1 && pack(absolute(t[i].text, origin), rd);
+        case kTypeMX:
+            if(n != 2 || !parse_u32(t[i].text, v[0]) || v[0] > 0xffff) return false;
+            put16(rd, v[0]);
+            return pack(absolute(t[i + 1].text, origin), rd);
+        case kTypeSRV:
+            if(n != 4) return false;
+            for(int k = 0; k < 3; ++k) {
+                if(!parse_u32(t[i + k].text, v[k]) || v[k] > 0xffff) return false;
+                put16(rd, v[k]);
+            }
+            return pack(absolute(t[i + 3].text, origin), rd);
+        case kTypeTXT:
+            if(!n) return false;
+            for(size_t k = i; k < t.size(); ++k) {
+                std::string s = unescape(t[k].text);
+                if(s.size() > 255) return false;
+                rd.push_back(s.size());
+                rd.insert(rd.end(), s.begin(), s.end());
+            }
+            return true;
+        case kTypeSOA:
+            if(n != 7 || !pack(absolute(t[i].text, origin), rd) || !pack(absolute(t[i + 1].text, origin), rd)) return false;
+            for(int k = 0; k < 5; ++k) {
+                if(!(k ? parse_ttl(t[i + 2 + k].text, v[k]) : parse_u32(t[i + 2].text, v[k]))) return false;
+                put32(rd, v[k]);
+            }
+            return true;
+    }
+    return false; // no presentation format known; use \#
+}
+
+std::vector<u_char> lowered(const u_char* wire, int len) {
+    std::vector<u_char> key(wire, wire + len);
+    for(auto& c : key) c = tolower(c); // length bytes (<= 63) are unaffected
+    return key;
+}
+
+/* Does `name` equal or descend from `apex`? Both are lowercased wire names. */
+bool under(const std::vector<u_char>& name, const std::vector<u_char>& apex) {
+    for(size_t pos = 0; pos < name.size(); pos += name[pos] + 1) {
+        if(name.size() - pos == apex.size() && std::equal(apex.begin(), apex.end(), name.begin() + pos)) return true;
+        if(!name[pos]) break;
+    }
+    return false;
+}
+
+/* RFC 4034 §6.1: label by label from the root; the name with fewer labels first. */
+int canonical_compare(const std::vector<u_char>& a, const std::vector<u_char>& b) {
+    u_char la[128], lb[128]; // label offsets; a name has at most 127 labels and 255 octets
+    int na = 0, nb = 0;
+    for(size_t pos = 0; a[pos]; pos += a[pos] + 1) la[na++] = pos;
+    for(size_t pos = 0; b[pos]; pos += b[pos] + 1) lb[nb++] = pos;
+    while(na && nb) {
+        const u_char* x = &a[la[--na]];
+        const u_char* y = &b[lb[--nb]];
+        int c = memcmp(x + 1, y + 1, std::min(*x, *y));
+        if(c) return c;
+        if(*x != *y) return *x < *y ? -1 : 1;
+    }
+    return na - nb;
+}
+
+std::vector<u_char> parent(const std::vector<u_char>& name) {
+    return name[0] ? std::vector<u_char>(name.begin() + name[0] + 1, name.end()) : name;
+}
+
+std::vector<u_char> wildcard_of(const std::vector<u_char>& name) {
+    std::vector<u_char> star(2 + name.size()); // sized up front, like wildcard() in neg.cpp
+    star[0] = 1;
+    star[1] = '*';
+    std::copy(name.begin(), name.end(), star.begin() + 2);
+    return star;
+}
+
+#ifdef RESOLW_HAVE_DNSSEC
+typedef std::array<u_char, 20> Hash;
+
+/* RFC 5155 §5. */
+Hash nsec3_hash(const std::vector<u_char>& name, const std::vector<u_char>& salt, unsigned iterations) {
+    Hash h;
+    std::vector<u_char> in(name);
+    for(unsigned i = 0; i <= iterations; ++i) {
+        in.insert(in.end(), salt.begin(), salt.end());
+        EVP_Digest(in.data(), in.size(), h.data(), nullptr, EVP_sha1(), nullptr);
+        in.assign(h.begin(), h.end());
+    }
+    return h;
+}
+
+/* The hash an NSEC3 owner's first label spells in base32hex. */
+bool owner_hash(const std::vector<u_char>& owner, Hash& h) {
+    if(owner.empty() || owner[0] != 32) return false;
+    uint32_t acc = 0;
+    int bits = 0;
+    size_t n = 0;
+    for(int i = 1; i <= 32; ++i) {
+        const char* digits = "0123456789abcdefghijklmnopqrstuv";
+        const char* d = strchr(digits, owner[i]);
+        if(!d || !owner[i]) return false;
+        acc = acc << 5 | (d - digits);
+        bits += 5;
+        if(bits >= 8) {
+            h[n++] = acc >> (bits - 8);
+            bits -= 8;
+        }
+    }
+    return true;
+}
+#endif
+
+/* Reply writer with RFC 1035 §4.1.4 compression of owners and well-known rdata names. */
+class Writer {
+public:
+    Writer(u_char* buf, int cap) : buf_(buf), cap_(cap), len_(0), overflow_(false) {}
+
+    void bytes(const u_char* p, int n) {
+        if(overflow_ || len_ + n > cap_) {
+            overflow_ = true;
+            return;
+        }
+        memcpy(buf_ + len_, p, n);
+        len_ += n;
+    }
+
+    void u16(unsigned v) { u_char b[2]; wr16(b, v); bytes(b, 2); }
+    void u32(uint32_t v) { u_char b[4]; wr32(b, v); bytes(b, 4); }
+
+    /* `name` is uncompressed; returns its length in the source. */
+    int name(const u_char* name) {
+        int pos = 0;
+        for(; name[pos]; pos += name[pos] + 1) {
+            int len = 0;
+            while(name[pos + len]) len += name[pos + len] + 1;
+            std::vector<u_char> suffix = lowered(name + pos, len + 1);
+            for(const auto& known : dict_) {
+                if(known.first == suffix) {
+                    u16(0xc000 | known.second);
+                    return pos + len + 1;
+                }
+            }
+            if(len_ < 0x4000) dict_.emplace_back(suffix, len_);
+            bytes(name + pos, name[pos] + 1);
+        }
+        bytes(name + pos, 1);
+        return pos + 1;
+    }
+
+    /* The question is echoed verbatim; this makes its name and suffixes available for compression. */
+    void remember(const u_char* name, int len, int at) {
+        for(int pos = 0; name[pos]; pos += name[pos] + 1) {
+            dict_.emplace_back(lowered(name + pos, len - pos), at + pos);
+        }
+    }
+
+    void rr(const u_char* owner, const Zone::Record& r) {
+        name(owner);
+        u16(r.type);
+        u16(kClassIN);
+        u32(r.ttl);
+        int rdlen_at = len_;
+        u16(0);
+        const u_char* rd = r.rdata.data();
+        switch(r.type) {
+            case kTypeNS:
+            case kTypeCNAME:
+            case kTypePTR:
+                name(rd);
+                break;
+            case kTypeMX:
+                bytes(rd, 2);
+                name(rd + 2);
+                break;
+            case kTypeSOA: {
+                int n = name(rd);
+                n += name(rd + n);
+                bytes(rd + n, 20);
+                break;
+            }
+            default: // including SRV, whose target RFC 2782 forbids compressing
+                bytes(rd, r.rdata.size());
+        }
+        if(!overflow_) wr16(buf_ + rdlen_at, len_ - rdlen_at - 2);
+    }
+
+    int len() const { return len_; }
+    bool overflow() const { return overflow_; }
+
+private:
+    u_char* buf_;
+    int cap_, len_;
+    bool overflow_;
+    std::vector<std::pair<std::vector<u_char>, int> > dict_;
+};
+
+/**
+ * Zone transfer messages: the question, then as many records as fit,
+ * with names compressed against the zone name only, which keeps a
+ * transfer of a million records linear. Full messages go to `send`; once
+ * that fails, the rest of the transfer is dropped.
+ */
+class Stream {
+public:
+    Stream(const u_char* query, int qend, const std::vector<u_char>& apex, int cap,
+           const std::function<bool(const u_char*, int)>& send)
+        : apex_(apex), buf_(cap), qend_(qend), len_(qend), count_(0), ok_(true), send_(send) {
+        memcpy(buf_.data(), query, qend);
+        wr16(buf_.data() + kHdrFlags, kFlagQR | kFlagAA);
+        memset(buf_.data() + kHdrAnCount, 0, 6);
+    }
+
+    void rr(const u_char* owner, const Zone::Record& r) {
+        int owner_len = 0;
+        while(owner[owner_len]) owner_len += owner[owner_len] + 1;
+        if(len_ + owner_len + 11 + (int) r.rdata.size() > (int) buf_.size()) flush();
+        name(owner);
+        u16(r.type);
+        u16(kClassIN);
+        wr32(buf_.data() + len_, r.ttl);
+        len_ += 4;
+        const int rdlen_at = len_;
+        len_ += 2;
+        const u_char* rd = r.rdata.data();
+        switch(r.type) {
+            case kTypeNS:
+            case kTypeCNAME:
+            case kTypePTR:
+                name(rd);
+                break;
+            case kTypeMX:
+                bytes(rd, 2);
+                name(rd + 2);
+                break;
+            case kTypeSOA: {
+                int n = name(rd);
+                n += name(rd + n);
+                bytes(rd + n, 20);
+                break;
+            }
+            default:
+                bytes(rd, r.rdata.size());
+        }
+        wr16(buf_.data() + rdlen_at, len_ - rdlen_at - 2);
+        ++count_;
+    }
+
+    /* Sends what is left; with `rcode`, an error instead. */
+    bool finish(unsigned rcode = kRcodeNoError) {
+        wr16(buf_.data() + kHdrFlags, kFlagQR | kFlagAA | rcode);
+        if(count_ || rcode) flush();
+        return ok_;
+    }
+
+private:
+    void bytes(const u_char* p, int n) {
+        memcpy(buf_.data() + len_, p, n);
+        len_ += n;
+    }
+
+    void u16(unsigned v) {
+        wr16(buf_.data() + len_, v);
+        len_ += 2;
+    }
+
+    /* `name` is uncompressed; returns its length in the source. */
+    int name(const u_char* name) {
+        int total = 0;
+        while(name[total]) total += name[total] + 1;
+        ++total;
+        for(int pos = 0; ; pos += name[pos] + 1) {
+            if(total - pos == (int) apex_.size() && pos < total - 1 && same(name + pos)) {
+                u16(0xc000 | kHdrSize); // the question is the zone name
+                return total;
+            }
+            bytes(name + pos, name[pos] + 1);
+            if(!name[pos]) return total;
+        }
+    }
+
+    bool same(const u_char* suffix) const {
+        for(size_t i = 0; i < apex_.size(); ++i) {
+            if(tolower(suffix[i]) != apex_[i]) return false;
+        }
+        return true;
+    }
+
+    void flush() {
+        wr16(buf_.data() + kHdrAnCount, count_);
+        ok_ = ok_ && send_(buf_.data(), len_);
+        len_ = qend_;
+        count_ = 0;
+    }
+
+    const std::vector<u_char>& apex_;
+    std::vector<u_char> buf_;
+    int qend_, len_;
+    unsigned count_;
+    bool ok_;
+    const std::function<bool(const u_char*, int)>& send_;
+};
+
+/* Length of header + question of `msg`, or -1. */
+int question_end(const u_char* msg, int len) {
+    if(len < kHdrSize) return -1;
+    if(rd16(msg + kHdrQdCount) != 1) return kHdrSize;
+    int n = msg_skip_name(msg + kHdrSize, msg + len);
+    return n < 0 || kHdrSize + n + 4 > len ? -1 : kHdrSize + n + 4;
+}
+
+} // anonymous
+
+bool Zone::load(const char* path, const char* origin, std::string& error) {
+    std::ifstream in(path, std::ios::binary);
+    if(!in) {
+        error = std::string(path) + ": cannot open";
+        return false;
+    }
+    std::stringstream text;
+    text << in.rdbuf();
+    return parse(text.str(), origin, error);
+}
+
+bool Zone::parse(const std::string& text, const char* origin_arg, std::string& error) {
+    std::vector<Line> lines;
+    if(!tokenize(text, lines, error)) return false;
+    std::string origin = origin_arg && *origin_arg ? absolute(origin_arg, ".") : ".";
+    std::string owner;
+    uint32_t default_ttl = 3600;
+    for(const Line& line : lines) {
+        const auto& t = line.tokens;
+        auto fail = [&](const char* what) {
+            error = "line " + std::to_string(line.lineno) + ": " + what;
+            return false;
+        };
+        if(t[0].text == "$ORIGIN") {
+            if(t.size() != 2) return fail("$ORIGIN needs one argument");
+            origin = absolute(t[1].text, origin);
+            continue;
+        }
+        if(t[0].text == "$TTL") {
+            if(t.size() != 2 || !parse_ttl(t[1].text, default_ttl)) return fail("bad $TTL");
+            continue;
+        }
+        if(t[0].text[0] == '$') return fail("unsupported directive");
+        size_t i = 0;
+        if(!line.blank_owner) {
+            owner = absolute(t[i++].text, origin);
+        } else if(owner.empty()) {
+            return fail("no previous owner");
+        }
+        uint32_t ttl = default_ttl;
+        int type = -1;
+        for(; i < t.size() && type < 0; ++i) {
+            const std::string& f = t[i].text;
+            if(parse_ttl(f, ttl)) continue;
+            if(!strcasecmp(f.c_str(), "IN")) continue;
+            if(!strcasecmp(f.c_str(), "CH") || !strcasecmp(f.c_str(), "HS")) return fail("only class IN is served");
+            if((type = parse_type(f)) < 0) return fail("unknown type");
+        }
+        if(type < 0) return fail("missing type");
+        std::vector<u_char> rdata;
+        if(!parse_rdata(type, t, i, origin, rdata)) return fail("bad record data");
+        if(type == kTypeSOA && apex_.empty()) {
+            u_char wire[256];
+            int n = msg_pack_name(owner.c_str(), wire, sizeof(wire));
+            apex_ = lowered(wire, n);
+        }
+        if(!add(owner.c_str(), type, ttl, rdata)) return fail("bad owner name");
+    }
+    if(apex_.empty()) {
+        error = "no SOA record";
+        return false;
+    }
+    return true;
+}
+
+bool Zone::add(const char* owner, unsigned type, uint32_t ttl, const std::vector<u_char>& rdata) {
+    u_char wire[256];
+    int n = msg_pack_name(owner, wire, sizeof(wire));
+    if(n <= 0) return false;
+    insert(lowered(wire, n), { type, ttl, rdata });
+    return true;
+}
+
+void Zone::insert(const Key& owner, const Record& record) {
+    nodes_[owner].push_back(record);
+    ++records_;
+    for(size_t pos = 0; pos < owner.size(); pos += owner[pos] + 1) {
+        names_[Key(owner.begin() + pos, owner.end())] = true;
+        if(!owner[pos]) break;
+    }
+}
+
+const Zone::Record* Zone::soa() const {
+    if(const std::vector<Record>* node = find(apex_)) {
+        for(const Record& r : *node) {
+            if(r.type == kTypeSOA && r.rdata.size() >= 20) return &r;
+        }
+    }
+    return nullptr;
+}
+
+bool Zone::commit(uint32_t serial, const std::vector<Change>& changes) {
+    if(!soa()) return false;
+    std::vector<Key> owners;
+    for(const Change& c : changes) {
+        u_char wire[256];
+        int n = msg_pack_name(c.owner.c_str(), wire, sizeof(wire));
+        if(n <= 0) return false;
+        owners.push_back(lowered(wire, n));
+        if(!under(owners.back(), apex_)) return false;
+    }
+    Diff diff;
+    diff.old_soa = *soa();
+    for(size_t i = 0; i < changes.size(); ++i) {
+        const Change& c = changes[i];
+        Record r = { c.type, c.ttl, c.rdata };
+        if(c.add) {
+            insert(owners[i], r);
+            diff.added.emplace_back(owners[i], r);
+            continue;
+        }
+        auto node = nodes_.find(owners[i]);
+        if(node == nodes_.end()) continue;
+        std::vector<Record>& rrs = node->second;
+        auto it = std::find_if(rrs.begin(), rrs.end(), [&](const Record& x) { return x.type == r.type && x.rdata == r.rdata; });
+        if(it == rrs.end()) continue;
+        diff.deleted.emplace_back(owners[i], *it);
+        rrs.erase(it);
+        --records_;
+        if(rrs.empty()) nodes_.erase(node); // the name stays behind as an empty non-terminal
+    }
+    Record* current = const_cast<Record*>(soa());
+    if(!current) { // deleted along the way
+        insert(apex_, diff.old_soa);
+        current = const_cast<Record*>(soa());
+    }
+    wr32(current->rdata.data() + current->rdata.size() - 20, serial);
+    diff.new_soa = *current;
+    journal_.push_back(std::move(diff));
+    return true;
+}
+
+bool Zone::transfer(const u_char* query, int qlen, int msgmax,
+                    const std::function<bool(const u_char*, int)>& send) const {
+    const int qend = question_end(query, qlen);
+    if(qend <= kHdrSize || (rd16(query + kHdrFlags) & kFlagQR)) return false;
+    const unsigned qtype = rd16(query + qend - 4);
+    if(qtype != kTypeAXFR && qtype != kTypeIXFR) return false;
+    Stream out(query, qend, apex_, msgmax, send);
+    const Record* current = soa();
+    if(!current || lowered(query + kHdrSize, qend - kHdrSize - 4) != apex_) {
+        out.finish(kRcodeNotAuth);
+        return true;
+    }
+    auto serial_of = [](const Record& r) { return rd32(r.rdata.data() + r.rdata.size() - 20); };
+
+    size_t from = journal_.size() + 1; // none: the whole zone
+    if(qtype == kTypeIXFR) { // the client's serial is in the SOA of the authority section
+        const u_char* p = query + qend;
+        const u_char* const eom = query + qlen;
+        int n = rd16(query + kHdrNsCount) ? msg_skip_name(p, eom) : -1;
+        if(n >= 0 && eom - p >= n + 10 + 22 && rd16(p + n) == kTypeSOA) {
+            p += n + 10;
+            for(int i = 0; i < 2 && n >= 0; ++i) {
+                n = msg_skip_name(p, eom);
+                p += std::max(n, 0);
+            }
+        } else {
+            n = -1;
+        }
+        if(n < 0 || eom - p < 20) {
+            out.finish(kRcodeFormErr);
+            return true;
+        }
+        const uint32_t since = rd32(p);
+        if(since == serial_of(*current)) { // up to date
+            out.rr(apex_.data(), *current);
+            out.finish();
+            return true;
+        }
+        for(size_t i = 0; i < journal_.size(); ++i) {
+            if(serial_of(journal_[i].old_soa) == since) {
+                from = i;
+                break;
+            }
+        }
+    }
+    out.rr(apex_.data(), *current);
+    if(from <= journal_.size()) {
+        for(size_t i = from; i < journal_.size(); ++i) {
+            const Diff& d = journal_[i];
+            out.rr(apex_.data(), d.old_soa);
+            for(const auto& rr : d.deleted) out.rr(rr.first.data(), rr.second);
+            out.rr(apex_.data(), d.new_soa);
+            for(const auto& rr : d.added) out.rr(rr.first.data(), rr.second);
+        }
+    } else {
+        for(const auto& node : nodes_) {
+            for(const Record& r : node.second) {
+                if(&r != current) out.rr(node.first.data(), r);
+            }
+        }
+    }
+    out.rr(apex_.data(), *current);
+    out.finish();
+    return true;
+}
+
+const std::vector<Zone::Record>* Zone::find(const Key& name) const {
+    auto it = nodes_.find(name);
+    return it == nodes_.end() ? nullptr : &it->second;
+}
+
+std::vector<Zone::Key> Zone::denial(const Key& name, bool nxdomain) const {
+    Key ce = name; // the closest encloser: the longest ancestor that exists, empty non-terminals included
+    while(ce[0] && !names_.count(ce)) ce = parent(ce);
+    std::vector<const Key*> nsec, nsec3;
+    for(const auto& node : nodes_) {
+        for(const Record& r : node.second) {
+            if(r.type == kTypeNSEC) nsec.push_back(&node.first);
+            if(r.type == kTypeNSEC3 && r.rdata.size() >= 5) nsec3.push_back(&node.first);
+        }
+    }
+    std::vector<Key> out;
+    if(!nsec3.empty()) {
+#ifdef RESOLW_HAVE_DNSSEC
+        // RFC 5155 §7.2: hashed with the parameters of the zone's (first) NSEC3 record
+        const Record* first = nullptr;
+        for(const Record& r : *find(*nsec3[0])) {
+            if(r.type == kTypeNSEC3) first = &r;
+        }
+        const std::vector<u_char> salt(first->rdata.begin() + 5, first->rdata.begin() + 5 + first->rdata[4]);
+        const unsigned iterations = rd16(first->rdata.data() + 2);
+        std::vector<std::pair<Hash, const Key*> > chain;
+        for(const Key* owner : nsec3) {
+            Hash h;
+            if(owner_hash(*owner, h)) chain.emplace_back(h, owner);
+        }
+        std::sort(chain.begin(), chain.end());
+        auto match = [&](const Key& n) -> const Key* {
+            Hash h = nsec3_hash(n, salt, iterations);
+            for(const auto& link : chain) {
+                if(link.first == h) return link.second;
+            }
+            return nullptr;
+        };
+        auto cover = [&](const Key& n) -> const Key* {
+            Hash h = nsec3_hash(n, salt, iterations);
+            const Key* best = chain.empty() ? nullptr : chain.back().second; // wraps around
+            for(const auto& link : chain) {
+                if(link.first < h) best = link.second;
+            }
+            return best;
+        };
+        std::vector<const Key*> proof;
+        if(!nxdomain) {
+            proof.push_back(match(name));
+        } else { // the closest encloser, the name below it on the way to `name`, and its wildcard
+            Key next = name;
+            while(parent(next) != ce) next = parent(next);
+            proof = { match(ce), cover(next), cover(wildcard_of(ce)) };
+        }
+        for(const Key* k : proof) {
+            if(k && std::find(out.begin(), out.end(), *k) == out.end()) out.push_back(*k);
+        }
+#endif
+        return out;
+    }
+    // RFC 4035 §3.1.3: the NSEC at or before the name, and for NXDOMAIN the one before the wildcard
+    auto covering = [&](const Key& n) -> const Key* {
+        const Key* best = nullptr;
+        const Key* last = nullptr;
+        for(const Key* owner : nsec) {
+            if(canonical_compare(*owner, n) <= 0 && (!best || canonical_compare(*best, *owner) < 0)) best = owner;
+            if(!last || canonical_compare(*last, *owner) < 0) last = owner;
+        }
+        return best ? best : last;
+    };
+    std::vector<const Key*> proof = { covering(name) };
+    if(nxdomain) proof.push_back(covering(wildcard_of(ce)));
+    for(const Key* k : proof) {
+        if(k && std::find(out.begin(), out.end(), *k) == out.end()) out.push_back(*k);
+    }
+    return out;
+}
+
+int Zone::answer(const u_char* query, int qlen, u_char* reply, int replen, bool udp) const {
+    if(qlen < kHdrSize || replen < kHdrSize) return -1;
+    const unsigned qflags = rd16(query + kHdrFlags);
+    const unsigned opcode = (qflags >> kOpcodeShift) & 0xf;
+    unsigned flags = kFlagQR | kFlagAA | (qflags & kFlagRD) | (opcode << kOpcodeShift);
+    memset(reply, 0, kHdrSize);
+    memcpy(reply, query, 2);
+    auto done = [&](unsigned rcode, int len) {
+        wr16(reply + kHdrFlags, flags | rcode);
+        return len;
+    };
+
+    const int qend = question_end(query, qlen);
+    if(qend <= kHdrSize || (qflags & kFlagQR)) return done(kRcodeFormErr, kHdrSize);
+    memcpy(reply + kHdrSize, query + kHdrSize, std::min(qend, replen) - kHdrSize);
+    if(qend > replen) return done(kRcodeServFail, kHdrSize);
+    wr16(reply + kHdrQdCount, 1);
+    if(opcode != kOpQuery) return done(kRcodeNotImp, qend);
+    if(rd16(query + qend - 4) == kTypeAXFR || rd16(query + qend - 4) == kTypeIXFR) {
+        return done(kRcodeNotImp, qend); // zone transfers go through transfer(), over TCP
+    }
+
+    const u_char* qname = query + kHdrSize;
+    for(const u_char* p = qname; *p; p += *p + 1) {
+        if(*p & 0xc0) return done(kRcodeFormErr, qend); // no pointers in a lone question
+    }
+    const unsigned qtype = rd16(query + qend - 4);
+    if(rd16(query + qend - 2) != kClassIN) return done(kRcodeRefused, qend);
+
+    // EDNS: the first OPT among the additional records, if any
+    int limit = udp ? kPacketSz : 0xffff;
+    bool edns = false, dnssec_ok = false;
+    const u_char* p = query + qend;
+    const u_char* const qeom = query + qlen;
+    unsigned rrs = rd16(query + kHdrAnCount) + rd16(query + kHdrNsCount) + rd16(query + kHdrArCount);
+    for(unsigned k = 0; k < rrs; ++k) {
+        int n = msg_skip_name(p, qeom);
+        if(n < 0 || p + n + 10 > qeom) break;
+        p += n;
+        if(rd16(p) == kTypeOPT && k >= rrs - rd16(query + kHdrArCount)) {
+            edns = true;
+            if(udp) limit = std::max<int>(kPacketSz, std::min<int>(rd16(p + 2), kEdnsPayload));
+            dnssec_ok = rd32(p + 4) & 0x8000;
+            break;
+        }
+        p += 10 + rd16(p + 8);
+    }
+    const int opt_len = edns ? 11 : 0;
+    limit = std::min(limit, replen) - opt_len;
+
+    Writer w(reply, limit);
+    w.bytes(query, qend); // header placeholder + question; the header is rewritten by done()
+    w.remember(qname, qend - kHdrSize - 4, kHdrSize);
+
+    Key name = lowered(qname, qend - kHdrSize - 4);
+    unsigned rcode = kRcodeNoError;
+    unsigned an = 0, ns = 0, ar = 0;
+    std::vector<const u_char*> targets; // names whose addresses go into the additional section
+    bool negative = false;
+    if(!under(name, apex_)) {
+        rcode = kRcodeRefused;
+    } else {
+        for(int hop = 0; ; ++hop) {
+            const std::vector<Record>* node = find(name);
+            if(!node) {
+                if(!names_.count(name)) rcode = kRcodeNxDomain;
+                negative = true;
+                break;
+            }
+            const Record* cname = nullptr;
+            bool matched = false;
+            for(const Record& r : *node) {
+                bool covers = dnssec_ok && r.type == kTypeRRSIG && r.rdata.size() >= 2 && rd16(r.rdata.data()) == qtype;
+                if(r.type == qtype || covers || (qtype == kTypeANY && r.type != kTypeRRSIG)) {
+                    w.rr(name.data(), r);
+                    ++an;
+                    matched |= !covers;
+                    if(r.type == kTypeMX) targets.push_back(r.rdata.data() + 2);
+                    if(r.type == kTypeSRV) targets.push_back(r.rdata.data() + 6);
+                    if(r.type == kTypeNS) targets.push_back(r.rdata.data());
+                } else if(r.type == kTypeCNAME) {
+                    cname = &r;
+                }
+            }
+            if(matched || !cname || hop >= kMaxChase) {
+                negative = !matched && !cname;
+                break;
+            }
+            w.rr(name.data(), *cname);
+            ++an;
+            if(dnssec_ok) {
+                for(const Record& r : *node) {
+                    if(r.type == kTypeRRSIG && r.rdata.size() >= 2 && rd16(r.rdata.data()) == kTypeCNAME) {
+                        w.rr(name.data(), r);
+                        ++an;
+                    }
+                }
+            }
+            name = lowered(cname->rdata.data(), cname->rdata.size());
+            if(!under(name, apex_)) break; // the client has to follow it elsewhere
+        }
+    }
+    if(negative) {
+        for(const Record& r : *find(apex_)) {
+            if(r.type == kTypeSOA) {
+                Record soa = r;
+                soa.ttl = std::min(r.ttl, rd32(r.rdata.data() + r.rdata.size() - 4)); // RFC 2308 §3
+                w.rr(apex_.data(), soa);
+                ++ns;
+            }
+        }
+        if(dnssec_ok) { // the SOA's signature, and the signed records that prove the denial
+            auto signs = [](const Record& r, unsigned type) {
+                return r.type == kTypeRRSIG && r.rdata.size() >= 2 && rd16(r.rdata.data()) == type;
+            };
+            for(const Record& r : *find(apex_)) {
+                if(signs(r, kTypeSOA)) {
+                    w.rr(apex_.data(), r);
+                    ++ns;
+                }
+            }
+            for(const Key& owner : denial(name, rcode == kRcodeNxDomain)) {
+                for(const Record& r : *find(owner)) {
+                    if(r.type == kTypeNSEC || r.type == kTypeNSEC3 || signs(r, kTypeNSEC) || signs(r, kTypeNSEC3)) {
+                        w.rr(owner.data(), r);
+                        ++ns;
+                    }
+                }
+            }
+        }
+    }
+    for(const u_char* target : targets) {
+        int len = 0;
+        while(target[len]) len += target[len] + 1;
+        if(const std::vector<Record>* node = find(lowered(target, len + 1))) {
+            for(const Record& r : *node) {
+                if(r.type == kTypeA || r.type == kTypeAAAA) {
+                    w.rr(target, r);
+                    ++ar;
+                }
+            }
+        }
+    }
+
+    int len = w.len();
+    if(w.overflow()) {
+        flags |= kFlagTC;
+        an = ns = ar = 0;
+        len = qend;
+    }
+    wr16(reply + kHdrAnCount, an);
+    wr16(reply + kHdrNsCount, ns);
+    if(edns) {
+        u_char* opt = reply + len;
+        opt[0] = 0;
+        wr16(opt + 1, kTypeOPT);
+        wr16(opt + 3, kEdnsPayload);
+        wr32(opt + 5, dnssec_ok ? 0x8000 : 0);
+        wr16(opt + 9, 0);
+        len += opt_len;
+        ++ar;
+    }
+    wr16(reply + kHdrArCount, ar);
+    return done(rcode, len);
+}
+
+/* Servers */
+
+#ifdef RESOLW_HAVE_DOT
+
+namespace {
+
+/* The key and self-signed certificate that every TLS server presents, made on first use. */
+struct TlsIdentity {
+    SSL_CTX* ctx = nullptr;
+    std::string pem;
+};
+
+const TlsIdentity& tls_identity() {
+    static const TlsIdentity* instance = [] {
+        TlsIdentity* id = new TlsIdentity(); // never freed
+        EVP_PKEY* key = EVP_EC_gen("P-256");
+        X509* cert = X509_new();
+        X509_set_version(cert, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+        X509_gmtime_adj(X509_getm_notBefore(cert), -3600);
+        X509_gmtime_adj(X509_getm_notAfter(cert), 365 * 86400L);
+        X509_set_pubkey(cert, key);
+        X509_NAME* subject = X509_get_subject_name(cert);
+        X509_NAME_add_entry_by_txt(subject, "CN", MBSTRING_ASC, reinterpret_cast<const u_char*>(StandIn::kTlsName), -1, -1, 0);
+        X509_set_issuer_name(cert, subject);
+        X509V3_CTX v3;
+        X509V3_set_ctx_nodb(&v3);
+        X509V3_set_ctx(&v3, cert, cert, nullptr, nullptr, 0);
+        const std::string alt_names = std::string("DNS:") + StandIn::kTlsName + ",IP:127.0.0.1";
+        X509_EXTENSION* ext = X509V3_EXT_conf_nid(nullptr, &v3, NID_subject_alt_name, alt_names.c_str());
+        X509_add_ext(cert, ext, -1);
+        X509_EXTENSION_free(ext);
+        X509_sign(cert, key, EVP_sha256());
+
+        id->ctx = SSL_CTX_new(TLS_server_method());
+        SSL_CTX_use_certificate(id->ctx, cert);
+        SSL_CTX_use_PrivateKey(id->ctx, key);
+        const u_char sid_ctx[] = "resolw_standin";
+        SSL_CTX_set_session_id_context(id->ctx, sid_ctx, sizeof(sid_ctx) - 1);
+        BIO* bio = BIO_new(BIO_s_mem());
+        PEM_write_bio_X509(bio, cert);
+        char* text;
+        long len = BIO_get_mem_data(bio, &text);
+        id->pem.assign(text, len);
+        BIO_free(bio);
+        X509_free(cert);
+        EVP_PKEY_free(key);
+        return id;
+    }();
+    return *instance;
+}
+
+} // anonymous
+
+#endif /* RESOLW_HAVE_DOT */
+
+struct StandIn::Server {
+    struct Conn {
+        uint64_t id;
+        sock_t fd;
+        std::vector<u_char> in;
+#ifdef RESOLW_HAVE_DOT
+        SSL* ssl = nullptr;
+#endif
+    };
+
+    struct Reply {
+        uint64_t due_ns, seq;
+        std::vector<u_char> bytes;
+        sockaddr_storage to;
+        socklen_t tolen;
+        uint64_t conn; // 0 = UDP
+        bool hold;
+        bool operator<(const Reply& other) const { // for a min-heap
+            return due_ns != other.due_ns ? due_ns > other.due_ns : seq > other.seq;
+        }
+    };
+
+    Server(const Zone& zone, const Behavior& b) : zone(zone), behavior(b), rng(b.seed) {}
+
+    bool roll(double rate) { return rate > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < rate; }
+
+    void handle(const u_char* query, int qlen, const sockaddr_storage* from, socklen_t fromlen, uint64_t conn);
+    void send(Reply& r);
+    bool write(uint64_t conn, const u_char* msg, int len);
+    int receive(Conn& c, u_char* in, int size);
+    void hang_up(Conn& c);
+    void flush(uint64_t now);
+    void run();
+
+    const Zone& zone;
+    const Behavior behavior;
+    std::mt19937_64 rng;
+    sockaddr_in addr;
+    sock_t udp = kBadSock, tcp = kBadSock;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> queries{0}, replies{0}, dropped{0}, truncated{0}, servfails{0}, reordered{0};
+
+    std::vector<Conn> conns;
+    uint64_t next_conn = 1, next_seq = 0;
+    std::vector<Reply> queue; // heap
+    Reply held;
+    bool holding = false;
+    uint64_t held_since = 0;
+    u_char out[0xffff];
+};
+
+void StandIn::Server::handle(const u_char* query, int qlen, const sockaddr_storage* from, socklen_t fromlen, uint64_t conn) {
+    queries.fetch_add(1, std::memory_order_relaxed);
+    const bool udp = !conn;
+    // a transfer is streamed there and then, holding up everything else
+    if(!udp && zone.transfer(query, qlen, sizeof(out), [&](const u_char* msg, int len) { return write(conn, msg, len); })) {
+        return;
+    }
+    if(udp && roll(behavior.drop)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    int len = zone.answer(query, qlen, out, sizeof(out), udp);
+    if(len < kHdrSize) return;
+    if(roll(behavior.servfail)) {
+        len = std::max(question_end(out, len), (int) kHdrSize);
+        wr16(out + kHdrFlags, (rd16(out + kHdrFlags) & ~(kRcodeMask | kFlagTC)) | kRcodeServFail);
+        memset(out + kHdrAnCount, 0, 6);
+        servfails.fetch_add(1, std::memory_order_relaxed);
+    } else if(udp && roll(behavior.truncate)) {
+        len = std::max(question_end(out, len), (int) kHdrSize);
+        wr16(out + kHdrFlags, rd16(out + kHdrFlags) | kFlagTC);
+        memset(out + kHdrAnCount, 0, 6);
+    }
+    if(rd16(out + kHdrFlags) & kFlagTC) {
+        truncated.fetch_add(1, std::memory_order_relaxed);
+    }
+#ifdef RESOLW_HAVE_DNSSEC
+    if(behavior.tsig_key) { // RFC 8945 section 5.2: what does not verify gets an unsigned NOTAUTH
+        if(resolw_tsig_verify(query, qlen, nullptr, 0) != 0) {
+            len = std::max(question_end(out, len), (int) kHdrSize);
+            wr16(out + kHdrFlags, (rd16(out + kHdrFlags) & ~(kRcodeMask | kFlagTC)) | kRcodeNotAuth);
+            memset(out + kHdrAnCount, 0, 6);
+        } else {
+            len = std::max(len, resolw_tsig_sign(behavior.tsig_key, out, len, sizeof(out), query, qlen));
+        }
+    }
+#endif
+    double delay_ms = behavior.delay_ms;
+    if(behavior.jitter_ms > 0) {
+        delay_ms += std::uniform_real_distribution<double>(0, behavior.jitter_ms)(rng);
+    }
+    if(roll(behavior.slow)) {
+        delay_ms += behavior.slow_ms;
+    }
+    Reply r;
+    r.due_ns = monotonic_ns() + uint64_t(delay_ms * 1e6);
+    r.seq = next_seq++;
+    r.bytes.assign(out, out + len);
+    if(from) memcpy(&r.to, from, fromlen);
+    r.tolen = fromlen;
+    r.conn = conn;
+    r.hold = roll(behavior.reorder);
+    queue.push_back(std::move(r));
+    std::push_heap(queue.begin(), queue.end());
+}
+
+void StandIn::Server::send(Reply& r) {
+    if(!r.conn) {
+        sendto(udp, reinterpret_cast<const char*>(r.bytes.data()), r.bytes.size(), 0,
+               reinterpret_cast<const sockaddr*>(&r.to), r.tolen);
+        replies.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    write(r.conn, r.bytes.data(), r.bytes.size());
+}
+
+bool StandIn::Server::write(uint64_t conn, const u_char* msg, int len) {
+    for(Conn& c : conns) {
+        if(c.id != conn) continue;
+        std::vector<u_char> framed(2);
+        wr16(framed.data(), len);
+        framed.insert(framed.end(), msg, msg + len);
+        size_t off = 0;
+        while(off < framed.size()) {
+            int n;
+            short wait = 0;
+#ifdef RESOLW_HAVE_DOT
+            if(c.ssl) {
+                ERR_clear_error();
+                n = SSL_write(c.ssl, framed.data() + off, framed.size() - off); // retried with the same arguments, as it has to be
+                const int err = n > 0 ? SSL_ERROR_NONE : SSL_get_error(c.ssl, n);
+                wait = err == SSL_ERROR_WANT_WRITE ? POLLOUT : err == SSL_ERROR_WANT_READ ? POLLIN : 0;
+            } else
+#endif
+            {
+                n = ::send(c.fd, reinterpret_cast<const char*>(framed.data() + off), framed.size() - off, 0);
+                wait = n < 0 && sock_errno() == kErrWouldBlock ? POLLOUT : 0;
+            }
+            if(n > 0) {
+                off += n;
+                continue;
+            }
+            if(wait) {
+                pollfd_t pfd = { c.fd, wait, 0 };
+                if(sock_poll(&pfd, 1, 1000) > 0) continue;
+            }
+            return false; // the client is gone; its connection is reaped on the next read
+        }
+        replies.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+/* Reads what `c` has for us: the byte count, 0 if there is nothing yet, or -1 once it is closed. */
+int StandIn::Server::receive(Conn& c, u_char* in, int size) {
+#ifdef RESOLW_HAVE_DOT
+    if(c.ssl) { // the handshake happens in here, too
+        ERR_clear_error();
+        int n = SSL_read(c.ssl, in, size);
+        if(n > 0) return n;
+        const int err = SSL_get_error(c.ssl, n);
+        return err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE ? 0 : -1;
+    }
+#endif
+    int n = recv(c.fd, reinterpret_cast<char*>(in), size, 0);
+    return n > 0 ? n : n < 0 && sock_errno() == kErrWouldBlock ? 0 : -1;
+}
+
+void StandIn::Server::hang_up(Conn& c) {
+#ifdef RESOLW_HAVE_DOT
+    SSL_free(c.ssl);
+    c.ssl = nullptr;
+#endif
+    sock_close(c.fd);
+    c.fd = kBadSock;
+}
+
+void StandIn::Server::flush(uint64_t now) {
+    while(!queue.empty() && queue.front().due_ns <= now) {
+        std::pop_heap(queue.begin(), queue.end());
+        Reply r = std::move(queue.back());
+        queue.pop_back();
+        if(r.hold && !holding) {
+            held = std::move(r);
+            holding = true;
+            held_since = now;
+            reordered.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        send(r);
+        if(holding) {
+            send(held);
+            holding = false;
+        }
+    }
+    // with no reply to overtake it, a held reply goes out late rather than never
+    const uint64_t max_hold = std::max(20e6, 2e6 * (behavior.delay_ms + behavior.jitter_ms));
+    if(holding && now - held_since >= max_hold) {
+        send(held);
+        holding = false;
+    }
+}
+
+void StandIn::Server::run() {
+    u_char in[0xffff];
+    std::vector<pollfd_t> pfds;
+    while(running.load(std::memory_order_relaxed)) {
+        uint64_t now = monotonic_ns();
+        flush(now);
+        int timeout_ms = 50; // also how long stop() may take
+        if(!queue.empty()) {
+            timeout_ms = std::min<int64_t>(timeout_ms, (queue.front().due_ns - std::min(now, queue.front().due_ns) + 999999) / 1000000);
+        }
+        if(holding) {
+            timeout_ms = std::min(timeout_ms, 10);
+        }
+        pfds.clear();
+        pfds.push_back({ udp, POLLIN, 0 });
+        pfds.push_back({ tcp, POLLIN, 0 });
+        for(const Conn& c : conns) pfds.push_back({ c.fd, POLLIN, 0 });
+        if(sock_poll(pfds.data(), pfds.size(), timeout_ms) <= 0) continue;
+
+        if(pfds[0].revents & POLLIN) {
+            for(;;) {
+                sockaddr_storage from;
+                socklen_t fromlen = sizeof(from);
+                int n = recvfrom(udp, reinterpret_cast<char*>(in), sizeof(in), 0, reinterpret_cast<sockaddr*>(&from), &fromlen);
+                if(n < 0) break;
+                handle(in, n, &from, fromlen, 0);
+            }
+        }
+        if(pfds[1].revents & POLLIN) {
+            sock_t fd;
+            while((fd = accept(tcp, nullptr, nullptr)) != kBadSock) {
+                sock_nonblock(fd);
+                int on = 1; // replies, and TLS handshake messages, go out as they are written
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on));
+                conns.push_back({ next_conn++, fd, {} });
+#ifdef RESOLW_HAVE_DOT
+                if(behavior.tls) {
+                    Conn& c = conns.back();
+                    c.ssl = SSL_new(tls_identity().ctx);
+                    SSL_set_fd(c.ssl, (int) fd);
+                    SSL_set_accept_state(c.ssl);
+                }
+#endif
+            }
+        }
+        for(size_t k = 2; k < pfds.size(); ++k) {
+            if(!pfds[k].revents) continue;
+            Conn& c = conns[k - 2];
+            int n;
+            // until there is no more: TLS may have decrypted more than was asked for
+            while((n = receive(c, in, sizeof(in))) > 0) {
+                c.in.insert(c.in.end(), in, in + n);
+                while(c.in.size() >= 2 && c.in.size() >= 2u + rd16(c.in.data())) {
+                    int len = rd16(c.in.data());
+                    handle(c.in.data() + 2, len, nullptr, 0, c.id);
+                    c.in.erase(c.in.begin(), c.in.begin() + 2 + len);
+                }
+            }
+            if(n < 0) hang_up(c);
+        }
+        conns.erase(std::remove_if(conns.begin(), conns.end(), [](const Conn& c) { return c.fd == kBadSock; }), conns.end());
+    }
+    for(Conn& c : conns) hang_up(c);
+    conns.clear();
+}
+
+StandIn::StandIn(const Zone& zone) : zone_(zone) {}
+
+StandIn::~StandIn() {
+    stop();
+}
+
+int StandIn::start(const Behavior& behavior, unsigned port) {
+    net_startup();
+    std::unique_ptr<Server> s(new Server(zone_, behavior));
+    // an ephemeral UDP port may be taken for TCP; try a few
+    for(int attempt = 0; attempt < 8 && s->tcp == kBadSock; ++attempt) {
+        if(s->udp != kBadSock) sock_close(s->udp);
+        memset(&s->addr, 0, sizeof(s->addr));
+        s->addr.sin_family = AF_INET;
+        s->addr.sin_port = htons(port);
+        s->addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        s->udp = socket(AF_INET, SOCK_DGRAM, 0);
+        socklen_t alen = sizeof(s->addr);
+        if(s->udp == kBadSock || bind(s->udp, reinterpret_cast<sockaddr*>(&s->addr), sizeof(s->addr))
+           || getsockname(s->udp, reinterpret_cast<sockaddr*>(&s->addr), &alen)) {
+            break;
+        }
+        sock_t tcp = socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        setsockopt(tcp, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&on), sizeof(on));
+        if(tcp != kBadSock && !bind(tcp, reinterpret_cast<sockaddr*>(&s->addr), sizeof(s->addr)) && !listen(tcp, 64)) {
+            s->tcp = tcp;
+        } else if(tcp != kBadSock) {
+            sock_close(tcp);
+        }
+        if(port) break; // a fixed port either works or does not
+    }
+    if(s->tcp == kBadSock) {
+        if(s->udp != kBadSock) sock_close(s->udp);
+        return -1;
+    }
+    sock_nonblock(s->udp);
+    sock_nonblock(s->tcp);
+    s->running = true;
+    Server* raw = s.get();
+    s->thread = std::thread([raw] { raw->run(); });
+    servers_.push_back(std::move(s));
+    return servers_.size() - 1;
+}
+
+const sockaddr_in& StandIn::address(int server) const {
+    return servers_[server]->addr;
+}
+
+ServerCounters StandIn::counters(int server) const {
+    const Server& s = *servers_[server];
+    return { s.queries.load(), s.replies.load(), s.dropped.load(), s.truncated.load(), s.servfails.load(), s.reordered.load() };
+}
+
+void StandIn::configure(res_state rs) const {
+    rs->nscount = std::min<int>(servers_.size(), MAXNS);
+    for(int i = 0; i < rs->nscount; ++i) {
+        rs->nsaddr_list[i] = servers_[i]->addr;
+    }
+}
+
+std::string StandIn::certificate() {
+#ifdef RESOLW_HAVE_DOT
+    return tls_identity().pem;
+#else
+    return std::string();
+#endif
+}
+
+void StandIn::stop() {
+    for(auto& s : servers_) {
+        s->running = false;
+    }
+    for(auto& s : servers_) {
+        if(s->thread.joinable()) s->thread.join();
+        sock_close(s->udp);
+        sock_close(s->tcp);
+    }
+    servers_.clear();
+}
+
+void parse_zone(Zone& zone, const std::string& text, const char* origin) {
+    std::string error;
+    if(!zone.parse(text, origin, error)) {
+        fprintf(stderr, "bench zone: %s\n", error.c_str());
+        abort();
+    }
+}
+
+const StandIn& shared_standin(const Zone& zone, std::initializer_list<Behavior> behaviors) {
+    StandIn* s = new StandIn(zone); // outlives the cases; never torn down
+    int index = 0;
+    for(const Behavior& behavior : behaviors) {
+        if(s->start(behavior) != index++) {
+            fprintf(stderr, "bench: cannot start loopback server\n");
+            abort();
+        }
+    }
+    return *s;
+}
+
+const StandIn& shared_standin(const std::string& zone_text, const char* origin,
+                              std::initializer_list<Behavior> behaviors) {
+    Zone* zone = new Zone; // as long-lived as the servers over it
+    parse_zone(*zone, zone_text, origin);
+    return shared_standin(*zone, behaviors);
+}
+
+void point_at(res_state rs, const StandIn& standin, int server) {
+    rs->nsaddr_list[0] = standin.address(server);
+    rs->nscount = 1;
+    rs->retry = 1;
+}
+
+} // resolw_bench
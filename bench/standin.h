@@ -0,0 +1,199 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#ifndef _BENCH_STANDIN_H_
+#define _BENCH_STANDIN_H_
+
+#include "net.h"
+
+#include <atomic>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * A loopback stand-in for an authoritative name server. It answers from one
+ * zone over UDP and TCP on 127.0.0.1 and can be told to misbehave, so that
+ * the send path, retries and failover can be exercised and benchmarked
+ * without a network. Used in-process by resolw_bench and as a subprocess
+ * via resolw_standin.
+ */
+
+namespace resolw_bench {
+
+/**
+ * A zone loaded from master file text (RFC 1035 §5): $ORIGIN, $TTL, `@`,
+ * relative owners, blank owners, parentheses and comments are understood;
+ * $INCLUDE and wildcards are not. Record data may be given in presentation
+ * format for A, AAAA, NS, CNAME, PTR, MX, TXT, SRV and SOA, and in RFC 3597
+ * generic format (`TYPE65 \# 3 010203`) for any type.
+ */
+class Zone {
+public:
+    struct Record {
+        unsigned type;
+        uint32_t ttl;
+        std::vector<u_char> rdata; // uncompressed wire format
+    };
+
+    /* One record added or deleted by commit(). */
+    struct Change {
+        std::string owner; // presentation format, absolute
+        bool add;
+        unsigned type;
+        uint32_t ttl;
+        std::vector<u_char> rdata;
+    };
+
+    bool load(const char* path, const char* origin, std::string& error);
+    bool parse(const std::string& text, const char* origin, std::string& error);
+
+    /* Adds a record; `owner` is in presentation format and must be absolute. */
+    bool add(const char* owner, unsigned type, uint32_t ttl, const std::vector<u_char>& rdata);
+
+    /**
+     * Writes an authoritative reply to `query` into `reply`. Over UDP, an
+     * answer that exceeds 512 bytes (or the EDNS payload size the query
+     * advertises) is cut down to the question and flagged TC. With the DO
+     * bit set, RRSIGs covering the answered type are included, and negative
+     * answers carry the SOA's RRSIG and the NSEC records (or, built with
+     * OpenSSL, the NSEC3 records) that prove the denial. Returns the reply
+     * length, or -1 if `query` does not even have a header.
+     */
+    int answer(const u_char* query, int qlen, u_char* reply, int replen, bool udp) const;
+
+    /**
+     * Applies the changes that make up version `serial` and keeps them in
+     * a journal for IXFR. Deleting takes out one record of the same type
+     * and rdata, if there is one. Fails, changing nothing, if there is no
+     * SOA yet or an owner is malformed or outside the zone. Not to be
+     * called while a StandIn is serving the zone.
+     */
+    bool commit(uint32_t serial, const std::vector<Change>& changes);
+
+    /**
+     * Answers an AXFR (RFC 5936) or IXFR (RFC 1995) `query` with messages
+     * of up to `msgmax` bytes, handing each to `send` as it fills up. An
+     * IXFR from a serial in the journal gets the diffs since; one from any
+     * other serial, the whole zone. Returns false if `query` is not a
+     * transfer.
+     */
+    bool transfer(const u_char* query, int qlen, int msgmax,
+                  const std::function<bool(const u_char*, int)>& send) const;
+
+    size_t size() const { return records_; }
+
+private:
+    typedef std::vector<u_char> Key; // lowercased wire name
+
+    /* The differences between two versions, for IXFR. */
+    struct Diff {
+        Record old_soa, new_soa;
+        std::vector<std::pair<Key, Record> > deleted, added;
+    };
+
+    void insert(const Key& owner, const Record& record);
+    const Record* soa() const;
+
+    const std::vector<Record>* find(const Key& name) const;
+
+    /* The owners of the NSEC or NSEC3 records that deny `name` (or a type at it). */
+    std::vector<Key> denial(const Key& name, bool nxdomain) const;
+
+    std::map<Key, std::vector<Record> > nodes_;
+    std::map<Key, bool> names_; // owners and their ancestors (empty non-terminals)
+    std::vector<Diff> journal_;
+    Key apex_;
+    size_t records_ = 0;
+};
+
+/* Misbehavior of one server. Rates are probabilities in [0, 1]. */
+struct Behavior {
+    double delay_ms = 0; // added to every reply
+    double jitter_ms = 0; // uniformly distributed extra delay
+    double slow = 0; // replies delayed by slow_ms more, for a bimodal latency
+    double slow_ms = 0;
+    double drop = 0; // UDP queries that are never answered
+    double truncate = 0; // UDP replies cut down to the question and flagged TC
+    double servfail = 0; // replies replaced by SERVFAIL
+    double reorder = 0; // replies held back until the next reply has been sent
+    const char* tsig_key = nullptr; // if set, queries must be TSIG-signed, and replies (but not transfers) are signed with this key
+    bool tls = false; // TCP is DNS over TLS (RFC 7858), with the certificate of StandIn::certificate()
+    unsigned seed = 1;
+};
+
+struct ServerCounters {
+    uint64_t queries, replies, dropped, truncated, servfails, reordered;
+};
+
+/**
+ * Runs any number of stand-in servers over one zone, each with its own
+ * socket pair, thread and Behavior. Delays are scheduled, not slept, so a
+ * slow server still reads every query as it arrives.
+ */
+class StandIn {
+public:
+    explicit StandIn(const Zone& zone);
+    ~StandIn();
+
+    /* Starts a server on 127.0.0.1:`port` (0 = any free port); returns its index or -1. */
+    int start(const Behavior& behavior, unsigned port = 0);
+
+    const sockaddr_in& address(int server) const;
+    ServerCounters counters(int server) const;
+
+    /* Fills the name server list of `rs` with the running servers. */
+    void configure(res_state rs) const;
+
+    /**
+     * The self-signed certificate of the TLS servers in PEM, for the name
+     * kTlsName and the address 127.0.0.1; empty if built without DoT.
+     */
+    static std::string certificate();
+    static constexpr const char* kTlsName = "dns.standin.test";
+
+    void stop();
+
+private:
+    struct Server;
+
+    const Zone& zone_;
+    std::vector<std::unique_ptr<Server> > servers_;
+};
+
+/* Parses `text` at `origin` into `zone` for a bench; aborts on an error. */
+void parse_zone(Zone& zone, const std::string& text, const char* origin);
+
+/**
+ * A stand-in for bench cases to share: one server over `zone` per entry
+ * of `behaviors`, with indices in that order. It outlives the cases and
+ * is never torn down, so callers keep it in a function-local static.
+ * Aborts if a server cannot start.
+ */
+const StandIn& shared_standin(const Zone& zone, std::initializer_list<Behavior> behaviors = {Behavior()});
+
+/* The same over a zone parsed from `zone_text` at `origin`. */
+const StandIn& shared_standin(const std::string& zone_text, const char* origin,
+                              std::initializer_list<Behavior> behaviors = {Behavior()});
+
+/* Points `rs` at server `server` of `standin` alone, with one try. */
+void point_at(res_state rs, const StandIn& standin, int server = 0);
+
+} // resolw_bench
+
+#endif /* _BENCH_STANDIN_H_ */
@@ -0,0 +1,131 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "standin.h"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * Usage: resolw_standin -z zone [-o origin] [knobs] [-p port]... 
+ *
+ * Knobs apply to the servers declared by the -p options that follow them,
+ * so one process can run a fast and a slow server side by side:
+ *   resolw_standin -z bench/example.zone -p 5301 -d 40 -j 20 -x 0.1 -p 5302
+ * Without -p, one server listens on 127.0.0.1:5353. Counters are printed
+ * when the process is interrupted.
+ */
+
+namespace {
+
+std::atomic<bool> _stop{false};
+
+void on_signal(int) {
+    _stop = true;
+}
+
+void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s -z zone [-o origin] [knobs] [-p port]...\n"
+            "  -z  master file to serve\n"
+            "  -o  initial $ORIGIN (default: the root)\n"
+            "  -p  start a server on 127.0.0.1:port with the knobs given so far (0 = any free port)\n"
+            "knobs:\n"
+            "  -d  reply delay in ms          -j  extra uniform delay in ms\n"
+            "  -x  UDP drop rate              -T  forced TC rate\n"
+            "  -F  SERVFAIL rate              -R  out-of-order reply rate\n"
+            "  -b  slow reply rate            -B  extra delay of slow replies in ms\n"
+            "  -L  1 = DNS over TLS on the TCP port, self-signed for dns.standin.test\n"
+            "  -S  random seed\n",
+            argv0);
+}
+
+} // anonymous
+
+int main(int argc, char** argv) {
+    using namespace resolw_bench;
+    const char* zone_path = nullptr;
+    const char* origin = nullptr;
+    Behavior knobs;
+    std::vector<std::pair<Behavior, unsigned> > planned;
+    for(int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if(arg[0] != '-' || !arg[1] || arg[2] || i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char* val = argv[++i];
+        switch(arg[1]) {
+            case 'z': zone_path = val; break;
+            case 'o': origin = val; break;
+            case 'p': planned.emplace_back(knobs, atoi(val)); break;
+            case 'd': knobs.delay_ms = atof(val); break;
+            case 'j': knobs.jitter_ms = atof(val); break;
+            case 'x': knobs.drop = atof(val); break;
+            case 'T': knobs.truncate = atof(val); break;
+            case 'F': knobs.servfail = atof(val); break;
+            case 'R': knobs.reorder = atof(val); break;
+            case 'b': knobs.slow = atof(val); break;
+            case 'B': knobs.slow_ms = atof(val); break;
+            case 'L': knobs.tls = atoi(val) != 0; break;
+            case 'S': knobs.seed = strtoul(val, nullptr, 10); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if(!zone_path) {
+        usage(argv[0]);
+        return 1;
+    }
+    if(planned.empty()) {
+        planned.emplace_back(knobs, 5353);
+    }
+
+    Zone zone;
+    std::string error;
+    if(!zone.load(zone_path, origin, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    StandIn standin(zone);
+    for(const auto& p : planned) {
+        int s = standin.start(p.first, p.second);
+        if(s < 0) {
+            fprintf(stderr, "cannot listen on 127.0.0.1:%u\n", p.second);
+            return 1;
+        }
+        printf("127.0.0.1:%u\n", ntohs(standin.address(s).sin_port));
+    }
+    printf("serving %zu records\n", zone.size());
+    fflush(stdout);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    while(!_stop) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    for(size_t s = 0; s < planned.size(); ++s) {
+        ServerCounters c = standin.counters(s);
+        printf("127.0.0.1:%u  queries %llu, replies %llu, dropped %llu, truncated %llu, servfails %llu, reordered %llu\n",
+               ntohs(standin.address(s).sin_port), (unsigned long long) c.queries, (unsigned long long) c.replies,
+               (unsigned long long) c.dropped, (unsigned long long) c.truncated, (unsigned long long) c.servfails,
+               (unsigned long long) c.reordered);
+    }
+    return 0;
+}
@@ -14,7 +14,12 @@
 #ifndef _RESOLV_H_
 #define _RESOLV_H_
 
+#ifdef _WIN32
 #include "_bsd_types.h"
+#else
+#include <sys/types.h> /* u_char, u_short, u_long */
+#include <netinet/in.h> /* sockaddr_in */
+#endif
 #include "sys/socket.h"
 #include "arpa/nameser.h"
 #include <stdint.h>
@@ -79,7 +84,7 @@ enum {
     RES_USE_INET6=1 << 13,
     RES_ROTATE  = 1 << 14, /* has to be implemented logically via custom servers */
     RES_NOCHECKNAME=1<<15,
-    RES_KEEPTSIG= 1 << 16, /* implemented with DNS_QUERY_RETURN_MESSAGE */
+    RES_KEEPTSIG= 1 << 16, /* res_nsend() leaves the TSIG record in signed answers; DNS_QUERY_RETURN_MESSAGE for WinDNS */
     RES_BLAST   = 1 << 17,
     RES_DEFAULT = RES_RECURSE | RES_DEFNAMES | RES_DNSRCH,
 };
@@ -155,11 +160,65 @@ int res_mailok(const char *dn);
 #endif
 int resolw_randomid(void);
 
+/**
+ * RESOLW_RANDOMID_STREAM (default): independent uniform 16-bit IDs.
+ * RESOLW_RANDOMID_PERMUTE: IDs drawn from a keyed permutation; a thread
+ * never sees the same ID twice within 32768 consecutive calls, so IDs of
+ * concurrently outstanding queries cannot collide.
+ * The mode is process-wide; the previous mode is returned.
+ */
+enum {
+    RESOLW_RANDOMID_STREAM  = 0,
+    RESOLW_RANDOMID_PERMUTE = 1,
+};
+int resolw_randomid_mode(int mode);
+
+/**
+ * res_nsend() draws UDP sockets from a process-wide pool; each socket is
+ * bound to a random source port and retired after `max_uses` queries or
+ * `max_age_sec` seconds. At most `max_idle` sockets per address family are
+ * kept open between queries. Zero leaves the respective setting unchanged.
+ */
+void resolw_sockpool_config(unsigned max_uses, unsigned max_age_sec, unsigned max_idle);
+
+/**
+ * With `sockets` (at most 16), res_nsend() sends UDP queries from all
+ * threads on that many shared sockets per address family instead of a
+ * socket of their own, and answers are matched to their queries by
+ * socket, ID and server. A shared socket is replaced after `max_age_sec`.
+ * Zero (the default) goes back to a socket per query. Returns 0, or -1
+ * with errno set.
+ */
+int resolw_sockpool_share(unsigned sockets);
+
+/**
+ * With `threads` (at most 4), res_nsend() hands UDP exchanges to that
+ * many dedicated I/O threads, which send and receive for all threads in
+ * batches (sendmmsg() and recvmmsg() on Linux) and wake each caller when
+ * its answer is in. This takes precedence over resolw_sockpool_share().
+ * Zero (the default) stops them once the exchanges they carry are over.
+ * Returns 0, or -1 with errno set.
+ */
+int resolw_sockpool_threads(unsigned threads);
+
+/**
+ * Hedged queries: when the first server of a res_nsend() round has not
+ * answered over UDP within the `percentile` (50 to 99) of its recent
+ * latencies, the query goes to the next server as well, and the first
+ * answer wins. Hedges are limited to `budget_permille` thousandths of
+ * the queries that could be hedged, plus a burst of 10. Zero
+ * `percentile` (the default) turns hedging off. Returns 0, or -1 with
+ * errno set.
+ */
+int resolw_hedge_config(unsigned percentile, unsigned budget_permille);
+
 /**
  * WinSock2: h_errno expands to WSAGetLastError()
  * h.*error() is implemented with FormatMessage()
  */
+#ifdef _WIN32
 void herror(const char *s);
+#endif /* elsewhere, <netdb.h> has it */
 
 /* __END_DECLS */
 #ifdef __cplusplus
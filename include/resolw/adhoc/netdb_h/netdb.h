@@ -26,6 +26,12 @@
 
 #include <errno.h>
 
+#if !defined(_WIN32) && defined(__has_include_next)
+#if __has_include_next(<netdb.h>)
+#include_next <netdb.h> /* the system header lacks only the declarations below */
+#endif
+#endif
+
 /* __BEGIN_DECLS */
 #ifdef __cplusplus
 extern "C" {
@@ -0,0 +1,63 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#ifndef _RESOLW_RESOLW_ADDR_H_
+#define _RESOLW_RESOLW_ADDR_H_
+
+#include "resolv.h"
+#include <netdb.h>
+#include <stdint.h>
+
+/**
+ * Dual-stack address lookup. The A and AAAA queries go out together to
+ * the servers of the resolver state (failing over as `res_nsend()` does).
+ * An AAAA answer with addresses ends the wait at once; an A answer first
+ * waits up to RESOLW_RESOLUTION_DELAY_MS for the AAAA one (Happy Eyeballs
+ * v2, RFC 8305 section 3). The addresses are then ordered by the
+ * destination address selection rules of RFC 6724, with the `sort_list`
+ * of the state ranking IPv4 addresses of equal precedence, and the
+ * addresses no local source can reach last.
+ */
+
+#define RESOLW_RESOLUTION_DELAY_MS 50
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct resolw_addr {
+    int family; /* AF_INET or AF_INET6 */
+    uint32_t ttl;
+    union {
+        struct in_addr in;
+        struct in6_addr in6;
+    } addr;
+};
+
+/*
+ * Looks up `name` as given (no search list) for `family`: AF_INET,
+ * AF_INET6, or AF_UNSPEC for both. With RES_USE_INET6 set, IPv4 answers
+ * come back as IPv4-mapped IPv6 addresses and AF_INET6 asks for both.
+ * Stores up to `max` addresses in order of preference and returns how
+ * many, or -1 with h_errno set like res_nquery().
+ */
+int resolw_addr_resolve(res_state statp, const char *name, int family, struct resolw_addr *addrs, int max);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RESOLW_RESOLW_ADDR_H_ */
@@ -0,0 +1,78 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#ifndef _RESOLW_RESOLW_DNSSEC_H_
+#define _RESOLW_RESOLW_DNSSEC_H_
+
+#include "resolv.h"
+#include <netdb.h>
+#include <stddef.h>
+
+/**
+ * Local DNSSEC validation. When the library is built with it (it needs
+ * OpenSSL), `getrrsetbyname()` sets RRSET_VALIDATED only for RRsets whose
+ * signatures check out along a chain of trust from a trust anchor, and
+ * no longer passes on the AD bit of the upstream resolver. The anchors
+ * are the root zone's key-signing keys unless replaced.
+ *
+ * Validated DNSKEY and DS sets are cached until their TTL (or their
+ * signatures) expire, and so are the signatures already checked, so
+ * repeated lookups in the same zone cost no public-key operations.
+ * Only positive results are cached; RSA/SHA-1, RSA/SHA-2, ECDSA P-256
+ * and P-384, Ed25519 and Ed448 are understood.
+ *
+ * The validated NSEC and NSEC3 records of negative answers are cached as
+ * well, and names and types they deny are answered without a query, by
+ * getrrsetbyname() and res_nquery() alike (RFC 8198).
+ *
+ * An RRset expanded from a wildcard is SECURE only with the NSEC or NSEC3
+ * proof, from the authority section of its answer, that no closer name
+ * exists (RFC 4035 section 5.3.4). getrrsetbyname() checks that proof; an
+ * rrsetinfo does not carry it, so resolw_dnssec_validate() finds such a
+ * set INDETERMINATE.
+ */
+
+enum {
+    RESOLW_DNSSEC_SECURE = 0, /* signed and checked up to a trust anchor */
+    RESOLW_DNSSEC_INSECURE = 1, /* under a delegation without DS records, or with none this library understands */
+    RESOLW_DNSSEC_BOGUS = 2, /* signed, but no signature checks out */
+    RESOLW_DNSSEC_INDETERMINATE = 3, /* no signatures, or the keys could not be fetched */
+};
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Validates a getrrsetbyname() result, fetching keys with `statp`. Returns RESOLW_DNSSEC_*, or -1 with errno set. */
+int resolw_dnssec_validate(res_state statp, const struct rrsetinfo *rrset);
+
+/* Adds a trust anchor: the wire rdata of a DS or DNSKEY record (`type`) owned by `owner`. Returns 0 or -1 with errno set. */
+int resolw_dnssec_add_anchor(const char *owner, unsigned type, const u_char *rdata, size_t rdlen);
+
+/* Removes every trust anchor, the built-in ones included, and empties the caches. */
+void resolw_dnssec_clear_anchors(void);
+
+/* Empties the key, signature and denial caches. */
+void resolw_dnssec_flush(void);
+
+/* Turns the use of cached NSEC and NSEC3 records for negative answers on (the default) or off; empties that cache. */
+void resolw_dnssec_set_aggressive(int enable);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RESOLW_RESOLW_DNSSEC_H_ */
@@ -0,0 +1,53 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#ifndef _RESOLW_RESOLW_IDNA_H_
+#define _RESOLW_RESOLW_IDNA_H_
+
+#include <stddef.h>
+
+/**
+ * Internationalized domain names. `res_nquery()`, `res_nmkquery()` and
+ * `getrrsetbyname()` apply `resolw_idna_to_ascii()` to the names they are
+ * given, so UTF-8 names can be passed to them directly.
+ *
+ * Each label that is not pure ASCII is taken as a U-label: letters are
+ * lowercased (ASCII, fullwidth ASCII, Latin-1, Latin Extended-A, Greek and
+ * Cyrillic), the label is checked against the IDNA2008 rules that need no
+ * Unicode tables (LDH in the ASCII range, no controls, symbols from the
+ * Latin-1 range, punctuation, private use or noncharacters, no leading
+ * combining mark, no hyphens at either end or in positions 3 and 4) and
+ * Punycode-encoded behind "xn--" (RFC 3492). Input is expected in NFC.
+ * U+3002, U+FF0E and U+FF61 separate labels like ".". ASCII labels are
+ * copied unchanged, escapes included.
+ */
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Writes the ASCII-compatible form of the UTF-8 name `name` to `out`.
+ * Returns its length, or -1 with errno set to EINVAL (not a valid name)
+ * or EMSGSIZE (a label over 63 bytes, or more than `outlen` - 1 in all).
+ */
+int resolw_idna_to_ascii(const char *name, char *out, size_t outlen);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RESOLW_RESOLW_IDNA_H_ */
@@ -0,0 +1,67 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#ifndef _RESOLW_RESOLW_PTR_H_
+#define _RESOLW_RESOLW_PTR_H_
+
+#include "resolv.h"
+#include <netdb.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Reverse lookups in bulk. Addresses come packed (4 bytes each for
+ * AF_INET, 16 for AF_INET6); each distinct one is asked once, with up
+ * to `window` queries in flight to the servers of the resolver state
+ * (failing over as `res_nsend()` does).
+ */
+
+/* Longest reverse name, "x.x. ... .x.ip6.arpa" (32 nibbles), with its NUL. */
+#define RESOLW_PTR_NAMELEN 73
+
+/* Queries in flight when `window` is 0. */
+#define RESOLW_PTR_WINDOW 64
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct resolw_ptr {
+    int status; /* 0, or HOST_NOT_FOUND, NO_DATA, TRY_AGAIN or NO_RECOVERY as in h_errno */
+    uint32_t ttl;
+    char name[MAXDNAME]; /* the first PTR target, in presentation form */
+};
+
+/*
+ * Writes the in-addr.arpa or ip6.arpa name of `addr`, without a trailing
+ * dot. Returns its length, or -1 with errno set to EINVAL (family) or
+ * EMSGSIZE (`outlen` under RESOLW_PTR_NAMELEN).
+ */
+int resolw_ptr_name(int family, const void *addr, char *out, size_t outlen);
+
+/*
+ * Reverse-resolves `count` packed addresses of `family` into `results`
+ * (one per address). Returns how many resolved to a name, or -1 with
+ * errno set if nothing could be sent.
+ */
+int resolw_ptr_batch(res_state statp, int family, const void *addrs, size_t count,
+                     struct resolw_ptr *results, unsigned window);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RESOLW_RESOLW_PTR_H_ */
@@ -0,0 +1,135 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#ifndef _RESOLW_RESOLW_RDATA_H_
+#define _RESOLW_RESOLW_RDATA_H_
+
+#include "resolv.h"
+#include <netdb.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Typed views over wire-format records, as returned by `res_nquery()`
+ * (whole messages) and `getrrsetbyname()` (rdata with names expanded).
+ * Views point into the caller's buffer and never allocate. Each one is
+ * checked in full when it is made (`resolw_*_view()` returns -1 with
+ * errno set to EBADMSG if anything is out of bounds, a name is malformed
+ * or a pointer loops), so reading its fields and iterating over it need
+ * no further checks. A view lives as long as the buffer it points into.
+ */
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* One record's rdata. `msg`..`eom` is the message it came from, for names that may be compressed; null if none. */
+struct resolw_rdata {
+    const u_char *msg, *eom;
+    const u_char *data;
+    uint16_t len;
+};
+
+/* A domain name in wire format; compression pointers (if any) lead into `msg`. */
+struct resolw_name {
+    const u_char *msg, *eom;
+    const u_char *wire;
+};
+
+/* One resource record of a message. */
+struct resolw_rr {
+    struct resolw_name owner;
+    uint16_t type, rdclass;
+    uint32_t ttl;
+    int section; /* 1 = answer, 2 = authority, 3 = additional */
+    struct resolw_rdata rdata;
+};
+
+/* Walks the records of a message; the question section is skipped. */
+struct resolw_msg_iter {
+    const u_char *msg, *eom, *cp;
+    unsigned counts[4];
+    int section;
+    unsigned left;
+};
+
+/* Character-strings of TXT, parameters of SVCB/HTTPS. */
+struct resolw_iter {
+    const u_char *p, *end;
+};
+
+struct resolw_srv {
+    uint16_t priority, weight, port;
+    struct resolw_name target;
+};
+
+struct resolw_mx {
+    uint16_t preference;
+    struct resolw_name exchange;
+};
+
+struct resolw_sshfp {
+    uint8_t algorithm, fp_type;
+    const u_char *fingerprint;
+    size_t fp_len;
+};
+
+struct resolw_tlsa {
+    uint8_t usage, selector, matching_type;
+    const u_char *data;
+    size_t data_len;
+};
+
+/* SVCB and HTTPS (RFC 9460). `priority` 0 is AliasForm, which has no parameters. */
+struct resolw_svcb {
+    uint16_t priority;
+    struct resolw_name target;
+    struct resolw_iter params;
+};
+
+/* Checks the header and skips the question section. Returns 0 or -1. */
+int resolw_msg_iter_init(struct resolw_msg_iter *it, const u_char *msg, int len);
+
+/* Returns 1 with the next record in `rr`, 0 after the last one, or -1 if the message is malformed. */
+int resolw_msg_iter_next(struct resolw_msg_iter *it, struct resolw_rr *rr);
+
+/* The rdata of a getrrsetbyname() result, whose names are never compressed. */
+void resolw_rdata_of(const struct rdatainfo *rdi, struct resolw_rdata *out);
+
+int resolw_srv_view(const struct resolw_rdata *rd, struct resolw_srv *out);
+int resolw_mx_view(const struct resolw_rdata *rd, struct resolw_mx *out);
+int resolw_sshfp_view(const struct resolw_rdata *rd, struct resolw_sshfp *out);
+int resolw_tlsa_view(const struct resolw_rdata *rd, struct resolw_tlsa *out);
+int resolw_svcb_view(const struct resolw_rdata *rd, struct resolw_svcb *out);
+int resolw_txt_view(const struct resolw_rdata *rd, struct resolw_iter *out);
+
+/* Returns 1 with the next character-string of a TXT view, or 0 at the end. */
+int resolw_txt_next(struct resolw_iter *it, const u_char **str, size_t *len);
+
+/* Returns 1 with the next SvcParam (keys come in strictly increasing order), or 0 at the end. */
+int resolw_svcb_next(struct resolw_iter *it, uint16_t *key, const u_char **value, size_t *len);
+
+/* Writes the name in presentation form, like dn_expand(). Returns its length or -1. */
+int resolw_name_text(const struct resolw_name *name, char *out, size_t outlen);
+
+/* Compares two names case-insensitively; 1 if equal. */
+int resolw_name_equal(const struct resolw_name *a, const struct resolw_name *b);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RESOLW_RESOLW_RDATA_H_ */
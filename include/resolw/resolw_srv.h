@@ -0,0 +1,71 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#ifndef _RESOLW_RESOLW_SRV_H_
+#define _RESOLW_RESOLW_SRV_H_
+
+#include "resolv.h"
+#include <netdb.h>
+#include <stdint.h>
+
+/**
+ * Service discovery (RFC 2782): looks up the SRV records of a service,
+ * orders them by priority and, within a priority, by a weighted random
+ * draw, and resolves their targets into socket addresses. Addresses from
+ * the additional section are used when the server sends them; targets
+ * without any are resolved concurrently. The resulting list is shared by
+ * all callers until the smallest TTL that went into it expires, so a
+ * repeated call costs a lookup and a reference count.
+ */
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct resolw_endpoint {
+    struct sockaddr_storage addr; /* with the SRV port */
+    socklen_t addrlen;
+    uint16_t priority, weight;
+    const char *target; /* the SRV target, in presentation form */
+};
+
+struct resolw_srv_list {
+    unsigned count; /* endpoints, in the order to try them */
+    uint32_t ttl; /* seconds the list was valid for when it was resolved */
+    const struct resolw_endpoint *endpoints;
+};
+
+/*
+ * Resolves `service` (e.g. "_sip._tcp.example.com") with the calling
+ * thread's implied state, keeping addresses of `family` (AF_INET,
+ * AF_INET6 or AF_UNSPEC for both, IPv6 first). Targets that resolve to
+ * nothing are left out. Returns ERRSET_SUCCESS with `*list` to release
+ * with resolw_srv_free(), or ERRSET_NONAME, ERRSET_NODATA (including a
+ * service that is "decidedly not available", RFC 2782), ERRSET_INVAL,
+ * ERRSET_NOMEMORY or ERRSET_FAIL.
+ */
+int resolw_srv_resolve(const char *service, int family, const struct resolw_srv_list **list);
+
+void resolw_srv_free(const struct resolw_srv_list *list);
+
+/* Drops every cached list; lists already handed out stay valid. */
+void resolw_srv_flush(void);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RESOLW_RESOLW_SRV_H_ */
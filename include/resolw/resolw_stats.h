@@ -0,0 +1,65 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#ifndef _RESOLW_RESOLW_STATS_H_
+#define _RESOLW_RESOLW_STATS_H_
+
+#include "resolv.h"
+#include <stdint.h>
+
+/**
+ * Resolver counters. Every thread records into its own shard without
+ * locks or atomic read-modify-write; `resolw_stats_read()` merges all
+ * shards (including those of threads that have since exited).
+ */
+
+/* Latency bucket `i` counts exchanges that took [2^(i-1), 2^i) microseconds; bucket 0 is "under 1 us". */
+#define RESOLW_STATS_BUCKETS 32
+#define RESOLW_STATS_MAXSERVERS 16
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct resolw_server_stats {
+    struct sockaddr_storage addr; /* AF_UNSPEC stands for the system (WinDNS) resolver */
+    uint64_t queries; /* messages sent */
+    uint64_t responses; /* matching answers received */
+    uint64_t timeouts; /* no matching answer in time */
+    uint64_t truncated; /* answers with TC set */
+    uint64_t errors; /* transport errors (e.g. ICMP unreachable, connection reset) */
+    uint64_t latency[RESOLW_STATS_BUCKETS]; /* log2-bucketed response times */
+};
+
+struct resolw_stats {
+    unsigned nservers; /* entries used in `servers`; servers beyond the limit are not tracked */
+    struct resolw_server_stats servers[RESOLW_STATS_MAXSERVERS];
+    uint64_t cache_hits; /* answers served by in-library caches */
+    uint64_t cache_misses;
+    uint64_t rcodes[16]; /* answers by RCODE */
+};
+
+/* Fills `out` with the counters accumulated since start-up or the last reset. Returns 0. */
+int resolw_stats_read(struct resolw_stats *out);
+
+/* Makes subsequent reads count from now. */
+void resolw_stats_reset(void);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RESOLW_RESOLW_STATS_H_ */
@@ -0,0 +1,83 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#ifndef _RESOLW_RESOLW_TLS_H_
+#define _RESOLW_RESOLW_TLS_H_
+
+#include "resolv.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * DNS over TLS (RFC 7858). Queries that the native backend sends to a
+ * registered server go over TLS instead of UDP or TCP: those of
+ * `res_nsend()` and of everything built on it. Batch lookups
+ * (resolw_ptr.h, resolw_addr.h) pipeline their queries on one
+ * connection. A few connections per server are kept open between
+ * queries, and a new one resumes the last TLS session the server handed
+ * out, which spares it the public-key operations of a full handshake.
+ * Like TSIG, this needs the library to be built with OpenSSL; otherwise
+ * every call fails with ENOSYS.
+ *
+ * A server is identified by address and port (853 for DoT proper) and is
+ * only asked if it is in the resolver's server list (`nsaddr_list`).
+ */
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct resolw_tls_stats {
+    uint64_t handshakes; /* full handshakes */
+    uint64_t resumptions; /* abbreviated handshakes that resumed a session */
+    uint64_t reuses; /* exchanges on a connection kept from an earlier one */
+};
+
+/**
+ * Sends queries to `server` over TLS from now on. With a null
+ * `auth_name`, the connection is encrypted but the server is not
+ * authenticated (the opportunistic profile of RFC 7858 section 4.1).
+ * Otherwise its certificate has to chain up to a trust anchor and match
+ * `auth_name` (the strict profile of RFC 8310), which is also sent as
+ * SNI. Returns 0 or -1 with errno set.
+ */
+int resolw_tls_add_server(const struct sockaddr *server, const char *auth_name);
+
+/* Goes back to plain DNS for `server`. Returns 0, or -1 with errno set if it was not added. */
+int resolw_tls_remove_server(const struct sockaddr *server);
+
+/**
+ * Adds the CA certificates in the PEM text `pem` to the trust anchors of
+ * the strict profile, which start out as OpenSSL's default ones.
+ * Returns the number added, or -1 with errno set.
+ */
+int resolw_tls_add_trust(const char *pem, size_t len);
+
+/**
+ * Closes the connections kept open. With `sessions`, also forgets the
+ * sessions kept for resumption, so that the next connection to each
+ * server makes a full handshake.
+ */
+void resolw_tls_flush(int sessions);
+
+/* Fills `out` with the counters accumulated since start-up. Returns 0, or -1 with errno set. */
+int resolw_tls_stats_read(struct resolw_tls_stats *out);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RESOLW_RESOLW_TLS_H_ */
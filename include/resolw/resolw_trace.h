@@ -0,0 +1,72 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#ifndef _RESOLW_RESOLW_TRACE_H_
+#define _RESOLW_RESOLW_TRACE_H_
+
+#include "resolv.h"
+#include <stdint.h>
+
+/**
+ * Query lifecycle hooks. Subscribers are called synchronously on the thread
+ * that runs the query and must not call back into the resolver. With no
+ * subscribers, each hook point costs one predictable branch on a global flag.
+ *
+ * When built with -DRESOLW_USDT=ON on a system providing <sys/sdt.h>, the
+ * same points are also USDT probes (provider `resolw`, probe names as below
+ * in lower case, e.g. `resolw:server_send`) usable from perf, bpftrace or
+ * SystemTap without registering anything.
+ */
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    RESOLW_TRACE_QUERY_START = 0, /* res_nquery/res_nsend/getrrsetbyname entered */
+    RESOLW_TRACE_SERVER_SEND = 1, /* a message left for `server` */
+    RESOLW_TRACE_RESPONSE    = 2, /* a matching answer arrived from `server` */
+    RESOLW_TRACE_RETRY       = 3, /* the previous attempt failed; `attempt` is the next one */
+    RESOLW_TRACE_CACHE_HIT   = 4, /* answered by an in-library cache */
+    RESOLW_TRACE_COMPLETE    = 5, /* the call returns `result` */
+};
+
+struct resolw_trace_event {
+    int kind; /* RESOLW_TRACE_* */
+    uint64_t query_serial; /* process-unique; shared by all events of one call */
+    uint64_t timestamp_ns; /* monotonic clock */
+    const char *qname; /* may be NULL if not known */
+    unsigned qtype;
+    unsigned dns_id; /* message ID, where one exists */
+    const struct sockaddr *server; /* SERVER_SEND, RESPONSE, RETRY; NULL = system resolver */
+    int attempt; /* 0-based attempt count within the call */
+    int rcode; /* RESPONSE, COMPLETE; -1 if none */
+    int result; /* COMPLETE: the value returned to the caller */
+};
+
+typedef void (*resolw_trace_fn)(const struct resolw_trace_event *event, void *ctx);
+
+/* Returns a handle for resolw_trace_unsubscribe(), or -1 if all subscriber slots are taken. */
+int resolw_trace_subscribe(resolw_trace_fn fn, void *ctx);
+
+/* Does not wait for callbacks already in progress on other threads. */
+void resolw_trace_unsubscribe(int handle);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RESOLW_RESOLW_TRACE_H_ */
@@ -0,0 +1,81 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#ifndef _RESOLW_RESOLW_TSIG_H_
+#define _RESOLW_RESOLW_TSIG_H_
+
+#include "resolv.h"
+#include <stddef.h>
+
+/**
+ * Transaction signatures (TSIG, RFC 8945) with shared secrets from a
+ * process-wide keyring. Like DNSSEC validation, this needs the library
+ * to be built with OpenSSL; otherwise every call fails with ENOSYS.
+ *
+ * A message is signed in place: the TSIG record is appended to it in
+ * the caller's buffer. Once signed, it can be sent with `res_nsend()`,
+ * which then accepts only answers signed with the same key and, unless
+ * RES_KEEPTSIG is set, removes their TSIG record before returning them.
+ * This covers queries, UPDATEs and the first message of a zone transfer.
+ *
+ * Keys are hashed into their HMAC pad states once, when added, so that
+ * signing or verifying a message costs no key setup.
+ */
+
+/* The TSIG error codes (RFC 8945 section 3), as returned by resolw_tsig_verify(). */
+enum {
+    RESOLW_TSIG_BADSIG = 16,
+    RESOLW_TSIG_BADKEY = 17,
+    RESOLW_TSIG_BADTIME = 18,
+    RESOLW_TSIG_BADTRUNC = 22,
+};
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Adds (or replaces) the key `name`. `algorithm` is the TSIG algorithm
+ * name: "hmac-sha256" (the one to use), "hmac-sha1", "hmac-sha224",
+ * "hmac-sha384", "hmac-sha512" or "hmac-md5.sig-alg.reg.int".
+ * Returns 0 or -1 with errno set.
+ */
+int resolw_tsig_add_key(const char *name, const char *algorithm, const u_char *secret, size_t secretlen);
+
+/* Removes the key `name`. Returns 0, or -1 with errno set if there is none. */
+int resolw_tsig_remove_key(const char *name);
+
+/**
+ * Signs the message of `msglen` bytes in `buf` with the key `keyname`,
+ * as an answer to the signed message `request` if that is not null.
+ * Returns the new length, or -1 with errno set (EMSGSIZE if the TSIG
+ * record does not fit into `buflen`).
+ */
+int resolw_tsig_sign(const char *keyname, u_char *buf, int msglen, int buflen, const u_char *request, int reqlen);
+
+/**
+ * Checks the signature of `msg`, as an answer to the signed message
+ * `request` if that is not null. Returns 0 if it is good, a
+ * RESOLW_TSIG_* code if it is not (or if the other side reported one),
+ * or -1 with errno set if the message is unsigned or malformed.
+ */
+int resolw_tsig_verify(const u_char *msg, int msglen, const u_char *request, int reqlen);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RESOLW_RESOLW_TSIG_H_ */
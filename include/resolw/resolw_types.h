@@ -15,7 +15,9 @@
 #ifndef _RESOLW_RESOLW_TYPES_H_
 #define _RESOLW_RESOLW_TYPES_H_
 #include <sys/types.h>
+#ifdef _WIN32
 #include <_bsd_types.h>
+#endif
 #include <stdint.h>
 
 /* Upstream OpenBSD is already getting rid of this type naming convention; we are simply following suit */
@@ -0,0 +1,97 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#ifndef _RESOLW_RESOLW_UPDATE_H_
+#define _RESOLW_RESOLW_UPDATE_H_
+
+#include "resolv.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * DNS UPDATE (RFC 2136) messages for one zone. Prerequisites and changes
+ * are collected first, then packed into as few messages as fit a given
+ * size, each with as many of the changes, in order, as fit. An update
+ * with prerequisites must fit in one message. One without them may be
+ * split, and a split update is not atomic: the server applies each
+ * message on its own, so a failure part way leaves the earlier messages'
+ * changes in the zone. Owner names, and the names in the rdata of the
+ * RFC 1035 types, are compressed against everything already in the
+ * message.
+ *
+ * A single change can also be sent without a builder: res_nmkquery()
+ * with `op` UPDATE makes a message for the zone `dname` and puts the
+ * uncompressed resource record `newrr`, if not null, into its update
+ * section.
+ *
+ * Rdata is given in uncompressed wire format. The builder is not thread
+ * safe; use one per thread.
+ */
+
+/* Prerequisites (RFC 2136 section 2.4). */
+enum {
+    RESOLW_UPDATE_YXRRSET = 1, /* the RRset exists; with rdata, one call per record, it is exactly these records */
+    RESOLW_UPDATE_NXRRSET = 2, /* the RRset does not exist */
+    RESOLW_UPDATE_YXDOMAIN = 3, /* the name owns at least one record; `type` is ignored */
+    RESOLW_UPDATE_NXDOMAIN = 4, /* the name owns no records; `type` is ignored */
+};
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct resolw_update resolw_update;
+
+/* A builder for updates to `zone` in class `rdclass` (C_IN, usually); null with errno set on failure. */
+resolw_update *resolw_update_new(const char *zone, unsigned rdclass);
+
+void resolw_update_free(resolw_update *upd);
+
+/* Adds a prerequisite; `rdata` only for a value-dependent RESOLW_UPDATE_YXRRSET. Returns 0 or -1 with errno set. */
+int resolw_update_require(resolw_update *upd, int what, const char *name, unsigned type, const u_char *rdata, size_t rdlen);
+
+/* Adds one record. Returns 0 or -1 with errno set. */
+int resolw_update_add(resolw_update *upd, const char *name, unsigned type, uint32_t ttl, const u_char *rdata, size_t rdlen);
+
+/**
+ * Deletes one record, or with a null `rdata` the whole RRset, or with
+ * `type` T_ANY (and no rdata) every RRset of `name`. Returns 0 or -1
+ * with errno set.
+ */
+int resolw_update_delete(resolw_update *upd, const char *name, unsigned type, const u_char *rdata, size_t rdlen);
+
+/**
+ * Packs the next message into `buf`, which is also the size limit: 512
+ * bytes for UDP, up to 65535 for TCP, less the room for a TSIG record
+ * if it is to be signed. The message ID is drawn as res_nmkquery() does.
+ * Returns the message length, 0 once every change has been packed, or
+ * -1 with errno set (EMSGSIZE if the prerequisites and a single change
+ * do not fit together, or if there are prerequisites and the changes do
+ * not all fit with them).
+ */
+int resolw_update_pack(resolw_update *upd, res_state statp, u_char *buf, int buflen);
+
+/* Makes resolw_update_pack() start over from the first change, e.g. to retry with a larger size. */
+void resolw_update_rewind(resolw_update *upd);
+
+/* Drops every prerequisite and change, keeping the zone and the memory. */
+void resolw_update_clear(resolw_update *upd);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RESOLW_RESOLW_UPDATE_H_ */
@@ -0,0 +1,96 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#ifndef _RESOLW_RESOLW_XFR_H_
+#define _RESOLW_RESOLW_XFR_H_
+
+#include "resolv.h"
+#include "resolw/resolw_rdata.h"
+#include <stdint.h>
+
+/**
+ * Zone transfers over TCP: AXFR (RFC 5936) and IXFR (RFC 1995). Records
+ * are handed out one at a time as the messages arrive, so a transfer
+ * holds one message (at most 64 KiB) whatever the size of the zone.
+ *
+ * An IXFR comes out as the diffs the server sends, in order: for each,
+ * RESOLW_XFR_DELETE events (the old SOA first), RESOLW_XFR_ADD events
+ * (the new SOA first), then RESOLW_XFR_COMMIT with the serial the zone
+ * is at once the diff is applied. A server may answer an IXFR with the
+ * whole zone instead, as it does an AXFR: RESOLW_XFR_ADD for every
+ * record, the SOA first, then one RESOLW_XFR_COMMIT. A server that does
+ * not implement IXFR is asked again for an AXFR.
+ *
+ * The native backend's servers (`nsaddr_list`) are tried in order until
+ * one starts the transfer; a transfer that breaks off is not resumed.
+ */
+
+/* What a resolw_xfr_next() event asks of the copy of the zone. */
+enum {
+    RESOLW_XFR_ADD = 1,
+    RESOLW_XFR_DELETE = 2,
+    RESOLW_XFR_COMMIT = 3, /* the records so far make up version `serial` of the zone */
+};
+
+/* How the server answers; see resolw_xfr_style(). */
+enum {
+    RESOLW_XFR_FULL = 1, /* the whole zone: start over from an empty copy */
+    RESOLW_XFR_INCREMENTAL = 2, /* diffs from the version asked about */
+    RESOLW_XFR_CURRENT = 3, /* the version asked about is current; no events follow */
+};
+
+struct resolw_xfr_event {
+    int what;
+    uint32_t serial; /* RESOLW_XFR_COMMIT */
+    struct resolw_rr rr; /* RESOLW_XFR_ADD, RESOLW_XFR_DELETE: valid until the next call */
+};
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct resolw_xfr resolw_xfr;
+
+/**
+ * Starts a transfer of `zone` in class `rdclass`. `type` is T_AXFR, or
+ * T_IXFR with the `serial` of the copy at hand. With a `tsig_key` from
+ * the TSIG keyring (resolw_tsig.h), the request is signed and the answer
+ * must be. Returns null with errno set if no server starts the transfer:
+ * ETIMEDOUT or ECONNREFUSED as res_nsend(), EACCES if an answer fails
+ * TSIG verification or its RCODE is not NOERROR, EBADMSG if it is not a
+ * transfer of `zone`.
+ */
+resolw_xfr *resolw_xfr_open(res_state statp, const char *zone, unsigned rdclass, unsigned type, uint32_t serial,
+                            const char *tsig_key);
+
+/* One of RESOLW_XFR_FULL, RESOLW_XFR_INCREMENTAL or RESOLW_XFR_CURRENT. */
+int resolw_xfr_style(const resolw_xfr *xfr);
+
+/**
+ * Returns 1 with the next event in `ev`, 0 once the transfer is complete,
+ * or -1 with errno set if it breaks off: as resolw_xfr_open(), or
+ * ECONNRESET if the server hangs up early. The events since the last
+ * RESOLW_XFR_COMMIT are then to be undone.
+ */
+int resolw_xfr_next(resolw_xfr *xfr, struct resolw_xfr_event *ev);
+
+void resolw_xfr_close(resolw_xfr *xfr);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RESOLW_RESOLW_XFR_H_ */
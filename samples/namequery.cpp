@@ -6,17 +6,409 @@
  *
  * This file is part of the libresolw compatibility library:
  *   https://github.com/treeswift/libresolw
- * 
+ *
  * The complete libresolw library reuses a substantial amount of code from
  * the OpenBSD project and is therefore distributed under the 3-clause BSD
  * license. Refer to the LICENSE file in the project root.
  */
 
+#include "resolv.h"
+#include "resolw/resolw_stats.h"
+#include "arpa/inet.h"
+
+#include <errno.h>
+#include <netdb.h> // h_errno
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * A dnsperf-style load generator: replays a query file through the library
+ * at a target rate or with a fixed number of concurrent clients, then
+ * reports throughput, latency percentiles, timeouts and response codes.
+ *
+ * Usage: namequery [-d file] [-s server[:port]]... [-c clients] [-Q qps]
+ *                  [-l seconds] [-n queries] [-t timeout] [-m send|query] [-u]
+ *
+ * The query file has one "name [type]" pair per line (type defaults to A);
+ * empty lines and lines starting with '#' or ';' are skipped. Without -d,
+ * queries are read from standard input. The file is replayed in a loop.
+ *
+ * Each client is a thread of its own, as res_nsend() and res_nquery() block
+ * until the exchange completes; -c therefore sets both the concurrency and
+ * the thread count. With -Q, clients share one send schedule and sleep until
+ * their next slot; latency is measured from the actual send.
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Query {
+    std::string name;
+    int type;
+};
+
+struct Options {
+    const char* file = nullptr;
+    std::vector<sockaddr_in> servers;
+    int clients = 1;
+    double qps = 0; // unlimited
+    double seconds = 10;
+    uint64_t limit = 0; // unlimited
+    int timeout = 5;
+    bool use_nquery = false;
+    bool use_tcp = false;
+};
+
+const struct { const char* name; int type; } kTypes[] = {
+    { "A", 1 }, { "NS", 2 }, { "CNAME", 5 }, { "SOA", 6 }, { "PTR", 12 }, { "MX", 15 }, { "TXT", 16 },
+    { "AAAA", 28 }, { "SRV", 33 }, { "NAPTR", 35 }, { "DS", 43 }, { "SSHFP", 44 }, { "RRSIG", 46 },
+    { "NSEC", 47 }, { "DNSKEY", 48 }, { "TLSA", 52 }, { "SVCB", 64 }, { "HTTPS", 65 }, { "ANY", 255 },
+    { "CAA", 257 },
+};
+
+const char* const kRcodes[] = {
+    "NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN", "NOTIMP", "REFUSED",
+    "YXDOMAIN", "YXRRSET", "NXRRSET", "NOTAUTH", "NOTZONE",
+};
+
+int parse_type(const char* text) {
+    for(const auto& t : kTypes) {
+        if(!strcasecmp(text, t.name)) return t.type;
+    }
+    if(!strncasecmp(text, "TYPE", 4) && text[4]) { // RFC 3597
+        char* end;
+        long v = strtol(text + 4, &end, 10);
+        if(!*end && v > 0 && v <= 0xffff) return v;
+    }
+    return -1;
+}
+
+bool load_queries(const char* path, std::vector<Query>& queries) {
+    FILE* in = path && strcmp(path, "-") ? fopen(path, "r") : stdin;
+    if(!in) {
+        perror(path);
+        return false;
+    }
+    char line[1024];
+    int lineno = 0;
+    while(fgets(line, sizeof(line), in)) {
+        ++lineno;
+        char* name = strtok(line, " \t\r\n");
+        if(!name || *name == '#' || *name == ';') continue;
+        char* type = strtok(nullptr, " \t\r\n");
+        int t = type ? parse_type(type) : 1;
+        if(t < 0) {
+            fprintf(stderr, "line %d: unknown type '%s', skipped\n", lineno, type);
+            continue;
+        }
+        queries.push_back({ name, t });
+    }
+    if(in != stdin) fclose(in);
+    return true;
+}
+
+bool parse_server(const char* text, sockaddr_in& sin) {
+    std::string host = text;
+    int port = NAMESERVER_PORT;
+    size_t colon = host.find(':');
+    if(colon != std::string::npos) {
+        port = atoi(host.c_str() + colon + 1);
+        host.resize(colon);
+    }
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    return port > 0 && port <= 0xffff && inet_pton(AF_INET, host.c_str(), &sin.sin_addr) == 1;
+}
+
+/* Log-linear latency histogram over microseconds; buckets are at most 1/16 wide. */
+class Histogram {
+public:
+    static constexpr int kSub = 16;
+    static constexpr int kBuckets = 61 * kSub;
+
+    Histogram() : counts_(kBuckets, 0), n_(0), sum_(0), sumsq_(0), min_(UINT64_MAX), max_(0) {}
+
+    void add(uint64_t us) {
+        ++counts_[index(us)];
+        ++n_;
+        sum_ += us;
+        sumsq_ += double(us) * us;
+        min_ = std::min(min_, us);
+        max_ = std::max(max_, us);
+    }
+
+    void merge(const Histogram& other) {
+        for(int i = 0; i < kBuckets; ++i) counts_[i] += other.counts_[i];
+        n_ += other.n_;
+        sum_ += other.sum_;
+        sumsq_ += other.sumsq_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    /* Lower bound of the bucket holding the q-quantile. */
+    uint64_t quantile(double q) const {
+        uint64_t rank = std::ceil(q * n_), seen = 0;
+        for(int i = 0; i < kBuckets; ++i) {
+            seen += counts_[i];
+            if(seen && seen >= rank) return lower(i);
+        }
+        return max_;
+    }
+
+    uint64_t count() const { return n_; }
+    uint64_t min() const { return n_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return n_ ? double(sum_) / n_ : 0; }
+    double stddev() const { return n_ > 1 ? std::sqrt(std::max(0.0, sumsq_ / n_ - mean() * mean())) : 0; }
+
+private:
+    static int index(uint64_t us) {
+        if(us < kSub) return us;
+        int e = 63 - __builtin_clzll(us); // >= 4
+        return (e - 3) * kSub + ((us >> (e - 4)) & (kSub - 1));
+    }
+
+    static uint64_t lower(int index) {
+        if(index < kSub) return index;
+        int e = index / kSub + 3;
+        return uint64_t(kSub + index % kSub) << (e - 4);
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t n_, sum_;
+    double sumsq_;
+    uint64_t min_, max_;
+};
+
+struct ClientResult {
+    Histogram latency;
+    uint64_t sent = 0, completed = 0, timeouts = 0, failed = 0;
+    uint64_t rcodes[16] = {};
+};
+
+struct Run {
+    const Options* opts;
+    const std::vector<Query>* queries;
+    Clock::time_point start, end;
+    std::atomic<uint64_t> next{0}; // the next query (and send slot) to take
+};
+
+void client(Run& run, ClientResult& out) {
+    const Options& opts = *run.opts;
+    const std::vector<Query>& queries = *run.queries;
+    _res_state rs;
+    res_ninit(&rs);
+    if(!opts.servers.empty()) {
+        rs.nscount = std::min<int>(opts.servers.size(), MAXNS);
+        std::copy(opts.servers.begin(), opts.servers.begin() + rs.nscount, rs.nsaddr_list);
+    }
+    rs.retrans = opts.timeout;
+    rs.retry = 1; // a timeout should show up as one, not as a slow answer
+    if(opts.use_tcp) rs.options |= RES_USEVC;
+
+    u_char query[HFIXEDSZ + MAXDNAME + 4], answer[65535] = {};
+    for(;;) {
+        uint64_t k = run.next.fetch_add(1, std::memory_order_relaxed);
+        if(opts.limit && k >= opts.limit) break;
+        if(opts.qps > 0) {
+            auto slot = run.start + std::chrono::nanoseconds(uint64_t(k * 1e9 / opts.qps));
+            if(slot >= run.end || Clock::now() >= run.end) break; // a client that fell behind stops on time too
+            std::this_thread::sleep_until(slot);
+        } else if(Clock::now() >= run.end) {
+            break;
+        }
+        const Query& q = queries[k % queries.size()];
+        auto sent = Clock::now();
+        int n = -1, denied = -1; // the rcode of an answer res_nquery() turns into -1
+        errno = 0;
+        if(opts.use_nquery) {
+            n = res_nquery(&rs, q.name.c_str(), C_IN, q.type, answer, sizeof(answer));
+            if(n < 0) denied = h_errno == HOST_NOT_FOUND ? 3 /* NXDOMAIN */ : h_errno == NO_DATA ? 0 /* NOERROR */ : -1;
+        } else {
+            int len = res_nmkquery(&rs, QUERY, q.name.c_str(), C_IN, q.type, nullptr, 0, nullptr, query, sizeof(query));
+            if(len > 0) {
+                n = res_nsend(&rs, query, len, answer, sizeof(answer));
+            }
+        }
+        auto done = Clock::now();
+        ++out.sent;
+        if(n >= HFIXEDSZ || denied >= 0) {
+            ++out.completed;
+            ++out.rcodes[denied >= 0 ? denied : answer[3] & 0xf];
+            out.latency.add(std::chrono::duration_cast<std::chrono::microseconds>(done - sent).count());
+        } else if(!opts.use_nquery && !memcmp(answer, query, 2) && (answer[2] & 0x80)) {
+            // every server answered, but with SERVFAIL/NOTIMP/REFUSED; res_nsend() leaves the last answer behind
+            ++out.failed;
+            ++out.rcodes[answer[3] & 0xf];
+        } else if(errno == ETIMEDOUT) {
+            ++out.timeouts;
+        } else {
+            ++out.failed;
+        }
+    }
+}
+
+const char* rcode_name(int rcode, char* buf, size_t len) {
+    if(rcode < (int) (sizeof(kRcodes) / sizeof(*kRcodes))) return kRcodes[rcode];
+    snprintf(buf, len, "RCODE%d", rcode);
+    return buf;
+}
+
+void print_rcodes(const char* title, const uint64_t* rcodes, int n) {
+    uint64_t total = 0;
+    for(int i = 0; i < n; ++i) total += rcodes[i];
+    printf("  %-22s", title);
+    const char* sep = "";
+    for(int i = 0; i < n; ++i) {
+        if(!rcodes[i]) continue;
+        char buf[16];
+        printf("%s%s %llu (%.2f%%)", sep, rcode_name(i, buf, sizeof(buf)), (unsigned long long) rcodes[i],
+               100.0 * rcodes[i] / total);
+        sep = ", ";
+    }
+    printf("%s\n", total ? "" : "none");
+}
+
+void report(const Options& opts, const ClientResult& total, double elapsed) {
+    auto pct = [&](uint64_t n) { return total.sent ? 100.0 * n / total.sent : 0.0; };
+    auto ms = [](double us) { return us / 1000.0; };
+    const Histogram& h = total.latency;
+    printf("Statistics:\n\n");
+    printf("  Queries sent:         %llu\n", (unsigned long long) total.sent);
+    printf("  Queries completed:    %llu (%.2f%%)\n", (unsigned long long) total.completed, pct(total.completed));
+    printf("  Queries timed out:    %llu (%.2f%%)\n", (unsigned long long) total.timeouts, pct(total.timeouts));
+    printf("  Queries failed:       %llu (%.2f%%)\n\n", (unsigned long long) total.failed, pct(total.failed));
+    print_rcodes("Response codes:", total.rcodes, 16);
+    printf("  Run time (s):         %.3f\n", elapsed);
+    printf("  Queries per second:   %.1f\n\n", elapsed > 0 ? total.completed / elapsed : 0.0);
+    printf("  Latency (ms):         min %.3f, avg %.3f, max %.3f, stddev %.3f\n",
+           ms(h.min()), ms(h.mean()), ms(h.max()), ms(h.stddev()));
+    printf("  Percentiles (ms):     p50 %.3f, p90 %.3f, p99 %.3f, p99.9 %.3f\n\n",
+           ms(h.quantile(0.5)), ms(h.quantile(0.9)), ms(h.quantile(0.99)), ms(h.quantile(0.999)));
+
+    resolw_stats stats;
+    resolw_stats_read(&stats);
+    print_rcodes("All responses seen:", stats.rcodes, 16); // including SERVFAIL etc. that caused failover
+    printf("\nPer server:\n");
+    for(unsigned i = 0; i < stats.nservers && i < RESOLW_STATS_MAXSERVERS; ++i) {
+        const resolw_server_stats& s = stats.servers[i];
+        if(!s.queries) continue;
+        char addr[INET6_ADDRSTRLEN] = "?";
+        unsigned port = 0;
+        if(s.addr.ss_family == AF_INET) {
+            const sockaddr_in* sin = reinterpret_cast<const sockaddr_in*>(&s.addr);
+            inet_ntop(AF_INET, &sin->sin_addr, addr, sizeof(addr));
+            port = ntohs(sin->sin_port);
+        }
+        printf("  %s:%u  queries %llu, responses %llu, timeouts %llu, truncated %llu, errors %llu\n", addr, port,
+               (unsigned long long) s.queries, (unsigned long long) s.responses, (unsigned long long) s.timeouts,
+               (unsigned long long) s.truncated, (unsigned long long) s.errors);
+    }
+}
+
+void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [-d file] [-s server[:port]]... [-c clients] [-Q qps] [-l seconds] [-n queries]\n"
+            "       %*s [-t timeout] [-m send|query] [-u]\n"
+            "  -d  query file, one \"name [type]\" per line (default: standard input)\n"
+            "  -s  IPv4 name server to query, repeatable (default: system configuration)\n"
+            "  -c  concurrent clients, one thread each (default: 1)\n"
+            "  -Q  target rate over all clients, in queries per second (default: unlimited)\n"
+            "  -l  run time limit in seconds (default: 10)\n"
+            "  -n  query count limit (default: none)\n"
+            "  -t  per-query timeout in seconds; queries are not retried (default: 5)\n"
+            "  -m  send: res_nmkquery() + res_nsend() (default); query: res_nquery()\n"
+            "  -u  use TCP only (RES_USEVC)\n",
+            argv0, (int) strlen(argv0), "");
+}
+
+} // anonymous
 
 int main(int argc, char** argv) {
-    // res_query
-    // res_search
-    // res_mkquery
+    Options opts;
+    for(int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* val = i + 1 < argc ? argv[i + 1] : nullptr;
+        if(!strcmp(arg, "-u")) {
+            opts.use_tcp = true;
+            continue;
+        }
+        if(arg[0] != '-' || !arg[1] || arg[2] || !val) {
+            usage(argv[0]);
+            return 1;
+        }
+        ++i;
+        switch(arg[1]) {
+            case 'd': opts.file = val; break;
+            case 's': {
+                sockaddr_in sin;
+                if(!parse_server(val, sin)) {
+                    fprintf(stderr, "bad server address: %s\n", val);
+                    return 1;
+                }
+                opts.servers.push_back(sin);
+                break;
+            }
+            case 'c': opts.clients = std::max(atoi(val), 1); break;
+            case 'Q': opts.qps = atof(val); break;
+            case 'l': opts.seconds = atof(val); break;
+            case 'n': opts.limit = strtoull(val, nullptr, 10); break;
+            case 't': opts.timeout = std::max(atoi(val), 1); break;
+            case 'm':
+                if(!strcmp(val, "query")) {
+                    opts.use_nquery = true;
+                } else if(strcmp(val, "send")) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    std::vector<Query> queries;
+    if(!load_queries(opts.file, queries)) return 1;
+    if(queries.empty()) {
+        fprintf(stderr, "no queries to send\n");
+        return 1;
+    }
+
+    resolw_stats_reset();
+    Run run;
+    run.opts = &opts;
+    run.queries = &queries;
+    run.start = Clock::now();
+    run.end = run.start + std::chrono::nanoseconds(uint64_t(opts.seconds * 1e9));
+    std::vector<ClientResult> results(opts.clients);
+    std::vector<std::thread> threads;
+    for(int c = 0; c < opts.clients; ++c) {
+        threads.emplace_back(client, std::ref(run), std::ref(results[c]));
+    }
+    for(auto& t : threads) t.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - run.start).count();
 
+    ClientResult total;
+    for(const auto& r : results) {
+        total.latency.merge(r.latency);
+        total.sent += r.sent;
+        total.completed += r.completed;
+        total.timeouts += r.timeouts;
+        total.failed += r.failed;
+        for(int i = 0; i < 16; ++i) total.rcodes[i] += r.rcodes[i];
+    }
+    report(opts, total, elapsed);
     return 0;
 }
@@ -0,0 +1,316 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "resolv.h"
+#include "resolw/resolw_addr.h"
+#include "resolw/resolw_rdata.h"
+#include "idn.h"
+#include "msg.h"
+#include "net.h"
+#include "trc.h"
+
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+/**
+ * Dual-stack lookup: both queries are built by res_nmkquery() and sent
+ * together by nsend_parallel(), so the slower family costs at most the
+ * resolution delay. Ordering follows RFC 6724 section 6 as far as it can
+ * be told from user space: the source address for each destination is
+ * what the routing table picks for a connected UDP socket (no packet is
+ * sent), which also finds the destinations no source can reach (rule 1).
+ * Rules 3, 4 and 7 need interface state we do not have; `sort_list`
+ * takes the place of rule 7 for IPv4.
+ */
+
+namespace {
+
+using namespace resolw_impl;
+
+constexpr int kMaxCandidates = 64; // addresses considered, both families together
+
+/* The default policy table of RFC 6724 section 2.1. */
+struct Policy {
+    u_char prefix[16];
+    int bits, precedence, label;
+};
+
+const Policy kPolicies[] = {
+    {{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1}, 128, 50, 0}, // ::1/128
+    {{0}, 0, 40, 1}, // ::/0
+    {{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff}, 96, 35, 4}, // ::ffff:0:0/96
+    {{0x20, 0x02}, 16, 30, 2}, // 2002::/16
+    {{0x20, 0x01, 0, 0}, 32, 5, 5}, // 2001::/32
+    {{0xfc}, 7, 3, 13}, // fc00::/7
+    {{0}, 96, 1, 3}, // ::/96
+    {{0xfe, 0xc0}, 10, 1, 11}, // fec0::/10
+    {{0x3f, 0xfe}, 16, 1, 12}, // 3ffe::/16
+};
+
+/* Leading bits `a` and `b` have in common, up to `limit`. */
+int common_bits(const u_char* a, const u_char* b, int limit) {
+    int bits = 0;
+    for(int i = 0; i < 16 && bits < limit; ++i) {
+        u_char diff = a[i] ^ b[i];
+        if(diff) return std::min(bits + __builtin_clz(diff) - 24, limit);
+        bits += 8;
+    }
+    return std::min(bits, limit);
+}
+
+const Policy& policy_of(const u_char* addr) {
+    const Policy* best = &kPolicies[1]; // ::/0 matches everything
+    for(const Policy& p : kPolicies) {
+        if(p.bits > best->bits && common_bits(addr, p.prefix, p.bits) == p.bits) best = &p;
+    }
+    return *best;
+}
+
+inline bool is_v4mapped(const u_char* a) {
+    static const u_char kMapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+    return !memcmp(a, kMapped, 12);
+}
+
+/* RFC 6724 section 3.1 scopes: 2 link-local, 5 site-local, 14 global; multicast carries its own. */
+int scope_of(const u_char* a) {
+    if(is_v4mapped(a)) {
+        return a[12] == 127 || (a[12] == 169 && a[13] == 254) ? 2 : 14;
+    }
+    if(a[0] == 0xff) return a[1] & 0x0f;
+    if(a[0] == 0xfe && (a[1] & 0xc0) == 0x80) return 2;
+    if(a[0] == 0xfe && (a[1] & 0xc0) == 0xc0) return 5;
+    static const u_char kLoopback[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1};
+    return memcmp(a, kLoopback, 16) ? 14 : 2;
+}
+
+struct Candidate {
+    resolw_addr addr;
+    u_char dst[16], src[16]; // IPv4 as IPv4-mapped
+    bool reachable;
+    int scope, precedence, label;
+    int src_scope, src_label;
+    int sort_rank; // index of the first matching `sort_list` entry (IPv4 only)
+};
+
+/* The source address the stack would use for `c`, via a connected UDP socket of the family. */
+bool find_source(sock_t socks[2], Candidate& c) {
+    const bool v6 = c.addr.family == AF_INET6;
+    sock_t& fd = socks[v6];
+    if(fd == kBadSock) {
+        fd = socket(c.addr.family, SOCK_DGRAM, IPPROTO_UDP);
+        if(fd == kBadSock) return false;
+    }
+    sockaddr_storage ss;
+    memset(&ss, 0, sizeof(ss));
+    if(v6) {
+        sockaddr_in6* sin6 = reinterpret_cast<sockaddr_in6*>(&ss);
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = htons(NAMESERVER_PORT); // any port; connect() only routes
+        sin6->sin6_addr = c.addr.addr.in6;
+    } else {
+        sockaddr_in* sin = reinterpret_cast<sockaddr_in*>(&ss);
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(NAMESERVER_PORT);
+        sin->sin_addr = c.addr.addr.in;
+    }
+    const sockaddr* sa = reinterpret_cast<const sockaddr*>(&ss);
+    if(connect(fd, sa, sockaddr_len(sa))) return false;
+    socklen_t len = sizeof(ss);
+    if(getsockname(fd, reinterpret_cast<sockaddr*>(&ss), &len)) return false;
+    if(v6) {
+        memcpy(c.src, &reinterpret_cast<sockaddr_in6*>(&ss)->sin6_addr, 16);
+    } else {
+        memset(c.src, 0, 10);
+        c.src[10] = c.src[11] = 0xff;
+        memcpy(c.src + 12, &reinterpret_cast<sockaddr_in*>(&ss)->sin_addr, 4);
+    }
+    return true;
+}
+
+int sort_rank(res_state rs, const Candidate& c) {
+    if(c.addr.family != AF_INET) return 0;
+    const unsigned nsort = std::min<unsigned>(rs->nsort, MAXRESOLVSORT);
+    for(unsigned i = 0; i < nsort; ++i) {
+        const uint32_t mask = rs->sort_list[i].mask;
+        if(((c.addr.addr.in.s_addr ^ rs->sort_list[i].addr.s_addr) & mask) == 0) return i;
+    }
+    return nsort;
+}
+
+/* RFC 6724 section 6: true if `a` goes before `b`. */
+bool prefer(const Candidate& a, const Candidate& b) {
+    if(a.reachable != b.reachable) return a.reachable; // rule 1
+    const bool sourced = a.reachable && b.reachable;
+    if(sourced) {
+        bool am = a.scope == a.src_scope, bm = b.scope == b.src_scope; // rule 2
+        if(am != bm) return am;
+        am = a.label == a.src_label; // rule 5
+        bm = b.label == b.src_label;
+        if(am != bm) return am;
+    }
+    if(a.precedence != b.precedence) return a.precedence > b.precedence; // rule 6
+    if(a.addr.family == AF_INET && b.addr.family == AF_INET && a.sort_rank != b.sort_rank) {
+        return a.sort_rank < b.sort_rank; // `sort_list`, in place of rule 7
+    }
+    if(a.scope != b.scope) return a.scope < b.scope; // rule 8
+    if(sourced && a.addr.family == b.addr.family) { // rule 9
+        const int limit = a.addr.family == AF_INET6 ? 64 : 128; // IPv6: up to the usual subnet prefix
+        int ap = common_bits(a.dst, a.src, limit), bp = common_bits(b.dst, b.src, limit);
+        if(ap != bp) return ap > bp;
+    }
+    return false; // rule 10: as received, IPv6 first
+}
+
+/* Collects the `type` records of an answer, following the CNAME chain the server already followed. */
+void collect(const Exchange& ex, int type, Candidate* cands, int& ncands) {
+    if(ex.n < kHdrSize) return;
+    resolw_msg_iter it;
+    resolw_rr rr;
+    if(resolw_msg_iter_init(&it, ex.answer, ex.n) < 0) return;
+    const uint16_t want = type == T_AAAA ? 16 : 4;
+    while(ncands < kMaxCandidates && resolw_msg_iter_next(&it, &rr) > 0) {
+        if(rr.section != 1 || rr.rdclass != C_IN || rr.type != type || rr.rdata.len != want) continue;
+        Candidate& c = cands[ncands++];
+        memset(&c, 0, sizeof(c));
+        c.addr.ttl = rr.ttl;
+        if(type == T_AAAA) {
+            c.addr.family = AF_INET6;
+            memcpy(&c.addr.addr.in6, rr.rdata.data, 16);
+            memcpy(c.dst, rr.rdata.data, 16);
+        } else {
+            c.addr.family = AF_INET;
+            memcpy(&c.addr.addr.in, rr.rdata.data, 4);
+            c.dst[10] = c.dst[11] = 0xff;
+            memcpy(c.dst + 12, rr.rdata.data, 4);
+        }
+    }
+}
+
+/* h_errno for an exchange that produced no addresses. */
+int no_address_h_errno(const Exchange& ex) {
+    if(ex.n < kHdrSize) return TRY_AGAIN;
+    switch(rd16(ex.answer + kHdrFlags) & kRcodeMask) {
+        case kRcodeNoError: return NO_DATA;
+        case kRcodeNxDomain: return HOST_NOT_FOUND;
+        case kRcodeServFail: return TRY_AGAIN;
+        default: return NO_RECOVERY;
+    }
+}
+
+/* The answer buffers, one per family; like getrrsetbyname(), this API has no caller-supplied one. */
+u_char* scratch_answers() {
+    static thread_local std::vector<u_char> buf;
+    if(buf.empty()) buf.resize(2 * kMaxAnswer);
+    return buf.data();
+}
+
+} // anonymous
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int resolw_addr_resolve(res_state statp, const char *name, int family, struct resolw_addr *addrs, int max)
+{
+    if(!statp || !name || !*name || (max > 0 && !addrs) || max < 0
+            || (family != AF_INET && family != AF_INET6 && family != AF_UNSPEC)) {
+        set_last_error(EINVAL);
+        set_h_errno(NETDB_INTERNAL);
+        return -1;
+    }
+    if(!(statp->options & RES_INIT)) { res_ninit(statp); } // see comment to RES_INIT
+    char ace[MAXDNAME + 1];
+    if(!(name = name_to_ascii(name, ace, sizeof(ace)))) {
+        set_h_errno(NETDB_INTERNAL);
+        return -1;
+    }
+    const bool mapped = statp->options & RES_USE_INET6;
+    int types[2], ntypes = 0;
+    if(family != AF_INET) types[ntypes++] = T_AAAA; // the preferred family goes first
+    if(family != AF_INET6 || mapped) types[ntypes++] = T_A;
+
+    TraceScope trace(name, types[0], statp->id);
+    u_char queries[2][kPacketSz];
+    u_char* const answers = scratch_answers();
+    Exchange ex[2];
+    for(int i = 0; i < ntypes; ++i) {
+        int qlen = res_nmkquery(statp, kOpQuery, name, C_IN, types[i], nullptr, 0, nullptr, queries[i], kPacketSz);
+        if(qlen < 0) {
+            set_h_errno(NO_RECOVERY);
+            trace.complete(-1, -1);
+            return -1;
+        }
+        ex[i] = Exchange{queries[i], qlen, answers + i * kMaxAnswer, kMaxAnswer, -1};
+    }
+    nsend_parallel(statp, ex, ntypes, RESOLW_RESOLUTION_DELAY_MS * 1000000ull, trace);
+
+    Candidate cands[kMaxCandidates];
+    int ncands = 0;
+    for(int i = 0; i < ntypes; ++i) collect(ex[i], types[i], cands, ncands);
+    const int rcode = ex[0].n >= kHdrSize ? rd16(ex[0].answer + kHdrFlags) & kRcodeMask : -1;
+    if(!ncands) {
+        int herr = NO_RECOVERY, rank = 0;
+        for(int i = 0; i < ntypes; ++i) {
+            // the most telling verdict wins: no such name, then no such data, then "try again"
+            int h = no_address_h_errno(ex[i]);
+            int r = h == HOST_NOT_FOUND ? 4 : h == NO_DATA ? 3 : h == TRY_AGAIN ? 2 : 1;
+            if(r > rank) {
+                herr = h;
+                rank = r;
+            }
+        }
+        set_h_errno(herr);
+        trace.complete(-1, rcode);
+        return -1;
+    }
+
+    net_startup();
+    sock_t socks[2] = {kBadSock, kBadSock};
+    for(int i = 0; i < ncands; ++i) {
+        Candidate& c = cands[i];
+        c.reachable = find_source(socks, c);
+        const Policy& dp = policy_of(c.dst);
+        c.scope = scope_of(c.dst);
+        c.precedence = dp.precedence;
+        c.label = dp.label;
+        if(c.reachable) {
+            c.src_scope = scope_of(c.src);
+            c.src_label = policy_of(c.src).label;
+        }
+        c.sort_rank = sort_rank(statp, c);
+    }
+    for(sock_t fd : socks) {
+        if(fd != kBadSock) sock_close(fd);
+    }
+    std::stable_sort(cands, cands + ncands, prefer);
+
+    const int count = std::min(ncands, max);
+    for(int i = 0; i < count; ++i) {
+        addrs[i] = cands[i].addr;
+        if(mapped && addrs[i].family == AF_INET) {
+            addrs[i].family = AF_INET6;
+            memcpy(&addrs[i].addr.in6, cands[i].dst, 16);
+        }
+    }
+    trace.complete(count, rcode);
+    return count;
+}
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
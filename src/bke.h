@@ -0,0 +1,54 @@
+#ifndef _SRC_BKE_H_
+#define _SRC_BKE_H_
+
+#include "resolv.h"
+#include <netdb.h>
+
+/**
+ * The resolver engine behind the public query API. res.cpp implements the
+ * API (state, search, wrappers) once; a backend supplies the three calls
+ * below. Two backends exist, chosen with -DRESOLW_BACKEND at configure time:
+ * `windns` (dns.cpp, ndb.cpp) hands queries to the system resolver, while
+ * `native` (cnf.cpp, nat.cpp) builds, sends and parses them itself. Both
+ * share res_nmkquery() (msg.cpp) and res_nsend() (snd.cpp).
+ */
+
+namespace resolw_impl {
+
+/* Fills `rs` from the system configuration; what res_ninit() does. */
+int backend_init(res_state rs);
+
+/**
+ * Looks up `dname` as given, with res_nquery() semantics: the answer
+ * length, or -1 with h_errno set. `rs` is initialized.
+ */
+int backend_query(res_state rs, const char* dname, int rq_class, int type, u_char* answer, int anslen);
+
+/**
+ * getrrsetbyname() for validated arguments. The result is laid out for
+ * freerrset(): the rrsetinfo with `rri_name` appended, and one block each
+ * for the rdatainfo array of `rri_rdatas` and `rri_sigs` followed by
+ * their data.
+ */
+int backend_rrset(res_state rs, const char* hostname, unsigned int rdclass, unsigned int rdtype,
+                  struct rrsetinfo** res);
+
+/**
+ * The answer behind this thread's last backend_rrset(), authority section
+ * and all, if it was ERRSET_NONAME or ERRSET_NODATA: its length, or 0 if
+ * it was not or the backend keeps no answers (windns). The validator
+ * checks its denial of existence (neg.cpp).
+ */
+int backend_negative(const u_char** msg);
+
+/**
+ * The answer behind this thread's last backend_rrset(), if it was
+ * ERRSET_SUCCESS: its length, or 0 if it was not or the backend keeps no
+ * answers (windns). Good only until the next backend call; the validator
+ * looks for the proof a wildcard expansion needs in its authority section.
+ */
+int backend_answer(const u_char** msg);
+
+} // resolw_impl
+
+#endif /* _SRC_BKE_H_ */
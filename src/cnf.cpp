@@ -0,0 +1,184 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "bke.h"
+#include "net.h"
+
+#ifdef _WIN32
+#include <iphlpapi.h> // GetNetworkParams
+#endif
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+/**
+ * `res_ninit()` of the native backend. On Windows, the name servers and the
+ * primary domain come from GetNetworkParams(). Elsewhere, the state is read
+ * from resolv.conf(5). Understood are `nameserver` (IPv4 only, as `nsaddr_list`
+ * holds `sockaddr_in`), `domain`, `search`, `sortlist` and the `ndots:`,
+ * `timeout:`, `attempts:`, `rotate` and `inet6` options; everything else
+ * is ignored, as are malformed lines. LOCALDOMAIN overrides the search list, as in BIND.
+ */
+
+namespace {
+
+constexpr int kRetranSec = 5; // retransmission time; same as on Windows
+constexpr int kRetryCount = 3; // retry count; same as on Windows
+#ifndef _WIN32
+constexpr const char* kConfPath = "/etc/resolv.conf";
+#endif
+
+void add_server(res_state rs, const char* addr) {
+    sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    if(rs->nscount < MAXNS && inet_pton(AF_INET, addr, &sin.sin_addr) == 1) {
+        sin.sin_family = AF_INET;
+        sin.sin_port = htons(NAMESERVER_PORT);
+        rs->nsaddr_list[rs->nscount++] = sin;
+    }
+}
+
+/* Packs `list` (whitespace separated) into defdname, NUL-separated, and points dnsrch into it. */
+void set_search(res_state rs, const char* list) {
+    char* out = rs->defdname;
+    char* const end = rs->defdname + sizeof(rs->defdname);
+    int n = 0;
+    memset(rs->dnsrch, 0, sizeof(rs->dnsrch));
+    while(*list && n < MAXDNSRCH) {
+        list += strspn(list, " \t\r\n");
+        size_t len = strcspn(list, " \t\r\n");
+        if(!len) break;
+        if(out + len + 1 > end) break;
+        memcpy(out, list, len);
+        out[len] = '\0';
+        rs->dnsrch[n++] = out;
+        out += len + 1;
+        list += len;
+    }
+    if(!n) rs->defdname[0] = '\0';
+}
+
+#ifndef _WIN32
+void set_options(res_state rs, const char* opts) {
+    while(*opts) {
+        opts += strspn(opts, " \t\r\n");
+        size_t len = strcspn(opts, " \t\r\n");
+        if(!len) break;
+        if(!strncmp(opts, "ndots:", 6)) {
+            rs->ndots = std::min(atoi(opts + 6), 15); // a 4-bit field
+        } else if(!strncmp(opts, "timeout:", 8)) {
+            rs->retrans = std::max(atoi(opts + 8), 1);
+        } else if(!strncmp(opts, "attempts:", 9)) {
+            rs->retry = std::max(atoi(opts + 9), 1);
+        } else if(len == 6 && !strncmp(opts, "rotate", 6)) {
+            rs->options |= RES_ROTATE;
+        } else if(len == 5 && !strncmp(opts, "inet6", 5)) {
+            rs->options |= RES_USE_INET6;
+        }
+        opts += len;
+    }
+}
+
+/* `address[/netmask]` pairs; without a netmask, the natural one of the address's class, as in BIND. */
+void set_sortlist(res_state rs, const char* list) {
+    unsigned n = 0;
+    while(*list && n < MAXRESOLVSORT) {
+        list += strspn(list, " \t\r\n");
+        size_t len = strcspn(list, " \t\r\n");
+        if(!len) break;
+        char item[64];
+        if(len < sizeof(item)) {
+            memcpy(item, list, len);
+            item[len] = '\0';
+            char* slash = strchr(item, '/');
+            if(slash) *slash++ = '\0';
+            in_addr addr, mask;
+            if(inet_pton(AF_INET, item, &addr) == 1) {
+                if(!slash || inet_pton(AF_INET, slash, &mask) != 1) {
+                    uint32_t a = ntohl(addr.s_addr);
+                    mask.s_addr = htonl(!(a & 0x80000000u) ? 0xff000000u : !(a & 0x40000000u) ? 0xffff0000u : 0xffffff00u);
+                }
+                rs->sort_list[n].addr = addr;
+                rs->sort_list[n].mask = mask.s_addr;
+                ++n;
+            }
+        }
+        list += len;
+    }
+    rs->nsort = n;
+}
+#endif
+
+} // anonymous
+
+namespace resolw_impl {
+
+int backend_init(res_state rs) {
+    memset(rs, 0, sizeof(_res_state));
+    rs->options = RES_INIT | RES_DEFAULT;
+    rs->retry = kRetryCount;
+    rs->retrans = kRetranSec;
+    rs->id = res_randomid();
+    rs->ndots = 1; // one dot qualifies for a suffixless query
+
+#ifdef _WIN32
+    ULONG len = 0;
+    if(GetNetworkParams(nullptr, &len) == ERROR_BUFFER_OVERFLOW) {
+        std::vector<char> buf(len);
+        FIXED_INFO* info = reinterpret_cast<FIXED_INFO*>(buf.data());
+        if(GetNetworkParams(info, &len) == NO_ERROR) {
+            for(const IP_ADDR_STRING* ip = &info->DnsServerList; ip; ip = ip->Next) {
+                add_server(rs, ip->IpAddress.String);
+            }
+            set_search(rs, info->DomainName);
+        }
+    }
+#else
+    if(FILE* conf = fopen(kConfPath, "r")) {
+        char line[1024];
+        while(fgets(line, sizeof(line), conf)) {
+            char* value = line + strcspn(line, " \t");
+            const size_t keylen = value - line;
+            value += strspn(value, " \t");
+            value[strcspn(value, "#;\r\n")] = '\0';
+            if(keylen == 10 && !strncmp(line, "nameserver", 10)) {
+                value[strcspn(value, " \t")] = '\0';
+                add_server(rs, value);
+            } else if((keylen == 6 && !strncmp(line, "domain", 6)) || (keylen == 6 && !strncmp(line, "search", 6))) {
+                set_search(rs, value); // the last of the two wins, as in BIND
+            } else if(keylen == 7 && !strncmp(line, "options", 7)) {
+                set_options(rs, value);
+            } else if(keylen == 8 && !strncmp(line, "sortlist", 8)) {
+                set_sortlist(rs, value);
+            }
+        }
+        fclose(conf);
+    }
+#endif
+    if(const char* local = getenv("LOCALDOMAIN")) {
+        set_search(rs, local);
+    }
+    if(!rs->nscount) {
+        // resolv.conf(5): "If no nameserver entries are present, the default is to use the local name server"
+        sockaddr_in& sin = rs->nsaddr_list[rs->nscount++];
+        sin.sin_family = AF_INET;
+        sin.sin_port = htons(NAMESERVER_PORT);
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    }
+    return 0;
+}
+
+} // resolw_impl
@@ -17,36 +17,50 @@
 #include <windns.h>
 #include <iphlpapi.h> // adapter list
 #include <algorithm> // std::min
-#include <string>
+#include <cstring>
 
+#include "bke.h"
 #include "dns.h"
+#include "idn.h"
+#include "msg.h" // wire format helpers
+#include "net.h" // monotonic_ns
 
 namespace resolw_impl {
 
-void set_last_error(int last_error) {
-#ifdef ERRNO_IS_LVALUE
-    errno = last_error; // POSIX way
-#else
-    _set_errno(last_error); // cannonical native Windows way
-#endif
-}
-
 constexpr unsigned int RESOLW_UTF8 = 65001; // CP_UTF8 per <winnls.h>
 
 // ROADMAP reuse
-std::wstring to_win_str(const char* posix_str, std::size_t in_len, bool einval_if_empty) {
-    if(!in_len) {
+std::size_t to_win_str(const char* posix_str, std::size_t in_len, wchar_t* out, std::size_t out_len, bool einval_if_empty) {
+    if(!in_len || !out_len) {
         if(einval_if_empty) {
             set_last_error(EINVAL);
         }
-        return {};
+        if(out_len) {
+            *out = L'\0';
+        }
+        return 0;
+    }
+    if(name_is_ascii(posix_str, in_len)) {
+        // the common case: widen byte by byte
+        if(in_len >= out_len) {
+            set_last_error(EINVAL);
+            *out = L'\0';
+            return 0;
+        }
+        for(std::size_t i = 0; i < in_len; ++i) {
+            out[i] = static_cast<unsigned char>(posix_str[i]);
+        }
+        out[in_len] = L'\0';
+        return in_len;
     }
-    std::wstring w_str(in_len, L'\0'); // a conservative estimate
-    w_str.resize(MultiByteToWideChar(RESOLW_UTF8, 0 /* flags */, posix_str, in_len, &w_str[0], in_len));
-    if(w_str.empty()) {
+    // a UTF-8 string never has more UTF-16 units than bytes, but `out` may still be short
+    int len = MultiByteToWideChar(RESOLW_UTF8, 0 /* flags */, posix_str, in_len, out, out_len - 1);
+    if(len <= 0) {
         set_last_error(EINVAL);
+        len = 0;
     }
-    return w_str;
+    out[len] = L'\0';
+    return len;
 }
 
 ULONG to_query_opts(u_long rs_options, ImplPolicies * pol_out) {
@@ -79,6 +93,26 @@ ULONG to_query_opts(u_long rs_options, ImplPolicies * pol_out) {
     return qo;
 }
 
+int stats_win_status(DNS_STATUS status, uint64_t started_ns) {
+    // WinDNS does not say which server answered; all of it goes to the AF_UNSPEC slot
+    StatsServer* stats = stats_server(nullptr);
+    stats_query(stats);
+    if(ERROR_TIMEOUT == status) {
+        stats_timeout(stats);
+        return -1;
+    }
+    int rcode = 0;
+    if(status >= DNS_ERROR_RCODE_FORMAT_ERROR && status <= DNS_ERROR_RCODE_LAST) {
+        rcode = status - DNS_ERROR_RESPONSE_CODES_BASE;
+    } else if(status && DNS_INFO_NO_RECORDS != status) {
+        stats_error(stats);
+        return -1;
+    }
+    stats_response(stats, monotonic_ns() - started_ns, false);
+    stats_rcode(rcode);
+    return rcode;
+}
+
 // ROADMAP return basic diagnostics
 void resolw_nprep(res_state rs, const wchar_t* hostname, unsigned int rdclass, unsigned int rdtype, ULONG qo,
         DNS_ADDR_ARRAY* nsaddrs, DNS_QUERY_REQUEST* req) {
@@ -110,32 +144,140 @@ void resolw_nprep(res_state rs, const wchar_t* hostname, unsigned int rdclass, u
     req->InterfaceIndex = 0; // all interfaces
 }
 
+int write_rdata(const DNS_RECORD* rec, u_char* cp, u_char* eom) {
+    u_char* const start = cp;
+    auto put_name = [&](const char* name) {
+        int len = msg_pack_name(name, cp, eom - cp);
+        if(len >= 0) cp += len;
+        return len >= 0;
+    };
+    auto room = [&](int need) { return eom - cp >= need; };
+    switch(rec->wType) {
+        case T_A:
+            if(!room(4)) return -1;
+            memcpy(cp, &rec->Data.A.IpAddress, 4); // network order
+            cp += 4;
+            break;
+        case T_AAAA:
+            if(!room(16)) return -1;
+            memcpy(cp, rec->Data.AAAA.Ip6Address.IP6Byte, 16);
+            cp += 16;
+            break;
+        case T_NS: case T_CNAME: case T_PTR:
+            if(!put_name(rec->Data.PTR.pNameHost)) return -1;
+            break;
+        case T_MX:
+            if(!room(2)) return -1;
+            wr16(cp, rec->Data.MX.wPreference);
+            cp += 2;
+            if(!put_name(rec->Data.MX.pNameExchange)) return -1;
+            break;
+        case T_SRV:
+            if(!room(6)) return -1;
+            wr16(cp, rec->Data.SRV.wPriority);
+            wr16(cp + 2, rec->Data.SRV.wWeight);
+            wr16(cp + 4, rec->Data.SRV.wPort);
+            cp += 6;
+            if(!put_name(rec->Data.SRV.pNameTarget)) return -1;
+            break;
+        case T_SOA:
+            if(!put_name(rec->Data.SOA.pNamePrimaryServer) || !put_name(rec->Data.SOA.pNameAdministrator)) return -1;
+            if(!room(20)) return -1;
+            wr32(cp, rec->Data.SOA.dwSerialNo);
+            wr32(cp + 4, rec->Data.SOA.dwRefresh);
+            wr32(cp + 8, rec->Data.SOA.dwRetry);
+            wr32(cp + 12, rec->Data.SOA.dwExpire);
+            wr32(cp + 16, rec->Data.SOA.dwDefaultTtl);
+            cp += 20;
+            break;
+        case T_TXT:
+            for(DWORD i = 0; i < rec->Data.TXT.dwStringCount; ++i) {
+                size_t len = strlen(rec->Data.TXT.pStringArray[i]);
+                if(len > 255) return kRdataUnsupported;
+                if(!room(len + 1)) return -1;
+                *cp++ = len;
+                memcpy(cp, rec->Data.TXT.pStringArray[i], len);
+                cp += len;
+            }
+            break;
+        case T_RRSIG: {
+            const DNS_SIG_DATAA& sig = rec->Data.SIG;
+            if(!room(18)) return -1;
+            wr16(cp, sig.wTypeCovered);
+            cp[2] = sig.chAlgorithm;
+            cp[3] = sig.chLabelCount;
+            wr32(cp + 4, sig.dwOriginalTtl);
+            wr32(cp + 8, sig.dwExpiration);
+            wr32(cp + 12, sig.dwTimeSigned);
+            wr16(cp + 16, sig.wKeyTag);
+            cp += 18;
+            if(!put_name(sig.pNameSigner) || !room(sig.wSignatureLength)) return -1;
+            memcpy(cp, sig.Signature, sig.wSignatureLength);
+            cp += sig.wSignatureLength;
+            break;
+        }
+        case T_KEY: case T_DNSKEY: {
+            const DNS_KEY_DATA& key = rec->Data.KEY;
+            if(!room(4 + key.wKeyLength)) return -1;
+            wr16(cp, key.wFlags);
+            cp[2] = key.chProtocol;
+            cp[3] = key.chAlgorithm;
+            memcpy(cp + 4, key.Key, key.wKeyLength);
+            cp += 4 + key.wKeyLength;
+            break;
+        }
+        default: {
+            // types WinDNS has no structure for come as they were on the wire
+            const DNS_UNKNOWN_DATA& raw = rec->Data.UNKNOWN;
+            if(raw.dwByteCount > 0xffff) return kRdataUnsupported;
+            if(!room(raw.dwByteCount)) return -1;
+            memcpy(cp, raw.bData, raw.dwByteCount);
+            cp += raw.dwByteCount;
+            break;
+        }
+    }
+    return cp - start;
+}
+
 } // resolw_impl
 
 namespace {
 
 using namespace resolw_impl;
 
-constexpr int kErrNotImp = -1;
-
 constexpr int kRetranSec = 5; // retransmission time
 constexpr int kRetryCount = 3; // retry count
 
-struct ResState : public _res_state {
-    ResState() { res_ninit(this); }
-};
+/* What res_nquery() callers expect to find in h_errno after a failed WinDNS call. */
+int to_h_errno(DNS_STATUS status) {
+    switch(status) {
+        case DNS_ERROR_RCODE_NAME_ERROR: return HOST_NOT_FOUND;
+        case DNS_INFO_NO_RECORDS: return NO_DATA;
+        case DNS_ERROR_RCODE_SERVER_FAILURE:
+        case ERROR_TIMEOUT: return TRY_AGAIN;
+        default: return NO_RECOVERY;
+    }
+}
 
-static thread_local ResState _resolw_state;
+/**
+ * Writes `rec` back in wire format (uncompressed) at `cp`. Returns the
+ * bytes written, 0 for a type we cannot re-serialize, -1 if out of room.
+ */
+int write_record(const DNS_RECORD* rec, int rq_class, u_char* cp, u_char* eom) {
+    int n = msg_pack_name(rec->pName, cp, eom - cp);
+    if(n < 0 || eom - cp - n < 10) return -1;
+    u_char* const hdr = cp + n;
+    int rdlen = write_rdata(rec, hdr + 10, eom);
+    if(rdlen < 0) return rdlen == kRdataUnsupported ? 0 : -1;
+    wr16(hdr, rec->wType);
+    wr16(hdr + 2, rq_class);
+    wr32(hdr + 4, rec->dwTtl);
+    wr16(hdr + 8, rdlen);
+    return n + 10 + rdlen;
+}
 
 } // anonymous
 
-/* __BEGIN_DECLS */
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-res_state _resolw_res_state() { return &_resolw_state; }
-
 // Correspondence:
 // rq_class is one of DNS_CLASS_*
 // type is one of DNS_TYPE_*
@@ -152,44 +294,12 @@ res_state _resolw_res_state() { return &_resolw_state; }
 // DnsSetApplicationSettings configures per-app settings (e.g. DNS_APP_SETTINGS_EXCLUSIVE_SERVERS)
 // res_mkquery is equivalent to DnsWriteQuestionToBuffer_UTF8
 
-int res_init(void)
-{
-    // special case -- implicit res_ninit called on first access to _res
-    return _res, 0;
-}
-
 // DnsQuery expects an FQDN
 // DNS_QUERY_STANDARD => use the resolver cache and repeat request
 
+namespace resolw_impl {
 
-int res_search(const char *dname, int rq_class, int type, u_char *answer, int anslen)
-{
-    return res_nsearch(_resolw_res_state(), dname, rq_class, type, answer, anslen);
-}
-
-int res_query(const char *dname, int rq_class, int type, u_char *answer, int anslen)
-{
-    return res_nquery(_resolw_res_state(), dname, rq_class, type, answer, anslen);
-}
-
-int res_mkquery(int op, const char *dname, int rq_class, int type, const u_char *data, 
-                int datalen, const u_char *newrr, u_char *buf, int buflen)
-{
-    return res_nmkquery(_resolw_res_state(), op, dname, rq_class, type, data, datalen, newrr, buf, buflen);
-}
-
-int res_send(const u_char *msg, int msglen, u_char *answer, int anslen)
-{
-    return res_nsend(_resolw_res_state(), msg, msglen, answer, anslen);
-}
-
-int res_querydomain(const char *name, const char *domain, int rq_class, int type, u_char *answer, int anslen)
-{
-    return res_nquerydomain(_resolw_res_state(), name, domain, rq_class, type, answer, anslen);
-}
-
-int res_ninit(res_state rs)
-{
+int backend_init(res_state rs) {
     memset(rs, 0, sizeof(_res_state));
     rs->options = RES_INIT | RES_DEFAULT;
     rs->retry = kRetryCount;
@@ -198,13 +308,13 @@ int res_ninit(res_state rs)
     // fill ns_count, ns_addr_list from DnsQueryConfig:
     IP4_ARRAY* buffer = nullptr;
     DWORD buf_len = sizeof(&buffer); // size of pointer
-    if(!DnsQueryConfig(DnsConfigDnsServerList, 0 /* DNS_CONFIG_FLAG_ALLOC */, nullptr, nullptr, &buffer, &buf_len) && buffer) {
+    if(!DnsQueryConfig(DnsConfigDnsServerList, DNS_CONFIG_FLAG_ALLOC, nullptr, nullptr, &buffer, &buf_len) && buffer) {
         rs->nscount = std::min((DWORD) MAXNS, buffer->AddrCount);
         for(int nsi = 0; nsi < rs->nscount; ++nsi) {
             sockaddr_in &sin = rs->nsaddr_list[nsi];
             sin.sin_family = AF_INET;
-            INLINE_HTONL(sin.sin_addr.S_un.S_addr, buffer->AddrArray[nsi]);
-            sin.sin_port = NAMESERVER_PORT;
+            sin.sin_addr.s_addr = buffer->AddrArray[nsi]; // IP4_ADDRESS is in network order already
+            sin.sin_port = htons(NAMESERVER_PORT);
         }
         LocalFree(buffer);
     }
@@ -218,15 +328,7 @@ int res_ninit(res_state rs)
     return 0;
 }
 
-int res_nsearch(res_state rs, const char *dname, int rq_class, int type, u_char *answer, int anslen)
-{
-    set_last_error(0); // errno, not h_errno
-    // TODO
-    return kErrNotImp;
-}
-
-int res_nquery(res_state rs, const char *dname, int rq_class, int type, u_char *answer, int anslen)
-{
+int backend_query(res_state rs, const char* dname, int rq_class, int type, u_char* answer, int anslen) {
     // We decide here whether https://learn.microsoft.com/en-us/windows/win32/api/windns/nf-windns-dnsquery_utf8
     // is good enough or we need DnsQueryEx (+DNS_QUERY_REQUEST3 rather than DNS_QUERY_REQUEST) for extra tuning.
     // Note, however, that DNS_QUERY_REQUEST3 is only available since Windows build 22000 (Win11; extremely new).
@@ -234,76 +336,62 @@ int res_nquery(res_state rs, const char *dname, int rq_class, int type, u_char *
 
     // Note: https://learn.microsoft.com/en-us/windows/win32/api/windns/nf-windns-dnssetapplicationsettings is stateful.
 
-    if(!(rs->options & RES_INIT)) { res_ninit(rs); } // see comment to RES_INIT
     // TODO check for Windows version (mappers pre-Win8; since Win8 all or nearly all documented flags are supported)
     ImplPolicies pol;
     ULONG qo = to_query_opts(rs->options, &pol);
     rs->id = res_randomid();
+    TraceScope trace(dname, type, rs->id);
 
     // MOREINFO the documentation is not definitive regarding the use of search lists. Does DnsQuery_*() append the suffix?
     // simple path. valid if: (!need_custom_servers && (rq_class==C_IN))
-    PDNS_RECORD record;
+    PDNS_RECORD record = nullptr;
+    trace.event(RESOLW_TRACE_SERVER_SEND, nullptr, 0, -1, rs->id);
+    uint64_t started = monotonic_ns();
     auto result = DnsQuery_UTF8(dname, type, qo, nullptr, &record, nullptr);
-    if(DNS_ERROR_RCODE_NO_ERROR == result) {
-        // success; now, unfortunately, re-serialize the response.
-        // first, write the original query into the output buffer:
-        // res_nmkquery(rs, QUERY, dname, rq_class, type, )
-        DWORD buf_sz = anslen;
-        DNS_MESSAGE_BUFFER * mb = reinterpret_cast<DNS_MESSAGE_BUFFER*>(answer);
-        if(DnsWriteQuestionToBuffer_UTF8(mb, &buf_sz, const_cast<char*>(dname), type, rs->id, pol.recurse)) {
-            // MOREINFO we assume numeric fields to be in host byte order. is that true???
-            // nevertheless, now append records; validate with DnsExtractRecordsFromMessage_UTF8
-            mb->MessageHead.IsResponse = true;
-            mb->MessageHead.ResponseCode = NOERROR;
-            // response record count:
-            mb->MessageHead.AnswerCount = 0; // if wType == type; as a special case,
-            // A counts for AAAA and vice versa if DNS_QUERY_DUAL_ADDR, but we don't support it
-            mb->MessageHead.NameServerCount = 0; // if DNS_SOA_DATA
-            mb->MessageHead.AdditionalCount = 0; // everything else
-            auto rcursor = record;
-            while(rcursor) {
-                // TODO
+    int rcode = stats_win_status(result, started);
+    if(rcode >= 0) {
+        trace.event(RESOLW_TRACE_RESPONSE, nullptr, 0, rcode, rs->id);
+    }
+    int len = -1;
+    DWORD buf_sz = anslen;
+    DNS_MESSAGE_BUFFER * mb = reinterpret_cast<DNS_MESSAGE_BUFFER*>(answer);
+    if(DNS_ERROR_RCODE_NO_ERROR == result
+            && DnsWriteQuestionToBuffer_UTF8(mb, &buf_sz, const_cast<char*>(dname), type, rs->id, pol.recurse)) {
+        // success; now, unfortunately, re-serialize the response after the question.
+        // WinDNS leaves the header in host byte order, so it is rewritten here byte by byte.
+        u_char* const eom = answer + anslen;
+        u_char* cp = answer + kHdrSize + msg_skip_name(answer + kHdrSize, eom) + 4;
+        unsigned flags = kFlagQR | (pol.recurse ? kFlagRD | kFlagRA : 0);
+        unsigned counts[4] = {1, 0, 0, 0}; // indexed by DNS_SECTION
+        // A counts for AAAA and vice versa if DNS_QUERY_DUAL_ADDR, but we don't support it
+        for(unsigned section = DnsSectionAnswer; section <= DnsSectionAddtional && !(flags & kFlagTC); ++section) {
+            for(auto rcursor = record; rcursor; rcursor = rcursor->pNext) {
+                if(rcursor->Flags.S.Section != section) continue;
+                int n = write_record(rcursor, rq_class, cp, eom);
+                if(n < 0) {
+                    flags |= kFlagTC; // as much as fits, like a truncated UDP answer
+                    break;
+                }
+                cp += n;
+                counts[section] += n > 0;
             }
-            // TODO
-            return kErrNotImp;
         }
+        wr16(answer + kHdrId, rs->id);
+        wr16(answer + kHdrFlags, flags);
+        wr16(answer + kHdrQdCount, counts[DnsSectionQuestion]);
+        wr16(answer + kHdrAnCount, counts[DnsSectionAnswer]);
+        wr16(answer + kHdrNsCount, counts[DnsSectionAuthority]);
+        wr16(answer + kHdrArCount, counts[DnsSectionAddtional]);
+        len = cp - answer;
     }
-    return -1;
-}
-
-int res_nquerydomain(res_state rs, const char *name, const char *rawdom, int rq_class, int type, u_char *answer, int anslen)
-{
-    // same as nquery, but concatenates name and domain
-    std::string domain;
-    std::string concat;
-    if(!rawdom || !*rawdom) {
-         rawdom = name;
-    } else if(name && *name) {
-        domain = rawdom;
-        concat = name;
-        if(concat.back() != '.' && domain.front() != '.') {
-            concat.push_back('.');
-        }
-        concat.append(domain);
-        rawdom = concat.c_str();
+    if(record) {
+        DnsRecordListFree(record, DnsFreeRecordList);
     }
-    return res_nquery(rs, rawdom, rq_class, type, answer, anslen);
-}
-
-int res_nmkquery(res_state rs, int op, const char *dname, int rq_class, int type, const u_char *data, 
-                int datalen, const u_char *newrr, u_char *buf, int buflen)
-{
-    // TODO
-    return kErrNotImp;
-}
-
-int res_nsend(res_state rs, const u_char *msg, int msglen, u_char *answer, int anslen)
-{
-    // TODO
-    return kErrNotImp;
+    if(len < 0) {
+        set_h_errno(to_h_errno(result));
+    }
+    trace.complete(len, rcode);
+    return len;
 }
 
-/* __END_DECLS */
-#ifdef __cplusplus
-}
-#endif
+} // resolw_impl
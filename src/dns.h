@@ -2,10 +2,12 @@
 #define _SRC_DNS_H_
 
 #include "resolv.h"
+#include "sts.h"
+#include "trc.h"
 #include <windows.h>
 #include <windns.h>
 #include <versionhelpers.h>
-#include <string>
+#include <cstddef>
 
 // the following definitions are sadly missing in MinGW;
 // we complement them according to WinDNS documentation.
@@ -81,7 +83,21 @@ struct ImplPolicies
 
 ULONG to_query_opts(u_long flags, ImplPolicies * pol);
 
-std::wstring to_win_str(const char* posix_str, std::size_t in_len, bool einval_if_empty = true);
+/* Converts UTF-8 into `out` (NUL-terminated, at most `out_len` units with the NUL); returns the length or 0. */
+std::size_t to_win_str(const char* posix_str, std::size_t in_len, wchar_t* out, std::size_t out_len,
+                       bool einval_if_empty = true);
+
+/* Accounts a completed WinDNS call against the system resolver's stats slot; returns the RCODE or -1. */
+int stats_win_status(DNS_STATUS status, uint64_t started_ns);
+
+enum { kRdataUnsupported = -2 };
+
+/**
+ * Writes the rdata of `rec` at `cp` in wire format, names uncompressed.
+ * Returns its length, -1 if it does not fit before `eom`, or
+ * kRdataUnsupported if `rec` cannot be expressed on the wire.
+ */
+int write_rdata(const DNS_RECORD* rec, u_char* cp, u_char* eom);
 
 void resolw_nprep(res_state rs, const wchar_t* hostname, unsigned int rdclass, unsigned int rdtype, ULONG qo,
     DNS_ADDR_ARRAY* nsaddrs, DNS_QUERY_REQUEST* req);
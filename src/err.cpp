@@ -4,19 +4,45 @@
 // https://learn.microsoft.com/en-us/windows/win32/winsock/windows-sockets-error-codes-2
 // https://learn.microsoft.com/en-us/windows/win32/winsock/error-codes-errno-h-errno-and-wsagetlasterror-2
 
+#include <errno.h>
+#ifndef _WIN32
+#include <netdb.h> // h_errno
+#endif
 #include <cstdio>
 #include <system_error>
 
+namespace resolw_impl {
+
+void set_last_error(int last_error) {
+#ifdef ERRNO_IS_LVALUE
+    errno = last_error; // POSIX way
+#else
+    _set_errno(last_error); // cannonical native Windows way
+#endif
+}
+
+void set_h_errno(int code) {
+#ifdef _WIN32
+    WSASetLastError(code); // h_errno expands to WSAGetLastError()
+#else
+    h_errno = code;
+#endif
+}
+
+} // resolw_impl
+
 /* __BEGIN_DECLS */
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#ifdef _WIN32
 void herror(const char *s) {
     int lastcode = h_errno;
     auto message = std::system_category().message(lastcode); // idiomatic
     std::fprintf(stderr, "%s: %s\n", s, message.c_str());
 }
+#endif
 
 /* __END_DECLS */
 #ifdef __cplusplus
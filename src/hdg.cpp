@@ -0,0 +1,180 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "net.h"
+
+#include <errno.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+/**
+ * Hedged queries. With `resolw_hedge_config(percentile, budget)`, a
+ * res_nsend() query that the first server has not answered within the
+ * given percentile of its recent UDP latencies goes to the next server
+ * as well, and the first answer wins (snd.cpp). The latencies are kept
+ * per server, process-wide, in a log-linear histogram that is halved
+ * every kDecayEvery samples so that it follows the server as it changes.
+ * Hedges are paid for from a token bucket that every eligible query
+ * tops up by `budget` thousandths of a hedge, so that hedging can never
+ * add more than that share of queries (plus a small burst) upstream.
+ */
+
+namespace resolw_impl {
+
+namespace {
+
+constexpr unsigned kMaxServers = 32;
+constexpr unsigned kSubBits = 2; // 4 buckets per octave: upper edges at most 25% above the samples
+constexpr unsigned kBuckets = 96; // up to 2^24 us
+constexpr unsigned kRecomputeEvery = 16;
+constexpr unsigned kDecayEvery = 256;
+constexpr unsigned kMinSamples = 32; // no hedging on a server until it has answered this often
+constexpr int64_t kHedgeCost = 1000;
+constexpr int64_t kBurst = 10 * kHedgeCost;
+
+struct Latency {
+    sockaddr_storage addr; // written before the entry is published
+    std::atomic<uint32_t> buckets[kBuckets];
+    std::atomic<uint32_t> samples; // ever
+    std::atomic<unsigned> percentile; // that `delay_ns` is for
+    std::atomic<uint64_t> delay_ns;
+};
+
+struct Hedging {
+    std::atomic<unsigned> percentile{0}; // 0 = off
+    std::atomic<unsigned> budget{50}; // thousandths of a hedge earned per query
+    std::atomic<int64_t> tokens{0}; // likewise
+    std::atomic<unsigned> count{0};
+    std::mutex add;
+    Latency servers[kMaxServers];
+};
+
+Hedging& hedging() {
+    static Hedging instance;
+    return instance;
+}
+
+unsigned bucket_of(uint64_t ns) {
+    const uint64_t us = ns / 1000;
+    if(us < (1u << kSubBits)) return (unsigned) us;
+    const unsigned octave = 63 - __builtin_clzll(us);
+    const unsigned b = (octave - kSubBits + 1) << kSubBits | (unsigned) (us >> (octave - kSubBits)) % (1u << kSubBits);
+    return b < kBuckets ? b : kBuckets - 1;
+}
+
+/* The least latency above everything in bucket `b`. */
+uint64_t bucket_limit_ns(unsigned b) {
+    if(b < (1u << kSubBits)) return (b + 1) * 1000ull;
+    const unsigned shift = (b >> kSubBits) - 1;
+    return ((uint64_t) (b % (1u << kSubBits) + (1u << kSubBits) + 1) << shift) * 1000;
+}
+
+Latency* find(const sockaddr* ns, bool add) {
+    Hedging& h = hedging();
+    const unsigned count = h.count.load(std::memory_order_acquire);
+    for(unsigned i = 0; i < count; ++i) {
+        if(sockaddr_same(reinterpret_cast<const sockaddr*>(&h.servers[i].addr), ns)) return &h.servers[i];
+    }
+    if(!add) return nullptr;
+    std::lock_guard<std::mutex> lock(h.add);
+    const unsigned now = h.count.load(std::memory_order_relaxed);
+    for(unsigned i = count; i < now; ++i) { // added while we looked
+        if(sockaddr_same(reinterpret_cast<const sockaddr*>(&h.servers[i].addr), ns)) return &h.servers[i];
+    }
+    if(now == kMaxServers) return nullptr;
+    memcpy(&h.servers[now].addr, ns, sockaddr_len(ns));
+    h.count.store(now + 1, std::memory_order_release);
+    return &h.servers[now];
+}
+
+void recompute(Latency& l, unsigned percentile) {
+    uint32_t counts[kBuckets];
+    uint64_t total = 0;
+    for(unsigned b = 0; b < kBuckets; ++b) total += counts[b] = l.buckets[b].load(std::memory_order_relaxed);
+    uint64_t seen = 0;
+    unsigned b = 0;
+    while(b + 1 < kBuckets && (seen += counts[b]) * 100 < total * percentile) ++b;
+    l.delay_ns.store(bucket_limit_ns(b), std::memory_order_relaxed);
+    l.percentile.store(percentile, std::memory_order_relaxed);
+}
+
+} // anonymous
+
+bool hedge_on() {
+    return hedging().percentile.load(std::memory_order_relaxed) != 0;
+}
+
+uint64_t hedge_delay_ns(const sockaddr* ns) {
+    const unsigned percentile = hedging().percentile.load(std::memory_order_relaxed);
+    Latency* l = percentile ? find(ns, false) : nullptr;
+    if(!l || l->samples.load(std::memory_order_relaxed) < kMinSamples) return 0;
+    if(l->percentile.load(std::memory_order_relaxed) != percentile) recompute(*l, percentile);
+    return l->delay_ns.load(std::memory_order_relaxed);
+}
+
+void hedge_sample(const sockaddr* ns, uint64_t elapsed_ns) {
+    const unsigned percentile = hedging().percentile.load(std::memory_order_relaxed);
+    Latency* l = percentile ? find(ns, true) : nullptr;
+    if(!l) return;
+    l->buckets[bucket_of(elapsed_ns)].fetch_add(1, std::memory_order_relaxed);
+    const uint32_t n = l->samples.fetch_add(1, std::memory_order_relaxed) + 1;
+    if(n % kDecayEvery == 0) {
+        for(auto& b : l->buckets) b.fetch_sub(b.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+    }
+    if(n % kRecomputeEvery == 0) recompute(*l, percentile);
+}
+
+void hedge_earn() {
+    std::atomic<int64_t>& tokens = hedging().tokens;
+    const int64_t earned = hedging().budget.load(std::memory_order_relaxed);
+    int64_t have = tokens.load(std::memory_order_relaxed);
+    while(have < kBurst && !tokens.compare_exchange_weak(have, std::min(have + earned, kBurst),
+                                                          std::memory_order_relaxed)) {
+    }
+}
+
+bool hedge_spend() {
+    std::atomic<int64_t>& tokens = hedging().tokens;
+    int64_t have = tokens.load(std::memory_order_relaxed);
+    while(have >= kHedgeCost) {
+        if(tokens.compare_exchange_weak(have, have - kHedgeCost, std::memory_order_relaxed)) return true;
+    }
+    return false;
+}
+
+} // resolw_impl
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int resolw_hedge_config(unsigned percentile, unsigned budget_permille) {
+    using namespace resolw_impl;
+    if((percentile && (percentile < 50 || percentile > 99)) || budget_permille > 1000) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    Hedging& h = hedging();
+    h.budget.store(budget_permille, std::memory_order_relaxed);
+    h.percentile.store(percentile, std::memory_order_relaxed);
+    return 0;
+}
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
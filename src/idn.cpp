@@ -0,0 +1,336 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "resolv.h"
+#include "resolw/resolw_idna.h"
+#include "idn.h"
+#include "net.h" // set_last_error
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+using namespace resolw_impl;
+
+constexpr int kMaxLabel = 63;
+constexpr uint32_t kInvalid = 0xffffffffu;
+
+/* Decodes one UTF-8 sequence at `*pp`, advancing it; kInvalid for malformed, overlong or surrogate input. */
+uint32_t next_cp(const u_char*& p, const u_char* end) {
+    u_char c = *p++;
+    if(c < 0x80) return c;
+    int more;
+    uint32_t cp, min;
+    if(c >= 0xc2 && c <= 0xdf) { more = 1; cp = c & 0x1f; min = 0x80; }
+    else if(c >= 0xe0 && c <= 0xef) { more = 2; cp = c & 0x0f; min = 0x800; }
+    else if(c >= 0xf0 && c <= 0xf4) { more = 3; cp = c & 0x07; min = 0x10000; }
+    else return kInvalid;
+    if(end - p < more) return kInvalid;
+    while(more--) {
+        if((*p & 0xc0) != 0x80) return kInvalid;
+        cp = (cp << 6) | (*p++ & 0x3f);
+    }
+    if(cp < min || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) return kInvalid;
+    return cp;
+}
+
+inline bool is_dot(uint32_t cp) {
+    return cp == '.' || cp == 0x3002 || cp == 0xff0e || cp == 0xff61;
+}
+
+/* The case mappings of RFC 5895 for the scripts most names use; disallowed() rejects the capitals of the rest. */
+uint32_t fold(uint32_t cp) {
+    if(cp >= 0xff01 && cp <= 0xff5e) cp -= 0xff01 - 0x21; // fullwidth ASCII
+    if(cp >= 'A' && cp <= 'Z') return cp + 0x20;
+    if(cp < 0xc0) return cp;
+    if(cp <= 0xde) return cp == 0xd7 ? cp : cp + 0x20;
+    if(cp < 0x100) return cp;
+    if(cp < 0x180) {
+        if(cp == 0x178) return 0xff;
+        if(cp == 0x17f) return 's';
+        bool odd_upper = (cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17e);
+        bool even_upper = (cp <= 0x12f) || (cp >= 0x132 && cp <= 0x137) || (cp >= 0x14a && cp <= 0x177);
+        if((odd_upper && (cp & 1)) || (even_upper && !(cp & 1))) return cp + 1;
+        return cp;
+    }
+    if(cp >= 0x386 && cp <= 0x3ab) {
+        if(cp == 0x386) return 0x3ac;
+        if(cp >= 0x388 && cp <= 0x38a) return cp + 0x25;
+        if(cp == 0x38c) return 0x3cc;
+        if(cp == 0x38e || cp == 0x38f) return cp + 0x3f;
+        if(cp >= 0x391 && cp != 0x3a2) return cp + 0x20;
+        return cp;
+    }
+    if(cp >= 0x400 && cp <= 0x40f) return cp + 0x50;
+    if(cp >= 0x410 && cp <= 0x42f) return cp + 0x20;
+    if(((cp >= 0x460 && cp <= 0x481) || (cp >= 0x48a && cp <= 0x4bf)) && !(cp & 1)) return cp + 1;
+    return cp;
+}
+
+/* A run of capitals: every code point from `first` to `last`, or every other one. */
+struct CapitalRun {
+    uint32_t first, last, step;
+};
+
+/* The uppercase and titlecase letters of Unicode 14 that fold() leaves as they are. */
+constexpr CapitalRun kUnfolded[] = {
+    {0x130, 0x130, 1}, {0x181, 0x182, 1}, {0x184, 0x186, 2}, {0x187, 0x189, 2}, {0x18a, 0x18b, 1},
+    {0x18e, 0x191, 1}, {0x193, 0x194, 1}, {0x196, 0x198, 1}, {0x19c, 0x19d, 1}, {0x19f, 0x1a0, 1},
+    {0x1a2, 0x1a6, 2}, {0x1a7, 0x1a9, 2}, {0x1ac, 0x1ae, 2}, {0x1af, 0x1b1, 2}, {0x1b2, 0x1b3, 1},
+    {0x1b5, 0x1b7, 2}, {0x1b8, 0x1b8, 1}, {0x1bc, 0x1bc, 1}, {0x1c4, 0x1c5, 1}, {0x1c7, 0x1c8, 1},
+    {0x1ca, 0x1cb, 1}, {0x1cd, 0x1db, 2}, {0x1de, 0x1ee, 2}, {0x1f1, 0x1f2, 1}, {0x1f4, 0x1f6, 2},
+    {0x1f7, 0x1f8, 1}, {0x1fa, 0x232, 2}, {0x23a, 0x23b, 1}, {0x23d, 0x23e, 1}, {0x241, 0x243, 2},
+    {0x244, 0x246, 1}, {0x248, 0x24e, 2}, {0x370, 0x372, 2}, {0x376, 0x376, 1}, {0x37f, 0x37f, 1},
+    {0x3cf, 0x3cf, 1}, {0x3d8, 0x3ee, 2}, {0x3f4, 0x3f4, 1}, {0x3f7, 0x3f9, 2}, {0x3fa, 0x3fa, 1},
+    {0x3fd, 0x3ff, 1}, {0x4c0, 0x4c1, 1}, {0x4c3, 0x4cd, 2}, {0x4d0, 0x52e, 2}, {0x531, 0x556, 1},
+    {0x10a0, 0x10c5, 1}, {0x10c7, 0x10c7, 1}, {0x10cd, 0x10cd, 1}, {0x13a0, 0x13f5, 1}, {0x1c90, 0x1cba, 1},
+    {0x1cbd, 0x1cbf, 1}, {0x1e00, 0x1e94, 2}, {0x1e9e, 0x1efe, 2}, {0x1f08, 0x1f0f, 1}, {0x1f18, 0x1f1d, 1},
+    {0x1f28, 0x1f2f, 1}, {0x1f38, 0x1f3f, 1}, {0x1f48, 0x1f4d, 1}, {0x1f59, 0x1f5f, 2}, {0x1f68, 0x1f6f, 1},
+    {0x1f88, 0x1f8f, 1}, {0x1f98, 0x1f9f, 1}, {0x1fa8, 0x1faf, 1}, {0x1fb8, 0x1fbc, 1}, {0x1fc8, 0x1fcc, 1},
+    {0x1fd8, 0x1fdb, 1}, {0x1fe8, 0x1fec, 1}, {0x1ff8, 0x1ffc, 1}, {0x2126, 0x2126, 1}, {0x212a, 0x212b, 1},
+    {0x2132, 0x2132, 1}, {0x2160, 0x216f, 1}, {0x2183, 0x2183, 1}, {0x24b6, 0x24cf, 1}, {0x2c00, 0x2c2f, 1},
+    {0x2c60, 0x2c62, 2}, {0x2c63, 0x2c64, 1}, {0x2c67, 0x2c6d, 2}, {0x2c6e, 0x2c70, 1}, {0x2c72, 0x2c72, 1},
+    {0x2c75, 0x2c75, 1}, {0x2c7e, 0x2c80, 1}, {0x2c82, 0x2ce2, 2}, {0x2ceb, 0x2ced, 2}, {0x2cf2, 0x2cf2, 1},
+    {0xa640, 0xa66c, 2}, {0xa680, 0xa69a, 2}, {0xa722, 0xa72e, 2}, {0xa732, 0xa76e, 2}, {0xa779, 0xa77d, 2},
+    {0xa77e, 0xa786, 2}, {0xa78b, 0xa78d, 2}, {0xa790, 0xa792, 2}, {0xa796, 0xa7aa, 2}, {0xa7ab, 0xa7ae, 1},
+    {0xa7b0, 0xa7b4, 1}, {0xa7b6, 0xa7c4, 2}, {0xa7c5, 0xa7c7, 1}, {0xa7c9, 0xa7c9, 1}, {0xa7d0, 0xa7d0, 1},
+    {0xa7d6, 0xa7d8, 2}, {0xa7f5, 0xa7f5, 1}, {0x10400, 0x10427, 1}, {0x104b0, 0x104d3, 1}, {0x10570, 0x1057a, 1},
+    {0x1057c, 0x1058a, 1}, {0x1058c, 0x10592, 1}, {0x10594, 0x10595, 1}, {0x10c80, 0x10cb2, 1},
+    {0x118a0, 0x118bf, 1}, {0x16e40, 0x16e5f, 1}, {0x1e900, 0x1e921, 1},
+};
+
+/* A capital that fold() does not cover, which would otherwise make it into an A-label as is. */
+bool unfolded_capital(uint32_t cp) {
+    if(cp < kUnfolded[0].first) return false;
+    const CapitalRun* run = std::upper_bound(std::begin(kUnfolded), std::end(kUnfolded), cp,
+                                             [](uint32_t v, const CapitalRun& r) { return v < r.first; }) - 1;
+    return cp <= run->last && (cp - run->first) % run->step == 0;
+}
+
+/* Code points IDNA2008 rejects that can be told without its derived property tables. */
+bool disallowed(uint32_t cp) {
+    if(cp < 0x80) return !((cp >= 'a' && cp <= 'z') || (cp >= '0' && cp <= '9') || cp == '-');
+    return cp < 0xc0 || cp == 0xd7 || cp == 0xf7 // C1 controls, Latin-1 symbols
+        || (cp >= 0x2000 && cp <= 0x206f) // spaces, joiners, punctuation
+        || cp == 0x3000 // ideographic space
+        || (cp >= 0xe000 && cp <= 0xf8ff) || cp >= 0xf0000 // private use
+        || (cp >= 0xfdd0 && cp <= 0xfdef) || (cp & 0xfffe) == 0xfffe // noncharacters
+        || (cp >= 0xe0000 && cp <= 0xe007f) // tags
+        || unfolded_capital(cp); // of a script fold() does not cover, rather than a wrong A-label
+}
+
+inline char digit(uint32_t d) { return d < 26 ? 'a' + d : '0' + d - 26; }
+
+uint32_t adapt(uint32_t delta, uint32_t points, bool first) {
+    delta = first ? delta / 700 : delta / 2;
+    delta += delta / points;
+    uint32_t k = 0;
+    while(delta > ((36 - 1) * 26) / 2) {
+        delta /= 36 - 1;
+        k += 36;
+    }
+    return k + (36 * delta) / (delta + 38);
+}
+
+/* RFC 3492 encoding of `n` code points into `out`; returns the length or -1 past `outlen`. */
+int punycode(const uint32_t* cps, int n, char* out, int outlen) {
+    int o = 0;
+    for(int i = 0; i < n; ++i) {
+        if(cps[i] < 0x80) {
+            if(o >= outlen) return -1;
+            out[o++] = cps[i];
+        }
+    }
+    const int b = o;
+    if(b > 0) {
+        if(o >= outlen) return -1;
+        out[o++] = '-';
+    }
+    uint32_t next = 0x80, delta = 0, bias = 72;
+    for(int h = b; h < n; ++next, ++delta) {
+        uint32_t m = kInvalid;
+        for(int i = 0; i < n; ++i) {
+            if(cps[i] >= next && cps[i] < m) m = cps[i];
+        }
+        delta += (m - next) * (h + 1); // at most 63 * 0x10ffff: no overflow
+        next = m;
+        for(int i = 0; i < n; ++i) {
+            if(cps[i] < next) ++delta;
+            if(cps[i] != next) continue;
+            uint32_t q = delta;
+            for(uint32_t k = 36;; k += 36) {
+                uint32_t t = k <= bias ? 1 : k >= bias + 26 ? 26 : k - bias;
+                if(q < t) break;
+                if(o >= outlen) return -1;
+                out[o++] = digit(t + (q - t) % (36 - t));
+                q = (q - t) / (36 - t);
+            }
+            if(o >= outlen) return -1;
+            out[o++] = digit(q);
+            bias = adapt(delta, h + 1, h == b);
+            delta = 0;
+            ++h;
+        }
+    }
+    return o;
+}
+
+/* Folds, checks and encodes one U-label into `out` (kMaxLabel bytes); returns the length or -1 with errno set. */
+int encode_label(uint32_t* cps, int n, char* out) {
+    bool ascii = true;
+    for(int i = 0; i < n; ++i) {
+        cps[i] = fold(cps[i]);
+        if(disallowed(cps[i])) {
+            set_last_error(EINVAL);
+            return -1;
+        }
+        ascii &= cps[i] < 0x80;
+    }
+    if(cps[0] == '-' || cps[n - 1] == '-' || (n >= 4 && cps[2] == '-' && cps[3] == '-')
+            || (cps[0] >= 0x300 && cps[0] <= 0x36f)) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    if(ascii) {
+        // fullwidth letters and digits, which map to ASCII: an LDH label, not a U-label
+        for(int i = 0; i < n; ++i) out[i] = cps[i];
+        return n;
+    }
+    memcpy(out, "xn--", 4);
+    int len = punycode(cps, n, out + 4, kMaxLabel - 4);
+    if(len < 0) {
+        set_last_error(EMSGSIZE);
+        return -1;
+    }
+    return 4 + len;
+}
+
+int to_ascii(const char* name, size_t len, char* out, size_t outlen) {
+    const u_char* p = reinterpret_cast<const u_char*>(name);
+    const u_char* const end = p + len;
+    size_t o = 0;
+    while(p < end) {
+        // one label: collect code points until a separator
+        const u_char* const start = p;
+        uint32_t cps[kMaxLabel + 1];
+        int n = 0;
+        bool ascii = true, escaped = false, dot = false;
+        const u_char* stop = p;
+        uint32_t cp;
+        while(p < end) {
+            stop = p;
+            if(*p == '\\') {
+                escaped = true;
+                p += p + 1 < end ? 2 : 1;
+                cp = '\\';
+            } else if((cp = next_cp(p, end)) == kInvalid) {
+                set_last_error(EINVAL);
+                return -1;
+            } else if((dot = is_dot(cp))) {
+                break;
+            }
+            ascii &= cp < 0x80;
+            if(n <= kMaxLabel) cps[n++] = cp; // one more than fits, to tell "too long"
+            stop = p;
+        }
+        if(ascii) {
+            size_t bytes = stop - start;
+            if(o + bytes >= outlen) {
+                set_last_error(EMSGSIZE);
+                return -1;
+            }
+            memcpy(out + o, start, bytes);
+            o += bytes;
+        } else {
+            char label[kMaxLabel];
+            int bytes = -1;
+            if(escaped) {
+                set_last_error(EINVAL); // escapes and U-labels do not mix
+            } else if(n > kMaxLabel) {
+                set_last_error(EMSGSIZE);
+            } else {
+                bytes = encode_label(cps, n, label);
+            }
+            if(bytes < 0) return -1;
+            if(o + bytes >= outlen) {
+                set_last_error(EMSGSIZE);
+                return -1;
+            }
+            memcpy(out + o, label, bytes);
+            o += bytes;
+        }
+        if(dot) {
+            if(o + 1 >= outlen) {
+                set_last_error(EMSGSIZE);
+                return -1;
+            }
+            out[o++] = '.';
+        }
+    }
+    out[o] = '\0';
+    return o;
+}
+
+} // anonymous
+
+namespace resolw_impl {
+
+bool name_is_ascii(const char* s, size_t len) {
+    // eight bytes at a time; names are short, so the tail matters as much as the body
+    constexpr uint64_t kHigh = 0x8080808080808080ull;
+    uint64_t acc = 0;
+    size_t i = 0;
+    for(; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, s + i, 8);
+        acc |= w;
+    }
+    if(i < len) {
+        uint64_t w = 0;
+        memcpy(&w, s + i, len - i);
+        acc |= w;
+    }
+    return !(acc & kHigh);
+}
+
+const char* name_to_ascii(const char* name, char* buf, size_t buflen) {
+    size_t len = strlen(name);
+    if(name_is_ascii(name, len)) return name;
+    return to_ascii(name, len, buf, buflen) < 0 ? nullptr : buf;
+}
+
+} // resolw_impl
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int resolw_idna_to_ascii(const char *name, char *out, size_t outlen)
+{
+    if(!name || !out || !outlen) {
+        resolw_impl::set_last_error(EINVAL);
+        return -1;
+    }
+    return to_ascii(name, strlen(name), out, outlen);
+}
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,24 @@
+#ifndef _SRC_IDN_H_
+#define _SRC_IDN_H_
+
+#include <stddef.h>
+
+// Query name normalization: ASCII names (nearly all of them) pass through
+// untouched after a word-at-a-time check, names with U-labels are turned
+// into their A-label (xn--) form on the caller's stack.
+
+namespace resolw_impl {
+
+/* True if the `len` bytes at `s` are all 7-bit. */
+bool name_is_ascii(const char* s, size_t len);
+
+/**
+ * `name` itself if it is ASCII, otherwise its ASCII-compatible form written
+ * to `buf` (MAXDNAME + 1 bytes suffice). Returns nullptr with errno set
+ * (EINVAL, EMSGSIZE) for names that cannot be encoded.
+ */
+const char* name_to_ascii(const char* name, char* buf, size_t buflen);
+
+} // resolw_impl
+
+#endif /* _SRC_IDN_H_ */
@@ -0,0 +1,129 @@
+#ifndef _SRC_INF_H_
+#define _SRC_INF_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+// The queries in flight on shared UDP sockets, keyed by socket, ID and
+// server port, so that whichever thread reads an answer can hand it to
+// the thread waiting for it. Open addressing in 64 independently locked
+// stripes: two threads only contend when their keys hash to the same
+// stripe, and a critical section is a few probes of one cache line pair.
+
+namespace resolw_impl {
+
+inline uint64_t inflight_key(unsigned sock, unsigned id, unsigned port) {
+    return (uint64_t) sock << 32 | (uint64_t) (id & 0xffff) << 16 | (port & 0xffff);
+}
+
+inline unsigned inflight_id(uint64_t key) { return (key >> 16) & 0xffff; }
+
+template<class T>
+class InflightTable {
+public:
+    enum {
+        kStripeBits = 6,
+        kStripes = 1 << kStripeBits,
+        kSlots = 64, // per stripe
+        kMaxLoad = kSlots * 3 / 4, // keeps probe sequences short
+    };
+
+    InflightTable() {
+        for(auto& c : ids_) c.store(0, std::memory_order_relaxed);
+    }
+
+    /* Registers `value` under `key`; false if the key is in flight already or the stripe is full. */
+    bool insert(uint64_t key, T* value) {
+        Stripe& s = stripe(key);
+        std::lock_guard<std::mutex> lock(s.mtx);
+        if(s.count >= kMaxLoad) return false;
+        unsigned i = home(key);
+        for(; s.values[i]; i = (i + 1) % kSlots) {
+            if(s.keys[i] == key) return false;
+        }
+        ids_[inflight_id(key)].fetch_add(1);
+        s.keys[i] = key;
+        s.values[i] = value;
+        ++s.count;
+        return true;
+    }
+
+    /**
+     * Takes the entry under `key` off the table and returns it if
+     * `accept(value)` agrees, or returns null. Answers with an ID that
+     * nothing is waiting for, as a spoofed one most likely has, are
+     * turned away without taking a lock. `accept` runs under the lock.
+     */
+    template<class F>
+    T* take(uint64_t key, F accept) {
+        if(!ids_[inflight_id(key)].load(std::memory_order_acquire)) return nullptr;
+        Stripe& s = stripe(key);
+        std::lock_guard<std::mutex> lock(s.mtx);
+        const unsigned i = find(s, key);
+        if(i == kSlots || !accept(s.values[i])) return nullptr;
+        T* value = s.values[i];
+        erase(s, i);
+        return value;
+    }
+
+    /* Takes `value` off the table if it is still under `key`; false if someone took it first. */
+    bool remove(uint64_t key, T* value) {
+        Stripe& s = stripe(key);
+        std::lock_guard<std::mutex> lock(s.mtx);
+        const unsigned i = find(s, key);
+        if(i == kSlots || s.values[i] != value) return false;
+        erase(s, i);
+        return true;
+    }
+
+private:
+    struct alignas(64) Stripe {
+        std::mutex mtx;
+        unsigned count = 0;
+        uint64_t keys[kSlots];
+        T* values[kSlots] = {}; // null = free
+    };
+
+    static uint64_t mix(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        return key;
+    }
+
+    Stripe& stripe(uint64_t key) { return stripes_[mix(key) >> (64 - kStripeBits)]; }
+    static unsigned home(uint64_t key) { return mix(key) % kSlots; }
+
+    static unsigned find(const Stripe& s, uint64_t key) {
+        for(unsigned i = home(key); s.values[i]; i = (i + 1) % kSlots) {
+            if(s.keys[i] == key) return i;
+        }
+        return kSlots;
+    }
+
+    /* Empties slot `i`, moving later entries of the probe sequence back so that no tombstone is needed. */
+    void erase(Stripe& s, unsigned i) {
+        ids_[inflight_id(s.keys[i])].fetch_sub(1, std::memory_order_release);
+        s.values[i] = nullptr;
+        --s.count;
+        for(unsigned j = (i + 1) % kSlots; s.values[j]; j = (j + 1) % kSlots) {
+            const unsigned h = home(s.keys[j]);
+            // `j` may move to the hole unless its home lies cyclically in (i, j]
+            if((j > i && (h <= i || h > j)) || (j < i && h <= i && h > j)) {
+                s.keys[i] = s.keys[j];
+                s.values[i] = s.values[j];
+                s.values[j] = nullptr;
+                i = j;
+            }
+        }
+    }
+
+    Stripe stripes_[kStripes];
+    std::atomic<uint16_t> ids_[0x10000]; // entries per ID across all stripes
+};
+
+} // resolw_impl
+
+#endif /* _SRC_INF_H_ */
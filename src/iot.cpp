@@ -0,0 +1,500 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "net.h"
+#include "inf.h"
+#include "msg.h"
+#include "sts.h"
+
+#include <errno.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+/**
+ * Dedicated I/O threads. With `resolw_sockpool_threads(n)`, a thread
+ * making a UDP exchange does not touch a socket: it pushes the exchange
+ * onto the submission list of one of `n` I/O threads (a lock-free stack
+ * that the I/O thread takes whole, so it sees everything submitted since
+ * it last looked) and sleeps on a condition variable. The I/O thread
+ * enters each exchange in the in-flight table (inf.h), sends them all
+ * with one sendmmsg() per socket, reads answers 32 at a time with
+ * recvmmsg() (sendto() and recvfrom() where those are missing), and
+ * wakes each caller whose answer it got. It sleeps in poll() on its
+ * sockets and on a "doorbell" (an eventfd on Linux, a loopback UDP
+ * socket elsewhere), which a caller rings only when the I/O thread has
+ * said that it is going to sleep.
+ *
+ * Callers keep their own deadlines: one that times out takes its
+ * exchange off the table itself, so the I/O thread has no timers. The
+ * sockets of an I/O thread are replaced after `max_age_sec` and the old
+ * ones read until the last exchange sent on them has timed out.
+ */
+
+namespace resolw_impl {
+
+namespace {
+
+constexpr unsigned kMaxThreads = 4;
+constexpr unsigned kBatch = 32;
+constexpr int kIdRetries = 4;
+
+enum State {
+    kQueued, // on the submission list, or being sent
+    kParked, // still kQueued when the caller timed out: it waits for the I/O thread to let go
+    kInflight, // sent and on the table; the caller may take it off
+    kDone, // `n` is final
+};
+
+struct Waiter {
+    const sockaddr* ns;
+    const u_char* msg;
+    int msglen;
+    u_char* answer;
+    int anslen;
+    TsigSession* tsig;
+    uint64_t deadline_ns;
+    Waiter* next; // on the submission list
+    // written by the I/O thread
+    const u_char* sent; // `msg` or, under another ID, `copy`
+    uint64_t key;
+    int n;
+    std::atomic<int> state{kQueued};
+    std::condition_variable cv;
+    u_char copy[kPacketSz];
+};
+
+/* A socket of an I/O thread. */
+struct Port {
+    sock_t fd = kBadSock;
+    uint64_t born_ns = 0;
+    uint64_t last_deadline_ns = 0; // of the exchanges sent on it
+};
+
+struct IoThread {
+    std::atomic<bool> running{false};
+    std::atomic<unsigned> users{0}; // callers between submitting and returning
+    std::atomic<Waiter*> submitted{nullptr};
+    std::atomic<bool> sleeping{false};
+    std::mutex mtx; // for the condition variables of the callers
+    std::thread thread;
+    sock_t doorbell = kBadSock;
+    sockaddr_in bell_addr; // where there is no eventfd
+    Port current[2], draining[2]; // [0] = AF_INET, [1] = AF_INET6
+
+    bool install_doorbell();
+    void ring() const;
+    void hush() const;
+    void run();
+    void submit(Waiter* list);
+    void flush(Port& p, Waiter** batch, unsigned count);
+    void receive(sock_t fd, u_char* bufs);
+    void finish(Waiter* w, int n);
+    Port& port(int family);
+};
+
+struct IoThreads {
+    std::mutex config; // starting and stopping
+    std::atomic<unsigned> count{0};
+    std::atomic<unsigned> next_thread{0};
+    IoThread threads[kMaxThreads];
+    InflightTable<Waiter> inflight;
+};
+
+IoThreads& io() {
+    static IoThreads* instance = new IoThreads(); // never destroyed: callers may still be waiting on the threads at exit
+    return *instance;
+}
+
+bool IoThread::install_doorbell() {
+    if(doorbell != kBadSock) return true;
+#if defined(__linux__)
+    doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return doorbell != kBadSock;
+#else
+    // a UDP socket on the loopback interface that callers send a byte to
+    doorbell = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    memset(&bell_addr, 0, sizeof(bell_addr));
+    bell_addr.sin_family = AF_INET;
+    bell_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(bell_addr);
+    if(doorbell != kBadSock && !bind(doorbell, reinterpret_cast<sockaddr*>(&bell_addr), sizeof(bell_addr))
+       && !getsockname(doorbell, reinterpret_cast<sockaddr*>(&bell_addr), &len) && sock_nonblock(doorbell)) {
+        return true;
+    }
+    if(doorbell != kBadSock) sock_close(doorbell);
+    doorbell = kBadSock;
+    return false;
+#endif
+}
+
+void IoThread::ring() const {
+#if defined(__linux__)
+    const uint64_t one = 1;
+    (void) !write(doorbell, &one, sizeof(one));
+#else
+    const char bell = 0;
+    sendto(doorbell, &bell, 1, 0, reinterpret_cast<const sockaddr*>(&bell_addr), sizeof(bell_addr));
+#endif
+}
+
+void IoThread::hush() const {
+#if defined(__linux__)
+    uint64_t rings;
+    (void) !read(doorbell, &rings, sizeof(rings));
+#else
+    char bells[16];
+    while(recv(doorbell, bells, sizeof(bells), 0) > 0) {}
+#endif
+}
+
+/* Hands `w` back to its caller and wakes it. */
+void IoThread::finish(Waiter* w, int n) {
+    std::lock_guard<std::mutex> lock(mtx);
+    w->n = n;
+    w->state.store(kDone, std::memory_order_release);
+    w->cv.notify_one();
+}
+
+/* The socket to send on for `family`, opened or replaced as needed. */
+Port& IoThread::port(int family) {
+    const int f = family == AF_INET6;
+    Port& p = current[f];
+    const uint64_t now = monotonic_ns();
+    if(p.fd != kBadSock && now - p.born_ns >= sockpool_max_age_ns() && draining[f].fd == kBadSock) {
+        draining[f] = p;
+        p.fd = kBadSock;
+    }
+    if(p.fd == kBadSock) {
+        p.fd = sockpool_open(family);
+        p.born_ns = now;
+        p.last_deadline_ns = 0;
+    }
+    return p;
+}
+
+/* Sends the `count` exchanges of `batch`, entered already, on `p`; hands back those it cannot send. */
+void IoThread::flush(Port& p, Waiter** batch, unsigned count) {
+    unsigned sent = 0;
+#if defined(__linux__)
+    mmsghdr msgs[kBatch];
+    iovec iov[kBatch];
+    for(unsigned i = 0; i < count; ++i) {
+        iov[i].iov_base = const_cast<u_char*>(batch[i]->sent);
+        iov[i].iov_len = batch[i]->msglen;
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_name = const_cast<sockaddr*>(batch[i]->ns);
+        msgs[i].msg_hdr.msg_namelen = sockaddr_len(batch[i]->ns);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    while(sent < count) {
+        const int n = sendmmsg(p.fd, msgs + sent, count - sent, 0);
+        if(n > 0) {
+            sent += n;
+        } else if(n < 0 && sock_errno() == EINTR) {
+            continue;
+        } else if(!(n < 0 && sock_errno() == kErrWouldBlock && wait_for(p.fd, POLLOUT, batch[sent]->deadline_ns))) {
+            break;
+        }
+    }
+#else
+    for(; sent < count; ++sent) {
+        const Waiter* w = batch[sent];
+        if(sendto(p.fd, reinterpret_cast<const char*>(w->sent), w->msglen, 0, w->ns, sockaddr_len(w->ns)) != w->msglen) {
+            break;
+        }
+    }
+#endif
+    for(unsigned i = 0; i < count; ++i) {
+        Waiter* w = batch[i];
+        if(i >= sent) {
+            io().inflight.remove(w->key, w);
+            finish(w, kSendFailed);
+            continue;
+        }
+        int expected = kQueued;
+        if(!w->state.compare_exchange_strong(expected, kInflight, std::memory_order_acq_rel)) {
+            // parked: its caller gave up waiting and waits for this instead
+            std::lock_guard<std::mutex> lock(mtx);
+            w->state.store(kInflight, std::memory_order_release);
+            w->cv.notify_one();
+        }
+    }
+}
+
+/* Enters and sends the exchanges on `list`, in the order they came. */
+void IoThread::submit(Waiter* list) {
+    Waiter* order = nullptr; // the stack reversed
+    while(list) {
+        Waiter* w = list;
+        list = w->next;
+        w->next = order;
+        order = w;
+    }
+    InflightTable<Waiter>& inflight = io().inflight;
+    Waiter* batch[2][kBatch];
+    unsigned count[2] = {0, 0};
+    Port* ports[2] = {nullptr, nullptr};
+    while(order) {
+        Waiter* w = order;
+        order = w->next; // `w` is its caller's again once handed back or sent
+        const int f = w->ns->sa_family == AF_INET6;
+        if(!ports[f]) ports[f] = &port(w->ns->sa_family);
+        const sock_t fd = ports[f]->fd;
+        w->sent = w->msg;
+        w->key = inflight_key(fd, rd16(w->msg + kHdrId), sockaddr_port(w->ns));
+        bool entered = fd != kBadSock && inflight.insert(w->key, w);
+        for(int i = 0; !entered && fd != kBadSock && !w->tsig && w->msglen <= kPacketSz && i < kIdRetries; ++i) {
+            // the ID is in flight to this server on this socket already: send a copy under another one
+            if(w->sent == w->msg) {
+                memcpy(w->copy, w->msg, w->msglen);
+                w->sent = w->copy;
+            }
+            wr16(w->copy + kHdrId, res_randomid());
+            w->key = inflight_key(fd, rd16(w->copy + kHdrId), sockaddr_port(w->ns));
+            entered = inflight.insert(w->key, w);
+        }
+        if(!entered) {
+            finish(w, kSendUnshared);
+            continue;
+        }
+        ports[f]->last_deadline_ns = std::max(ports[f]->last_deadline_ns, w->deadline_ns);
+        batch[f][count[f]++] = w;
+        if(count[f] == kBatch) {
+            flush(*ports[f], batch[f], count[f]);
+            count[f] = 0;
+        }
+    }
+    for(int f = 0; f < 2; ++f) {
+        if(count[f]) flush(*ports[f], batch[f], count[f]);
+    }
+}
+
+/* Reads what has arrived on `fd` and hands the answers over. */
+void IoThread::receive(sock_t fd, u_char* bufs) {
+    InflightTable<Waiter>& inflight = io().inflight;
+    for(;;) {
+        sockaddr_storage from[kBatch];
+        int lens[kBatch];
+        unsigned got = 0;
+#if defined(__linux__)
+        mmsghdr msgs[kBatch];
+        iovec iov[kBatch];
+        for(unsigned i = 0; i < kBatch; ++i) {
+            iov[i].iov_base = bufs + i * kMaxUdpRead;
+            iov[i].iov_len = kMaxUdpRead;
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_name = &from[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        const int n = recvmmsg(fd, msgs, kBatch, MSG_DONTWAIT, nullptr);
+        if(n < 0 && sock_errno() == EINTR) continue;
+        if(n <= 0) return; // drained; anything else (e.g. ICMP) concerns no one in particular
+        got = n;
+        for(unsigned i = 0; i < got; ++i) lens[i] = msgs[i].msg_len;
+#else
+        for(; got < kBatch; ++got) {
+            socklen_t fromlen = sizeof(from[got]);
+            lens[got] = recvfrom(fd, reinterpret_cast<char*>(bufs + got * kMaxUdpRead), kMaxUdpRead, 0,
+                                 reinterpret_cast<sockaddr*>(&from[got]), &fromlen);
+            if(lens[got] < 0) break;
+        }
+        if(!got) return;
+#endif
+        for(unsigned i = 0; i < got; ++i) {
+            const u_char* buf = bufs + i * kMaxUdpRead;
+            const int len = lens[i];
+            if(len < kHdrSize) continue;
+            const sockaddr* sa = reinterpret_cast<const sockaddr*>(&from[i]);
+            Waiter* w = inflight.take(inflight_key(fd, rd16(buf + kHdrId), sockaddr_port(sa)), [&](Waiter* w) {
+                w->n = mux_accept(buf, len, sa, w->ns, w->sent, w->msglen, w->answer, w->anslen, w->tsig);
+                return w->n > 0;
+            });
+            if(w) finish(w, w->n);
+        }
+        if(got < kBatch) return;
+    }
+}
+
+void IoThread::run() {
+    std::vector<u_char> bufs(kBatch * kMaxUdpRead);
+    for(;;) {
+        if(Waiter* list = submitted.exchange(nullptr)) submit(list);
+        if(!running.load() && !users.load()) break;
+
+        const uint64_t now = monotonic_ns();
+        uint64_t wake = UINT64_MAX;
+        pollfd_t pfds[5];
+        unsigned npoll = 0;
+        pfds[npoll].fd = doorbell;
+        pfds[npoll++].events = POLLIN;
+        for(int f = 0; f < 2; ++f) {
+            if(draining[f].fd != kBadSock && now >= draining[f].last_deadline_ns) {
+                sock_close(draining[f].fd); // whoever could still want an answer from it has timed out
+                draining[f].fd = kBadSock;
+            }
+            for(const Port* p : { &current[f], &draining[f] }) {
+                if(p->fd == kBadSock) continue;
+                pfds[npoll].fd = p->fd;
+                pfds[npoll++].events = POLLIN;
+            }
+            if(draining[f].fd != kBadSock) wake = std::min(wake, draining[f].last_deadline_ns);
+        }
+        for(unsigned i = 0; i < npoll; ++i) pfds[i].revents = 0;
+
+        // callers ring the doorbell only while `sleeping` is set, so look at the list once more after setting it
+        sleeping.store(true);
+        if(submitted.load()) {
+            sleeping.store(false, std::memory_order_relaxed);
+            continue;
+        }
+        const int rc = sock_poll(pfds, npoll, wake == UINT64_MAX ? -1 : remaining_ms(wake));
+        sleeping.store(false, std::memory_order_relaxed);
+        if(rc <= 0) continue;
+        if(pfds[0].revents) hush();
+        for(unsigned i = 1; i < npoll; ++i) {
+            if(pfds[i].revents) receive(pfds[i].fd, bufs.data());
+        }
+    }
+    for(Port* p : { &current[0], &current[1], &draining[0], &draining[1] }) {
+        if(p->fd != kBadSock) sock_close(p->fd);
+        *p = Port();
+    }
+}
+
+/* Starts `count` I/O threads; with the config mutex held and none running. */
+bool start(IoThreads& all, unsigned count) {
+    for(unsigned i = 0; i < count; ++i) {
+        IoThread& t = all.threads[i];
+        if(!t.install_doorbell()) return false;
+        t.running.store(true);
+        t.thread = std::thread(&IoThread::run, &t);
+    }
+    all.count.store(count);
+    return true;
+}
+
+/* Stops the I/O threads once the exchanges they carry are over; with the config mutex held. */
+void stop(IoThreads& all) {
+    all.count.store(0);
+    for(IoThread& t : all.threads) {
+        if(!t.thread.joinable()) continue;
+        t.running.store(false);
+        t.ring();
+        t.thread.join();
+    }
+}
+
+} // anonymous
+
+int io_send(const sockaddr* ns, const u_char* msg, int msglen, u_char* answer, int anslen, uint64_t deadline_ns,
+            bool& truncated, TsigSession* tsig) {
+    IoThreads& all = io();
+    const unsigned count = all.count.load(std::memory_order_relaxed);
+    if(!count) return kSendUnshared;
+    static thread_local unsigned pick = all.next_thread.fetch_add(1, std::memory_order_relaxed);
+    IoThread& t = all.threads[pick % count];
+    t.users.fetch_add(1);
+    if(!t.running.load()) {
+        if(t.users.fetch_sub(1) == 1) t.ring(); // it may be waiting for the last user to leave
+        return kSendUnshared;
+    }
+
+    Waiter w;
+    w.ns = ns;
+    w.msg = msg;
+    w.msglen = msglen;
+    w.answer = answer;
+    w.anslen = anslen;
+    w.tsig = tsig;
+    w.deadline_ns = deadline_ns;
+    w.n = 0;
+    const uint64_t sent_ns = monotonic_ns();
+    w.next = t.submitted.load(std::memory_order_relaxed);
+    while(!t.submitted.compare_exchange_weak(w.next, &w)) {}
+    if(t.sleeping.load() && t.sleeping.exchange(false)) t.ring();
+
+    using namespace std::chrono;
+    std::unique_lock<std::mutex> lock(t.mtx);
+    w.cv.wait_until(lock, steady_clock::time_point{nanoseconds(deadline_ns)},
+                    [&] { return w.state.load(std::memory_order_acquire) == kDone; });
+    int expected = kQueued;
+    if(w.state.compare_exchange_strong(expected, kParked, std::memory_order_acq_rel)) {
+        w.cv.wait(lock, [&] { return w.state.load(std::memory_order_acquire) != kParked; });
+    }
+    if(w.state.load(std::memory_order_acquire) == kInflight) {
+        lock.unlock();
+        if(all.inflight.remove(w.key, &w)) {
+            w.n = kSendTimeout;
+        } else {
+            lock.lock(); // the I/O thread has just taken it
+            w.cv.wait(lock, [&] { return w.state.load(std::memory_order_acquire) == kDone; });
+        }
+    }
+    if(lock.owns_lock()) lock.unlock();
+    if(t.users.fetch_sub(1) == 1 && !t.running.load()) t.ring();
+
+    if(w.n == kSendUnshared) return kSendUnshared;
+    StatsServer* stats = stats_server(ns);
+    stats_query(stats);
+    if(w.n == kSendTimeout) {
+        stats_timeout(stats);
+    } else if(w.n <= 0) {
+        stats_error(stats);
+    } else {
+        if(w.sent != msg) wr16(answer + kHdrId, rd16(msg + kHdrId));
+        truncated = rd16(answer + kHdrFlags) & kFlagTC;
+        stats_response(stats, monotonic_ns() - sent_ns, truncated);
+    }
+    return w.n;
+}
+
+} // resolw_impl
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int resolw_sockpool_threads(unsigned threads) {
+    using namespace resolw_impl;
+    if(threads > kMaxThreads) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    net_startup();
+    IoThreads& all = io();
+    std::lock_guard<std::mutex> lock(all.config);
+    stop(all);
+    if(threads && !start(all, threads)) {
+        int err = sock_errno();
+        stop(all);
+        set_last_error(err);
+        return -1;
+    }
+    return 0;
+}
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,394 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "msg.h"
+#include "idn.h"
+#include "net.h" // set_last_error
+
+#include <errno.h>
+#include <algorithm>
+#include <cstring>
+
+namespace resolw_impl {
+
+namespace {
+
+constexpr u_char kPtrMask = 0xc0;
+constexpr int kMaxHops = 127; // more pointers than that can only be a loop
+
+inline u_char lower(u_char c) { return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c; }
+
+/* Follows compression pointers until `p` points at a length byte; null on error. */
+const u_char* deref(const u_char* msg, const u_char* eom, const u_char* p, int& hops) {
+    while(p < eom && (*p & kPtrMask) == kPtrMask) {
+        if(p + 1 >= eom || ++hops > kMaxHops) return nullptr;
+        p = msg + (((p[0] & ~kPtrMask) << 8) | p[1]);
+    }
+    return p < eom ? p : nullptr;
+}
+
+} // anonymous
+
+int msg_pack_name(const char* src, u_char* dst, int dstlen) {
+    constexpr int kMaxName = 255;
+    constexpr int kMaxLabel = 63;
+    if(!src) return -1;
+    if(src[0] == '.' && !src[1]) ++src; // the root
+    u_char* out = dst;
+    u_char* const end = dst + std::min(dstlen, kMaxName);
+    u_char* label = out; // length byte of the current label
+    if(out >= end) return -1;
+    *out++ = 0;
+    for(const char* p = src; ; ++p) {
+        char c = *p;
+        if(!c || c == '.') {
+            int len = out - label - 1;
+            if(!len) {
+                if(c || label != dst) return -1; // empty label inside the name
+                break; // "" or "."
+            }
+            *label = len;
+            if(!c || !p[1]) {
+                if(out >= end) return -1;
+                *out++ = 0; // terminating root label
+                break;
+            }
+            label = out;
+            if(out >= end) return -1;
+            *out++ = 0;
+            continue;
+        }
+        u_char byte = c;
+        if(c == '\\') {
+            if(p[1] >= '0' && p[1] <= '9') {
+                if(p[2] < '0' || p[2] > '9' || p[3] < '0' || p[3] > '9') return -1;
+                int v = (p[1] - '0') * 100 + (p[2] - '0') * 10 + (p[3] - '0');
+                if(v > 255) return -1;
+                byte = v;
+                p += 3;
+            } else if(p[1]) {
+                byte = *++p;
+            } else {
+                return -1;
+            }
+        }
+        if(out - label > kMaxLabel || out >= end) return -1;
+        *out++ = byte;
+    }
+    return out - dst;
+}
+
+int msg_skip_name(const u_char* p, const u_char* eom) {
+    const u_char* start = p;
+    while(p < eom) {
+        u_char n = *p;
+        if(!n) {
+            return p + 1 - start;
+        }
+        if((n & kPtrMask) == kPtrMask) {
+            return p + 2 <= eom ? p + 2 - start : -1;
+        }
+        if(n & kPtrMask) {
+            return -1; // reserved label types
+        }
+        p += n + 1;
+    }
+    return -1;
+}
+
+int msg_expand_name(const u_char* msg, const u_char* eom, const u_char* src, char* dst, int dstlen) {
+    int consumed = msg_skip_name(src, eom);
+    if(consumed < 0 || dstlen < 1) return -1;
+    char* out = dst;
+    char* const end = dst + dstlen - 1; // room for the terminator
+    int hops = 0;
+    const u_char* p = src;
+    for(;;) {
+        p = deref(msg, eom, p, hops);
+        if(!p) return -1;
+        u_char n = *p++;
+        if(!n) break;
+        if((n & kPtrMask) || p + n > eom) return -1;
+        if(out != dst) {
+            if(out >= end) return -1;
+            *out++ = '.';
+        }
+        for(int i = 0; i < n; ++i) {
+            u_char c = p[i];
+            if(c == '.' || c == '\\' || c == '"' || c == ';' || c == '(' || c == ')' || c == '@' || c == '$') {
+                if(end - out < 2) return -1;
+                *out++ = '\\';
+                *out++ = c;
+            } else if(c <= 0x20 || c >= 0x7f) {
+                if(end - out < 4) return -1;
+                *out++ = '\\';
+                *out++ = '0' + c / 100;
+                *out++ = '0' + c / 10 % 10;
+                *out++ = '0' + c % 10;
+            } else {
+                if(out >= end) return -1;
+                *out++ = c;
+            }
+        }
+        p += n;
+    }
+    *out = '\0';
+    return consumed;
+}
+
+bool msg_names_equal(const u_char* msg1, const u_char* eom1, const u_char* name1,
+                     const u_char* msg2, const u_char* eom2, const u_char* name2) {
+    int hops1 = 0, hops2 = 0;
+    for(;;) {
+        name1 = deref(msg1, eom1, name1, hops1);
+        name2 = deref(msg2, eom2, name2, hops2);
+        if(!name1 || !name2) return false;
+        u_char n = *name1;
+        if(n != *name2 || (n & kPtrMask)) return false;
+        if(name1 + n >= eom1 || name2 + n >= eom2) return false;
+        if(!n) return true;
+        for(int i = 1; i <= n; ++i) {
+            if(lower(name1[i]) != lower(name2[i])) return false;
+        }
+        name1 += n + 1;
+        name2 += n + 1;
+    }
+}
+
+bool msg_is_reply_to(const u_char* query, int qlen, const u_char* reply, int rlen) {
+    if(qlen < kHdrSize || rlen < kHdrSize) return false;
+    if(rd16(query + kHdrId) != rd16(reply + kHdrId)) return false;
+    unsigned qf = rd16(query + kHdrFlags), rf = rd16(reply + kHdrFlags);
+    if(!(rf & kFlagQR)) return false;
+    if(((qf ^ rf) >> kOpcodeShift) & 0xf) return false;
+    unsigned qd = rd16(query + kHdrQdCount);
+    if(!qd) return true; // e.g. NOTIFY/UPDATE without zone section echo
+    if(qd != 1 || rd16(reply + kHdrQdCount) != 1) {
+        // a truncated reply (e.g. FORMERR) may carry no question at all
+        return !rd16(reply + kHdrQdCount) && (rf & kRcodeMask);
+    }
+    const u_char* qeom = query + qlen;
+    const u_char* reom = reply + rlen;
+    const u_char* qn = query + kHdrSize;
+    const u_char* rn = reply + kHdrSize;
+    int ql = msg_skip_name(qn, qeom), rl = msg_skip_name(rn, reom);
+    if(ql < 0 || rl < 0 || qn + ql + 4 > qeom || rn + rl + 4 > reom) return false;
+    if(rd32(qn + ql) != rd32(rn + rl)) return false; // qtype, qclass
+    return msg_names_equal(query, qeom, qn, reply, reom, rn);
+}
+
+int msg_add_opt(u_char* buf, int len, int buflen, unsigned payload, bool dnssec_ok) {
+    if(len < kHdrSize || buflen - len < 11) return -1;
+    u_char* cp = buf + len;
+    *cp++ = 0; // root owner
+    wr16(cp, T_OPT);
+    wr16(cp + 2, payload); // in place of the class
+    wr32(cp + 4, dnssec_ok ? 0x8000 : 0); // extended RCODE, version, DO and zero flags in place of the TTL
+    wr16(cp + 8, 0);
+    wr16(buf + kHdrArCount, rd16(buf + kHdrArCount) + 1);
+    return len + 11;
+}
+
+int msg_check_name(const u_char* msg, const u_char* eom, const u_char* p, const u_char* end) {
+    constexpr int kMaxName = 255;
+    const u_char* const start = p;
+    const u_char* limit = end; // until the first pointer; `eom` after it
+    int consumed = -1, total = 0, hops = 0;
+    for(;;) {
+        if(p >= limit) return -1;
+        u_char n = *p;
+        if((n & kPtrMask) == kPtrMask) {
+            if(!msg || p + 1 >= limit || ++hops > kMaxHops) return -1;
+            if(consumed < 0) consumed = p + 2 - start;
+            p = msg + (((n & ~kPtrMask) << 8) | p[1]);
+            limit = eom;
+            continue;
+        }
+        if((n & kPtrMask) || p + n >= limit) return -1;
+        total += n + 1;
+        if(total > kMaxName) return -1;
+        if(!n) return consumed < 0 ? p + 1 - start : consumed;
+        p += n + 1;
+    }
+}
+
+int msg_unpack_name(const u_char* msg, const u_char* eom, const u_char* src, u_char* dst, int dstlen, int* written) {
+    int consumed = msg_check_name(msg, eom, src, eom);
+    if(consumed < 0) return -1;
+    int out = 0;
+    for(const u_char* p = src;;) {
+        if((*p & kPtrMask) == kPtrMask) {
+            p = msg + (((p[0] & ~kPtrMask) << 8) | p[1]);
+            continue;
+        }
+        u_char n = *p;
+        if(dst) {
+            if(out + n + 1 > dstlen) return -1;
+            memcpy(dst + out, p, n + 1);
+        }
+        out += n + 1;
+        if(!n) break;
+        p += n + 1;
+    }
+    *written = out;
+    return consumed;
+}
+
+int msg_unpack_rdata(const u_char* msg, const u_char* eom, unsigned type, const u_char* rdata, int rdlen,
+                     u_char* dst, int dstlen) {
+    int prefix = 0, names = 0; // fixed bytes before the names; everything after them is copied as is
+    switch(type) {
+        case T_NS: case kTypeMd: case kTypeMf: case T_CNAME: case kTypeMb: case kTypeMg: case kTypeMr: case T_PTR:
+            names = 1;
+            break;
+        case T_SOA: case kTypeMinfo: case kTypeRp:
+            names = 2;
+            break;
+        case T_MX: case kTypeAfsdb: case kTypeRt:
+            prefix = 2;
+            names = 1;
+            break;
+        case kTypePx:
+            prefix = 2;
+            names = 2;
+            break;
+        case T_SRV: // not to be compressed, but RFC 3597 asks receivers to cope
+            prefix = 6;
+            names = 1;
+            break;
+    }
+    if(rdlen < prefix) return -1;
+    const u_char* p = rdata;
+    const u_char* const rdend = rdata + rdlen;
+    int out = 0;
+    auto copy = [&](int len) {
+        if(dst) {
+            if(out + len > dstlen) return false;
+            memcpy(dst + out, p, len);
+        }
+        out += len;
+        p += len;
+        return true;
+    };
+    if(!copy(prefix)) return -1;
+    for(int i = 0; i < names; ++i) {
+        int written;
+        int n = msg_unpack_name(msg, eom, p, dst ? dst + out : nullptr, dst ? dstlen - out : 0, &written);
+        if(n < 0 || p + n > rdend) return -1;
+        out += written;
+        p += n;
+    }
+    return copy(rdend - p) ? out : -1;
+}
+
+} // resolw_impl
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int res_nmkquery(res_state rs, int op, const char *dname, int rq_class, int type, const u_char *data,
+                int datalen, const u_char *newrr, u_char *buf, int buflen)
+{
+    using namespace resolw_impl;
+    if(!buf || buflen < kHdrSize || datalen < 0) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    memset(buf, 0, kHdrSize);
+    rs->id = res_randomid();
+    wr16(buf + kHdrId, rs->id);
+    wr16(buf + kHdrFlags, ((op & 0xf) << kOpcodeShift) | ((rs->options & RES_RECURSE) ? kFlagRD : 0));
+    u_char* cp = buf + kHdrSize;
+    u_char* const eom = buf + buflen;
+    int n;
+    switch(op) {
+        case kOpQuery:
+        case kOpNotify: {
+            char ace[MAXDNAME + 1];
+            if(dname && !(dname = name_to_ascii(dname, ace, sizeof(ace)))) return -1;
+            if((n = msg_pack_name(dname, cp, eom - cp)) < 0 || eom - cp - n < 4) break;
+            cp += n;
+            wr16(cp, type);
+            wr16(cp + 2, rq_class);
+            cp += 4;
+            wr16(buf + kHdrQdCount, 1);
+            if(op == kOpQuery && data) {
+                // as in BIND: an additional T_NULL record naming the completion domain
+                if((n = msg_pack_name(reinterpret_cast<const char*>(data), cp, eom - cp)) < 0 || eom - cp - n < 10) break;
+                cp += n;
+                wr16(cp, T_NULL);
+                wr16(cp + 2, rq_class);
+                wr32(cp + 4, 0);
+                wr16(cp + 8, 0);
+                cp += 10;
+                wr16(buf + kHdrArCount, 1);
+            }
+            return cp - buf;
+        }
+        case kOpUpdate: {
+            // the zone section, and `newrr` (uncompressed) as the only change (RFC 2136)
+            char ace[MAXDNAME + 1];
+            if(!dname || !(dname = name_to_ascii(dname, ace, sizeof(ace)))) {
+                set_last_error(EINVAL);
+                return -1;
+            }
+            wr16(buf + kHdrFlags, (op & 0xf) << kOpcodeShift); // no RD: the Z bits of an UPDATE
+            if((n = msg_pack_name(dname, cp, eom - cp)) < 0 || eom - cp - n < 4) break;
+            cp += n;
+            wr16(cp, type);
+            wr16(cp + 2, rq_class);
+            cp += 4;
+            wr16(buf + kHdrQdCount, 1); // ZOCOUNT
+            if(newrr) {
+                if((n = msg_check_name(nullptr, nullptr, newrr, newrr + MAXCDNAME)) < 0) {
+                    set_last_error(EINVAL);
+                    return -1;
+                }
+                const int rrlen = n + 10 + rd16(newrr + n + 8);
+                if(eom - cp < rrlen) break;
+                memcpy(cp, newrr, rrlen);
+                cp += rrlen;
+                wr16(buf + kHdrNsCount, 1); // UPCOUNT
+            }
+            return cp - buf;
+        }
+        case kOpIQuery:
+            // an answer record with an empty owner name and the caller's rdata
+            if(eom - cp < 11 + datalen) break;
+            *cp++ = 0;
+            wr16(cp, type);
+            wr16(cp + 2, rq_class);
+            wr32(cp + 4, 0);
+            wr16(cp + 8, datalen);
+            cp += 10;
+            if(datalen) {
+                memcpy(cp, data, datalen);
+                cp += datalen;
+            }
+            wr16(buf + kHdrAnCount, 1);
+            return cp - buf;
+        default:
+            set_last_error(EINVAL);
+            return -1;
+    }
+    set_last_error(EMSGSIZE);
+    return -1;
+}
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
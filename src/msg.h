@@ -0,0 +1,144 @@
+#ifndef _SRC_MSG_H_
+#define _SRC_MSG_H_
+
+#include "resolv.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// Wire format helpers shared by the native code paths. Unlike `dn_*()`,
+// these are available in the public domain build as well.
+
+namespace resolw_impl {
+
+inline uint16_t rd16(const u_char* p) { return (uint16_t) ((p[0] << 8) | p[1]); }
+inline uint32_t rd32(const u_char* p) { return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+inline void wr16(u_char* p, unsigned v) { p[0] = v >> 8; p[1] = v; }
+inline void wr32(u_char* p, uint32_t v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+
+/* Byte offsets into the fixed 12-byte header. */
+enum {
+    kHdrId = 0,
+    kHdrFlags = 2,
+    kHdrQdCount = 4,
+    kHdrAnCount = 6,
+    kHdrNsCount = 8,
+    kHdrArCount = 10,
+    kHdrSize = 12,
+    kPacketSz = 512, // largest plain (non-EDNS) UDP payload
+    kEdnsPayload = 1232, // the UDP payload we advertise with EDNS (DNS Flag Day 2020)
+    kMaxAnswer = 65535, // largest message TCP can carry (RFC 1035 §4.2.2 two-byte length)
+};
+
+/* Bits of the 16-bit flags word. */
+enum {
+    kFlagQR = 0x8000,
+    kFlagAA = 0x0400,
+    kFlagTC = 0x0200,
+    kFlagRD = 0x0100,
+    kFlagRA = 0x0080,
+    kFlagAD = 0x0020,
+    kFlagCD = 0x0010,
+    kOpcodeShift = 11,
+    kRcodeMask = 0x000f,
+};
+
+/* Opcodes by number, for the same reason as the RCODEs below. */
+enum {
+    kOpQuery = 0,
+    kOpIQuery = 1,
+    kOpNotify = 4,
+    kOpUpdate = 5,
+};
+
+/* Types by number that not both `nameser.h` variants define. */
+enum {
+    kTypeMd = 3,
+    kTypeMf = 4,
+    kTypeMb = 7,
+    kTypeMg = 8,
+    kTypeMr = 9,
+    kTypeMinfo = 14,
+    kTypeRp = 17,
+    kTypeAfsdb = 18,
+    kTypeRt = 21,
+    kTypePx = 26,
+    kTypeSshfp = 44,
+    kTypeTlsa = 52,
+    kTypeSvcb = 64,
+    kTypeHttps = 65,
+};
+
+/* RCODEs by number, since the two `nameser.h` variants spell them differently. */
+enum {
+    kRcodeNoError = 0,
+    kRcodeFormErr = 1,
+    kRcodeServFail = 2,
+    kRcodeNxDomain = 3,
+    kRcodeNotImp = 4,
+    kRcodeRefused = 5,
+};
+
+/**
+ * Encodes a presentation-form name (`\\.` and `\\DDD` escapes allowed, trailing
+ * dot optional) as uncompressed wire labels. Returns the encoded length, or
+ * -1 if the name is malformed or does not fit.
+ */
+int msg_pack_name(const char* src, u_char* dst, int dstlen);
+
+/* Length of the (possibly compressed) name at `p`, or -1 if malformed. */
+int msg_skip_name(const u_char* p, const u_char* eom);
+
+/**
+ * Expands the name at `src` into presentation form like `dn_expand()`:
+ * no trailing dot, special and non-printable characters escaped.
+ * Returns the number of bytes the name occupies at `src`, or -1.
+ */
+int msg_expand_name(const u_char* msg, const u_char* eom, const u_char* src, char* dst, int dstlen);
+
+/**
+ * Case-insensitive comparison of two wire names, each of which may use
+ * compression pointers into its own message.
+ */
+bool msg_names_equal(const u_char* msg1, const u_char* eom1, const u_char* name1,
+                     const u_char* msg2, const u_char* eom2, const u_char* name2);
+
+/**
+ * Checks that `reply` answers `query`: same ID, QR set, same opcode and
+ * the same (single) question. Returns false on anything malformed.
+ */
+bool msg_is_reply_to(const u_char* query, int qlen, const u_char* reply, int rlen);
+
+/**
+ * Appends an EDNS OPT record advertising `payload` bytes (and DO, if
+ * `dnssec_ok`) to the message of length `len` in `buf`, and counts it in
+ * ARCOUNT. Returns the new length, or -1 if it does not fit.
+ */
+int msg_add_opt(u_char* buf, int len, int buflen, unsigned payload, bool dnssec_ok);
+
+/**
+ * Checks the name at `p`, which must end by `end`, and whatever its
+ * pointers lead to within `msg`..`eom`: labels in bounds, no loops, at
+ * most 255 bytes once expanded. A null `msg` admits no pointers at all.
+ * Returns the number of bytes the name occupies at `p`, or -1.
+ */
+int msg_check_name(const u_char* msg, const u_char* eom, const u_char* p, const u_char* end);
+
+/**
+ * Copies the name at `src` into `dst` as uncompressed wire labels (or, with
+ * a null `dst`, only measures it) and stores the copied length in
+ * `*written`. Returns the bytes the name occupies at `src`, or -1.
+ */
+int msg_unpack_name(const u_char* msg, const u_char* eom, const u_char* src, u_char* dst, int dstlen, int* written);
+
+/**
+ * Copies the rdata of a `type` record into `dst` (or measures it, with a
+ * null `dst`), expanding the names that RFC 3597 section 4 allows to be
+ * compressed. Other types are copied as they are. Returns the length, or
+ * -1 if the rdata is malformed or does not fit.
+ */
+int msg_unpack_rdata(const u_char* msg, const u_char* eom, unsigned type, const u_char* rdata, int rdlen,
+                     u_char* dst, int dstlen);
+
+} // resolw_impl
+
+#endif /* _SRC_MSG_H_ */
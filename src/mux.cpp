@@ -0,0 +1,293 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "net.h"
+#include "inf.h"
+#include "msg.h"
+#include "sts.h"
+#include "tsg.h"
+
+#include <errno.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+
+/**
+ * Shared UDP sockets. With `resolw_sockpool_share(n)`, every thread's
+ * UDP exchanges go out on one of `n` sockets per address family instead
+ * of a socket leased for the exchange, so that the number of sockets
+ * (and of ports to keep track of in a NAT or a firewall) no longer
+ * grows with the number of threads.
+ *
+ * Each query is entered in the in-flight table (inf.h) under its socket,
+ * ID and server port before it is sent. The threads waiting on a socket
+ * take turns at reading it (leader/followers): one polls and reads, and
+ * hands each answer to the thread that asked, after checking its source
+ * address, question and TSIG signature; the others sleep on a condition
+ * variable until their answer is handed to them or the reader leaves.
+ * A query whose ID is already in flight on its socket and server goes
+ * out under a fresh one, which is put back in the answer; a signed one
+ * goes out on a socket of its own instead. A shared socket is replaced
+ * after `max_age_sec` (resolw_sockpool_config()), once the exchanges
+ * already on it are over, so that its port does not stay predictable.
+ */
+
+namespace resolw_impl {
+
+namespace {
+
+constexpr unsigned kMaxShared = 16; // per address family
+constexpr int kIdRetries = 4;
+
+struct Waiter {
+    const sockaddr* ns;
+    const u_char* msg;
+    int msglen;
+    u_char* answer;
+    int anslen;
+    TsigSession* tsig;
+    int n = 0; // written by the reader before `done`
+    std::atomic<bool> done{false};
+    std::condition_variable cv;
+    Waiter* prev = nullptr; // among the followers
+    Waiter* next = nullptr;
+};
+
+struct Shared {
+    sock_t fd;
+    uint64_t born_ns;
+    // under the mutex of the slot
+    unsigned users = 0;
+    bool retired = false;
+    bool leading = false;
+    Waiter* followers = nullptr;
+};
+
+struct Slot {
+    std::mutex mtx;
+    Shared* current = nullptr;
+};
+
+struct Mux {
+    std::atomic<unsigned> sockets{0};
+    std::atomic<unsigned> next_slot{0};
+    Slot slots[2][kMaxShared]; // [0] = AF_INET, [1] = AF_INET6
+    InflightTable<Waiter> inflight;
+};
+
+Mux& mux() {
+    static Mux* instance = new Mux(); // never destroyed: a thread may still be sending while static destructors run
+    return *instance;
+}
+
+/* Under the slot mutex: takes `sh` out of service, closing it now if no one is using it. */
+void retire(Slot& slot, Shared* sh) {
+    slot.current = nullptr;
+    sh->retired = true;
+    if(!sh->users) {
+        sock_close(sh->fd);
+        delete sh;
+    }
+}
+
+/* The shared socket this thread sends on; null if there is none to be had. */
+Shared* acquire(int family, Slot*& slot_out) {
+    Mux& m = mux();
+    const unsigned count = m.sockets.load(std::memory_order_relaxed);
+    if(!count) return nullptr;
+    static thread_local unsigned pick = m.next_slot.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = m.slots[family == AF_INET6][pick % count];
+    std::lock_guard<std::mutex> lock(slot.mtx);
+    Shared* sh = slot.current;
+    if(sh && monotonic_ns() - sh->born_ns >= sockpool_max_age_ns()) {
+        retire(slot, sh);
+        sh = nullptr;
+    }
+    if(!sh) {
+        sock_t fd = sockpool_open(family);
+        if(fd == kBadSock) return nullptr;
+        sh = slot.current = new Shared{fd, monotonic_ns()};
+    }
+    ++sh->users;
+    slot_out = &slot;
+    return sh;
+}
+
+void release(Slot& slot, Shared* sh) {
+    std::lock_guard<std::mutex> lock(slot.mtx);
+    if(!--sh->users && sh->retired) {
+        sock_close(sh->fd);
+        delete sh;
+    }
+}
+
+/* Reads `sh` until `self` has its answer or `deadline_ns` passes, handing answers to whoever asked. */
+void lead(Slot& slot, Shared* sh, Waiter& self, uint64_t deadline_ns) {
+    InflightTable<Waiter>& inflight = mux().inflight;
+    u_char buf[kMaxUdpRead];
+    while(!self.done.load(std::memory_order_acquire) && wait_for(sh->fd, POLLIN, deadline_ns)) {
+        for(;;) {
+            sockaddr_storage from;
+            socklen_t fromlen = sizeof(from);
+            const int n = recvfrom(sh->fd, reinterpret_cast<char*>(buf), sizeof(buf), 0,
+                                   reinterpret_cast<sockaddr*>(&from), &fromlen);
+            if(n < 0 && sock_errno() == EINTR) continue;
+            if(n < 0) break; // drained; anything else (e.g. ICMP) concerns no one in particular
+            if(n < kHdrSize) continue;
+            const sockaddr* sa = reinterpret_cast<const sockaddr*>(&from);
+            Waiter* w = inflight.take(inflight_key(sh->fd, rd16(buf + kHdrId), sockaddr_port(sa)), [&](Waiter* w) {
+                w->n = mux_accept(buf, n, sa, w->ns, w->msg, w->msglen, w->answer, w->anslen, w->tsig);
+                return w->n > 0;
+            });
+            if(!w) continue;
+            if(w == &self) {
+                self.done.store(true, std::memory_order_release);
+            } else {
+                std::lock_guard<std::mutex> lock(slot.mtx);
+                w->done.store(true, std::memory_order_release);
+                w->cv.notify_one();
+            }
+        }
+    }
+}
+
+/* Waits for the answer to `w`, reading the socket whenever no one else is. */
+void await(Slot& slot, Shared* sh, Waiter& w, uint64_t key, uint64_t deadline_ns) {
+    using namespace std::chrono;
+    const steady_clock::time_point until{nanoseconds(deadline_ns)};
+    std::unique_lock<std::mutex> lock(slot.mtx);
+    while(!w.done.load(std::memory_order_acquire) && monotonic_ns() < deadline_ns) {
+        if(!sh->leading) {
+            sh->leading = true;
+            lock.unlock();
+            lead(slot, sh, w, deadline_ns);
+            lock.lock();
+            sh->leading = false;
+            if(sh->followers) sh->followers->cv.notify_one(); // the next reader
+            continue;
+        }
+        w.next = sh->followers;
+        if(w.next) w.next->prev = &w;
+        sh->followers = &w;
+        w.cv.wait_until(lock, until);
+        if(w.prev) w.prev->next = w.next;
+        else sh->followers = w.next;
+        if(w.next) w.next->prev = w.prev;
+        w.prev = w.next = nullptr;
+    }
+    if(w.done.load(std::memory_order_acquire)) return;
+    lock.unlock();
+    if(mux().inflight.remove(key, &w)) return; // timed out
+    lock.lock();
+    while(!w.done.load(std::memory_order_acquire)) w.cv.wait(lock); // the reader has just taken it
+}
+
+} // anonymous
+
+int mux_accept(const u_char* buf, int n, const sockaddr* from, const sockaddr* ns, const u_char* msg, int msglen,
+               u_char* answer, int anslen, TsigSession* tsig) {
+    // anything not from the server asked, or not about what was asked, is noise (or an attack)
+    if(!sockaddr_same(from, ns) || !msg_is_reply_to(msg, msglen, buf, n)) return 0;
+    const int keep = std::min(n, anslen);
+    memcpy(answer, buf, keep);
+    if(tsig && tsig->check(answer, keep, true)) return 0;
+    if(n == kMaxUdpRead && keep > kHdrSize) {
+        wr16(answer + kHdrFlags, rd16(answer + kHdrFlags) | kFlagTC); // may have been cut short
+    }
+    return keep;
+}
+
+int mux_send(const sockaddr* ns, const u_char* msg, int msglen, u_char* answer, int anslen, uint64_t deadline_ns,
+             bool& truncated, TsigSession* tsig) {
+    Mux& m = mux();
+    if(!m.sockets.load(std::memory_order_relaxed)) return kSendUnshared;
+    Slot* slot;
+    Shared* sh = acquire(ns->sa_family, slot);
+    if(!sh) return kSendUnshared;
+
+    Waiter w;
+    w.ns = ns;
+    w.msg = msg;
+    w.msglen = msglen;
+    w.answer = answer;
+    w.anslen = anslen;
+    w.tsig = tsig;
+    const unsigned id = rd16(msg + kHdrId);
+    uint64_t key = inflight_key(sh->fd, id, sockaddr_port(ns));
+    bool entered = m.inflight.insert(key, &w);
+    u_char copy[kPacketSz];
+    for(int i = 0; !entered && !tsig && msglen <= kPacketSz && i < kIdRetries; ++i) {
+        // the ID is in flight to this server on this socket already: send a copy under another one
+        if(w.msg == msg) {
+            memcpy(copy, msg, msglen);
+            w.msg = copy;
+        }
+        wr16(copy + kHdrId, res_randomid());
+        key = inflight_key(sh->fd, rd16(copy + kHdrId), sockaddr_port(ns));
+        entered = m.inflight.insert(key, &w);
+    }
+    if(!entered) {
+        release(*slot, sh);
+        return kSendUnshared;
+    }
+
+    StatsServer* stats = stats_server(ns);
+    const uint64_t sent_ns = monotonic_ns();
+    stats_query(stats);
+    if(sendto(sh->fd, reinterpret_cast<const char*>(w.msg), msglen, 0, ns, sockaddr_len(ns)) != msglen
+       && m.inflight.remove(key, &w)) {
+        stats_error(stats);
+        release(*slot, sh);
+        return kSendFailed;
+    }
+    await(*slot, sh, w, key, deadline_ns);
+    release(*slot, sh);
+    if(!w.done.load(std::memory_order_acquire)) {
+        stats_timeout(stats);
+        return kSendTimeout;
+    }
+    if(w.msg != msg) wr16(answer + kHdrId, id);
+    truncated = rd16(answer + kHdrFlags) & kFlagTC;
+    stats_response(stats, monotonic_ns() - sent_ns, truncated);
+    return w.n;
+}
+
+} // resolw_impl
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int resolw_sockpool_share(unsigned sockets) {
+    using namespace resolw_impl;
+    if(sockets > kMaxShared) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    Mux& m = mux();
+    m.sockets.store(sockets, std::memory_order_relaxed);
+    for(auto& family : m.slots) {
+        for(unsigned i = sockets; i < kMaxShared; ++i) {
+            std::lock_guard<std::mutex> lock(family[i].mtx);
+            if(family[i].current) retire(family[i], family[i].current);
+        }
+    }
+    return 0;
+}
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
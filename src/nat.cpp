@@ -0,0 +1,290 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "resolv.h"
+#include "bke.h"
+#include "msg.h"
+#include "neg.h"
+#include "net.h"
+#include "trc.h"
+
+#include <netdb.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+/**
+ * The native backend: queries are built by res_nmkquery(), sent by
+ * res_nsend() to the servers in the resolver state, and their answers
+ * parsed here. Nothing is cached, so every call costs one exchange
+ * (plus failover), and timing follows `retrans` and `retry` exactly.
+ */
+
+namespace resolw_impl {
+
+namespace {
+
+/* The answer buffer of getrrsetbyname(), which (unlike res_nquery()) has no caller-supplied one. */
+u_char* scratch_answer() {
+    static thread_local std::vector<u_char> buf;
+    if(buf.empty()) buf.resize(kMaxAnswer);
+    return buf.data();
+}
+
+/* The length of the answer in scratch_answer() that this thread's last backend_rrset() succeeded with; 0 if it failed. */
+int& scratch_success() {
+    static thread_local int len = 0;
+    return len;
+}
+
+#ifdef RESOLW_HAVE_DNSSEC
+/* The last negative answer of this thread's backend_rrset(), for backend_negative(). */
+std::vector<u_char>& negative_answer() {
+    static thread_local std::vector<u_char> buf;
+    return buf;
+}
+
+/* Learns from a negative answer (with queries of its own, which reuse `answer`) and keeps it. */
+void keep_negative(res_state rs, const u_char* answer, int n) {
+    std::vector<u_char> copy(answer, answer + n);
+    negative_learn(rs, copy.data(), n);
+    negative_answer().swap(copy);
+}
+#endif
+
+/* h_errno for an answer that res_nquery() does not return, or 0 for one it does. */
+int answer_h_errno(const u_char* answer, int len) {
+    if(len < kHdrSize) return NO_RECOVERY;
+    switch(rd16(answer + kHdrFlags) & kRcodeMask) {
+        case kRcodeNoError: return rd16(answer + kHdrAnCount) ? 0 : NO_DATA;
+        case kRcodeNxDomain: return HOST_NOT_FOUND;
+        case kRcodeServFail: return TRY_AGAIN;
+        default: return NO_RECOVERY;
+    }
+}
+
+/* One answer record, as walked by backend_rrset(). */
+struct Rr {
+    const u_char* owner;
+    unsigned type, rdclass;
+    uint32_t ttl;
+    const u_char* rdata;
+    unsigned rdlen;
+};
+
+bool next_rr(const u_char* msg, const u_char* eom, const u_char*& cp, Rr& rr) {
+    int n = msg_skip_name(cp, eom);
+    if(n < 0 || eom - cp - n < 10) return false;
+    rr.owner = cp;
+    cp += n;
+    rr.type = rd16(cp);
+    rr.rdclass = rd16(cp + 2);
+    rr.ttl = rd32(cp + 4);
+    rr.rdlen = rd16(cp + 8);
+    rr.rdata = cp + 10;
+    cp += 10 + rr.rdlen;
+    return cp <= eom;
+}
+
+/* Where the CNAME chain from `qname` ends among the `ancount` answer records at `first`. */
+const u_char* chain_end(const u_char* msg, const u_char* eom, const u_char* first, unsigned ancount, unsigned rdclass,
+                        const u_char* qname) {
+    const u_char* owner = qname;
+    for(unsigned hop = 0; hop < ancount; ++hop) { // one hop per record at most, so that a loop ends too
+        const u_char* cp = first;
+        const u_char* target = nullptr;
+        Rr rr;
+        for(unsigned i = 0; i < ancount && !target && next_rr(msg, eom, cp, rr); ++i) {
+            if(rr.type == T_CNAME && rr.rdclass == rdclass && msg_names_equal(msg, eom, rr.owner, msg, eom, owner)) {
+                target = rr.rdata;
+            }
+        }
+        if(!target) break;
+        owner = target;
+    }
+    return owner;
+}
+
+} // anonymous
+
+int backend_query(res_state rs, const char* dname, int rq_class, int type, u_char* answer, int anslen) {
+    u_char query[kPacketSz];
+    int qlen = res_nmkquery(rs, kOpQuery, dname, rq_class, type, nullptr, 0, nullptr, query, sizeof(query));
+    if(qlen <= 0) {
+        set_h_errno(NO_RECOVERY);
+        return -1;
+    }
+    TraceScope trace(dname, type, rs->id);
+    int n = res_nsend(rs, query, qlen, answer, anslen);
+    if(n < 0) {
+        set_h_errno(TRY_AGAIN);
+        trace.complete(-1, -1);
+        return -1;
+    }
+    int rcode = n >= kHdrSize ? rd16(answer + kHdrFlags) & kRcodeMask : -1;
+    if(int herr = answer_h_errno(answer, n)) {
+        set_h_errno(herr);
+        n = -1;
+    }
+    trace.complete(n, rcode);
+    return n;
+}
+
+int backend_rrset(res_state rs, const char* hostname, unsigned int rdclass, unsigned int rdtype,
+                  struct rrsetinfo** res) {
+    u_char query[kPacketSz];
+    int qlen = res_nmkquery(rs, kOpQuery, hostname, rdclass, rdtype, nullptr, 0, nullptr, query, sizeof(query));
+    int elen = qlen > 0 ? msg_add_opt(query, qlen, sizeof(query), kEdnsPayload, true) : -1; // DO: we want the RRSIGs
+    if(elen < 0) return ERRSET_INVAL;
+    TraceScope trace(hostname, rdtype, rs->id);
+    u_char* const answer = scratch_answer();
+    scratch_success() = 0;
+#ifdef RESOLW_HAVE_DNSSEC
+    negative_answer().clear();
+#endif
+    int n = res_nsend(rs, query, elen, answer, kMaxAnswer);
+    unsigned rcode = n >= kHdrSize ? rd16(answer + kHdrFlags) & kRcodeMask : kRcodeServFail;
+    if(n >= kHdrSize && (rcode == kRcodeFormErr || rcode == kRcodeNotImp)) {
+        n = res_nsend(rs, query, qlen, answer, kMaxAnswer); // a server from before EDNS
+        rcode = n >= kHdrSize ? rd16(answer + kHdrFlags) & kRcodeMask : kRcodeServFail;
+    }
+    int rv = ERRSET_SUCCESS;
+    if(n < kHdrSize) {
+        rv = ERRSET_FAIL;
+    } else if(rcode == kRcodeNxDomain) {
+        rv = ERRSET_NONAME;
+    } else if(rcode != kRcodeNoError) {
+        rv = ERRSET_FAIL;
+    }
+    const u_char* const eom = answer + std::max(n, 0);
+    const u_char* cp = answer + kHdrSize;
+    int skip = rv ? -1 : msg_skip_name(cp, eom);
+    if(!rv && (skip < 0 || eom - cp - skip < 4)) {
+        rv = ERRSET_FAIL;
+    }
+    if(rv) {
+#ifdef RESOLW_HAVE_DNSSEC
+        if(rv == ERRSET_NONAME) keep_negative(rs, answer, n);
+#endif
+        trace.complete(rv, n >= kHdrSize ? (int) rcode : -1);
+        return rv;
+    }
+    cp += skip + 4;
+    const u_char* const first = cp;
+    const unsigned ancount = rd16(answer + kHdrAnCount);
+
+    // first pass: sizes; the RRset's owner is the name the CNAME chain (if any) ends at
+    struct rrsetinfo retval = {};
+    retval.rri_rdclass = rdclass;
+    retval.rri_rdtype = rdtype;
+    retval.rri_ttl = 0xffffffffu;
+    if(rd16(answer + kHdrFlags) & kFlagAD) {
+        retval.rri_flags |= RRSET_VALIDATED;
+    }
+    const u_char* const qname = answer + kHdrSize;
+    const u_char* const owner = rdtype == T_CNAME ? qname : chain_end(answer, eom, first, ancount, rdclass, qname);
+    size_t datasz = 0, sigssz = 0;
+    Rr rr;
+    for(unsigned i = 0; i < ancount; ++i) {
+        if(!next_rr(answer, eom, cp, rr)) {
+            trace.complete(ERRSET_FAIL, rcode);
+            return ERRSET_FAIL;
+        }
+        if(rr.rdclass != rdclass || !msg_names_equal(answer, eom, rr.owner, answer, eom, owner)) continue;
+        if(rr.type == rdtype) {
+            int len = msg_unpack_rdata(answer, eom, rr.type, rr.rdata, rr.rdlen, nullptr, 0);
+            if(len < 0) {
+                trace.complete(ERRSET_FAIL, rcode);
+                return ERRSET_FAIL;
+            }
+            retval.rri_nrdatas++;
+            retval.rri_ttl = std::min(retval.rri_ttl, (unsigned) rr.ttl);
+            datasz += len;
+        } else if(rr.type == T_RRSIG && rr.rdlen >= 2 && rd16(rr.rdata) == rdtype) {
+            retval.rri_nsigs++;
+            sigssz += rr.rdlen;
+        }
+    }
+    char name[MAXDNAME];
+    if(!retval.rri_nrdatas || msg_expand_name(answer, eom, owner, name, sizeof(name)) < 0) {
+        rv = retval.rri_nrdatas ? ERRSET_FAIL : ERRSET_NODATA;
+#ifdef RESOLW_HAVE_DNSSEC
+        if(rv == ERRSET_NODATA) keep_negative(rs, answer, n);
+#endif
+        trace.complete(rv, rcode);
+        return rv;
+    }
+
+    // second pass: copies, in the layout freerrset() expects
+    const size_t namesz = strlen(name) + 1;
+    char* head = static_cast<char*>(malloc(sizeof(struct rrsetinfo) + namesz));
+    u_char* data_block = static_cast<u_char*>(malloc(retval.rri_nrdatas * sizeof(struct rdatainfo) + datasz));
+    u_char* sigs_block = static_cast<u_char*>(malloc(retval.rri_nsigs * sizeof(struct rdatainfo) + sigssz));
+    if(!head || !data_block || !sigs_block) {
+        free(head);
+        free(data_block);
+        free(sigs_block);
+        trace.complete(ERRSET_NOMEMORY, rcode);
+        return ERRSET_NOMEMORY;
+    }
+    retval.rri_name = head + sizeof(struct rrsetinfo);
+    memcpy(retval.rri_name, name, namesz);
+    retval.rri_rdatas = reinterpret_cast<struct rdatainfo*>(data_block);
+    retval.rri_sigs = reinterpret_cast<struct rdatainfo*>(sigs_block);
+    data_block += retval.rri_nrdatas * sizeof(struct rdatainfo);
+    u_char* const data_end = data_block + datasz;
+    sigs_block += retval.rri_nsigs * sizeof(struct rdatainfo);
+    unsigned di = 0, si = 0;
+    cp = first;
+    for(unsigned i = 0; i < ancount; ++i) {
+        next_rr(answer, eom, cp, rr);
+        if(rr.rdclass != rdclass || !msg_names_equal(answer, eom, rr.owner, answer, eom, owner)) continue;
+        if(rr.type == rdtype) {
+            // names expanded, so that the rdata stands on its own
+            struct rdatainfo& rd = retval.rri_rdatas[di++];
+            rd.rdi_data = data_block;
+            rd.rdi_length = msg_unpack_rdata(answer, eom, rr.type, rr.rdata, rr.rdlen, data_block, data_end - data_block);
+            data_block += rd.rdi_length;
+        } else if(rr.type == T_RRSIG && rr.rdlen >= 2 && rd16(rr.rdata) == rdtype) {
+            struct rdatainfo& rd = retval.rri_sigs[si++];
+            rd.rdi_data = sigs_block;
+            rd.rdi_length = rr.rdlen;
+            memcpy(rd.rdi_data, rr.rdata, rr.rdlen); // the signer's name is never compressed
+            sigs_block += rr.rdlen;
+        }
+    }
+    *res = reinterpret_cast<struct rrsetinfo*>(head);
+    **res = retval;
+    scratch_success() = n;
+    trace.complete(ERRSET_SUCCESS, rcode);
+    return ERRSET_SUCCESS;
+}
+
+int backend_answer(const u_char** msg) {
+    *msg = scratch_answer();
+    return scratch_success();
+}
+
+int backend_negative(const u_char** msg) {
+#ifdef RESOLW_HAVE_DNSSEC
+    *msg = negative_answer().data();
+    return (int) negative_answer().size();
+#else
+    *msg = nullptr;
+    return 0;
+#endif
+}
+
+} // resolw_impl
@@ -1,13 +1,34 @@
 #include <netdb.h>
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm> // std::min
 #include <limits>
 #include <vector>
+#include "bke.h"
 #include "dns.h"
+#include "msg.h" // T_RRSIG
+#include "net.h" // monotonic_ns
 
 namespace {
 
 using namespace resolw_impl;
 
+constexpr std::size_t kMaxRdata = 65535;
+
+/* Where write_rdata() measures records before resolw_parserrs() allocates for them. */
+u_char* scratch_rdata() {
+    static thread_local std::vector<u_char> buf;
+    if(buf.empty()) buf.resize(kMaxRdata);
+    return buf.data();
+}
+
+/* What the record contributes to the RRset: 1 for rdata, 2 for a signature, 0 for nothing. */
+int rrset_part(const DNS_RECORD* rec, unsigned int rdtype) {
+    if(rec->wType == rdtype) return 1;
+    if(rec->wType == T_RRSIG && rec->Data.SIG.wTypeCovered == rdtype) return 2;
+    return 0;
+}
+
 int resolw_parserrs(struct rrsetinfo ** res, const char* hostname, unsigned int rdclass, unsigned int rdtype, unsigned int options, DNS_RECORDA* recs) {
     struct rrsetinfo retval = {};
     retval.rri_rdclass = rdclass;
@@ -16,27 +37,26 @@ int resolw_parserrs(struct rrsetinfo ** res, const char* hostname, unsigned int
     if(!(options & (RES_INSECURE1 | RES_INSECURE2))) {
         retval.rri_flags |= RRSET_VALIDATED;
     }
-    std::string cname = hostname;
-    DNS_RECORD* dnsrec = recs;
-    // TODO refactor and de-duplicate
+    const char* cname = hostname; // points into `recs` once a CNAME is seen
+    // first pass: sizes of the rdata in wire format; records that have none are left out
+    u_char* const scratch = scratch_rdata();
     std::size_t datasz = 0u;
     std::size_t sigssz = 0u;
-    while(dnsrec) {
-        if(dnsrec->wType == rdtype) {
-            // answer
+    for(DNS_RECORD* dnsrec = recs; dnsrec; dnsrec = dnsrec->pNext) {
+        if(dnsrec->wType == T_CNAME) {
+            cname = dnsrec->Data.CNAME.pNameHost; // wDataLength is that of DNS_PTR_DATA, not of the name
+        }
+        int part = rrset_part(dnsrec, rdtype);
+        int len = part ? write_rdata(dnsrec, scratch, scratch + kMaxRdata) : -1;
+        if(len < 0) continue;
+        if(part == 1) {
             retval.rri_nrdatas++;
             retval.rri_ttl = std::min(retval.rri_ttl, (unsigned int) dnsrec->dwTtl);
-            datasz += dnsrec->wDataLength;
-        }
-        if(dnsrec->wType == T_RRSIG) {
-            // signature
+            datasz += len;
+        } else {
             retval.rri_nsigs++;
-            sigssz += dnsrec->wDataLength;
+            sigssz += len;
         }
-        if(dnsrec->wType == T_CNAME) {
-            cname.assign(dnsrec->Data.CNAME.pNameHost, dnsrec->Data.CNAME.pNameHost + dnsrec->wDataLength);
-        }
-        dnsrec = dnsrec->pNext;
     }
     // TODO handle ERRSET_NODATA here
 
@@ -46,66 +66,79 @@ int resolw_parserrs(struct rrsetinfo ** res, const char* hostname, unsigned int
     unsigned char* sigs_block = static_cast<unsigned char*>(malloc(sigssz + msigsz));
     retval.rri_rdatas = reinterpret_cast<struct rdatainfo *>(data_block);
     retval.rri_sigs = reinterpret_cast<struct rdatainfo *>(sigs_block);
-    dnsrec = recs;
     data_block += metasz;
     sigs_block += msigsz;
+    unsigned char* const data_end = data_block + datasz;
+    unsigned char* const sigs_end = sigs_block + sigssz;
+    // second pass: the same records, written in place
     std::size_t di = 0u, si = 0u;
-    while(dnsrec) {
-        if(dnsrec->wType == rdtype) {
-            struct rdatainfo &rd = retval.rri_sigs[di++];
+    for(DNS_RECORD* dnsrec = recs; dnsrec; dnsrec = dnsrec->pNext) {
+        int part = rrset_part(dnsrec, rdtype);
+        if(part == 1) {
+            int len = write_rdata(dnsrec, data_block, data_end);
+            if(len < 0) continue;
+            struct rdatainfo &rd = retval.rri_rdatas[di++];
             rd.rdi_data = data_block;
-            rd.rdi_length = dnsrec->wDataLength;
-            memcpy(rd.rdi_data, &dnsrec->Data, rd.rdi_length);
-            data_block += rd.rdi_length;
-        }
-        if(dnsrec->wType == T_RRSIG) {
+            rd.rdi_length = len;
+            data_block += len;
+        } else if(part == 2) {
+            int len = write_rdata(dnsrec, sigs_block, sigs_end);
+            if(len < 0) continue;
             struct rdatainfo &rd = retval.rri_sigs[si++];
             rd.rdi_data = sigs_block;
-            rd.rdi_length = dnsrec->wDataLength;
-            memcpy(rd.rdi_data, &dnsrec->Data, rd.rdi_length);
-            sigs_block += rd.rdi_length;
+            rd.rdi_length = len;
+            sigs_block += len;
         }
-        // MOREINFO how is pDataPtr treated?
-        dnsrec = dnsrec->pNext;
     }
-    // free incoming data
-    DnsRecordListFree(recs, DnsFreeRecordList);
     // copy, transfer ownership:
-    char* with_cname = static_cast<char*>(malloc(sizeof(struct rrsetinfo) + cname.size() + 1));
+    std::size_t cnamesz = strlen(cname) + 1;
+    char* with_cname = static_cast<char*>(malloc(sizeof(struct rrsetinfo) + cnamesz));
     *res = reinterpret_cast<struct rrsetinfo*>(with_cname);
-    memcpy(with_cname + sizeof(struct rrsetinfo), cname.c_str(), cname.size() + 1);
+    memcpy(with_cname + sizeof(struct rrsetinfo), cname, cnamesz);
     (**res) = retval;
+    (*res)->rri_name = with_cname + sizeof(struct rrsetinfo);
+    // free incoming data (`cname` with it)
+    DnsRecordListFree(recs, DnsFreeRecordList);
     return ERRSET_SUCCESS;
 }
 
 } // anonymous
 
-/* __BEGIN_DECLS */
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-int getrrsetbyname(const char *hostname, unsigned int rdclass, unsigned int rdtype, unsigned int flags, struct rrsetinfo **res)
-{
-    if(flags) return ERRSET_INVAL;
-    if(!hostname || !*hostname) return ERRSET_INVAL;
+namespace resolw_impl {
 
+int backend_rrset(res_state rs, const char* hostname, unsigned int rdclass, unsigned int rdtype,
+                  struct rrsetinfo** res) {
     ImplPolicies pol;
-    auto opts = _res.options;
+    auto opts = rs->options;
     ULONG qo = to_query_opts(opts, &pol);
     qo |= DNS_QUERY_RETURN_MESSAGE;
+    TraceScope trace(hostname, rdtype, 0);
+    int rcode = -1;
 #ifdef DNS_ADDR_MAX_SOCKADDR_LENGTH // newer Win8+ API
     if(IsWindows8OrGreater()) {
-        std::wstring wdname = to_win_str(hostname, strlen(hostname));
+        wchar_t wdname[MAXDNAME + 1];
+        if(!to_win_str(hostname, strlen(hostname), wdname, MAXDNAME + 1)) {
+            trace.complete(ERRSET_INVAL, rcode);
+            return ERRSET_INVAL;
+        }
         constexpr std::size_t maxBytes = sizeof(DNS_ADDR_ARRAY) + MAXNS * sizeof(DNS_ADDR);
-        std::vector<char> nsbuf(maxBytes, 0);
-        DNS_ADDR_ARRAY* nsadd = reinterpret_cast<DNS_ADDR_ARRAY*>(nsbuf.data());
+        alignas(DNS_ADDR_ARRAY) char nsbuf[maxBytes] = {};
+        DNS_ADDR_ARRAY* nsadd = reinterpret_cast<DNS_ADDR_ARRAY*>(nsbuf);
         nsadd->MaxCount = maxBytes;
         DNS_QUERY_REQUEST req;
         DNS_QUERY_RESULT resp;
-        resolw_nprep(&_res, wdname.c_str(), rdclass, rdtype, qo, nsadd, &req);
-        if(ERROR_SUCCESS == DnsQueryEx(&req, &resp, nullptr)) {
-            return resolw_parserrs(res, hostname, rdclass, rdtype, opts, resp.pQueryRecords);
+        resolw_nprep(rs, wdname, rdclass, rdtype, qo, nsadd, &req);
+        trace.event(RESOLW_TRACE_SERVER_SEND, nullptr, 0, -1, 0);
+        uint64_t started = monotonic_ns();
+        DNS_STATUS status = DnsQueryEx(&req, &resp, nullptr);
+        rcode = stats_win_status(status, started);
+        if(rcode >= 0) {
+            trace.event(RESOLW_TRACE_RESPONSE, nullptr, 0, rcode, 0);
+        }
+        if(ERROR_SUCCESS == status) {
+            int rv = resolw_parserrs(res, hostname, rdclass, rdtype, opts, resp.pQueryRecords);
+            trace.complete(rv, rcode);
+            return rv;
         }
     } else
 #endif
@@ -113,31 +146,35 @@ int getrrsetbyname(const char *hostname, unsigned int rdclass, unsigned int rdty
         // fall back to DnsQuery_UTF8
         DNS_RECORDA* recs = nullptr;
         constexpr std::size_t maxBytes = sizeof(IP4_ARRAY) + (MAXNS - 1) * sizeof(IP4_ADDRESS);
-        std::vector<char> nsbuf(maxBytes, 0);
-        IP4_ARRAY* srvs = reinterpret_cast<IP4_ARRAY*>(nsbuf.data());
-        if(DnsQuery_UTF8(hostname, rdtype, qo, srvs, &recs, nullptr)) {
-            return resolw_parserrs(res, hostname, rdclass, rdtype, opts, recs);
+        alignas(IP4_ARRAY) char nsbuf[maxBytes] = {};
+        IP4_ARRAY* srvs = reinterpret_cast<IP4_ARRAY*>(nsbuf);
+        trace.event(RESOLW_TRACE_SERVER_SEND, nullptr, 0, -1, 0);
+        uint64_t started = monotonic_ns();
+        DNS_STATUS status = DnsQuery_UTF8(hostname, rdtype, qo, srvs, &recs, nullptr);
+        rcode = stats_win_status(status, started);
+        if(rcode >= 0) {
+            trace.event(RESOLW_TRACE_RESPONSE, nullptr, 0, rcode, 0);
+        }
+        if(ERROR_SUCCESS == status) {
+            int rv = resolw_parserrs(res, hostname, rdclass, rdtype, opts, recs);
+            trace.complete(rv, rcode);
+            return rv;
         }
     }
 
     // TODO handle ERRSET_NONAME
+    trace.complete(ERRSET_FAIL, rcode);
     return ERRSET_FAIL;
 }
 
-void freerrset(struct rrsetinfo *rrset)
-{
-    if(rrset) {
-        if(rrset->rri_nrdatas && rrset->rri_rdatas) {
-            free(rrset->rri_rdatas);
-        }
-        if(rrset->rri_nsigs && rrset->rri_sigs) {
-            free(rrset->rri_sigs);
-        }
-        free(rrset);
-    }
+int backend_negative(const u_char** msg) {
+    *msg = nullptr;
+    return 0; // DnsQuery() keeps the authority section to itself
 }
 
-/* __END_DECLS */
-#ifdef __cplusplus
+int backend_answer(const u_char** msg) {
+    *msg = nullptr;
+    return 0; // likewise
 }
-#endif
\ No newline at end of file
+
+} // resolw_impl
@@ -0,0 +1,538 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "resolv.h"
+#include "resolw/resolw_dnssec.h"
+
+#ifdef RESOLW_HAVE_DNSSEC
+
+#include "msg.h"
+#include "neg.h"
+#include "net.h"
+#include "sec.h"
+#include "sts.h"
+#include "trc.h"
+
+#include <netdb.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
+
+/**
+ * Aggressive use of DNSSEC-validated cache (RFC 8198). The NSEC and NSEC3
+ * records that come with negative answers are validated and kept as
+ * ranges per zone: NSEC ranges in a map ordered canonically (RFC 4034
+ * section 6.1), NSEC3 ranges in a map ordered by hash, which is the
+ * canonical order of their owner names. A later name that falls inside
+ * a range (and whose wildcard does too) is denied without a query; so is
+ * a type missing from the bitmap of a name's own record.
+ *
+ * Records come from the native backend's getrrsetbyname(), which asks
+ * with the DO bit; answers are synthesized for res_nquery() as well.
+ */
+
+namespace {
+
+using namespace resolw_impl;
+
+constexpr size_t kMaxRanges = 16384; // across zones; the cache starts over when it fills up
+constexpr unsigned kMaxIterations = 150; // RFC 9276 section 3.2: beyond this, NSEC3 is not worth trusting
+constexpr unsigned kNsec3Sha1 = 1;
+constexpr unsigned kNsec3OptOut = 0x01;
+
+typedef std::array<u_char, 20> Hash; // SHA-1, the only NSEC3 hash there is
+
+/* RFC 4034 section 6.1: label by label from the root, as octets; the name with fewer labels first. */
+int canonical_compare(const u_char* a, const u_char* b) {
+    const u_char* la[128];
+    const u_char* lb[128];
+    int na = 0, nb = 0;
+    for(; *a; a += *a + 1) la[na++] = a;
+    for(; *b; b += *b + 1) lb[nb++] = b;
+    while(na && nb) {
+        const u_char* x = la[--na];
+        const u_char* y = lb[--nb];
+        int c = memcmp(x + 1, y + 1, std::min(*x, *y));
+        if(c) return c;
+        if(*x != *y) return *x < *y ? -1 : 1;
+    }
+    return na - nb;
+}
+
+struct CanonicalLess {
+    bool operator()(const Wire& a, const Wire& b) const { return canonical_compare(a.data(), b.data()) < 0; }
+};
+
+/* RFC 4034 section 4.1.2. */
+bool has_type(const std::vector<u_char>& bitmap, unsigned type) {
+    const unsigned window = type >> 8, bit = type & 0xff;
+    for(size_t i = 0; i + 2 <= bitmap.size(); ) {
+        const unsigned w = bitmap[i], len = bitmap[i + 1];
+        if(i + 2 + len > bitmap.size()) return false;
+        if(w == window) return bit / 8 < len && (bitmap[i + 2 + bit / 8] & (0x80 >> (bit % 8)));
+        i += 2 + len;
+    }
+    return false;
+}
+
+/* A zone cut, seen from above: the records below it are the child zone's. */
+bool delegation(const std::vector<u_char>& types) {
+    return has_type(types, T_NS) && !has_type(types, T_SOA);
+}
+
+/* Whether the record of an existing name denies `type` there. */
+bool nodata(const std::vector<u_char>& types, unsigned type) {
+    return !has_type(types, type) && !has_type(types, T_CNAME) && (type == T_DS || !delegation(types));
+}
+
+bool in_range(int owner_vs_next, int owner_vs_name, int name_vs_next) {
+    return owner_vs_next < 0 ? owner_vs_name < 0 && name_vs_next < 0 // owner < name < next
+                             : owner_vs_name < 0 || name_vs_next < 0; // the last range, which wraps around
+}
+
+struct NsecRange {
+    Wire next;
+    std::vector<u_char> types;
+    uint64_t expires_ns;
+};
+
+struct Nsec3Range {
+    Hash next;
+    std::vector<u_char> types;
+    uint64_t expires_ns;
+    bool opt_out;
+};
+
+typedef std::map<Wire, NsecRange, CanonicalLess> NsecZone;
+
+struct Nsec3Zone {
+    std::vector<u_char> salt;
+    unsigned iterations = 0;
+    std::map<Hash, Nsec3Range> ranges;
+};
+
+struct Cache {
+    std::mutex lock;
+    std::map<Wire, NsecZone> nsec; // by zone apex
+    std::map<Wire, Nsec3Zone> nsec3;
+    std::atomic<size_t> ranges{0}; // written under `lock`; read without it to skip lookups while there are none
+    std::atomic<bool> aggressive{true};
+};
+
+Cache& cache() {
+    static Cache* instance = new Cache(); // never destroyed: lookups may outlive static destruction
+    return *instance;
+}
+
+/* The ancestor of `name` with `keep` labels, below a wildcard label. */
+Wire wildcard(const u_char* name, int keep) {
+    const u_char* ce = wire_suffix(name, keep);
+    const int len = wire_len(ce);
+    Wire w(2 + len); // sized up front: GCC 12 -O2 misreads an insert() into a two-byte vector as an overflow
+    w[0] = 1;
+    w[1] = '*';
+    std::copy(ce, ce + len, w.begin() + 2);
+    return w;
+}
+
+/* The number of trailing labels `a` and `b` share. */
+int common_labels(const u_char* a, const u_char* b) {
+    int na = wire_labels(a), nb = wire_labels(b), n = std::min(na, nb);
+    while(n > 0) {
+        const u_char* x = wire_suffix(a, n);
+        if(!memcmp(x, wire_suffix(b, n), wire_len(x))) break;
+        --n;
+    }
+    return n;
+}
+
+/* The unexpired range that starts at or before `n`, if any. */
+NsecZone::const_iterator nsec_covering(const NsecZone& ranges, const Wire& n, uint64_t now) {
+    auto it = ranges.upper_bound(n);
+    if(it == ranges.begin()) return ranges.end();
+    --it;
+    return it->second.expires_ns > now ? it : ranges.end();
+}
+
+/* Whether `n` lies strictly between the ends of range `r`. */
+bool nsec_covers(const NsecZone::value_type& r, const Wire& n) {
+    return in_range(canonical_compare(r.first.data(), r.second.next.data()),
+                    canonical_compare(r.first.data(), n.data()), canonical_compare(n.data(), r.second.next.data()));
+}
+
+/* RFC 4035 section 5.4, RFC 8198 section 5.1. */
+int nsec_deny(const NsecZone& ranges, const Wire& q, unsigned type, uint64_t now) {
+    auto it = nsec_covering(ranges, q, now);
+    if(it == ranges.end()) return 0;
+    if(it->first == q) return nodata(it->second.types, type) ? ERRSET_NODATA : 0;
+    if(!nsec_covers(*it, q)) return 0;
+    if(wire_under(q.data(), it->first.data()) && (delegation(it->second.types) || has_type(it->second.types, T_DNAME))) {
+        return 0; // not this zone's to deny
+    }
+    // the closest encloser is the longer of the ancestors `q` shares with either end of the range
+    const int ce = std::max(common_labels(q.data(), it->first.data()), common_labels(q.data(), it->second.next.data()));
+    const Wire star = wildcard(q.data(), ce);
+    auto w = nsec_covering(ranges, star, now);
+    if(w == ranges.end()) return 0;
+    if(w->first == star) return nodata(w->second.types, type) ? ERRSET_NODATA : 0;
+    return nsec_covers(*w, star) ? ERRSET_NONAME : 0;
+}
+
+/* RFC 5155 section 5. */
+bool nsec3_hash(const u_char* name, const Nsec3Zone& z, Hash& out) {
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    bool ok = ctx && EVP_DigestInit_ex(ctx, EVP_sha1(), nullptr) == 1
+            && EVP_DigestUpdate(ctx, name, wire_len(name)) == 1
+            && EVP_DigestUpdate(ctx, z.salt.data(), z.salt.size()) == 1
+            && EVP_DigestFinal_ex(ctx, out.data(), nullptr) == 1;
+    for(unsigned i = 0; ok && i < z.iterations; ++i) {
+        ok = EVP_DigestInit_ex(ctx, EVP_sha1(), nullptr) == 1
+            && EVP_DigestUpdate(ctx, out.data(), out.size()) == 1
+            && EVP_DigestUpdate(ctx, z.salt.data(), z.salt.size()) == 1
+            && EVP_DigestFinal_ex(ctx, out.data(), nullptr) == 1;
+    }
+    EVP_MD_CTX_free(ctx);
+    return ok;
+}
+
+/**
+ * RFC 5155 sections 8.4 to 8.7, without opt-out ranges (RFC 8198 section
+ * 5.2) unless `opt_out`: then an opt-out range over the next closer name
+ * of a DS query proves an unsigned delegation (section 8.6).
+ */
+/* The unexpired range whose owner hashes `name`, if any. */
+const Nsec3Range* nsec3_match(const Nsec3Zone& z, const u_char* name, uint64_t now) {
+    Hash h;
+    if(!nsec3_hash(name, z, h)) return nullptr;
+    auto it = z.ranges.find(h);
+    return it != z.ranges.end() && it->second.expires_ns > now ? &it->second : nullptr;
+}
+
+/* The unexpired range the hash of `name` falls strictly inside, if any; an opt-out one only if `opt_out_ok`. */
+const Nsec3Range* nsec3_cover(const Nsec3Zone& z, const u_char* name, uint64_t now, bool opt_out_ok) {
+    Hash h;
+    if(z.ranges.empty() || !nsec3_hash(name, z, h)) return nullptr;
+    auto it = z.ranges.upper_bound(h);
+    it = it == z.ranges.begin() ? std::prev(z.ranges.end()) : std::prev(it);
+    const Hash& owner = it->first;
+    const Nsec3Range& r = it->second;
+    if(r.expires_ns <= now || (r.opt_out && !opt_out_ok) || owner == h) return nullptr;
+    auto cmp = [](const Hash& a, const Hash& b) { return memcmp(a.data(), b.data(), a.size()); };
+    return in_range(cmp(owner, r.next), cmp(owner, h), cmp(h, r.next)) ? &r : nullptr;
+}
+
+int nsec3_deny(const Nsec3Zone& z, const Wire& zone, const Wire& q, unsigned type, uint64_t now, bool opt_out) {
+    if(const Nsec3Range* m = nsec3_match(z, q.data(), now)) return nodata(m->types, type) ? ERRSET_NODATA : 0;
+    const int zone_labels = wire_labels(zone.data());
+    for(int keep = wire_labels(q.data()) - 1; keep >= zone_labels; --keep) {
+        const Nsec3Range* ce = nsec3_match(z, wire_suffix(q.data(), keep), now);
+        if(!ce) continue;
+        if(delegation(ce->types) || has_type(ce->types, T_DNAME)) return 0;
+        const Nsec3Range* next_closer = nsec3_cover(z, wire_suffix(q.data(), keep + 1), now, opt_out && type == T_DS);
+        if(!next_closer) return 0;
+        if(next_closer->opt_out) return ERRSET_NODATA;
+        const Wire star = wildcard(q.data(), keep);
+        if(const Nsec3Range* w = nsec3_match(z, star.data(), now)) return nodata(w->types, type) ? ERRSET_NODATA : 0;
+        return nsec3_cover(z, star.data(), now, false) ? ERRSET_NONAME : 0;
+    }
+    return 0;
+}
+
+/* The 20 bytes base32hex spells in the first label of an NSEC3 owner (RFC 4648 section 7). */
+bool owner_hash(const u_char* label, Hash& out) {
+    if(*label != 32) return false;
+    uint32_t acc = 0;
+    int bits = 0;
+    size_t n = 0;
+    for(int i = 1; i <= 32; ++i) {
+        const u_char c = label[i];
+        unsigned v;
+        if(c >= '0' && c <= '9') v = c - '0';
+        else if(c >= 'a' && c <= 'v') v = c - 'a' + 10;
+        else return false;
+        acc = acc << 5 | v;
+        bits += 5;
+        if(bits >= 8) {
+            out[n++] = acc >> (bits - 8);
+            bits -= 8;
+        }
+    }
+    return n == out.size();
+}
+
+struct Rr {
+    Wire owner;
+    unsigned type;
+    uint32_t ttl;
+    std::vector<u_char> rdata;
+};
+
+/* The authority section of `msg`, owners expanded and lowercased; false if the message is malformed. */
+bool authority(const u_char* msg, const u_char* eom, std::vector<Rr>& out) {
+    const u_char* cp = msg + kHdrSize;
+    for(unsigned q = rd16(msg + kHdrQdCount); q; --q) {
+        int skip = msg_skip_name(cp, eom);
+        if(skip < 0 || eom - cp < skip + 4) return false;
+        cp += skip + 4;
+    }
+    const unsigned an = rd16(msg + kHdrAnCount), ns = rd16(msg + kHdrNsCount);
+    for(unsigned i = 0; i < an + ns; ++i) {
+        u_char owner[MAXCDNAME];
+        int written = 0;
+        int skip = msg_unpack_name(msg, eom, cp, i < an ? nullptr : owner, sizeof(owner), &written);
+        if(skip < 0 || eom - cp < skip + 10) return false;
+        cp += skip;
+        const unsigned rdlen = rd16(cp + 8);
+        if(eom - cp - 10 < (int) rdlen) return false;
+        if(i >= an && rd16(cp + 2) == C_IN) {
+            wire_lower(owner);
+            out.push_back(Rr{Wire(owner, owner + written), rd16(cp), rd32(cp + 4), std::vector<u_char>(cp + 10, cp + 10 + rdlen)});
+        }
+        cp += 10 + rdlen;
+    }
+    return true;
+}
+
+/* Files one validated NSEC or NSEC3 record of `zone`; the caller holds the lock. */
+void insert(Cache& c, const Wire& zone, const Wire& owner, unsigned type, const std::vector<u_char>& rd, uint64_t expires) {
+    const u_char* p = rd.data();
+    const u_char* const end = p + rd.size();
+    if(type == T_NSEC) {
+        int n = msg_check_name(nullptr, nullptr, p, end);
+        if(n < 0) return;
+        Wire next(p, p + n);
+        wire_lower(next.data());
+        if(!wire_under(next.data(), zone.data())) return;
+        NsecRange& r = c.nsec[zone][owner];
+        c.ranges += r.types.empty();
+        r = NsecRange{next, std::vector<u_char>(p + n, end), expires};
+        return;
+    }
+    // NSEC3: hash algorithm, flags, iterations, salt, next hashed owner, types; the owner is the hash under the apex
+    Hash hash, next;
+    if(end - p < 5 || p[0] != kNsec3Sha1 || rd16(p + 2) > kMaxIterations) return;
+    const unsigned salt_len = p[4];
+    if(end - p < 6 + (int) salt_len || p[5 + salt_len] != next.size() || end - p < 6 + (int) (salt_len + next.size())) return;
+    if(!owner_hash(owner.data(), hash) || owner.data() + 1 + 32 != wire_suffix(owner.data(), wire_labels(zone.data()))
+            || memcmp(owner.data() + 33, zone.data(), zone.size())) {
+        return;
+    }
+    memcpy(next.data(), p + 6 + salt_len, next.size());
+    Nsec3Zone& z = c.nsec3[zone];
+    std::vector<u_char> salt(p + 5, p + 5 + salt_len);
+    if(z.salt != salt || z.iterations != rd16(p + 2)) { // the zone was re-salted; the old chain is gone
+        c.ranges -= std::min<size_t>(c.ranges, z.ranges.size());
+        z.ranges.clear();
+        z.salt = salt;
+        z.iterations = rd16(p + 2);
+    }
+    Nsec3Range& r = z.ranges[hash];
+    c.ranges += r.types.empty();
+    r = Nsec3Range{next, std::vector<u_char>(p + 6 + salt_len + next.size(), end), expires, (p[1] & kNsec3OptOut) != 0};
+}
+
+/**
+ * What the denials of the closest enclosing zone with any on file in `c`
+ * make of `q`/`type`; `known` tells whether there was such a zone. A DS
+ * set is the parent's to deny, so the search starts above `q` for one.
+ * The caller holds the lock.
+ */
+int deny(const Cache& c, const Wire& q, unsigned type, uint64_t now, bool opt_out, bool& known) {
+    const u_char* a = q.data();
+    if(type == T_DS && *a) a += *a + 1;
+    for(;; a += *a + 1) {
+        const Wire zone(a, a + wire_len(a));
+        auto n = c.nsec.find(zone);
+        if(n != c.nsec.end()) {
+            known = true;
+            return nsec_deny(n->second, q, type, now);
+        }
+        auto n3 = c.nsec3.find(zone);
+        if(n3 != c.nsec3.end()) {
+            known = true;
+            return nsec3_deny(n3->second, zone, q, type, now, opt_out);
+        }
+        if(!*a) return 0;
+    }
+}
+
+/**
+ * RFC 4035 section 5.3.4, RFC 5155 section 8.8: whether the denials in
+ * `c` show that `q`, answered from the wildcard below its ancestor with
+ * `source` labels, has no closer match. With NSEC, a range covers `q`
+ * and leaves that ancestor its closest encloser; with NSEC3, a range
+ * that is not opt-out covers the next closer name. The caller holds the
+ * lock.
+ */
+bool no_closer_match(const Cache& c, const Wire& q, int source, uint64_t now) {
+    if(source >= wire_labels(q.data())) return false;
+    for(const u_char* a = q.data();; a += *a + 1) {
+        const Wire zone(a, a + wire_len(a));
+        auto n = c.nsec.find(zone);
+        if(n != c.nsec.end()) {
+            auto it = nsec_covering(n->second, q, now);
+            if(it == n->second.end() || it->first == q || !nsec_covers(*it, q)) return false;
+            const int ce = std::max(common_labels(q.data(), it->first.data()), common_labels(q.data(), it->second.next.data()));
+            return ce == source;
+        }
+        auto n3 = c.nsec3.find(zone);
+        if(n3 != c.nsec3.end()) {
+            return source >= wire_labels(zone.data())
+                && nsec3_cover(n3->second, wire_suffix(q.data(), source + 1), now, false) != nullptr;
+        }
+        if(!*a) return false;
+    }
+}
+
+/* Validates the NSEC and NSEC3 RRsets among `rrs`, from the authority section of a negative answer, and files them in `c`. */
+void learn(res_state rs, Cache& c, std::vector<Rr>& rrs, int depth) {
+    // RFC 8198 section 5.4 (and RFC 9077): no longer than the SOA's negative TTL either
+    uint32_t negative_ttl = UINT32_MAX;
+    for(const Rr& rr : rrs) {
+        if(rr.type == T_SOA && rr.rdata.size() >= 20) {
+            negative_ttl = std::min({negative_ttl, rr.ttl, rd32(rr.rdata.data() + rr.rdata.size() - 4)});
+        }
+    }
+    for(size_t i = 0; i < rrs.size(); ++i) {
+        const Rr& head = rrs[i];
+        if(head.type != T_NSEC && head.type != T_NSEC3) continue;
+        bool first = true; // one validation per RRset
+        for(size_t k = 0; k < i && first; ++k) first = rrs[k].type != head.type || rrs[k].owner != head.owner;
+        if(!first) continue;
+        std::vector<rdatainfo> rdatas, sigs;
+        uint32_t ttl = UINT32_MAX;
+        for(Rr& rr : rrs) {
+            if(rr.owner != head.owner) continue;
+            if(rr.type == head.type) {
+                rdatas.push_back(rdatainfo{(unsigned) rr.rdata.size(), rr.rdata.data()});
+                ttl = std::min(ttl, rr.ttl);
+            } else if(rr.type == T_RRSIG && rr.rdata.size() >= 2 && rd16(rr.rdata.data()) == head.type) {
+                sigs.push_back(rdatainfo{(unsigned) rr.rdata.size(), rr.rdata.data()});
+            }
+        }
+        if(sigs.empty()) continue;
+        DnssecVerdict v = dnssec_check_rrset(rs, head.owner.data(), head.type, C_IN, ttl,
+                                             rdatas.data(), rdatas.size(), sigs.data(), sigs.size(), depth);
+        if(v.status != RESOLW_DNSSEC_SECURE || v.wildcard || !wire_under(head.owner.data(), v.signer.data())) continue;
+        const uint64_t expires = std::min<uint64_t>(v.expires_ns, monotonic_ns() + std::min(ttl, negative_ttl) * 1000000000ull);
+        std::lock_guard<std::mutex> lock(c.lock);
+        if(c.ranges >= kMaxRanges) {
+            c.nsec.clear();
+            c.nsec3.clear();
+            c.ranges = 0;
+        }
+        for(const rdatainfo& rd : rdatas) {
+            insert(c, v.signer, head.owner, head.type, std::vector<u_char>(rd.rdi_data, rd.rdi_data + rd.rdi_length), expires);
+        }
+    }
+}
+
+} // anonymous
+
+namespace resolw_impl {
+
+int negative_lookup(res_state rs, const char* name, unsigned type) {
+    Cache& c = cache();
+    Wire q;
+    if(!c.aggressive.load(std::memory_order_relaxed) || !c.ranges.load(std::memory_order_relaxed) || !to_wire(name, q)) {
+        return 0;
+    }
+    bool known = false;
+    int rv = 0;
+    {
+        std::lock_guard<std::mutex> guard(c.lock);
+        if(!c.ranges) return 0;
+        rv = deny(c, q, type, monotonic_ns(), false, known);
+    }
+    if(!known) return 0;
+    stats_cache(rv != 0);
+    if(rv) {
+        const int rcode = rv == ERRSET_NONAME ? kRcodeNxDomain : kRcodeNoError;
+        TraceScope trace(name, type, rs->id);
+        trace.event(RESOLW_TRACE_CACHE_HIT, nullptr, 0, rcode, 0);
+        trace.complete(-1, rcode);
+    }
+    return rv;
+}
+
+void negative_learn(res_state rs, const u_char* msg, int len) {
+    Cache& c = cache();
+    static thread_local bool busy = false; // validation queries for keys, which may come back here
+    if(busy || len < kHdrSize || !c.aggressive.load(std::memory_order_relaxed)) return;
+    struct Busy {
+        Busy() { busy = true; }
+        ~Busy() { busy = false; }
+    } guard;
+    std::vector<Rr> rrs;
+    if(!authority(msg, msg + len, rrs)) return; // copied out: the answer buffer is reused by those queries
+    learn(rs, c, rrs, 0);
+}
+
+int negative_proof(res_state rs, const u_char* msg, int len, const u_char* name, unsigned type, int depth) {
+    std::vector<Rr> rrs;
+    if(len < kHdrSize || !authority(msg, msg + len, rrs)) return 0;
+    Cache proof; // this answer's records only, whatever is on file
+    learn(rs, proof, rrs, depth);
+    Wire q(name, name + wire_len(name));
+    wire_lower(q.data());
+    bool known = false;
+    std::lock_guard<std::mutex> guard(proof.lock);
+    return deny(proof, q, type, monotonic_ns(), true, known);
+}
+
+bool wildcard_proof(res_state rs, const u_char* msg, int len, const u_char* name, int source, int depth) {
+    std::vector<Rr> rrs;
+    if(!msg || len < kHdrSize || !authority(msg, msg + len, rrs)) return false;
+    Cache proof;
+    learn(rs, proof, rrs, depth);
+    Wire q(name, name + wire_len(name));
+    wire_lower(q.data());
+    std::lock_guard<std::mutex> guard(proof.lock);
+    return no_closer_match(proof, q, source, monotonic_ns());
+}
+
+void negative_flush() {
+    Cache& c = cache();
+    std::lock_guard<std::mutex> guard(c.lock);
+    c.nsec.clear();
+    c.nsec3.clear();
+    c.ranges = 0;
+}
+
+} // resolw_impl
+
+#endif /* RESOLW_HAVE_DNSSEC */
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void resolw_dnssec_set_aggressive(int enable)
+{
+#ifdef RESOLW_HAVE_DNSSEC
+    resolw_impl::negative_flush();
+    cache().aggressive = enable != 0;
+#else
+    (void) enable;
+#endif
+}
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
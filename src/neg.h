@@ -0,0 +1,38 @@
+#ifndef _SRC_NEG_H_
+#define _SRC_NEG_H_
+
+#include "resolv.h"
+
+// Aggressive use of validated NSEC and NSEC3 records (RFC 8198). Only
+// built with RESOLW_HAVE_DNSSEC.
+
+namespace resolw_impl {
+
+/* ERRSET_NONAME or ERRSET_NODATA if cached denials already answer `name`/`type` (class IN); 0 otherwise. */
+int negative_lookup(res_state rs, const char* name, unsigned type);
+
+/* Caches the NSEC and NSEC3 records in the authority section of a negative answer to a DO query, if they validate. */
+void negative_learn(res_state rs, const u_char* msg, int len);
+
+void negative_flush();
+
+/**
+ * Whether the NSEC or NSEC3 records in the authority section of `msg`, a
+ * negative answer, validate and deny `name` (wire format)/`type`, class
+ * IN: ERRSET_NONAME or ERRSET_NODATA if so, 0 otherwise. Unlike the
+ * cache, takes an opt-out range as proof of an unsigned delegation.
+ * `depth` is the validator's, for the keys the records are signed with.
+ */
+int negative_proof(res_state rs, const u_char* msg, int len, const u_char* name, unsigned type, int depth);
+
+/**
+ * Whether the NSEC or NSEC3 records in the authority section of `msg`
+ * validate and show that `name` (wire format), answered by expanding the
+ * wildcard below its ancestor with `source` labels, has no closer match
+ * (RFC 4035 section 5.3.4).
+ */
+bool wildcard_proof(res_state rs, const u_char* msg, int len, const u_char* name, int source, int depth);
+
+} // resolw_impl
+
+#endif /* _SRC_NEG_H_ */
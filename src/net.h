@@ -0,0 +1,192 @@
+#ifndef _SRC_NET_H_
+#define _SRC_NET_H_
+
+#include "resolv.h"
+#include <stdint.h>
+#include <chrono>
+
+// Just enough socket portability for the native send path. The WinSock2
+// spelling is used on Windows, the BSD one everywhere else.
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+namespace resolw_impl {
+
+#ifdef _WIN32
+typedef SOCKET sock_t;
+constexpr sock_t kBadSock = INVALID_SOCKET;
+typedef WSAPOLLFD pollfd_t;
+inline int sock_close(sock_t s) { return closesocket(s); }
+inline int sock_errno() { return WSAGetLastError(); }
+inline int sock_poll(pollfd_t* fds, unsigned n, int ms) { return WSAPoll(fds, n, ms); }
+inline bool sock_nonblock(sock_t s) { u_long on = 1; return !ioctlsocket(s, FIONBIO, &on); }
+constexpr int kErrAddrInUse = WSAEADDRINUSE;
+constexpr int kErrWouldBlock = WSAEWOULDBLOCK;
+constexpr int kErrInProgress = WSAEWOULDBLOCK;
+#else
+typedef int sock_t;
+constexpr sock_t kBadSock = -1;
+typedef struct pollfd pollfd_t;
+inline int sock_close(sock_t s) { return close(s); }
+inline int sock_errno() { return errno; }
+inline int sock_poll(pollfd_t* fds, unsigned n, int ms) { return poll(fds, n, ms); }
+inline bool sock_nonblock(sock_t s) { int fl = fcntl(s, F_GETFL); return fl >= 0 && !fcntl(s, F_SETFL, fl | O_NONBLOCK); }
+constexpr int kErrAddrInUse = EADDRINUSE;
+constexpr int kErrWouldBlock = EWOULDBLOCK;
+constexpr int kErrInProgress = EINPROGRESS;
+#endif
+
+void set_last_error(int last_error);
+
+/* Sets h_errno, which WinSock keeps as its last error. */
+void set_h_errno(int code);
+
+/* WSAStartup() on Windows, nothing elsewhere; safe to call repeatedly. */
+void net_startup();
+
+inline uint64_t monotonic_ns() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/* Milliseconds until `deadline_ns`, rounded up; 0 once it has passed. */
+inline int remaining_ms(uint64_t deadline_ns) {
+    uint64_t now = monotonic_ns();
+    return now >= deadline_ns ? 0 : (int) ((deadline_ns - now + 999999) / 1000000);
+}
+
+inline socklen_t sockaddr_len(const sockaddr* sa) {
+    return sa->sa_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+}
+
+/* Compares family, address and port. */
+bool sockaddr_same(const sockaddr* a, const sockaddr* b);
+
+/* The port of an AF_INET or AF_INET6 address, in host order. */
+inline unsigned sockaddr_port(const sockaddr* sa) {
+    return ntohs(sa->sa_family == AF_INET6 ? reinterpret_cast<const sockaddr_in6*>(sa)->sin6_port
+                                           : reinterpret_cast<const sockaddr_in*>(sa)->sin_port);
+}
+
+/* Polls `fd` for `events` until `deadline_ns`; false on timeout or error. */
+bool wait_for(sock_t fd, short events, uint64_t deadline_ns);
+
+/* Write and read exactly `len` bytes of a non-blocking stream socket by `deadline_ns`; a null `p` discards what is read. */
+bool write_all(sock_t fd, const u_char* p, int len, uint64_t deadline_ns);
+bool read_all(sock_t fd, u_char* p, int len, uint64_t deadline_ns);
+
+/**
+ * A pooled UDP socket bound to a randomized ephemeral port. A lease gives
+ * its holder exclusive use of the socket until it is handed back.
+ */
+struct UdpLease {
+    sock_t fd;
+    int family;
+    unsigned uses; // queries carried so far, including the current one
+    uint64_t born_ns;
+};
+
+bool sockpool_acquire(int family, UdpLease* lease);
+
+/* `healthy` = false discards the socket instead of recycling it. */
+void sockpool_release(UdpLease* lease, bool healthy);
+
+/* A socket bound to a random port, as the pool hands out, for the caller to keep; kBadSock on failure. */
+sock_t sockpool_open(int family);
+
+/* How long a socket keeps its port (`resolw_sockpool_config()`). */
+uint64_t sockpool_max_age_ns();
+
+/* What a single exchange with one server comes to, short of an answer. */
+enum SendResult {
+    kSendFailed = -1, // transport error; try the next server
+    kSendTimeout = -2, // no (valid) answer in time; try the next server
+    kSendUnshared = -3, // io_send() or mux_send() cannot take the exchange; lease a socket of its own
+};
+
+class TsigSession;
+class TraceScope;
+
+/**
+ * One UDP exchange on a socket shared with other threads, if
+ * `resolw_sockpool_share()` has enabled them (see mux.cpp). Returns the
+ * answer's length, a SendResult, or kSendUnshared if shared sockets are
+ * off or cannot carry this message.
+ */
+int mux_send(const sockaddr* ns, const u_char* msg, int msglen, u_char* answer, int anslen, uint64_t deadline_ns,
+             bool& truncated, TsigSession* tsig);
+
+/**
+ * The same through a dedicated I/O thread, if `resolw_sockpool_threads()`
+ * has started any (see iot.cpp).
+ */
+int io_send(const sockaddr* ns, const u_char* msg, int msglen, u_char* answer, int anslen, uint64_t deadline_ns,
+            bool& truncated, TsigSession* tsig);
+
+/* The most a reader of a shared socket takes in at once; longer answers are handed over cut short, with TC. */
+constexpr int kMaxUdpRead = 4096;
+
+/**
+ * For the readers of shared sockets: whether `buf`, `n` bytes that came
+ * from `from`, answers `msg` as sent to `ns` (and is signed, if `tsig`).
+ * If so, copies it to `answer` and returns the length kept; 0 otherwise.
+ */
+int mux_accept(const u_char* buf, int n, const sockaddr* from, const sockaddr* ns, const u_char* msg, int msglen,
+               u_char* answer, int anslen, TsigSession* tsig);
+
+/* Whether `resolw_hedge_config()` has turned hedged queries on (see hdg.cpp). */
+bool hedge_on();
+
+/* How long to wait for `ns` before asking the next server too; 0 = not yet known, or hedging is off. */
+uint64_t hedge_delay_ns(const sockaddr* ns);
+
+/* Records how long `ns` took to answer over UDP (or how long it was waited for in vain). */
+void hedge_sample(const sockaddr* ns, uint64_t elapsed_ns);
+
+/* A query that may be hedged adds its share to the hedge budget; a hedge takes one from it, if there is one. */
+void hedge_earn();
+bool hedge_spend();
+
+/* One query of nsend_parallel(); `n` receives what res_nsend() would have returned. */
+struct Exchange {
+    const u_char* msg;
+    int msglen;
+    u_char* answer;
+    int anslen;
+    int n;
+    int tc_attempt = -1; // for the loop behind both calls: the attempt whose UDP answer needs a TCP retry
+};
+
+/**
+ * Sends `count` queries at once, each with res_nsend()'s failover, and
+ * returns when every one has finished, when `ex[0]` has an answer with
+ * records, or `linger_ns` after another one got such an answer (the
+ * "resolution delay" of Happy Eyeballs, RFC 8305). Exchanges cut short
+ * are left with `n` = -1. `rs` is initialized; events go to the caller's
+ * `trace`.
+ */
+void nsend_parallel(res_state rs, Exchange* ex, unsigned count, uint64_t linger_ns, TraceScope& trace);
+
+/**
+ * Sends `count` queries with at most `window` (up to 128) in flight,
+ * each with res_nsend()'s failover, and returns when all have finished.
+ * RES_USEVC sends them one after the other. `rs` is initialized; events
+ * go to the caller's `trace`.
+ */
+void nsend_batch(res_state rs, Exchange* ex, size_t count, unsigned window, TraceScope& trace);
+
+} // resolw_impl
+
+#endif /* _SRC_NET_H_ */
@@ -0,0 +1,238 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "resolv.h"
+#include "resolw/resolw_ptr.h"
+#include "msg.h"
+#include "net.h"
+#include "trc.h"
+
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+/**
+ * Bulk PTR lookups. Names come from lookup tables (one 4-byte copy per
+ * octet or byte, then the suffix), distinct addresses are found with an
+ * open-addressed hash table, and the queries go out in chunks through
+ * nsend_batch(), which keeps `window` of them in flight.
+ */
+
+namespace {
+
+using namespace resolw_impl;
+
+constexpr size_t kChunk = 1024; // queries (and answer buffers) per nsend_batch() call
+constexpr int kQueryLen = 128; // a reverse query is at most 12 + 74 + 4 bytes
+constexpr int kAnswerLen = 1024;
+
+/* "N." for every octet, and "l.h." (the two nibbles, low first) for every byte. */
+struct Tables {
+    char octet[256][4];
+    u_char octet_len[256];
+    char nibbles[256][4];
+
+    constexpr Tables() : octet(), octet_len(), nibbles() {
+        const char* hex = "0123456789abcdef";
+        for(int i = 0; i < 256; ++i) {
+            int n = 0;
+            if(i >= 100) octet[i][n++] = '0' + i / 100;
+            if(i >= 10) octet[i][n++] = '0' + i / 10 % 10;
+            octet[i][n++] = '0' + i % 10;
+            octet[i][n++] = '.';
+            octet_len[i] = n;
+            nibbles[i][0] = hex[i & 0xf];
+            nibbles[i][1] = '.';
+            nibbles[i][2] = hex[i >> 4];
+            nibbles[i][3] = '.';
+        }
+    }
+};
+
+constexpr Tables kTables;
+
+/* The name without its NUL; `out` has room for RESOLW_PTR_NAMELEN bytes. */
+int ptr_name(int family, const u_char* a, char* out) {
+    char* p = out;
+    if(family == AF_INET) {
+        for(int i = 3; i >= 0; --i) {
+            memcpy(p, kTables.octet[a[i]], 4); // the spare byte is overwritten by the next one
+            p += kTables.octet_len[a[i]];
+        }
+        memcpy(p, "in-addr.arpa", 12);
+        return p + 12 - out;
+    }
+    for(int i = 15; i >= 0; --i, p += 4) {
+        memcpy(p, kTables.nibbles[a[i]], 4);
+    }
+    memcpy(p, "ip6.arpa", 8);
+    return p + 8 - out;
+}
+
+inline size_t addr_len(int family) { return family == AF_INET6 ? 16 : 4; }
+
+uint64_t hash_addr(const u_char* a, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for(size_t i = 0; i < len; ++i) h = (h ^ a[i]) * 0x100000001b3ull;
+    return h;
+}
+
+/* For every address, the index of its first occurrence; `uniq` receives those first occurrences. */
+void dedup(const u_char* addrs, size_t count, size_t len, std::vector<uint32_t>& first_of, std::vector<uint32_t>& uniq) {
+    size_t cap = 16;
+    while(cap < count * 2) cap <<= 1;
+    std::vector<uint32_t> slots(cap, UINT32_MAX);
+    first_of.resize(count);
+    for(size_t i = 0; i < count; ++i) {
+        const u_char* a = addrs + i * len;
+        size_t s = hash_addr(a, len) & (cap - 1);
+        while(slots[s] != UINT32_MAX && memcmp(addrs + slots[s] * len, a, len)) s = (s + 1) & (cap - 1);
+        if(slots[s] == UINT32_MAX) {
+            slots[s] = i;
+            uniq.push_back(i);
+        }
+        first_of[i] = slots[s];
+    }
+}
+
+/* Fills `r` from the answer to one reverse query. */
+void parse(const Exchange& ex, resolw_ptr& r) {
+    r.ttl = 0;
+    r.name[0] = '\0';
+    if(ex.n < kHdrSize) {
+        r.status = TRY_AGAIN;
+        return;
+    }
+    const u_char* const msg = ex.answer;
+    const u_char* const eom = msg + ex.n;
+    switch(rd16(msg + kHdrFlags) & kRcodeMask) {
+        case kRcodeNoError: r.status = NO_DATA; break;
+        case kRcodeNxDomain: r.status = HOST_NOT_FOUND; return;
+        case kRcodeServFail: r.status = TRY_AGAIN; return;
+        default: r.status = NO_RECOVERY; return;
+    }
+    const u_char* cp = msg + kHdrSize;
+    for(unsigned q = rd16(msg + kHdrQdCount); q; --q) {
+        int skip = msg_skip_name(cp, eom);
+        if(skip < 0 || eom - cp < skip + 4) {
+            r.status = NO_RECOVERY;
+            return;
+        }
+        cp += skip + 4;
+    }
+    for(unsigned an = rd16(msg + kHdrAnCount); an; --an) {
+        int skip = msg_skip_name(cp, eom);
+        if(skip < 0 || eom - cp < skip + 10) break;
+        cp += skip;
+        const unsigned type = rd16(cp), rdclass = rd16(cp + 2), rdlen = rd16(cp + 8);
+        const uint32_t ttl = rd32(cp + 4);
+        cp += 10;
+        if(eom - cp < (int) rdlen) break;
+        if(type == T_PTR && rdclass == C_IN && msg_expand_name(msg, eom, cp, r.name, sizeof(r.name)) > 0) {
+            r.ttl = ttl;
+            r.status = 0;
+            return;
+        }
+        cp += rdlen; // a CNAME (RFC 2317 delegation) on the way
+    }
+    r.name[0] = '\0';
+}
+
+} // anonymous
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int resolw_ptr_name(int family, const void *addr, char *out, size_t outlen)
+{
+    if((family != AF_INET && family != AF_INET6) || !addr || !out) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    if(outlen < RESOLW_PTR_NAMELEN) {
+        set_last_error(EMSGSIZE);
+        return -1;
+    }
+    int len = ptr_name(family, static_cast<const u_char*>(addr), out);
+    out[len] = '\0';
+    return len;
+}
+
+int resolw_ptr_batch(res_state statp, int family, const void *addrs, size_t count,
+                     struct resolw_ptr *results, unsigned window)
+{
+    if(!statp || (family != AF_INET && family != AF_INET6) || (count && (!addrs || !results)) || count > UINT32_MAX) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    if(!(statp->options & RES_INIT)) { res_ninit(statp); } // see comment to RES_INIT
+    if(!count) return 0;
+    const u_char* const packed = static_cast<const u_char*>(addrs);
+    const size_t len = addr_len(family);
+    TraceScope trace(nullptr, T_PTR, statp->id);
+    std::vector<uint32_t> first_of, uniq, sent; // sent: the index into `uniq` of each exchange
+    std::vector<u_char> queries, answers;
+    std::vector<Exchange> ex;
+    try {
+        dedup(packed, count, len, first_of, uniq);
+        const size_t chunk = std::min(uniq.size(), kChunk);
+        queries.resize(chunk * kQueryLen);
+        answers.resize(chunk * kAnswerLen);
+        ex.resize(chunk);
+        sent.resize(chunk);
+    } catch(const std::bad_alloc&) {
+        set_last_error(ENOMEM);
+        trace.complete(-1, -1);
+        return -1;
+    }
+
+    for(size_t base = 0; base < uniq.size(); base += kChunk) {
+        const size_t n = std::min(uniq.size() - base, kChunk);
+        size_t m = 0;
+        for(size_t i = 0; i < n; ++i) {
+            char name[RESOLW_PTR_NAMELEN];
+            name[ptr_name(family, packed + uniq[base + i] * len, name)] = '\0';
+            u_char* q = &queries[m * kQueryLen];
+            int qlen = res_nmkquery(statp, kOpQuery, name, C_IN, T_PTR, nullptr, 0, nullptr, q, kQueryLen);
+            if(qlen < 0) { // not sent at all
+                resolw_ptr& r = results[uniq[base + i]];
+                r.status = NO_RECOVERY;
+                r.ttl = 0;
+                r.name[0] = '\0';
+                continue;
+            }
+            ex[m] = Exchange{q, qlen, &answers[m * kAnswerLen], kAnswerLen, -1};
+            sent[m++] = base + i;
+        }
+        nsend_batch(statp, ex.data(), m, window ? window : RESOLW_PTR_WINDOW, trace);
+        for(size_t i = 0; i < m; ++i) {
+            parse(ex[i], results[uniq[sent[i]]]);
+        }
+    }
+    int resolved = 0;
+    for(size_t i = 0; i < count; ++i) {
+        if(first_of[i] != i) results[i] = results[first_of[i]];
+        resolved += !results[i].status;
+    }
+    trace.complete(resolved, -1);
+    return resolved;
+}
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,222 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "resolw/resolw_rdata.h"
+#include "msg.h"
+#include "net.h" // set_last_error
+
+#include <errno.h>
+#include <string.h>
+
+/**
+ * Typed rdata views. All the checking happens in resolw_*_view(); the
+ * iterators that follow rely on it and only compare against the end.
+ */
+
+namespace {
+
+using namespace resolw_impl;
+
+int bad() {
+    set_last_error(EBADMSG);
+    return -1;
+}
+
+/* Checks the name at `p` (ending by `end`) and fills `out`; the bytes it occupies, or -1. */
+int take_name(const resolw_rdata* rd, const u_char* p, const u_char* end, resolw_name* out) {
+    int n = msg_check_name(rd->msg, rd->eom, p, end);
+    if(n < 0) return -1;
+    out->msg = rd->msg;
+    out->eom = rd->eom;
+    out->wire = p;
+    return n;
+}
+
+/* A name without a message cannot have pointers, so it is its own `msg` for the helpers below. */
+inline const u_char* base(const resolw_name* name) { return name->msg ? name->msg : name->wire; }
+inline const u_char* limit(const resolw_name* name) { return name->msg ? name->eom : name->wire + MAXCDNAME; }
+
+} // anonymous
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int resolw_msg_iter_init(struct resolw_msg_iter *it, const u_char *msg, int len)
+{
+    if(!it || !msg || len < kHdrSize) return bad();
+    it->msg = msg;
+    it->eom = msg + len;
+    it->cp = msg + kHdrSize;
+    for(int i = 0; i < 4; ++i) {
+        it->counts[i] = rd16(msg + kHdrQdCount + 2 * i);
+    }
+    for(unsigned i = 0; i < it->counts[0]; ++i) {
+        int n = msg_skip_name(it->cp, it->eom);
+        if(n < 0 || it->eom - it->cp - n < 4) return bad();
+        it->cp += n + 4;
+    }
+    it->section = 1;
+    it->left = it->counts[1];
+    return 0;
+}
+
+int resolw_msg_iter_next(struct resolw_msg_iter *it, struct resolw_rr *rr)
+{
+    while(!it->left) {
+        if(it->section >= 3) return 0;
+        it->left = it->counts[++it->section];
+    }
+    const u_char* cp = it->cp;
+    resolw_rdata whole = { it->msg, it->eom, cp, 0 };
+    int n = take_name(&whole, cp, it->eom, &rr->owner);
+    if(n < 0 || it->eom - cp - n < 10) return bad();
+    cp += n;
+    rr->type = rd16(cp);
+    rr->rdclass = rd16(cp + 2);
+    rr->ttl = rd32(cp + 4);
+    uint16_t rdlen = rd16(cp + 8);
+    cp += 10;
+    if(it->eom - cp < rdlen) return bad();
+    rr->section = it->section;
+    rr->rdata.msg = it->msg;
+    rr->rdata.eom = it->eom;
+    rr->rdata.data = cp;
+    rr->rdata.len = rdlen;
+    it->cp = cp + rdlen;
+    --it->left;
+    return 1;
+}
+
+void resolw_rdata_of(const struct rdatainfo *rdi, struct resolw_rdata *out)
+{
+    out->msg = nullptr;
+    out->eom = nullptr;
+    out->data = rdi->rdi_data;
+    out->len = rdi->rdi_length;
+}
+
+int resolw_srv_view(const struct resolw_rdata *rd, struct resolw_srv *out)
+{
+    const u_char* const end = rd->data + rd->len;
+    if(rd->len < 7) return bad();
+    out->priority = rd16(rd->data);
+    out->weight = rd16(rd->data + 2);
+    out->port = rd16(rd->data + 4);
+    int n = take_name(rd, rd->data + 6, end, &out->target);
+    return n < 0 || rd->data + 6 + n != end ? bad() : 0;
+}
+
+int resolw_mx_view(const struct resolw_rdata *rd, struct resolw_mx *out)
+{
+    const u_char* const end = rd->data + rd->len;
+    if(rd->len < 3) return bad();
+    out->preference = rd16(rd->data);
+    int n = take_name(rd, rd->data + 2, end, &out->exchange);
+    return n < 0 || rd->data + 2 + n != end ? bad() : 0;
+}
+
+int resolw_sshfp_view(const struct resolw_rdata *rd, struct resolw_sshfp *out)
+{
+    if(rd->len < 3) return bad(); // RFC 4255: some fingerprint
+    out->algorithm = rd->data[0];
+    out->fp_type = rd->data[1];
+    out->fingerprint = rd->data + 2;
+    out->fp_len = rd->len - 2;
+    return 0;
+}
+
+int resolw_tlsa_view(const struct resolw_rdata *rd, struct resolw_tlsa *out)
+{
+    if(rd->len < 4) return bad();
+    out->usage = rd->data[0];
+    out->selector = rd->data[1];
+    out->matching_type = rd->data[2];
+    out->data = rd->data + 3;
+    out->data_len = rd->len - 3;
+    return 0;
+}
+
+int resolw_svcb_view(const struct resolw_rdata *rd, struct resolw_svcb *out)
+{
+    const u_char* const end = rd->data + rd->len;
+    if(rd->len < 3) return bad();
+    out->priority = rd16(rd->data);
+    // RFC 9460 section 2.2: the target is never compressed
+    resolw_rdata flat = { nullptr, nullptr, rd->data, rd->len };
+    int n = take_name(&flat, rd->data + 2, end, &out->target);
+    if(n < 0) return bad();
+    const u_char* p = rd->data + 2 + n;
+    out->params.p = p;
+    out->params.end = end;
+    if(!out->priority && p != end) return bad(); // AliasForm has no parameters
+    for(long last = -1; p < end; ) {
+        if(end - p < 4) return bad();
+        unsigned key = rd16(p), len = rd16(p + 2);
+        if((long) key <= last || end - p - 4 < len) return bad();
+        last = key;
+        p += 4 + len;
+    }
+    return 0;
+}
+
+int resolw_txt_view(const struct resolw_rdata *rd, struct resolw_iter *out)
+{
+    const u_char* const end = rd->data + rd->len;
+    if(!rd->len) return bad(); // at least one (possibly empty) string
+    for(const u_char* p = rd->data; p < end; p += *p + 1) {
+        if(end - p - 1 < *p) return bad();
+    }
+    out->p = rd->data;
+    out->end = end;
+    return 0;
+}
+
+int resolw_txt_next(struct resolw_iter *it, const u_char **str, size_t *len)
+{
+    if(it->p >= it->end) return 0;
+    *len = *it->p;
+    *str = it->p + 1;
+    it->p += *len + 1;
+    return 1;
+}
+
+int resolw_svcb_next(struct resolw_iter *it, uint16_t *key, const u_char **value, size_t *len)
+{
+    if(it->p >= it->end) return 0;
+    *key = rd16(it->p);
+    *len = rd16(it->p + 2);
+    *value = it->p + 4;
+    it->p += 4 + *len;
+    return 1;
+}
+
+int resolw_name_text(const struct resolw_name *name, char *out, size_t outlen)
+{
+    if(msg_expand_name(base(name), limit(name), name->wire, out, outlen > MAXDNAME + 1 ? MAXDNAME + 1 : outlen) < 0) {
+        return bad();
+    }
+    return strlen(out);
+}
+
+int resolw_name_equal(const struct resolw_name *a, const struct resolw_name *b)
+{
+    return msg_names_equal(base(a), limit(a), a->wire, base(b), limit(b), b->wire);
+}
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,219 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "resolv.h"
+#include "resolw/resolw_dnssec.h"
+#include "bke.h"
+#include "idn.h"
+#include "neg.h"
+#include "net.h"
+#ifdef RESOLW_HAVE_DNSSEC
+#include "sec.h"
+#endif
+
+#include <netdb.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The query API proper, on top of whichever backend was built (see bke.h):
+ * the implied per-thread state, the search list, and the BIND 4 style
+ * wrappers that use the implied state.
+ */
+
+namespace {
+
+using namespace resolw_impl;
+
+struct ResState : public _res_state {
+    ResState() { res_ninit(this); }
+};
+
+static thread_local ResState _resolw_state;
+
+} // anonymous
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+res_state _resolw_res_state() { return &_resolw_state; }
+
+int res_init(void)
+{
+    // special case -- implicit res_ninit called on first access to _res
+    return (void) _res, 0;
+}
+
+int res_search(const char *dname, int rq_class, int type, u_char *answer, int anslen)
+{
+    return res_nsearch(_resolw_res_state(), dname, rq_class, type, answer, anslen);
+}
+
+int res_query(const char *dname, int rq_class, int type, u_char *answer, int anslen)
+{
+    return res_nquery(_resolw_res_state(), dname, rq_class, type, answer, anslen);
+}
+
+int res_mkquery(int op, const char *dname, int rq_class, int type, const u_char *data, 
+                int datalen, const u_char *newrr, u_char *buf, int buflen)
+{
+    return res_nmkquery(_resolw_res_state(), op, dname, rq_class, type, data, datalen, newrr, buf, buflen);
+}
+
+int res_send(const u_char *msg, int msglen, u_char *answer, int anslen)
+{
+    return res_nsend(_resolw_res_state(), msg, msglen, answer, anslen);
+}
+
+int res_querydomain(const char *name, const char *domain, int rq_class, int type, u_char *answer, int anslen)
+{
+    return res_nquerydomain(_resolw_res_state(), name, domain, rq_class, type, answer, anslen);
+}
+
+int res_ninit(res_state rs)
+{
+    return backend_init(rs);
+}
+
+int res_nquery(res_state rs, const char *dname, int rq_class, int type, u_char *answer, int anslen)
+{
+    if(!(rs->options & RES_INIT)) { res_ninit(rs); } // see comment to RES_INIT
+    char ace[MAXDNAME + 1];
+    if(!dname || !(dname = name_to_ascii(dname, ace, sizeof(ace)))) {
+        set_h_errno(NO_RECOVERY);
+        return -1;
+    }
+#ifdef RESOLW_HAVE_DNSSEC
+    if(rq_class == C_IN) { // denied by cached NSEC/NSEC3 ranges already?
+        switch(negative_lookup(rs, dname, type)) {
+            case ERRSET_NONAME: set_h_errno(HOST_NOT_FOUND); return -1;
+            case ERRSET_NODATA: set_h_errno(NO_DATA); return -1;
+        }
+    }
+#endif
+    return backend_query(rs, dname, rq_class, type, answer, anslen);
+}
+
+int res_nsearch(res_state rs, const char *dname, int rq_class, int type, u_char *answer, int anslen)
+{
+    // as in BIND: names with at least `ndots` dots are tried as is first, all others last
+    if(!(rs->options & RES_INIT)) { res_ninit(rs); }
+    if(!dname || !*dname) {
+        set_h_errno(NO_RECOVERY);
+        return -1;
+    }
+    unsigned dots = 0;
+    for(const char* cp = dname; *cp; ++cp) {
+        dots += *cp == '.';
+    }
+    const size_t len = strlen(dname);
+    if(dname[len - 1] == '.') {
+        return res_nquery(rs, dname, rq_class, type, answer, anslen); // absolute
+    }
+    bool tried_as_is = false, got_nodata = false;
+    if(dots >= rs->ndots) {
+        int n = res_nquery(rs, dname, rq_class, type, answer, anslen);
+        if(n > 0) return n;
+        got_nodata = h_errno == NO_DATA;
+        tried_as_is = true;
+    }
+    if((!dots && (rs->options & RES_DEFNAMES)) || (dots && (rs->options & RES_DNSRCH))) {
+        // the search list, or just the default domain where there is none
+        const char* const fallback[] = {rs->defdname, nullptr};
+        const char* const* domains = ((rs->options & RES_DNSRCH) && rs->dnsrch[0]) ? rs->dnsrch : fallback;
+        for(; *domains && **domains; ++domains) {
+            int n = res_nquerydomain(rs, dname, *domains, rq_class, type, answer, anslen);
+            if(n > 0) return n;
+            if(h_errno == NO_DATA) {
+                got_nodata = true;
+            } else if(h_errno != HOST_NOT_FOUND) {
+                break; // a server failure will not go away with another suffix
+            }
+        }
+    }
+    if(!tried_as_is) {
+        int n = res_nquery(rs, dname, rq_class, type, answer, anslen);
+        if(n > 0) return n;
+    }
+    if(got_nodata) {
+        set_h_errno(NO_DATA);
+    }
+    return -1;
+}
+
+int res_nquerydomain(res_state rs, const char *name, const char *rawdom, int rq_class, int type, u_char *answer, int anslen)
+{
+    // same as nquery, but concatenates name and domain (on the stack; this path does not allocate)
+    char concat[MAXDNAME + 1];
+    if(!rawdom || !*rawdom) {
+         rawdom = name;
+    } else if(name && *name) {
+        size_t nlen = strlen(name);
+        size_t dlen = strlen(rawdom);
+        bool dot = name[nlen - 1] != '.' && rawdom[0] != '.';
+        if(nlen + dot + dlen > MAXDNAME) {
+            set_h_errno(NO_RECOVERY);
+            return -1;
+        }
+        memcpy(concat, name, nlen);
+        concat[nlen] = '.';
+        memcpy(concat + nlen + dot, rawdom, dlen + 1);
+        rawdom = concat;
+    }
+    return res_nquery(rs, rawdom, rq_class, type, answer, anslen);
+}
+
+// res_nmkquery() is native; see msg.cpp
+// res_nsend() is native; see snd.cpp
+
+int getrrsetbyname(const char *hostname, unsigned int rdclass, unsigned int rdtype, unsigned int flags, struct rrsetinfo **res)
+{
+    if(flags) return ERRSET_INVAL;
+    if(!hostname || !*hostname || !res) return ERRSET_INVAL;
+    if(rdclass > 0xffff || rdtype > 0xffff) return ERRSET_INVAL;
+    char ace[MAXDNAME + 1];
+    if(!(hostname = name_to_ascii(hostname, ace, sizeof(ace)))) return ERRSET_INVAL;
+    res_state rs = _resolw_res_state(); // initialized on first access
+#ifdef RESOLW_HAVE_DNSSEC
+    if(rdclass == C_IN) {
+        if(int denied = negative_lookup(rs, hostname, rdtype)) return denied;
+    }
+#endif
+    int rv = backend_rrset(rs, hostname, rdclass, rdtype, res);
+#ifdef RESOLW_HAVE_DNSSEC
+    if(rv == ERRSET_SUCCESS) { // our own verdict rather than the upstream resolver's
+        (*res)->rri_flags &= ~RRSET_VALIDATED;
+        if(dnssec_validate(rs, *res, true) == RESOLW_DNSSEC_SECURE) {
+            (*res)->rri_flags |= RRSET_VALIDATED;
+        }
+    }
+#endif
+    return rv;
+}
+
+void freerrset(struct rrsetinfo *rrset)
+{
+    if(rrset) {
+        free(rrset->rri_rdatas); // allocated even when empty
+        free(rrset->rri_sigs);
+        free(rrset); // rri_name included
+    }
+}
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
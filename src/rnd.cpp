@@ -13,10 +13,9 @@
  */
 #include "resolv.h"
 
+#include <atomic>
+#include <cstring>
 #include <random>
-#include <limits>
-
-#include <time.h>
 
 /**
  * One may wonder why we don't reuse a proven implementation from e.g.
@@ -30,33 +29,145 @@
  * -- `libresolw` is a public domain library. You are free to change it,
  *     or its API, as you wish, including plugging in your own RNG. Use
  *    `#define res_randomid another_rng_fn` before including `resolv.h`.
+ *
+ * The generator itself is ChaCha20 (RFC 8439) in "fast key erasure" mode:
+ * each refill produces a batch of keystream blocks, the first 32 bytes of
+ * which immediately replace the key. Everything else in the batch is handed
+ * out as 16-bit IDs until exhausted, so the amortized cost of an ID is a
+ * couple of loads. `std::random_device` is only consulted on first use and
+ * every RESEED_BATCHES refills thereafter.
  */
 
 namespace {
-constexpr int RNG_BITS = 15;
-constexpr int RESEED_S = 600;
+
+constexpr int KEY_WORDS = 8;
+constexpr int BLOCK_WORDS = 16;
+constexpr int BATCH_BLOCKS = 4; // 256 bytes per refill
+constexpr int BATCH_IDS = (BATCH_BLOCKS * BLOCK_WORDS - KEY_WORDS) * 2; // 112 IDs per refill
+constexpr unsigned RESEED_BATCHES = 1u << 14; // ~1.8M IDs between entropy injections
+
+constexpr int PERM_BITS = 15; // permutation domain; the 16th bit alternates between cycles
+constexpr unsigned PERM_SIZE = 1u << PERM_BITS;
+constexpr int PERM_ROUNDS = 4;
+
+std::atomic<int> _randomid_mode{RESOLW_RANDOMID_STREAM};
+
+inline uint32_t rotl(uint32_t v, int c) { return (v << c) | (v >> (32 - c)); }
+
+inline void quarter(uint32_t* x, int a, int b, int c, int d) {
+    x[a] += x[b]; x[d] = rotl(x[d] ^ x[a], 16);
+    x[c] += x[d]; x[b] = rotl(x[b] ^ x[c], 12);
+    x[a] += x[b]; x[d] = rotl(x[d] ^ x[a], 8);
+    x[c] += x[d]; x[b] = rotl(x[b] ^ x[c], 7);
+}
+
+void chacha20_block(const uint32_t* in, uint32_t* out) {
+    uint32_t x[BLOCK_WORDS];
+    memcpy(x, in, sizeof(x));
+    for(int i = 0; i < 10; ++i) {
+        quarter(x, 0, 4,  8, 12); quarter(x, 1, 5,  9, 13);
+        quarter(x, 2, 6, 10, 14); quarter(x, 3, 7, 11, 15);
+        quarter(x, 0, 5, 10, 15); quarter(x, 1, 6, 11, 12);
+        quarter(x, 2, 7,  8, 13); quarter(x, 3, 4,  9, 14);
+    }
+    for(int i = 0; i < BLOCK_WORDS; ++i) {
+        out[i] = x[i] + in[i];
+    }
+}
 
 struct RNGState {
-    std::random_device rd;
-    std::minstd_rand rng;
-    std::uniform_int_distribution<int> dist, tm_d;
-    time_t next_reseed_tm;
+    uint32_t input[BLOCK_WORDS]; // constants | key | counter | nonce
+    uint32_t batch[BATCH_BLOCKS * BLOCK_WORDS];
+    int next_id; // index into the ID area of `batch`
+    unsigned refills;
+
+    // permutation mode: a keyed 16-bit Feistel network, cycle-walked into 15 bits
+    uint8_t sbox[PERM_ROUNDS][256];
+    unsigned perm_ctr;
+    unsigned perm_msb;
+
+    RNGState() : next_id(BATCH_IDS), refills(0), perm_ctr(PERM_SIZE), perm_msb(0) {
+        static const uint32_t sigma[4] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 }; // "expand 32-byte k"
+        memcpy(input, sigma, sizeof(sigma));
+        reseed();
+    }
 
     void reseed() {
-        time_t cur_tm;
-        time(&cur_tm);
-        if(cur_tm > next_reseed_tm) {
-            rng.seed(rd());
-            next_reseed_tm = cur_tm + tm_d(rng);
+        std::random_device rd;
+        for(int i = 0; i < KEY_WORDS; ++i) {
+            input[4 + i] ^= rd();
+        }
+        for(int i = 12; i < BLOCK_WORDS; ++i) {
+            input[i] = rd(); // counter and nonce start at a random point, too
         }
     }
 
-    RNGState() : dist(0, 1 << RNG_BITS), tm_d(RESEED_S, RESEED_S * 2),
-                 next_reseed_tm(std::numeric_limits<time_t>::min()) {}
+    void refill() {
+        if(++refills >= RESEED_BATCHES) {
+            refills = 0;
+            reseed();
+        }
+        for(int b = 0; b < BATCH_BLOCKS; ++b) {
+            chacha20_block(input, batch + b * BLOCK_WORDS);
+            if(!++input[12]) { ++input[13]; }
+        }
+        // fast key erasure: the key that produced this batch is gone
+        memcpy(input + 4, batch, KEY_WORDS * sizeof(uint32_t));
+        memset(batch, 0, KEY_WORDS * sizeof(uint32_t));
+        next_id = 0;
+    }
+
+    uint16_t next16() {
+        if(next_id >= BATCH_IDS) {
+            refill();
+        }
+        const uint16_t* ids = reinterpret_cast<const uint16_t*>(batch + KEY_WORDS);
+        return ids[next_id++];
+    }
+
+    void rekey_permutation() {
+        for(int r = 0; r < PERM_ROUNDS; ++r) {
+            for(int i = 0; i < 256; i += 2) {
+                uint16_t w = next16();
+                sbox[r][i] = w;
+                sbox[r][i + 1] = w >> 8;
+            }
+        }
+        perm_ctr = 0;
+        perm_msb ^= PERM_SIZE;
+    }
+
+    unsigned feistel(unsigned v) const {
+        unsigned l = v >> 8, r = v & 0xff;
+        for(int i = 0; i < PERM_ROUNDS; ++i) {
+            unsigned t = r;
+            r = l ^ sbox[i][r];
+            l = t;
+        }
+        return (l << 8) | r;
+    }
+
+    /**
+     * Yields each 15-bit value exactly once per cycle of PERM_SIZE calls.
+     * Consecutive cycles use opposite halves of the 16-bit ID space, hence
+     * no ID repeats within any PERM_SIZE + 1 consecutive calls.
+     */
+    uint16_t next_permuted() {
+        if(perm_ctr >= PERM_SIZE) {
+            rekey_permutation();
+        }
+        unsigned v = perm_ctr++;
+        do {
+            v = feistel(v); // cycle walking keeps the mapping bijective on [0, PERM_SIZE)
+        } while(v >= PERM_SIZE);
+        return v | perm_msb;
+    }
 
     int operator()() {
-        reseed();
-        return dist(rng);
+        if(_randomid_mode.load(std::memory_order_relaxed) == RESOLW_RANDOMID_PERMUTE) {
+            return next_permuted();
+        }
+        return next16();
     }
 };
 
@@ -71,6 +182,13 @@ extern "C" {
 
 int res_randomid() { return _tls_rnd(); }
 
+int resolw_randomid_mode(int mode) {
+    if(mode != RESOLW_RANDOMID_STREAM && mode != RESOLW_RANDOMID_PERMUTE) {
+        return _randomid_mode.load(std::memory_order_relaxed);
+    }
+    return _randomid_mode.exchange(mode, std::memory_order_relaxed);
+}
+
 /* __END_DECLS */
 #ifdef __cplusplus
 }
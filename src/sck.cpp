@@ -0,0 +1,198 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "net.h"
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+/**
+ * UDP source port pool. Every socket is bound to a port picked with
+ * `res_randomid()` (RFC 5452 §4.5: the source port is the second half
+ * of the spoofing defense), then reused by many queries so that the
+ * steady-state cost of a UDP exchange is sendto + poll + recvfrom.
+ * A socket is retired once it has carried `max_uses` queries or lived
+ * for `max_age` seconds, whichever comes first, so that its port does
+ * not stay predictable for long.
+ *
+ * Sockets are leased exclusively: two threads never wait on the same
+ * socket, and the pool itself only holds a mutex for a vector push/pop.
+ */
+
+namespace resolw_impl {
+
+namespace {
+
+constexpr unsigned kDefaultMaxUses = 64;
+constexpr unsigned kDefaultMaxAgeSec = 30;
+constexpr unsigned kDefaultMaxIdle = 64; // per address family
+constexpr int kBindAttempts = 16;
+constexpr unsigned kMinEphemeral = 1024;
+
+struct PooledSock {
+    sock_t fd;
+    unsigned uses;
+    uint64_t born_ns;
+};
+
+struct SockPool {
+    std::mutex mtx;
+    std::vector<PooledSock> idle[2]; // [0] = AF_INET, [1] = AF_INET6
+    std::atomic<unsigned> max_uses{kDefaultMaxUses};
+    std::atomic<unsigned> max_age_sec{kDefaultMaxAgeSec};
+    std::atomic<unsigned> max_idle{kDefaultMaxIdle};
+
+    ~SockPool() {
+        for(auto& v : idle) {
+            for(auto& ps : v) sock_close(ps.fd);
+        }
+    }
+
+    bool expired(const PooledSock& ps, uint64_t now) const {
+        return ps.uses >= max_uses.load(std::memory_order_relaxed)
+            || now - ps.born_ns >= max_age_sec.load(std::memory_order_relaxed) * 1000000000ull;
+    }
+};
+
+SockPool& pool() {
+    static SockPool instance;
+    return instance;
+}
+
+sock_t open_random_port(int family) {
+    sock_t fd = socket(family, SOCK_DGRAM, IPPROTO_UDP);
+    if(fd == kBadSock) return fd;
+    sockaddr_storage ss;
+    for(int attempt = 0; attempt <= kBindAttempts; ++attempt) {
+        // the final attempt lets the OS choose, which is still randomized on modern stacks
+        unsigned port = attempt < kBindAttempts ? kMinEphemeral + res_randomid() % (65536 - kMinEphemeral) : 0;
+        memset(&ss, 0, sizeof(ss));
+        if(family == AF_INET6) {
+            sockaddr_in6* sin6 = reinterpret_cast<sockaddr_in6*>(&ss);
+            sin6->sin6_family = AF_INET6;
+            sin6->sin6_port = htons(port);
+        } else {
+            sockaddr_in* sin = reinterpret_cast<sockaddr_in*>(&ss);
+            sin->sin_family = AF_INET;
+            sin->sin_port = htons(port);
+        }
+        if(!bind(fd, reinterpret_cast<sockaddr*>(&ss), sockaddr_len(reinterpret_cast<sockaddr*>(&ss)))) {
+            sock_nonblock(fd);
+            return fd;
+        }
+        if(sock_errno() != kErrAddrInUse) break;
+    }
+    sock_close(fd);
+    return kBadSock;
+}
+
+} // anonymous
+
+void net_startup() {
+#ifdef _WIN32
+    static const bool started = [] {
+        WSADATA wsa;
+        return !WSAStartup(MAKEWORD(2, 2), &wsa);
+    }();
+    (void) started;
+#endif
+}
+
+bool sockaddr_same(const sockaddr* a, const sockaddr* b) {
+    if(a->sa_family != b->sa_family) return false;
+    if(a->sa_family == AF_INET6) {
+        const sockaddr_in6* a6 = reinterpret_cast<const sockaddr_in6*>(a);
+        const sockaddr_in6* b6 = reinterpret_cast<const sockaddr_in6*>(b);
+        return a6->sin6_port == b6->sin6_port && !memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(in6_addr));
+    }
+    const sockaddr_in* a4 = reinterpret_cast<const sockaddr_in*>(a);
+    const sockaddr_in* b4 = reinterpret_cast<const sockaddr_in*>(b);
+    return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+}
+
+bool sockpool_acquire(int family, UdpLease* lease) {
+    net_startup();
+    SockPool& sp = pool();
+    auto& idle = sp.idle[family == AF_INET6];
+    uint64_t now = monotonic_ns();
+    PooledSock ps = {kBadSock, 0u, now};
+    {
+        std::lock_guard<std::mutex> lock(sp.mtx);
+        while(!idle.empty()) {
+            PooledSock cand = idle.back();
+            idle.pop_back();
+            if(!sp.expired(cand, now)) {
+                ps = cand;
+                break;
+            }
+            sock_close(cand.fd);
+        }
+    }
+    if(ps.fd == kBadSock) {
+        ps.fd = open_random_port(family);
+        if(ps.fd == kBadSock) return false;
+    }
+    lease->fd = ps.fd;
+    lease->family = family;
+    lease->uses = ps.uses + 1;
+    lease->born_ns = ps.born_ns;
+    return true;
+}
+
+sock_t sockpool_open(int family) {
+    net_startup();
+    return open_random_port(family);
+}
+
+uint64_t sockpool_max_age_ns() {
+    return pool().max_age_sec.load(std::memory_order_relaxed) * 1000000000ull;
+}
+
+void sockpool_release(UdpLease* lease, bool healthy) {
+    if(lease->fd == kBadSock) return;
+    PooledSock ps = {lease->fd, lease->uses, lease->born_ns};
+    lease->fd = kBadSock;
+    SockPool& sp = pool();
+    if(healthy && !sp.expired(ps, monotonic_ns())) {
+        std::lock_guard<std::mutex> lock(sp.mtx);
+        auto& idle = sp.idle[lease->family == AF_INET6];
+        if(idle.size() < sp.max_idle.load(std::memory_order_relaxed)) {
+            idle.push_back(ps);
+            return;
+        }
+    }
+    sock_close(ps.fd);
+}
+
+} // resolw_impl
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void resolw_sockpool_config(unsigned max_uses, unsigned max_age_sec, unsigned max_idle) {
+    using namespace resolw_impl;
+    SockPool& sp = pool();
+    if(max_uses) sp.max_uses.store(max_uses, std::memory_order_relaxed);
+    if(max_age_sec) sp.max_age_sec.store(max_age_sec, std::memory_order_relaxed);
+    if(max_idle) sp.max_idle.store(max_idle, std::memory_order_relaxed);
+}
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
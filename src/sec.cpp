@@ -0,0 +1,758 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "resolv.h"
+#include "resolw/resolw_dnssec.h"
+#include "net.h"
+
+#include <errno.h>
+
+#ifdef RESOLW_HAVE_DNSSEC
+
+#include "bke.h"
+#include "msg.h"
+#include "neg.h"
+#include "sec.h"
+#include "sts.h"
+#include "trc.h"
+
+#include <openssl/bn.h>
+#include <openssl/core_names.h>
+#include <openssl/ec.h>
+#include <openssl/param_build.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * DNSSEC validation (RFC 4033-4035) of getrrsetbyname() results. The
+ * chain of trust is walked upwards from the signer of the RRset: every
+ * zone's DNSKEY set must be signed by a key its parent's (validated) DS
+ * set vouches for, or by a key a trust anchor names. Validated key sets
+ * are kept per zone, and signatures already checked are remembered by a
+ * digest of key, signed data and signature, so the public-key operations
+ * are paid once per zone and RRset version rather than once per lookup.
+ *
+ * A zone is INSECURE without a DS set only if negative_proof() finds the
+ * parent's NSEC or NSEC3 denial of it valid (ERRSET_NODATA); an unproven
+ * "no DS" leaves it INDETERMINATE. A set that expands a wildcard is SECURE
+ * only with a proof, from the authority section of its answer, that no
+ * closer name exists (wildcard_proof()). Only SECURE sets RRSET_VALIDATED.
+ */
+
+namespace {
+
+using namespace resolw_impl;
+
+constexpr int kMaxDepth = 16; // zone cuts between an RRset and its anchor
+constexpr uint64_t kMaxCacheSec = 86400; // positive results, whatever the TTL says
+constexpr uint64_t kRetrySec = 300; // insecure and bogus zones are looked at again after this
+constexpr size_t kMaxZones = 1024;
+constexpr size_t kMaxVerdicts = 16384;
+constexpr unsigned kDnskeyZone = 0x0100; // DNSKEY flags
+constexpr unsigned kDnskeyProtocol = 3;
+constexpr size_t kRrsigFixed = 18; // RRSIG rdata up to the signer's name
+
+void wire_text(const Wire& w, char* out, size_t len) {
+    if(w.size() == 1) {
+        strncpy(out, ".", len); // msg_expand_name() spells the root ""
+    } else if(msg_expand_name(w.data(), w.data() + w.size(), w.data(), out, len) < 0) {
+        out[0] = '\0';
+    }
+}
+
+/* Lowercases the (uncompressed) name at `p`; returns the end of it, or null. */
+u_char* lower_at(u_char* p, u_char* end) {
+    int n = p < end ? msg_check_name(nullptr, nullptr, p, end) : -1;
+    if(n < 0) return nullptr;
+    wire_lower(p);
+    return p + n;
+}
+
+/* RFC 4034 section 6.2 (as amended by RFC 6840 section 5.1): the names in the rdata of these types are lowercased. */
+void canonical_rdata(unsigned type, u_char* p, u_char* end) {
+    switch(type) {
+        case T_NS: case kTypeMd: case kTypeMf: case T_CNAME: case kTypeMb: case kTypeMg: case kTypeMr:
+        case T_PTR: case T_DNAME:
+            lower_at(p, end);
+            break;
+        case T_SOA: case kTypeMinfo: case kTypeRp:
+            if((p = lower_at(p, end))) lower_at(p, end);
+            break;
+        case T_MX: case kTypeAfsdb: case kTypeRt: case T_KX:
+            if(end - p > 2) lower_at(p + 2, end);
+            break;
+        case kTypePx:
+            if(end - p > 2 && (p = lower_at(p + 2, end))) lower_at(p, end);
+            break;
+        case T_SRV:
+            if(end - p > 6) lower_at(p + 6, end);
+            break;
+        case T_NAPTR:
+            if(end - p < 4) break;
+            p += 4; // order, preference; then flags, services, regexp
+            for(int i = 0; i < 3 && p < end; ++i) p += 1 + *p;
+            if(p < end) lower_at(p, end);
+            break;
+    }
+}
+
+struct Rrsig {
+    unsigned covered, alg, labels, tag;
+    uint32_t orig_ttl, expiration, inception;
+    const u_char* rdata; // the whole of it
+    const u_char* signer;
+    size_t signer_len;
+    const u_char* sig;
+    size_t siglen;
+};
+
+bool parse_rrsig(const rdatainfo& ri, Rrsig& s) {
+    const u_char* p = ri.rdi_data;
+    if(!p || ri.rdi_length <= kRrsigFixed) return false;
+    int n = msg_check_name(nullptr, nullptr, p + kRrsigFixed, p + ri.rdi_length);
+    if(n < 0 || kRrsigFixed + n >= ri.rdi_length) return false;
+    s.covered = rd16(p);
+    s.alg = p[2];
+    s.labels = p[3];
+    s.orig_ttl = rd32(p + 4);
+    s.expiration = rd32(p + 8);
+    s.inception = rd32(p + 12);
+    s.tag = rd16(p + 16);
+    s.rdata = p;
+    s.signer = p + kRrsigFixed;
+    s.signer_len = n;
+    s.sig = s.signer + n;
+    s.siglen = ri.rdi_length - kRrsigFixed - n;
+    return true;
+}
+
+/* RFC 4034 section 3.1.5: serial number arithmetic, so that the window survives 2106. */
+bool in_window(const Rrsig& s, time_t now) {
+    const uint32_t t = (uint32_t) now;
+    return (int32_t) (t - s.inception) >= 0 && (int32_t) (s.expiration - t) >= 0;
+}
+
+/* Seconds left until the earliest of a TTL, a signature expiration and the cache bound, as a monotonic deadline. */
+uint64_t deadline(uint64_t now_ns, uint32_t ttl, const Rrsig& s, time_t wall) {
+    const int64_t left = (int32_t) (s.expiration - (uint32_t) wall);
+    const uint64_t sec = std::min<uint64_t>({ttl, (uint64_t) std::max<int64_t>(left, 0), kMaxCacheSec});
+    return now_ns + sec * 1000000000ull;
+}
+
+bool algorithm_supported(unsigned alg) {
+    switch(alg) {
+        case kAlgRsaSha1: case kAlgRsaSha1Nsec3: case kAlgRsaSha256: case kAlgRsaSha512:
+        case kAlgEcdsaP256: case kAlgEcdsaP384: case kAlgEd25519: case kAlgEd448:
+            return true;
+    }
+    return false;
+}
+
+/* RFC 4035 section 5.3.2: the data an RRSIG signs, with the RRset in canonical form and order. */
+bool signed_data(const Rrsig& s, const Wire& owner, unsigned type, unsigned rdclass,
+                 const rdatainfo* rdatas, unsigned count, std::vector<u_char>& out) {
+    const int labels = wire_labels(owner.data());
+    if((int) s.labels > labels) return false;
+    u_char name[MAXCDNAME + 2];
+    size_t namelen;
+    if((int) s.labels < labels) { // synthesized from a wildcard
+        const u_char* suffix = wire_suffix(owner.data(), s.labels);
+        namelen = wire_len(suffix);
+        name[0] = 1;
+        name[1] = '*';
+        memcpy(name + 2, suffix, namelen);
+        namelen += 2;
+    } else {
+        namelen = owner.size();
+        memcpy(name, owner.data(), namelen);
+    }
+
+    static thread_local std::vector<u_char> canon;
+    static thread_local std::vector<std::pair<size_t, size_t>> spans;
+    canon.clear();
+    spans.clear();
+    for(unsigned i = 0; i < count; ++i) {
+        const size_t at = canon.size(), len = rdatas[i].rdi_length;
+        if(len > 0xffff) return false;
+        canon.insert(canon.end(), rdatas[i].rdi_data, rdatas[i].rdi_data + len);
+        canonical_rdata(type, canon.data() + at, canon.data() + at + len);
+        spans.emplace_back(at, len);
+    }
+    const u_char* const base = canon.data();
+    auto less = [base](const std::pair<size_t, size_t>& a, const std::pair<size_t, size_t>& b) {
+        int c = memcmp(base + a.first, base + b.first, std::min(a.second, b.second));
+        return c ? c < 0 : a.second < b.second;
+    };
+    auto same = [base](const std::pair<size_t, size_t>& a, const std::pair<size_t, size_t>& b) {
+        return a.second == b.second && !memcmp(base + a.first, base + b.first, a.second);
+    };
+    std::sort(spans.begin(), spans.end(), less);
+    spans.erase(std::unique(spans.begin(), spans.end(), same), spans.end());
+
+    out.clear();
+    out.insert(out.end(), s.rdata, s.rdata + kRrsigFixed);
+    out.insert(out.end(), s.signer, s.signer + s.signer_len);
+    wire_lower(out.data() + kRrsigFixed);
+    for(const auto& span : spans) {
+        u_char fixed[10];
+        wr16(fixed, type);
+        wr16(fixed + 2, rdclass);
+        wr32(fixed + 4, s.orig_ttl);
+        wr16(fixed + 8, span.second);
+        out.insert(out.end(), name, name + namelen);
+        out.insert(out.end(), fixed, fixed + sizeof(fixed));
+        out.insert(out.end(), base + span.first, base + span.first + span.second);
+    }
+    return true;
+}
+
+/* RFC 4034 appendix B. */
+unsigned key_tag(const u_char* rdata, size_t len) {
+    uint32_t ac = 0;
+    for(size_t i = 0; i < len; ++i) ac += i & 1 ? rdata[i] : rdata[i] << 8;
+    ac += ac >> 16 & 0xffff;
+    return ac & 0xffff;
+}
+
+struct PkeyFree {
+    void operator()(EVP_PKEY* key) const { EVP_PKEY_free(key); }
+};
+
+struct Key {
+    std::vector<u_char> rdata;
+    unsigned tag, alg;
+    std::unique_ptr<EVP_PKEY, PkeyFree> pkey;
+};
+
+/* A zone key this library can verify with; false for anything else. */
+bool parse_dnskey(const rdatainfo& ri, Key& k) {
+    const u_char* p = ri.rdi_data;
+    if(!p || ri.rdi_length <= 4) return false;
+    if(!(rd16(p) & kDnskeyZone) || p[2] != kDnskeyProtocol) return false;
+    k.alg = p[3];
+    k.pkey.reset(dnssec_parse_key(k.alg, p + 4, ri.rdi_length - 4));
+    if(!k.pkey) return false;
+    k.rdata.assign(p, p + ri.rdi_length);
+    k.tag = key_tag(p, ri.rdi_length);
+    return true;
+}
+
+const EVP_MD* ds_digest(unsigned type) {
+    switch(type) {
+        case 1: return EVP_sha1();
+        case 2: return EVP_sha256();
+        case 4: return EVP_sha384();
+    }
+    return nullptr;
+}
+
+bool ds_supported(const u_char* ds, size_t len) {
+    return len > 4 && algorithm_supported(ds[2]) && ds_digest(ds[3]);
+}
+
+/* RFC 4034 section 5.1.4: the DS digest is over the owner name and the DNSKEY rdata. */
+bool ds_matches(const u_char* ds, size_t len, const Wire& owner, const Key& k) {
+    if(len <= 4 || rd16(ds) != k.tag || ds[2] != k.alg) return false;
+    const EVP_MD* md = ds_digest(ds[3]);
+    if(!md || len - 4 != (size_t) EVP_MD_get_size(md)) return false;
+    u_char digest[EVP_MAX_MD_SIZE];
+    unsigned dlen = 0;
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    bool ok = ctx && EVP_DigestInit_ex(ctx, md, nullptr) == 1
+            && EVP_DigestUpdate(ctx, owner.data(), owner.size()) == 1
+            && EVP_DigestUpdate(ctx, k.rdata.data(), k.rdata.size()) == 1
+            && EVP_DigestFinal_ex(ctx, digest, &dlen) == 1;
+    EVP_MD_CTX_free(ctx);
+    return ok && dlen == len - 4 && !memcmp(digest, ds + 4, dlen);
+}
+
+struct KeySet {
+    int status; // RESOLW_DNSSEC_*
+    uint64_t expires_ns;
+    std::vector<Key> keys; // when SECURE: every zone key of the DNSKEY set
+};
+
+typedef std::shared_ptr<const KeySet> KeySetRef;
+typedef std::array<u_char, 32> Digest;
+
+struct Anchor {
+    Wire owner;
+    unsigned type; // T_DS or T_DNSKEY
+    std::vector<u_char> rdata;
+};
+
+struct Caches {
+    std::mutex lock;
+    std::vector<Anchor> anchors;
+    std::map<Wire, KeySetRef> zones;
+    std::map<Digest, uint64_t> verdicts; // signatures known to be good, until when
+
+    Caches() { default_anchors(); }
+
+    /* The root zone's KSK-2017 and KSK-2024, as published at https://data.iana.org/root-anchors/ */
+    void default_anchors() {
+        static const char* const ds[] = {
+            "4f66" "08" "02" "E06D44B80B8F1D39A95C0B0D7C65D08458E880409BBC683457104237C7F8EC8D",
+            "9728" "08" "02" "683D2D0ACB8C9B712A1948B27F741219298D0A450D612C483AF444A4C0FB2B16",
+        };
+        for(const char* hex : ds) {
+            Anchor a{Wire(1, 0), T_DS, {}};
+            for(const char* p = hex; p[0] && p[1]; p += 2) {
+                auto nibble = [](char c) { return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10; };
+                a.rdata.push_back(nibble(p[0]) << 4 | nibble(p[1]));
+            }
+            anchors.push_back(std::move(a));
+        }
+    }
+};
+
+Caches& caches() {
+    static Caches* instance = new Caches(); // never destroyed: lookups may outlive static destruction
+    return *instance;
+}
+
+KeySetRef remember(const Wire& zone, std::shared_ptr<KeySet> set, uint64_t expires_ns) {
+    set->expires_ns = expires_ns;
+    Caches& c = caches();
+    std::lock_guard<std::mutex> guard(c.lock);
+    if(c.zones.size() >= kMaxZones) c.zones.clear(); // rare; refilling costs a few lookups
+    c.zones[zone] = set;
+    return set;
+}
+
+/* Whether `k` signed `data` with `s`; the answer is remembered when it is yes. */
+bool check_signature(const Key& k, const Rrsig& s, const std::vector<u_char>& data, time_t wall) {
+    Digest d;
+    unsigned dlen = 0;
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    bool hashed = ctx && EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) == 1
+            && EVP_DigestUpdate(ctx, k.rdata.data(), k.rdata.size()) == 1
+            && EVP_DigestUpdate(ctx, data.data(), data.size()) == 1
+            && EVP_DigestUpdate(ctx, s.sig, s.siglen) == 1
+            && EVP_DigestFinal_ex(ctx, d.data(), &dlen) == 1;
+    EVP_MD_CTX_free(ctx);
+    Caches& c = caches();
+    const uint64_t now = monotonic_ns();
+    if(hashed) {
+        std::lock_guard<std::mutex> guard(c.lock);
+        auto it = c.verdicts.find(d);
+        if(it != c.verdicts.end()) {
+            if(it->second > now) {
+                stats_cache(true);
+                return true;
+            }
+            c.verdicts.erase(it);
+        }
+    }
+    stats_cache(false);
+    if(!dnssec_verify(k.pkey.get(), s.alg, data.data(), data.size(), s.sig, s.siglen)) return false;
+    if(hashed) {
+        std::lock_guard<std::mutex> guard(c.lock);
+        if(c.verdicts.size() >= kMaxVerdicts) c.verdicts.clear();
+        c.verdicts[d] = deadline(now, UINT32_MAX, s, wall);
+    }
+    return true;
+}
+
+struct RrsetFree {
+    void operator()(rrsetinfo* r) const { freerrset(r); }
+};
+
+typedef std::unique_ptr<rrsetinfo, RrsetFree> Rrset;
+
+int fetch(res_state rs, const Wire& name, unsigned type, Rrset& out) {
+    char text[MAXDNAME + 1];
+    wire_text(name, text, sizeof(text));
+    rrsetinfo* r = nullptr;
+    int rv = backend_rrset(rs, text, C_IN, type, &r);
+    out.reset(rv ? nullptr : r);
+    return rv;
+}
+
+KeySetRef zone_keys(res_state rs, const Wire& zone, int depth);
+
+/**
+ * `delegation`: the RRset is a DS set, which the zone above signs rather
+ * than `owner` itself. `msg` is the answer the RRset came in, if known: a
+ * set expanded from a wildcard is SECURE only if its authority section
+ * proves that no closer name exists, and INDETERMINATE otherwise.
+ */
+DnssecVerdict validate(res_state rs, const Wire& owner, unsigned type, unsigned rdclass, uint32_t ttl,
+                 const rdatainfo* rdatas, unsigned count, const rdatainfo* sigs, unsigned nsigs,
+                 bool delegation, int depth, const u_char* msg = nullptr, int msglen = 0) {
+    const time_t wall = time(nullptr);
+    bool insecure = false, bogus = false;
+    std::vector<u_char> data;
+    for(unsigned i = 0; i < nsigs; ++i) {
+        Rrsig s;
+        if(!parse_rrsig(sigs[i], s) || s.covered != type || !algorithm_supported(s.alg)) continue;
+        Wire signer(s.signer, s.signer + s.signer_len);
+        wire_lower(signer.data());
+        if(!wire_under(owner.data(), signer.data()) || (delegation && signer == owner)) {
+            bogus = true; // a signer with no authority over the name
+            continue;
+        }
+        if(!in_window(s, wall)) {
+            bogus = true;
+            continue;
+        }
+        KeySetRef keys = zone_keys(rs, signer, depth + 1);
+        if(keys->status != RESOLW_DNSSEC_SECURE) {
+            insecure |= keys->status == RESOLW_DNSSEC_INSECURE;
+            bogus |= keys->status == RESOLW_DNSSEC_BOGUS;
+            continue;
+        }
+        if(!signed_data(s, owner, type, rdclass, rdatas, count, data)) {
+            bogus = true;
+            continue;
+        }
+        for(const Key& k : keys->keys) {
+            if(k.tag == s.tag && k.alg == s.alg && check_signature(k, s, data, wall)) {
+                const uint64_t expires = deadline(monotonic_ns(), std::min(ttl, s.orig_ttl), s, wall);
+                const bool wildcard = (int) s.labels < wire_labels(owner.data());
+                if(wildcard && !wildcard_proof(rs, msg, msglen, owner.data(), s.labels, depth + 1)) {
+                    return DnssecVerdict{RESOLW_DNSSEC_INDETERMINATE, 0, {}, false}; // RFC 4035 section 5.3.4
+                }
+                return DnssecVerdict{RESOLW_DNSSEC_SECURE, std::min(expires, keys->expires_ns), signer, wildcard};
+            }
+        }
+        bogus = true;
+    }
+    if(insecure) return DnssecVerdict{RESOLW_DNSSEC_INSECURE, 0, {}, false};
+    return DnssecVerdict{bogus ? RESOLW_DNSSEC_BOGUS : RESOLW_DNSSEC_INDETERMINATE, 0, {}, false};
+}
+
+/* The validated zone keys of `zone`, from the cache or from a walk towards an anchor. */
+KeySetRef zone_keys(res_state rs, const Wire& zone, int depth) {
+    Caches& c = caches();
+    const uint64_t now = monotonic_ns();
+    std::vector<Anchor> anchors;
+    {
+        std::lock_guard<std::mutex> guard(c.lock);
+        auto it = c.zones.find(zone);
+        if(it != c.zones.end() && it->second->expires_ns > now) {
+            stats_cache(true);
+            return it->second;
+        }
+        for(const Anchor& a : c.anchors) {
+            if(a.owner == zone) anchors.push_back(a);
+        }
+    }
+    stats_cache(false);
+    auto set = std::make_shared<KeySet>();
+    set->status = RESOLW_DNSSEC_INDETERMINATE;
+    set->expires_ns = 0;
+    if(depth > kMaxDepth) return set;
+    const uint64_t retry = now + kRetrySec * 1000000000ull;
+
+    // what vouches for the keys: the anchors, or else the DS set in the parent zone
+    Rrset ds;
+    uint64_t expires = now + kMaxCacheSec * 1000000000ull;
+    if(anchors.empty()) {
+        if(zone.size() == 1) { // no anchor for the root: nothing is secure
+            set->status = RESOLW_DNSSEC_INSECURE;
+            return remember(zone, set, retry);
+        }
+        int rv = fetch(rs, zone, T_DS, ds);
+        if(rv == ERRSET_NODATA || rv == ERRSET_NONAME) {
+            // unsigned only if the parent proves it: an unsigned "no DS" is as easily spoofed as anything else
+            const u_char* msg;
+            const int len = backend_negative(&msg);
+            if(negative_proof(rs, msg, len, zone.data(), T_DS, depth + 1) != ERRSET_NODATA) return set;
+            set->status = RESOLW_DNSSEC_INSECURE;
+            return remember(zone, set, retry);
+        }
+        if(rv) return set;
+        DnssecVerdict v = validate(rs, zone, T_DS, C_IN, ds->rri_ttl, ds->rri_rdatas, ds->rri_nrdatas,
+                             ds->rri_sigs, ds->rri_nsigs, true, depth);
+        if(v.status != RESOLW_DNSSEC_SECURE) {
+            set->status = v.status;
+            return v.status == RESOLW_DNSSEC_INDETERMINATE ? KeySetRef(set) : remember(zone, set, retry);
+        }
+        bool usable = false; // RFC 4035 section 5.2: a DS set with nothing understood in it is as good as none
+        for(unsigned i = 0; i < ds->rri_nrdatas; ++i) {
+            usable |= ds_supported(ds->rri_rdatas[i].rdi_data, ds->rri_rdatas[i].rdi_length);
+        }
+        if(!usable) {
+            set->status = RESOLW_DNSSEC_INSECURE;
+            return remember(zone, set, retry);
+        }
+        expires = v.expires_ns;
+    }
+
+    Rrset dnskeys;
+    if(fetch(rs, zone, T_DNSKEY, dnskeys)) return set;
+    std::vector<Key> keys;
+    for(unsigned i = 0; i < dnskeys->rri_nrdatas; ++i) {
+        Key k;
+        if(parse_dnskey(dnskeys->rri_rdatas[i], k)) keys.push_back(std::move(k));
+    }
+    std::vector<const Key*> trusted;
+    for(const Key& k : keys) {
+        bool vouched = false;
+        for(const Anchor& a : anchors) {
+            vouched |= a.type == T_DNSKEY ? a.rdata == k.rdata : ds_matches(a.rdata.data(), a.rdata.size(), zone, k);
+        }
+        for(unsigned i = 0; ds && i < ds->rri_nrdatas; ++i) {
+            vouched |= ds_matches(ds->rri_rdatas[i].rdi_data, ds->rri_rdatas[i].rdi_length, zone, k);
+        }
+        if(vouched) trusted.push_back(&k);
+    }
+
+    // the DNSKEY set must be signed by one of the keys vouched for
+    const time_t wall = time(nullptr);
+    std::vector<u_char> data;
+    for(unsigned i = 0; i < dnskeys->rri_nsigs; ++i) {
+        Rrsig s;
+        if(trusted.empty() || !parse_rrsig(dnskeys->rri_sigs[i], s) || s.covered != T_DNSKEY || !in_window(s, wall)) continue;
+        Wire signer(s.signer, s.signer + s.signer_len);
+        wire_lower(signer.data());
+        if(signer != zone || !signed_data(s, zone, T_DNSKEY, C_IN, dnskeys->rri_rdatas, dnskeys->rri_nrdatas, data)) continue;
+        for(const Key* k : trusted) {
+            if(k->tag == s.tag && k->alg == s.alg && check_signature(*k, s, data, wall)) {
+                set->status = RESOLW_DNSSEC_SECURE;
+                set->keys = std::move(keys);
+                const uint64_t own = deadline(now, std::min(dnskeys->rri_ttl, s.orig_ttl), s, wall);
+                return remember(zone, set, std::min(expires, own));
+            }
+        }
+    }
+    set->status = RESOLW_DNSSEC_BOGUS;
+    return remember(zone, set, retry);
+}
+
+EVP_PKEY* from_params(const char* type, OSSL_PARAM* params) {
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_from_name(nullptr, type, nullptr);
+    EVP_PKEY* key = nullptr;
+    if(!ctx || EVP_PKEY_fromdata_init(ctx) <= 0 || EVP_PKEY_fromdata(ctx, &key, EVP_PKEY_PUBLIC_KEY, params) <= 0) {
+        key = nullptr;
+    }
+    EVP_PKEY_CTX_free(ctx);
+    return key;
+}
+
+/* RFC 3110 section 2: exponent length (1 or 3 bytes), exponent, modulus. */
+EVP_PKEY* rsa_key(const u_char* pub, size_t len) {
+    if(len < 3) return nullptr;
+    size_t elen = pub[0], off = 1;
+    if(!elen) {
+        elen = rd16(pub + 1);
+        off = 3;
+    }
+    if(!elen || off + elen >= len) return nullptr;
+    BIGNUM* e = BN_bin2bn(pub + off, elen, nullptr);
+    BIGNUM* n = BN_bin2bn(pub + off + elen, len - off - elen, nullptr);
+    OSSL_PARAM_BLD* bld = OSSL_PARAM_BLD_new();
+    EVP_PKEY* key = nullptr;
+    if(e && n && bld && OSSL_PARAM_BLD_push_BN(bld, OSSL_PKEY_PARAM_RSA_N, n)
+            && OSSL_PARAM_BLD_push_BN(bld, OSSL_PKEY_PARAM_RSA_E, e)) {
+        OSSL_PARAM* params = OSSL_PARAM_BLD_to_param(bld);
+        if(params) key = from_params("RSA", params);
+        OSSL_PARAM_free(params);
+    }
+    OSSL_PARAM_BLD_free(bld);
+    BN_free(e);
+    BN_free(n);
+    return key;
+}
+
+/* RFC 6605 section 4: the point's X and Y, without the uncompressed-point prefix. */
+EVP_PKEY* ec_key(const char* group, const u_char* pub, size_t len, size_t want) {
+    if(len != want) return nullptr;
+    u_char point[1 + 96];
+    point[0] = 0x04;
+    memcpy(point + 1, pub, len);
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_utf8_string(OSSL_PKEY_PARAM_GROUP_NAME, const_cast<char*>(group), 0),
+        OSSL_PARAM_construct_octet_string(OSSL_PKEY_PARAM_PUB_KEY, point, len + 1),
+        OSSL_PARAM_construct_end(),
+    };
+    return from_params("EC", params);
+}
+
+const EVP_MD* sig_digest(unsigned alg) {
+    switch(alg) {
+        case kAlgRsaSha1: case kAlgRsaSha1Nsec3: return EVP_sha1();
+        case kAlgRsaSha256: case kAlgEcdsaP256: return EVP_sha256();
+        case kAlgEcdsaP384: return EVP_sha384();
+        case kAlgRsaSha512: return EVP_sha512();
+    }
+    return nullptr; // EdDSA hashes internally
+}
+
+} // anonymous
+
+namespace resolw_impl {
+
+EVP_PKEY* dnssec_parse_key(unsigned alg, const u_char* pub, size_t len) {
+    switch(alg) {
+        case kAlgRsaSha1: case kAlgRsaSha1Nsec3: case kAlgRsaSha256: case kAlgRsaSha512:
+            return rsa_key(pub, len);
+        case kAlgEcdsaP256: return ec_key("prime256v1", pub, len, 64);
+        case kAlgEcdsaP384: return ec_key("secp384r1", pub, len, 96);
+        case kAlgEd25519: return len == 32 ? EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, nullptr, pub, len) : nullptr;
+        case kAlgEd448: return len == 57 ? EVP_PKEY_new_raw_public_key(EVP_PKEY_ED448, nullptr, pub, len) : nullptr;
+    }
+    return nullptr;
+}
+
+DnssecVerdict dnssec_check_rrset(res_state rs, const u_char* owner, unsigned type, unsigned rdclass, uint32_t ttl,
+                                 const rdatainfo* rdatas, unsigned count, const rdatainfo* sigs, unsigned nsigs,
+                                 int depth) {
+    Wire name(owner, owner + wire_len(owner));
+    wire_lower(name.data());
+    return validate(rs, name, type, rdclass, ttl, rdatas, count, sigs, nsigs, type == T_DS, depth);
+}
+
+bool dnssec_verify(EVP_PKEY* key, unsigned alg, const u_char* data, size_t len, const u_char* sig, size_t siglen) {
+    u_char der[2 * (3 + 49) + 3]; // an ECDSA-Sig-Value for P-384 at its largest
+    if(alg == kAlgEcdsaP256 || alg == kAlgEcdsaP384) { // RFC 6605 section 4: r and s back to back; OpenSSL wants DER
+        const size_t half = alg == kAlgEcdsaP256 ? 32 : 48;
+        if(siglen != 2 * half) return false;
+        ECDSA_SIG* es = ECDSA_SIG_new();
+        BIGNUM* r = BN_bin2bn(sig, half, nullptr);
+        BIGNUM* s = BN_bin2bn(sig + half, half, nullptr);
+        if(!es || !r || !s || !ECDSA_SIG_set0(es, r, s)) {
+            BN_free(r);
+            BN_free(s);
+            ECDSA_SIG_free(es);
+            return false;
+        }
+        u_char* p = der;
+        int n = i2d_ECDSA_SIG(es, &p);
+        ECDSA_SIG_free(es); // r and s with it
+        if(n <= 0) return false;
+        sig = der;
+        siglen = n;
+    }
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    bool ok = ctx && EVP_DigestVerifyInit(ctx, nullptr, sig_digest(alg), nullptr, key) == 1
+            && EVP_DigestVerify(ctx, sig, siglen, data, len) == 1;
+    EVP_MD_CTX_free(ctx);
+    return ok;
+}
+
+int dnssec_validate(res_state statp, const rrsetinfo* rrset, bool fetched) {
+    u_char wire[MAXCDNAME]; // checked on the stack: an unsigned set, the usual case, costs no allocation
+    if(!statp || !rrset || !rrset->rri_name || msg_pack_name(rrset->rri_name, wire, sizeof(wire)) <= 0) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    if(!(statp->options & RES_INIT)) { res_ninit(statp); } // see comment to RES_INIT
+    if(!rrset->rri_nsigs) return RESOLW_DNSSEC_INDETERMINATE;
+    std::vector<u_char> answer; // copied, since the validation's own queries reuse the backend's buffer
+    const int labels = wire_labels(wire);
+    for(unsigned i = 0; fetched && answer.empty() && i < rrset->rri_nsigs; ++i) {
+        const rdatainfo& sig = rrset->rri_sigs[i];
+        if(sig.rdi_length > 3 && sig.rdi_data[3] < labels) { // an expansion, which needs the proof in the answer
+            const u_char* msg;
+            const int len = backend_answer(&msg);
+            answer.assign(msg, msg + len);
+        }
+    }
+    Wire owner;
+    to_wire(rrset->rri_name, owner);
+    TraceScope trace(rrset->rri_name, rrset->rri_rdtype, statp->id);
+    DnssecVerdict v = validate(statp, owner, rrset->rri_rdtype, rrset->rri_rdclass, rrset->rri_ttl,
+                               rrset->rri_rdatas, rrset->rri_nrdatas, rrset->rri_sigs, rrset->rri_nsigs, false, 0,
+                               answer.data(), (int) answer.size());
+    trace.complete(v.status, -1);
+    return v.status;
+}
+
+} // resolw_impl
+
+#endif /* RESOLW_HAVE_DNSSEC */
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef RESOLW_HAVE_DNSSEC
+
+int resolw_dnssec_validate(res_state statp, const struct rrsetinfo *rrset)
+{
+    return dnssec_validate(statp, rrset, false);
+}
+
+int resolw_dnssec_add_anchor(const char *owner, unsigned type, const u_char *rdata, size_t rdlen)
+{
+    Anchor a;
+    if(!owner || !rdata || rdlen <= 4 || rdlen > 0xffff || (type != T_DS && type != T_DNSKEY) || !to_wire(owner, a.owner)) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    a.type = type;
+    a.rdata.assign(rdata, rdata + rdlen);
+    Caches& c = caches();
+    std::lock_guard<std::mutex> guard(c.lock);
+    c.zones.clear(); // whatever was decided without the anchor
+    c.anchors.push_back(std::move(a));
+    return 0;
+}
+
+void resolw_dnssec_clear_anchors(void)
+{
+    Caches& c = caches();
+    std::lock_guard<std::mutex> guard(c.lock);
+    c.anchors.clear();
+    c.zones.clear();
+    c.verdicts.clear();
+    negative_flush();
+}
+
+void resolw_dnssec_flush(void)
+{
+    Caches& c = caches();
+    std::lock_guard<std::mutex> guard(c.lock);
+    c.zones.clear();
+    c.verdicts.clear();
+    negative_flush();
+}
+
+#else /* no OpenSSL: nothing can be validated */
+
+int resolw_dnssec_validate(res_state statp, const struct rrsetinfo *rrset)
+{
+    if(!statp || !rrset) {
+        resolw_impl::set_last_error(EINVAL);
+        return -1;
+    }
+    return RESOLW_DNSSEC_INDETERMINATE;
+}
+
+int resolw_dnssec_add_anchor(const char *owner, unsigned type, const u_char *rdata, size_t rdlen)
+{
+    (void) owner; (void) type; (void) rdata; (void) rdlen;
+    resolw_impl::set_last_error(ENOSYS);
+    return -1;
+}
+
+void resolw_dnssec_clear_anchors(void) {}
+
+void resolw_dnssec_flush(void) {}
+
+#endif /* RESOLW_HAVE_DNSSEC */
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,102 @@
+#ifndef _SRC_SEC_H_
+#define _SRC_SEC_H_
+
+#include "resolv.h"
+#include "msg.h"
+#include <netdb.h>
+#include <openssl/evp.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+// The validator under `resolw_dnssec_validate()`, for getrrsetbyname()
+// (res.cpp), the negative cache (neg.cpp) and the benchmarks, and the wire
+// name helpers TSIG (tsg.cpp) shares. Only built with RESOLW_HAVE_DNSSEC.
+
+namespace resolw_impl {
+
+/* A lowercased uncompressed name in wire format. */
+typedef std::vector<u_char> Wire;
+
+inline size_t wire_len(const u_char* n) {
+    const u_char* p = n;
+    while(*p) p += *p + 1;
+    return p - n + 1;
+}
+
+inline int wire_labels(const u_char* n) {
+    int count = 0;
+    for(; *n; n += *n + 1) ++count;
+    return count;
+}
+
+inline void wire_lower(u_char* n) {
+    for(; *n; n += *n + 1) {
+        for(int i = 1; i <= *n; ++i) {
+            if(n[i] >= 'A' && n[i] <= 'Z') n[i] += 'a' - 'A';
+        }
+    }
+}
+
+/* The ancestor of `n` (or `n` itself) with `keep` labels. */
+inline const u_char* wire_suffix(const u_char* n, int keep) {
+    for(int skip = wire_labels(n) - keep; skip > 0; --skip) n += *n + 1;
+    return n;
+}
+
+inline bool wire_under(const u_char* child, const u_char* parent) {
+    const int labels = wire_labels(parent);
+    if(wire_labels(child) < labels) return false;
+    return !memcmp(wire_suffix(child, labels), parent, wire_len(parent));
+}
+
+inline bool to_wire(const char* name, Wire& out) {
+    u_char buf[MAXCDNAME];
+    int n = msg_pack_name(name, buf, sizeof(buf));
+    if(n <= 0) return false;
+    wire_lower(buf);
+    out.assign(buf, buf + n);
+    return true;
+}
+
+/* DNSSEC algorithm numbers (RFC 8624) this library validates. */
+enum {
+    kAlgRsaSha1 = 5,
+    kAlgRsaSha1Nsec3 = 7,
+    kAlgRsaSha256 = 8,
+    kAlgRsaSha512 = 10,
+    kAlgEcdsaP256 = 13,
+    kAlgEcdsaP384 = 14,
+    kAlgEd25519 = 15,
+    kAlgEd448 = 16,
+};
+
+/* The public key field of a DNSKEY as an EVP_PKEY; null if the algorithm is unsupported or the key malformed. */
+EVP_PKEY* dnssec_parse_key(unsigned alg, const u_char* pub, size_t len);
+
+/* What resolw_dnssec_validate() makes of one RRset. */
+struct DnssecVerdict {
+    int status; // RESOLW_DNSSEC_*; the rest is only filled in when SECURE
+    uint64_t expires_ns; // the monotonic time the verdict holds until
+    std::vector<u_char> signer; // the signing zone, lowercased wire format
+    bool wildcard; // the RRset was synthesized from a wildcard
+};
+
+/* Validates an RRset given in parts; `owner` is in wire format. `depth` counts the zones walked so far. */
+DnssecVerdict dnssec_check_rrset(res_state rs, const u_char* owner, unsigned type, unsigned rdclass, uint32_t ttl,
+                                 const rdatainfo* rdatas, unsigned count, const rdatainfo* sigs, unsigned nsigs,
+                                 int depth = 0);
+
+/**
+ * resolw_dnssec_validate(); with `fetched`, `rrset` is what this thread's
+ * last backend_rrset() returned, and the answer it came in is used as
+ * proof for a wildcard expansion.
+ */
+int dnssec_validate(res_state statp, const rrsetinfo* rrset, bool fetched);
+
+/* Checks one RRSIG signature (in its DNSSEC encoding) over `data`, the signed data of RFC 4034 section 3.1.8.1. */
+bool dnssec_verify(EVP_PKEY* key, unsigned alg, const u_char* data, size_t len, const u_char* sig, size_t siglen);
+
+} // resolw_impl
+
+#endif /* _SRC_SEC_H_ */
@@ -0,0 +1,793 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "net.h"
+#include "msg.h"
+#include "sts.h"
+#include "tls.h"
+#include "tmr.h"
+#include "trc.h"
+#include "tsg.h"
+
+#include <errno.h>
+#include <algorithm>
+#include <cstring>
+
+/**
+ * Native `res_nsend()`. WinDNS has no call that sends a preformatted
+ * message, so unlike the rest of the query API this one talks to the
+ * configured name servers directly: UDP through the source port pool
+ * (or the I/O threads of iot.cpp, or the shared sockets of mux.cpp),
+ * TCP for RES_USEVC, oversized messages and truncated UDP answers.
+ * Servers registered for DNS over TLS (resolw_tls.h) get every message
+ * over TLS instead. Failover follows BIND: every server is tried once
+ * per round, and the per-server wait is `retrans << round`, split
+ * between servers after the first round; with resolw_hedge_config(),
+ * the second server is asked as well once the first is late (hdg.cpp).
+ * The answer to a TSIG-signed
+ * message has to be signed with the same key; anything else is dropped
+ * like a spoofed answer.
+ */
+
+namespace resolw_impl {
+
+bool wait_for(sock_t fd, short events, uint64_t deadline_ns) {
+    pollfd_t pfd;
+    pfd.fd = fd;
+    pfd.events = events;
+    pfd.revents = 0;
+    for(;;) {
+        int ms = remaining_ms(deadline_ns);
+        int rc = sock_poll(&pfd, 1, ms);
+        if(rc > 0) return true;
+        if(!rc || sock_errno() != EINTR) return false;
+    }
+}
+
+bool write_all(sock_t fd, const u_char* p, int len, uint64_t deadline_ns) {
+    while(len > 0) {
+        int n = send(fd, reinterpret_cast<const char*>(p), len, 0);
+        if(n > 0) {
+            p += n;
+            len -= n;
+        } else if(n < 0 && (sock_errno() == kErrWouldBlock || sock_errno() == EINTR)) {
+            if(!wait_for(fd, POLLOUT, deadline_ns)) return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool read_all(sock_t fd, u_char* p, int len, uint64_t deadline_ns) {
+    u_char sink[512];
+    while(len > 0) {
+        u_char* dst = p ? p : sink;
+        int want = p ? len : std::min(len, (int) sizeof(sink));
+        int n = recv(fd, reinterpret_cast<char*>(dst), want, 0);
+        if(n > 0) {
+            if(p) p += n;
+            len -= n;
+        } else if(n < 0 && (sock_errno() == kErrWouldBlock || sock_errno() == EINTR)) {
+            if(!wait_for(fd, POLLIN, deadline_ns)) return false;
+        } else {
+            return false; // EOF or hard error
+        }
+    }
+    return true;
+}
+
+namespace {
+
+/* One UDP exchange. Sets `truncated` if the answer came back with TC. */
+int send_dg(const sockaddr* ns, const u_char* msg, int msglen, u_char* answer, int anslen,
+            uint64_t deadline_ns, bool& truncated, TsigSession* tsig) {
+    int shared = io_send(ns, msg, msglen, answer, anslen, deadline_ns, truncated, tsig);
+    if(shared == kSendUnshared) shared = mux_send(ns, msg, msglen, answer, anslen, deadline_ns, truncated, tsig);
+    if(shared != kSendUnshared) return shared;
+    StatsServer* stats = stats_server(ns);
+    UdpLease lease;
+    if(!sockpool_acquire(ns->sa_family, &lease)) {
+        stats_error(stats);
+        return kSendFailed;
+    }
+    uint64_t sent_ns = monotonic_ns();
+    stats_query(stats);
+    if(sendto(lease.fd, reinterpret_cast<const char*>(msg), msglen, 0, ns, sockaddr_len(ns)) != msglen) {
+        stats_error(stats);
+        sockpool_release(&lease, false);
+        return kSendFailed;
+    }
+    while(wait_for(lease.fd, POLLIN, deadline_ns)) {
+        sockaddr_storage from;
+        socklen_t fromlen = sizeof(from);
+        int n = recvfrom(lease.fd, reinterpret_cast<char*>(answer), anslen, 0,
+                         reinterpret_cast<sockaddr*>(&from), &fromlen);
+        if(n < 0) {
+            int err = sock_errno();
+            if(err == kErrWouldBlock || err == EINTR) continue;
+            stats_error(stats);
+            sockpool_release(&lease, false); // e.g. ICMP port unreachable
+            return kSendFailed;
+        }
+        // anything not from the server we asked, or not about what we asked, is noise (or an attack)
+        if(!sockaddr_same(reinterpret_cast<sockaddr*>(&from), ns)) continue;
+        if(!msg_is_reply_to(msg, msglen, answer, n)) continue;
+        if(tsig && tsig->check(answer, n, true)) continue;
+        truncated = rd16(answer + kHdrFlags) & kFlagTC;
+        stats_response(stats, monotonic_ns() - sent_ns, truncated);
+        sockpool_release(&lease, true);
+        return n;
+    }
+    stats_timeout(stats);
+    sockpool_release(&lease, true);
+    return kSendTimeout;
+}
+
+/* A non-blocking TCP connection to `ns`, on its way; kBadSock on failure. */
+sock_t vc_connect(const sockaddr* ns) {
+    sock_t fd = socket(ns->sa_family, SOCK_STREAM, IPPROTO_TCP);
+    if(fd == kBadSock) return kBadSock;
+    sock_nonblock(fd);
+    if(connect(fd, ns, sockaddr_len(ns)) && sock_errno() != kErrInProgress && sock_errno() != kErrWouldBlock) {
+        sock_close(fd);
+        return kBadSock;
+    }
+    return fd;
+}
+
+/* Writes `msg` to `fd` with RFC 1035 §4.2.2 two-byte length framing. */
+bool vc_write(sock_t fd, const u_char* msg, int msglen, uint64_t deadline_ns) {
+    u_char len[2];
+    wr16(len, msglen);
+    return write_all(fd, len, 2, deadline_ns) && write_all(fd, msg, msglen, deadline_ns);
+}
+
+/* Reads from `fd` until the answer to `msg` arrives; its length, or kSendFailed. */
+int vc_read(sock_t fd, const u_char* msg, int msglen, u_char* answer, int anslen, uint64_t deadline_ns,
+            TsigSession* tsig) {
+    u_char len[2];
+    for(;;) {
+        if(!read_all(fd, len, 2, deadline_ns)) return kSendFailed;
+        int rlen = rd16(len);
+        int keep = std::min(rlen, anslen);
+        if(!read_all(fd, answer, keep, deadline_ns) || !read_all(fd, nullptr, rlen - keep, deadline_ns)) {
+            return kSendFailed;
+        }
+        if(keep < kHdrSize || !msg_is_reply_to(msg, msglen, answer, keep)) continue; // stale; keep reading
+        if(tsig && (keep < rlen || tsig->check(answer, keep, true))) return kSendFailed; // no one else could have sent it
+        if(keep < rlen) {
+            wr16(answer + kHdrFlags, rd16(answer + kHdrFlags) | kFlagTC); // caller's buffer was too small
+        }
+        return keep;
+    }
+}
+
+/* Counts how a TCP exchange sent at `sent_ns` ended; `result` as it is, or kSendTimeout past the deadline. */
+int vc_account(StatsServer* stats, int result, const u_char* answer, uint64_t sent_ns, uint64_t deadline_ns) {
+    if(result > 0) {
+        stats_response(stats, monotonic_ns() - sent_ns, rd16(answer + kHdrFlags) & kFlagTC);
+    } else if(!remaining_ms(deadline_ns)) {
+        result = kSendTimeout;
+        stats_timeout(stats);
+    } else {
+        stats_error(stats);
+    }
+    return result;
+}
+
+/* One TCP exchange. */
+int send_vc(const sockaddr* ns, const u_char* msg, int msglen, u_char* answer, int anslen, uint64_t deadline_ns,
+            TsigSession* tsig) {
+    StatsServer* stats = stats_server(ns);
+    uint64_t sent_ns = monotonic_ns();
+    stats_query(stats);
+    sock_t fd = vc_connect(ns);
+    if(fd == kBadSock) {
+        stats_error(stats);
+        return kSendFailed;
+    }
+    int result = kSendFailed;
+    if(vc_write(fd, msg, msglen, deadline_ns)) {
+        result = vc_read(fd, msg, msglen, answer, anslen, deadline_ns, tsig);
+    }
+    result = vc_account(stats, result, answer, sent_ns, deadline_ns);
+    sock_close(fd);
+    return result;
+}
+
+bool retry_elsewhere(const u_char* answer) {
+    switch(rd16(answer + kHdrFlags) & kRcodeMask) {
+        case kRcodeServFail:
+        case kRcodeNotImp:
+        case kRcodeRefused:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* How many servers one round asks. */
+int servers_per_round(res_state rs) {
+    return (rs->options & RES_PRIMARY) ? 1 : std::min(rs->nscount, MAXNS);
+}
+
+/* Where a round starts; advances the rotation cursor if RES_ROTATE is set. */
+int first_server(res_state rs) {
+    if(!(rs->options & RES_ROTATE)) return 0;
+    char& robin = rs->unused[0]; // same rotation cursor as the WinDNS path
+    if(++robin >= rs->nscount) {
+        robin = 0;
+    }
+    return robin;
+}
+
+/* The wait for one server in `round`: `retrans << round`, split between servers after the first round. */
+int64_t server_wait_ms(res_state rs, int round, int nscount) {
+    int64_t wait_ms = (int64_t) std::max(rs->retrans, 1) * 1000 << round;
+    if(round > 0) {
+        wait_ms = std::max<int64_t>(wait_ms / nscount, 1000);
+    }
+    return wait_ms;
+}
+
+/* A NOERROR answer with records, which ends an exchange of nsend_parallel() early. */
+bool has_records(const Exchange& ex) {
+    return ex.n >= kHdrSize && !(rd16(ex.answer + kHdrFlags) & kRcodeMask) && rd16(ex.answer + kHdrAnCount);
+}
+
+/**
+ * One UDP exchange with `ns[0]` that goes to `ns[1]` as well if `ns[0]`
+ * has not answered within `hedge_ns` and the hedge budget allows it
+ * (hdg.cpp). The first answer wins, except that one asking to try
+ * elsewhere does not end the wait for the other server. Hedged exchanges
+ * always go out on pooled sockets. Sets `asked` to the number of servers
+ * asked and `from` to the one that answered.
+ */
+int send_hedged(const sockaddr* const ns[2], uint64_t hedge_ns, const u_char* msg, int msglen, u_char* answer,
+                int anslen, int64_t wait_ms, bool& truncated, TsigSession* tsig, TraceScope& trace, int attempt,
+                int& asked, const sockaddr*& from) {
+    const unsigned id = rd16(msg + kHdrId);
+    StatsServer* stats[2] = { stats_server(ns[0]), stats_server(ns[1]) };
+    UdpLease lease[2]; // [1] only if the servers differ in family
+    int leases = 0;
+    bool healthy = true;
+    uint64_t sent_ns[2] = { 0, 0 }, deadline[2] = { 0, 0 };
+    bool pending[2] = { false, false };
+    asked = 0;
+    from = ns[0];
+    hedge_earn();
+
+    auto send_to = [&](int i) {
+        const int l = ns[i]->sa_family != ns[0]->sa_family;
+        if(l == leases) {
+            if(!sockpool_acquire(ns[i]->sa_family, &lease[l])) {
+                stats_error(stats[i]);
+                return;
+            }
+            ++leases;
+        }
+        sent_ns[i] = monotonic_ns();
+        deadline[i] = sent_ns[i] + wait_ms * 1000000;
+        stats_query(stats[i]);
+        if(sendto(lease[l].fd, reinterpret_cast<const char*>(msg), msglen, 0, ns[i], sockaddr_len(ns[i])) != msglen) {
+            stats_error(stats[i]);
+            healthy = false;
+            return;
+        }
+        pending[i] = true;
+        asked = i + 1;
+    };
+
+    send_to(0);
+    bool hedge = pending[0]; // ns[1] may still be asked
+    const uint64_t hedge_at = sent_ns[0] + hedge_ns;
+    int result = pending[0] ? kSendTimeout : kSendFailed;
+    u_char buf[kMaxUdpRead];
+    while(pending[0] || pending[1]) {
+        uint64_t now = monotonic_ns();
+        if(hedge && now >= hedge_at) {
+            hedge = false;
+            if(hedge_spend()) {
+                trace.event(RESOLW_TRACE_SERVER_SEND, ns[1], attempt + 1, -1, id);
+                send_to(1);
+            }
+        }
+        uint64_t until = hedge ? hedge_at : UINT64_MAX;
+        for(int i = 0; i < 2; ++i) {
+            if(pending[i] && now >= deadline[i]) {
+                pending[i] = false;
+                stats_timeout(stats[i]);
+                hedge_sample(ns[i], deadline[i] - sent_ns[i]);
+            }
+            if(pending[i]) until = std::min(until, deadline[i]);
+        }
+        if(!pending[0] && !pending[1]) break;
+        pollfd_t pfd[2];
+        for(int l = 0; l < leases; ++l) {
+            pfd[l].fd = lease[l].fd;
+            pfd[l].events = POLLIN;
+            pfd[l].revents = 0;
+        }
+        if(sock_poll(pfd, leases, remaining_ms(until)) <= 0) continue; // timeouts and EINTR alike
+        for(int l = 0; l < leases; ++l) {
+            if(!pfd[l].revents) continue;
+            sockaddr_storage addr;
+            socklen_t addrlen = sizeof(addr);
+            const int n = recvfrom(lease[l].fd, reinterpret_cast<char*>(buf), sizeof(buf), 0,
+                                   reinterpret_cast<sockaddr*>(&addr), &addrlen);
+            if(n < 0) {
+                const int err = sock_errno();
+                if(err == kErrWouldBlock || err == EINTR) continue;
+                healthy = false; // e.g. ICMP port unreachable
+                if(asked > 1) continue; // from either server: let the other one answer
+                stats_error(stats[0]);
+                result = kSendFailed;
+                pending[0] = hedge = false;
+                break;
+            }
+            now = monotonic_ns();
+            for(int i = 0; i < 2; ++i) {
+                if(!pending[i] || (ns[i]->sa_family != ns[0]->sa_family) != l) continue;
+                const int keep = mux_accept(buf, n, reinterpret_cast<sockaddr*>(&addr), ns[i], msg, msglen, answer,
+                                            anslen, tsig);
+                if(!keep) continue;
+                pending[i] = false;
+                truncated = rd16(answer + kHdrFlags) & kFlagTC;
+                stats_response(stats[i], now - sent_ns[i], truncated);
+                hedge_sample(ns[i], now - sent_ns[i]);
+                if(pending[!i] && retry_elsewhere(answer)) {
+                    const int rcode = rd16(answer + kHdrFlags) & kRcodeMask;
+                    stats_rcode(rcode);
+                    trace.event(RESOLW_TRACE_RESPONSE, ns[i], attempt + i, rcode, id);
+                    break;
+                }
+                if(i && pending[0]) hedge_sample(ns[0], now - sent_ns[0]); // it takes this long at least
+                from = ns[i];
+                result = keep;
+                pending[!i] = hedge = false;
+                break;
+            }
+        }
+    }
+    for(int l = 0; l < leases; ++l) sockpool_release(&lease[l], healthy);
+    return result;
+}
+
+constexpr unsigned kMaxWindow = 128; // exchanges in flight at once
+
+/* One exchange of nsend_parallel() or nsend_batch() in progress: the UDP attempt in flight, if any, and its deadline. */
+struct Flight : Timer {
+    Exchange* ex;
+    unsigned id;
+    int attempt; // the next one to make
+    bool leased, done;
+    UdpLease lease;
+    const sockaddr* ns;
+    StatsServer* stats;
+    int64_t wait_ms;
+    uint64_t sent_ns;
+};
+
+/* Sends `f` to the next server that takes it; false (and `done`) once there are none left. */
+bool launch(res_state rs, Flight& f, int first, int nscount, TraceScope& trace, TimerWheel& wheel) {
+    const int attempts = std::max(rs->retry, 1) * nscount;
+    while(f.attempt < attempts) {
+        const int attempt = f.attempt++;
+        const int round = attempt / nscount;
+        f.ns = reinterpret_cast<const sockaddr*>(&rs->nsaddr_list[(first + attempt % nscount) % rs->nscount]);
+        f.wait_ms = server_wait_ms(rs, round, nscount);
+        if(attempt) {
+            trace.event(RESOLW_TRACE_RETRY, f.ns, attempt, -1, f.id);
+        }
+        trace.event(RESOLW_TRACE_SERVER_SEND, f.ns, attempt, -1, f.id);
+        f.stats = stats_server(f.ns);
+        if(!sockpool_acquire(f.ns->sa_family, &f.lease)) {
+            stats_error(f.stats);
+            continue;
+        }
+        f.sent_ns = monotonic_ns();
+        stats_query(f.stats);
+        if(sendto(f.lease.fd, reinterpret_cast<const char*>(f.ex->msg), f.ex->msglen, 0, f.ns, sockaddr_len(f.ns))
+                != f.ex->msglen) {
+            stats_error(f.stats);
+            sockpool_release(&f.lease, false);
+            continue;
+        }
+        f.leased = true;
+        wheel.arm(&f, f.sent_ns + f.wait_ms * 1000000);
+        return true;
+    }
+    f.done = true;
+    wheel.cancel(&f);
+    return false;
+}
+
+/**
+ * Reads what arrived for `f`: an answer ends it, anything else sends it
+ * on to the next server. A truncated answer ends it too, to be retried
+ * over TCP once the other flights are over (retry_truncated()).
+ */
+void receive(res_state rs, Flight& f, int first, int nscount, TraceScope& trace, TimerWheel& wheel) {
+    Exchange& ex = *f.ex;
+    sockaddr_storage from;
+    socklen_t fromlen = sizeof(from);
+    int n = recvfrom(f.lease.fd, reinterpret_cast<char*>(ex.answer), ex.anslen, 0,
+                     reinterpret_cast<sockaddr*>(&from), &fromlen);
+    if(n < 0) {
+        int err = sock_errno();
+        if(err == kErrWouldBlock || err == EINTR) return;
+        stats_error(f.stats);
+        sockpool_release(&f.lease, false);
+        f.leased = false;
+        launch(rs, f, first, nscount, trace, wheel);
+        return;
+    }
+    if(!sockaddr_same(reinterpret_cast<sockaddr*>(&from), f.ns)) return;
+    if(!msg_is_reply_to(ex.msg, ex.msglen, ex.answer, n)) return;
+    const bool truncated = rd16(ex.answer + kHdrFlags) & kFlagTC;
+    stats_response(f.stats, monotonic_ns() - f.sent_ns, truncated);
+    sockpool_release(&f.lease, true);
+    f.leased = false;
+    if(truncated && !(rs->options & RES_IGNTC)) {
+        ex.tc_attempt = f.attempt - 1;
+        f.done = true;
+        wheel.cancel(&f);
+        return;
+    }
+    const int rcode = rd16(ex.answer + kHdrFlags) & kRcodeMask;
+    stats_rcode(rcode);
+    trace.event(RESOLW_TRACE_RESPONSE, f.ns, f.attempt - 1, rcode, f.id);
+    if(retry_elsewhere(ex.answer)) {
+        launch(rs, f, first, nscount, trace, wheel);
+        return;
+    }
+    ex.n = n;
+    f.done = true;
+    wheel.cancel(&f);
+}
+
+/**
+ * The TCP retries of exchanges fly() got truncated answers for, each to
+ * the server that truncated it. All of `count` (at most kMaxWindow) are
+ * connected and sent before any answer is read, so that they overlap;
+ * those that still fail go through res_nsend()'s failover one by one.
+ */
+void retry_truncated(res_state rs, Exchange** ex, unsigned count, int first, int nscount, TraceScope& trace) {
+    struct Retry {
+        const sockaddr* ns;
+        StatsServer* stats;
+        sock_t fd;
+        uint64_t sent_ns;
+        uint64_t deadline_ns;
+    } retries[kMaxWindow];
+    for(unsigned i = 0; i < count; ++i) {
+        Retry& r = retries[i];
+        const int attempt = ex[i]->tc_attempt;
+        r.ns = reinterpret_cast<const sockaddr*>(&rs->nsaddr_list[(first + attempt % nscount) % rs->nscount]);
+        r.stats = stats_server(r.ns);
+        r.sent_ns = monotonic_ns();
+        r.deadline_ns = r.sent_ns + server_wait_ms(rs, attempt / nscount, nscount) * 1000000;
+        trace.event(RESOLW_TRACE_SERVER_SEND, r.ns, attempt, -1, rd16(ex[i]->msg + kHdrId)); // same attempt, over TCP
+        stats_query(r.stats);
+        r.fd = vc_connect(r.ns);
+    }
+    for(unsigned i = 0; i < count; ++i) {
+        Retry& r = retries[i];
+        if(r.fd != kBadSock && !vc_write(r.fd, ex[i]->msg, ex[i]->msglen, r.deadline_ns)) {
+            stats_error(r.stats);
+            sock_close(r.fd);
+            r.fd = kBadSock;
+        } else if(r.fd == kBadSock) {
+            stats_error(r.stats);
+        }
+    }
+    for(unsigned i = 0; i < count; ++i) {
+        Retry& r = retries[i];
+        Exchange& e = *ex[i];
+        const int attempt = e.tc_attempt;
+        e.tc_attempt = -1;
+        if(r.fd == kBadSock) continue; // counted above
+        int n = vc_read(r.fd, e.msg, e.msglen, e.answer, e.anslen, r.deadline_ns, nullptr);
+        n = vc_account(r.stats, n, e.answer, r.sent_ns, r.deadline_ns);
+        sock_close(r.fd);
+        if(n > 0) {
+            const int rcode = rd16(e.answer + kHdrFlags) & kRcodeMask;
+            stats_rcode(rcode);
+            trace.event(RESOLW_TRACE_RESPONSE, r.ns, attempt, rcode, rd16(e.msg + kHdrId));
+            if(!retry_elsewhere(e.answer)) e.n = n;
+        }
+    }
+    for(unsigned i = 0; i < count; ++i) {
+        if(ex[i]->n <= 0) ex[i]->n = res_nsend(rs, ex[i]->msg, ex[i]->msglen, ex[i]->answer, ex[i]->anslen);
+    }
+}
+
+/**
+ * fly() to a TLS server: `window` exchanges at a time are pipelined on
+ * one connection, and those left without a final answer go through
+ * res_nsend()'s failover one by one.
+ */
+void fly_tls(res_state rs, const sockaddr* ns, Exchange* ex, size_t count, unsigned window, TraceScope& trace) {
+    const uint64_t wait_ns = server_wait_ms(rs, 0, servers_per_round(rs)) * 1000000;
+    for(size_t at = 0; at < count; at += window) {
+        const unsigned n = (unsigned) std::min<size_t>(window, count - at);
+        for(unsigned i = 0; i < n; ++i) {
+            trace.event(RESOLW_TRACE_SERVER_SEND, ns, 0, -1, rd16(ex[at + i].msg + kHdrId));
+        }
+        tls_send(ns, ex + at, n, monotonic_ns() + wait_ns, nullptr);
+        for(unsigned i = 0; i < n; ++i) {
+            Exchange& e = ex[at + i];
+            if(e.n > 0) {
+                const int rcode = rd16(e.answer + kHdrFlags) & kRcodeMask;
+                stats_rcode(rcode);
+                trace.event(RESOLW_TRACE_RESPONSE, ns, 0, rcode, rd16(e.msg + kHdrId));
+                if(!retry_elsewhere(e.answer)) continue;
+            }
+            e.n = res_nsend(rs, e.msg, e.msglen, e.answer, e.anslen);
+        }
+    }
+}
+
+/**
+ * The loop behind nsend_parallel() and nsend_batch(): sends the exchanges
+ * in order, at most `window` at a time. With `early`, it stops as soon as
+ * `ex[0]` has records or `linger_ns` after another exchange got some.
+ */
+void fly(res_state rs, Exchange* ex, size_t count, unsigned window, bool early, uint64_t linger_ns,
+         TraceScope& trace) {
+    for(size_t i = 0; i < count; ++i) ex[i].n = -1;
+    if(rs->nscount <= 0) {
+        set_last_error(ESRCH);
+        return;
+    }
+    net_startup();
+
+    const int nscount = servers_per_round(rs);
+    const int first = first_server(rs);
+    window = (unsigned) std::min<size_t>(std::min(window, kMaxWindow), count);
+    const sockaddr* head = reinterpret_cast<const sockaddr*>(&rs->nsaddr_list[first]);
+    if(tls_server(head)) {
+        fly_tls(rs, head, ex, count, window, trace);
+        return;
+    }
+    Flight flights[kMaxWindow];
+    TimerWheel wheel(monotonic_ns());
+    size_t next = 0;
+    unsigned active = 0;
+    auto refill = [&](Flight& f) {
+        // takes the next exchange; exchanges with no server to take them finish on the spot
+        while(next < count) {
+            f.ex = &ex[next++];
+            f.ex->tc_attempt = -1;
+            f.id = rd16(f.ex->msg + kHdrId);
+            f.attempt = 0;
+            f.leased = f.done = false;
+            if(launch(rs, f, first, nscount, trace, wheel)) return true;
+        }
+        f.done = true;
+        return false;
+    };
+    for(unsigned i = 0; i < window; ++i) active += refill(flights[i]);
+    uint64_t linger_until = 0;
+    bool timed_out = false;
+    while(active) {
+        uint64_t now = monotonic_ns();
+        if(early) {
+            // the preferred answer, or the end of the resolution delay after another one
+            if(has_records(ex[0])) break;
+            for(size_t i = 1; i < count && !linger_until; ++i) {
+                if(has_records(ex[i])) linger_until = now + linger_ns;
+            }
+            if(linger_until && now >= linger_until) break;
+        }
+
+        pollfd_t pfds[kMaxWindow];
+        Flight* polled[kMaxWindow];
+        unsigned npoll = 0;
+        for(unsigned i = 0; i < window; ++i) {
+            Flight& f = flights[i];
+            if(f.done) continue;
+            pfds[npoll].fd = f.lease.fd;
+            pfds[npoll].events = POLLIN;
+            pfds[npoll].revents = 0;
+            polled[npoll++] = &f;
+        }
+        const uint64_t wake = std::min(linger_until ? linger_until : UINT64_MAX, wheel.next_ns());
+        int rc = sock_poll(pfds, npoll, remaining_ms(wake));
+        if(rc < 0 && sock_errno() != EINTR) break;
+        for(unsigned i = 0; rc > 0 && i < npoll; ++i) {
+            if(!pfds[i].revents) continue;
+            Flight& f = *polled[i];
+            receive(rs, f, first, nscount, trace, wheel);
+            if(f.done) active -= !refill(f);
+        }
+
+        // only after reading what has arrived, which is then not taken for a timeout
+        while(Timer* t = wheel.expire(monotonic_ns())) {
+            // the attempt timed out: on to the next server, or give the exchange up
+            Flight& f = static_cast<Flight&>(*t);
+            stats_timeout(f.stats);
+            sockpool_release(&f.lease, true);
+            f.leased = false;
+            if(!launch(rs, f, first, nscount, trace, wheel)) {
+                timed_out = true;
+                active -= !refill(f);
+            }
+        }
+    }
+    for(unsigned i = 0; i < window; ++i) {
+        if(!flights[i].done && flights[i].leased) {
+            sockpool_release(&flights[i].lease, true); // a late answer is dropped by the next user
+        }
+    }
+    // the TCP retries, a window at a time; with `early`, only those still wanted
+    Exchange* truncated[kMaxWindow];
+    unsigned ntruncated = 0;
+    for(size_t i = 0; i < count; ++i) {
+        if(ex[i].tc_attempt < 0) continue;
+        if(early && i && has_records(ex[0])) {
+            ex[i].tc_attempt = -1;
+            continue;
+        }
+        truncated[ntruncated++] = &ex[i];
+        if(ntruncated == window) {
+            retry_truncated(rs, truncated, ntruncated, first, nscount, trace);
+            ntruncated = 0;
+        }
+    }
+    if(ntruncated) retry_truncated(rs, truncated, ntruncated, first, nscount, trace);
+    if(timed_out) set_last_error(ETIMEDOUT);
+}
+
+} // anonymous
+
+void nsend_parallel(res_state rs, Exchange* ex, unsigned count, uint64_t linger_ns, TraceScope& trace) {
+    bool vc = rs->options & RES_USEVC;
+    for(unsigned i = 0; i < count; ++i) vc |= ex[i].msglen > kPacketSz;
+    if(vc) {
+        // TCP: one after the other, which the early return still shortens
+        for(unsigned i = 0; i < count; ++i) ex[i].n = -1;
+        for(unsigned i = 0; i < count && !(i && has_records(ex[0])); ++i) {
+            ex[i].n = res_nsend(rs, ex[i].msg, ex[i].msglen, ex[i].answer, ex[i].anslen);
+        }
+        return;
+    }
+    fly(rs, ex, count, count, true, linger_ns, trace);
+}
+
+void nsend_batch(res_state rs, Exchange* ex, size_t count, unsigned window, TraceScope& trace) {
+    if(rs->options & RES_USEVC) {
+        for(size_t i = 0; i < count; ++i) ex[i].n = res_nsend(rs, ex[i].msg, ex[i].msglen, ex[i].answer, ex[i].anslen);
+        return;
+    }
+    fly(rs, ex, count, window, false, 0, trace);
+}
+
+} // resolw_impl
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int res_nsend(res_state rs, const u_char *msg, int msglen, u_char *answer, int anslen)
+{
+    using namespace resolw_impl;
+    if(!(rs->options & RES_INIT)) { res_ninit(rs); } // see comment to RES_INIT
+    if(!msg || msglen < kHdrSize || msglen > 0xffff || !answer || anslen < kHdrSize) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    if(rs->nscount <= 0) {
+        set_last_error(ESRCH);
+        return -1;
+    }
+    net_startup();
+
+    char qname_buf[MAXDNAME];
+    const char* qname = nullptr;
+    unsigned qtype = 0;
+    if(trace_on() && rd16(msg + kHdrQdCount)) {
+        int len = msg_expand_name(msg, msg + msglen, msg + kHdrSize, qname_buf, sizeof(qname_buf));
+        if(len > 0 && kHdrSize + len + 2 <= msglen) {
+            qname = qname_buf;
+            qtype = rd16(msg + kHdrSize + len);
+        }
+    }
+    const unsigned id = rd16(msg + kHdrId);
+    TraceScope trace(qname, qtype, id);
+
+    const u_long options = rs->options;
+    TsigSession session;
+    TsigSession* const tsig = session.start(msg, msglen) ? &session : nullptr;
+    const bool always_vc = (options & RES_USEVC) || msglen > kPacketSz;
+    const int nscount = servers_per_round(rs);
+    const int first = first_server(rs);
+
+    bool got_somewhere = false;
+    int attempt = 0;
+    const int rounds = std::max(rs->retry, 1);
+    for(int round = 0; round < rounds; ++round) {
+        for(int k = 0; k < nscount; ++k, ++attempt) {
+            const sockaddr* ns = reinterpret_cast<const sockaddr*>(&rs->nsaddr_list[(first + k) % rs->nscount]);
+            const int64_t wait_ms = server_wait_ms(rs, round, nscount);
+            if(attempt) {
+                trace.event(RESOLW_TRACE_RETRY, ns, attempt, -1, id);
+            }
+            trace.event(RESOLW_TRACE_SERVER_SEND, ns, attempt, -1, id);
+            uint64_t deadline = monotonic_ns() + wait_ms * 1000000;
+            // the first server of the first round may be hedged with the second
+            const sockaddr* next = !round && !k && nscount > 1 && !always_vc && hedge_on()
+                ? reinterpret_cast<const sockaddr*>(&rs->nsaddr_list[(first + 1) % rs->nscount]) : nullptr;
+            const uint64_t hedge_ns = next && !tls_server(ns) && !tls_server(next) ? hedge_delay_ns(ns) : 0;
+            int answered = attempt;
+            bool truncated = false;
+            int n;
+            if(tls_server(ns)) {
+                Exchange ex = { msg, msglen, answer, anslen, 0 };
+                tls_send(ns, &ex, 1, deadline, tsig);
+                n = ex.n;
+            } else if(always_vc) {
+                n = send_vc(ns, msg, msglen, answer, anslen, deadline, tsig);
+            } else if(hedge_ns && hedge_ns < (uint64_t) wait_ms * 1000000) {
+                const sockaddr* const pair[2] = { ns, next };
+                int asked;
+                n = send_hedged(pair, hedge_ns, msg, msglen, answer, anslen, wait_ms, truncated, tsig, trace, attempt,
+                                asked, ns);
+                if(asked > 1) { // the second server has had its turn
+                    ++k;
+                    ++attempt;
+                    if(ns == next) answered = attempt;
+                }
+            } else {
+                const uint64_t sent_ns = hedge_on() ? monotonic_ns() : 0;
+                n = send_dg(ns, msg, msglen, answer, anslen, deadline, truncated, tsig);
+                if(sent_ns && (n > 0 || n == kSendTimeout)) {
+                    hedge_sample(ns, (n > 0 ? monotonic_ns() : deadline) - sent_ns);
+                }
+            }
+            if(n > 0 && truncated && !(options & RES_IGNTC)) {
+                trace.event(RESOLW_TRACE_SERVER_SEND, ns, answered, -1, id); // same attempt, over TCP
+                n = send_vc(ns, msg, msglen, answer, anslen, monotonic_ns() + wait_ms * 1000000, tsig);
+            }
+            if(n == kSendTimeout) {
+                got_somewhere = true;
+            }
+            if(n <= 0) {
+                continue;
+            }
+            got_somewhere = true;
+            const int rcode = rd16(answer + kHdrFlags) & kRcodeMask;
+            stats_rcode(rcode);
+            trace.event(RESOLW_TRACE_RESPONSE, ns, answered, rcode, id);
+            if(retry_elsewhere(answer)) {
+                continue; // as in BIND, SERVFAIL/NOTIMP/REFUSED mean "ask someone else"
+            }
+            if(tsig && !(options & RES_KEEPTSIG)) {
+                n = tsig->strip(answer, n);
+            }
+            trace.complete(n, rcode);
+            return n;
+        }
+    }
+    set_last_error(got_somewhere ? ETIMEDOUT : ECONNREFUSED);
+    trace.complete(-1, -1);
+    return -1;
+}
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,437 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "resolv.h"
+#include "resolw/resolw_rdata.h"
+#include "resolw/resolw_srv.h"
+#include "idn.h"
+#include "msg.h"
+#include "net.h"
+#include "sts.h"
+#include "trc.h"
+
+#include <netdb.h> // h_errno
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+/**
+ * Service discovery. A miss costs the SRV query plus, for targets the
+ * additional section says nothing about, one A and/or AAAA query each,
+ * spread over a few threads. The ordered list is built in one block and
+ * shared by reference count between the cache and its callers; a hit
+ * takes the cache lock just long enough to bump the count.
+ */
+
+namespace {
+
+using namespace resolw_impl;
+
+constexpr unsigned kMaxWorkers = 8; // concurrent follow-up queries
+constexpr size_t kMaxEntries = 256; // cached services
+
+/* One address of a target, port not yet applied. */
+struct Addr {
+    int family;
+    u_char bytes[16];
+};
+
+/* One SRV record and what it resolves to. */
+struct Target {
+    uint16_t priority, weight, port;
+    resolw_name wire; // into the SRV answer
+    char name[MAXDNAME + 1];
+    std::vector<Addr> addrs[2]; // [0] = AAAA, [1] = A
+    uint32_t ttl, addr_ttl[2]; // the SRV record's; the smallest of each address type
+    uint32_t sum; // running weight during selection
+};
+
+inline int slot(int type) { return type == T_AAAA ? 0 : 1; }
+
+/* Adds an A or AAAA record to `t`; false if it is neither (or malformed). */
+bool take_addr(const resolw_rr& rr, Target& t) {
+    Addr a;
+    if(rr.type == T_A && rr.rdata.len == 4) {
+        a.family = AF_INET;
+    } else if(rr.type == T_AAAA && rr.rdata.len == 16) {
+        a.family = AF_INET6;
+    } else {
+        return false;
+    }
+    memcpy(a.bytes, rr.rdata.data, rr.rdata.len);
+    t.addrs[slot(rr.type)].push_back(a);
+    t.addr_ttl[slot(rr.type)] = std::min(t.addr_ttl[slot(rr.type)], rr.ttl);
+    return true;
+}
+
+/* Types to ask for, in the order the endpoints list them. */
+int wanted(int family, int types[2]) {
+    int n = 0;
+    if(family != AF_INET) types[n++] = T_AAAA;
+    if(family != AF_INET6) types[n++] = T_A;
+    return n;
+}
+
+/* One follow-up query: a target without addresses, and the type to ask for. */
+struct Lookup {
+    Target* target;
+    int type;
+    bool failed; // as opposed to "no such name" or "no such data"
+};
+
+void run_lookup(struct _res_state& rs, std::vector<u_char>& buf, Lookup& lk) {
+    int n = res_nquery(&rs, lk.target->name, C_IN, lk.type, buf.data(), buf.size());
+    if(n < 0) {
+        lk.failed = h_errno != HOST_NOT_FOUND && h_errno != NO_DATA;
+        return;
+    }
+    resolw_msg_iter it;
+    resolw_rr rr;
+    if(resolw_msg_iter_init(&it, buf.data(), n) < 0) {
+        lk.failed = true;
+        return;
+    }
+    int more;
+    while((more = resolw_msg_iter_next(&it, &rr)) > 0) {
+        if(rr.section == 1 && rr.rdclass == C_IN && rr.type == lk.type) { // the end of a CNAME chain, if any
+            take_addr(rr, *lk.target);
+        }
+    }
+    lk.failed = more < 0;
+}
+
+/* Resolves the targets the SRV answer left without addresses. Each worker has its own state and buffer. */
+bool resolve_missing(res_state rs, std::vector<Lookup>& lookups) {
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        struct _res_state local = *rs; // the servers and options of the caller
+        std::vector<u_char> buf(kMaxAnswer);
+        for(size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < lookups.size();) {
+            run_lookup(local, buf, lookups[i]);
+        }
+    };
+    const unsigned nworkers = std::min<size_t>(lookups.size(), kMaxWorkers);
+    std::vector<std::thread> workers;
+    try {
+        for(unsigned i = 1; i < nworkers; ++i) workers.emplace_back(work);
+    } catch(const std::system_error&) {
+        // fewer threads than planned; the ones there are (and this one) take the rest
+    }
+    work();
+    for(std::thread& w : workers) w.join();
+    bool failed = false;
+    for(const Lookup& lk : lookups) failed |= lk.failed;
+    return failed;
+}
+
+/* RFC 2782 selection: by priority, then by a weighted draw in which zero weights have a small chance to go first. */
+void order(std::vector<Target*>& ts) {
+    std::stable_sort(ts.begin(), ts.end(), [](const Target* a, const Target* b) { return a->priority < b->priority; });
+    for(auto group = ts.begin(); group != ts.end();) {
+        auto group_end = std::find_if(group, ts.end(), [&](const Target* t) { return t->priority != (*group)->priority; });
+        std::stable_partition(group, group_end, [](const Target* t) { return t->weight == 0; });
+        for(auto pick = group; pick != group_end; ++pick) {
+            uint32_t total = 0;
+            for(auto it = pick; it != group_end; ++it) (*it)->sum = total += (*it)->weight;
+            uint32_t r = (((uint32_t) res_randomid() << 16) | res_randomid()) % (total + 1);
+            auto chosen = std::find_if(pick, group_end, [r](const Target* t) { return t->sum >= r; });
+            std::rotate(pick, chosen, chosen + 1); // keeps the rest in order, zero weights first
+        }
+        group = group_end;
+    }
+}
+
+/* A list and its endpoints and target names, in one allocation; `list` is what callers see. */
+struct Block {
+    std::atomic<unsigned> refs;
+    resolw_srv_list list;
+};
+
+inline Block* block_of(const resolw_srv_list* list) {
+    return reinterpret_cast<Block*>(reinterpret_cast<char*>(const_cast<resolw_srv_list*>(list)) - offsetof(Block, list));
+}
+
+void release(Block* block) {
+    if(block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        block->~Block();
+        free(block);
+    }
+}
+
+/* Lays the ordered targets out as endpoints; null if out of memory. */
+Block* build(const std::vector<Target*>& ts, int family, uint32_t ttl) {
+    int types[2];
+    const int ntypes = wanted(family, types);
+    size_t count = 0, names = 0;
+    for(const Target* t : ts) {
+        for(int i = 0; i < ntypes; ++i) count += t->addrs[slot(types[i])].size();
+        names += strlen(t->name) + 1;
+    }
+    const size_t head = (sizeof(Block) + alignof(resolw_endpoint) - 1) / alignof(resolw_endpoint) * alignof(resolw_endpoint);
+    void* mem = malloc(head + count * sizeof(resolw_endpoint) + names);
+    if(!mem) return nullptr;
+    Block* block = new(mem) Block();
+    block->refs.store(1, std::memory_order_relaxed);
+    resolw_endpoint* ep = reinterpret_cast<resolw_endpoint*>(static_cast<char*>(mem) + head);
+    char* name = reinterpret_cast<char*>(ep + count);
+    block->list.count = count;
+    block->list.ttl = ttl;
+    block->list.endpoints = ep;
+    for(const Target* t : ts) {
+        size_t len = strlen(t->name) + 1;
+        memcpy(name, t->name, len);
+        for(int i = 0; i < ntypes; ++i) {
+            for(const Addr& a : t->addrs[slot(types[i])]) {
+                memset(ep, 0, sizeof(*ep));
+                if(a.family == AF_INET6) {
+                    sockaddr_in6* sin6 = reinterpret_cast<sockaddr_in6*>(&ep->addr);
+                    sin6->sin6_family = AF_INET6;
+                    sin6->sin6_port = htons(t->port);
+                    memcpy(&sin6->sin6_addr, a.bytes, 16);
+                    ep->addrlen = sizeof(sockaddr_in6);
+                } else {
+                    sockaddr_in* sin = reinterpret_cast<sockaddr_in*>(&ep->addr);
+                    sin->sin_family = AF_INET;
+                    sin->sin_port = htons(t->port);
+                    memcpy(&sin->sin_addr, a.bytes, 4);
+                    ep->addrlen = sizeof(sockaddr_in);
+                }
+                ep->priority = t->priority;
+                ep->weight = t->weight;
+                ep->target = name;
+                ++ep;
+            }
+        }
+        name += len;
+    }
+    return block;
+}
+
+/* The miss path: query, match additional records, fill the gaps, order. */
+int resolve(res_state rs, const char* service, int family, Block** out) {
+    std::vector<u_char> answer(kMaxAnswer);
+    int n = res_nquery(rs, service, C_IN, T_SRV, answer.data(), answer.size());
+    if(n < 0) {
+        switch(h_errno) {
+            case HOST_NOT_FOUND: return ERRSET_NONAME;
+            case NO_DATA: return ERRSET_NODATA;
+            default: return ERRSET_FAIL;
+        }
+    }
+    resolw_msg_iter it;
+    resolw_rr rr;
+    if(resolw_msg_iter_init(&it, answer.data(), n) < 0) return ERRSET_FAIL;
+    std::vector<Target> targets;
+    std::vector<resolw_rr> addrs;
+    int more;
+    while((more = resolw_msg_iter_next(&it, &rr)) > 0) {
+        if(rr.rdclass != C_IN) continue;
+        if(rr.section == 1 && rr.type == T_SRV) {
+            resolw_srv srv;
+            if(resolw_srv_view(&rr.rdata, &srv) < 0) return ERRSET_FAIL;
+            targets.emplace_back();
+            Target& t = targets.back();
+            t.priority = srv.priority;
+            t.weight = srv.weight;
+            t.port = srv.port;
+            t.wire = srv.target;
+            t.ttl = rr.ttl;
+            t.addr_ttl[0] = t.addr_ttl[1] = 0xffffffffu;
+            if(resolw_name_text(&srv.target, t.name, sizeof(t.name)) < 0) return ERRSET_FAIL;
+        } else if(rr.type == T_A || rr.type == T_AAAA) {
+            addrs.push_back(rr);
+        }
+    }
+    if(more < 0) return ERRSET_FAIL;
+    if(targets.empty()) return ERRSET_NODATA;
+    if(targets.size() == 1 && !strcmp(targets[0].name, ".")) return ERRSET_NODATA; // "decidedly not available"
+
+    int types[2];
+    const int ntypes = wanted(family, types);
+    std::vector<Lookup> lookups;
+    for(Target& t : targets) {
+        for(const resolw_rr& a : addrs) {
+            if(resolw_name_equal(&a.owner, &t.wire) == 1) take_addr(a, t);
+        }
+        bool any = false;
+        for(int i = 0; i < ntypes; ++i) any |= !t.addrs[slot(types[i])].empty();
+        if(!any && strcmp(t.name, ".")) {
+            for(int i = 0; i < ntypes; ++i) lookups.push_back(Lookup{&t, types[i], false});
+        }
+    }
+    bool failed = lookups.empty() ? false : resolve_missing(rs, lookups);
+
+    std::vector<Target*> usable;
+    uint32_t ttl = 0xffffffffu;
+    for(Target& t : targets) {
+        bool any = false;
+        for(int i = 0; i < ntypes; ++i) {
+            if(t.addrs[slot(types[i])].empty()) continue;
+            any = true;
+            ttl = std::min(ttl, t.addr_ttl[slot(types[i])]);
+        }
+        if(!any) continue;
+        usable.push_back(&t);
+        ttl = std::min(ttl, t.ttl);
+    }
+    if(usable.empty()) return failed ? ERRSET_FAIL : ERRSET_NODATA;
+    order(usable);
+    return (*out = build(usable, family, ttl)) ? ERRSET_SUCCESS : ERRSET_NOMEMORY;
+}
+
+/* The cache: a short list under a lock, searched by hash. Entries hold one reference each. */
+struct Entry {
+    uint64_t hash;
+    uint64_t expires_ns;
+    std::string key;
+    Block* block;
+};
+
+struct Cache {
+    std::mutex lock;
+    std::vector<Entry> entries;
+};
+
+Cache& cache() {
+    static Cache* instance = new Cache(); // never destroyed: lists may be released after static destructors run
+    return *instance;
+}
+
+uint64_t fnv1a(const char* s) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for(; *s; ++s) h = (h ^ (u_char) *s) * 0x100000001b3ull;
+    return h;
+}
+
+/* "family:name", lowercase and without the trailing dot; false if it does not fit. */
+bool make_key(const char* service, int family, char* key, size_t keylen) {
+    int n = snprintf(key, keylen, "%d:%s", family, service);
+    if(n < 0 || (size_t) n >= keylen) return false;
+    if(n > 0 && key[n - 1] == '.') key[--n] = '\0';
+    for(char* p = key; *p; ++p) {
+        if(*p >= 'A' && *p <= 'Z') *p += 'a' - 'A';
+    }
+    return true;
+}
+
+Block* cache_find(const char* key, uint64_t hash, uint64_t now) {
+    Cache& c = cache();
+    std::lock_guard<std::mutex> guard(c.lock);
+    for(Entry& e : c.entries) {
+        if(e.hash == hash && e.expires_ns > now && e.key == key) {
+            e.block->refs.fetch_add(1, std::memory_order_relaxed);
+            return e.block;
+        }
+    }
+    return nullptr;
+}
+
+void cache_store(const char* key, uint64_t hash, uint64_t now, Block* block) {
+    Cache& c = cache();
+    Entry fresh{hash, now + block->list.ttl * 1000000000ull, std::string(), block};
+    try {
+        fresh.key = key;
+    } catch(const std::bad_alloc&) {
+        return; // simply not cached
+    }
+    std::vector<Block*> dropped; // released outside the lock
+    {
+        std::lock_guard<std::mutex> guard(c.lock);
+        auto stale = [&](const Entry& e) { return e.expires_ns <= now || (e.hash == hash && e.key == key); };
+        for(const Entry& e : c.entries) {
+            if(stale(e)) dropped.push_back(e.block);
+        }
+        c.entries.erase(std::remove_if(c.entries.begin(), c.entries.end(), stale), c.entries.end());
+        if(c.entries.size() >= kMaxEntries) {
+            auto soonest = std::min_element(c.entries.begin(), c.entries.end(),
+                    [](const Entry& a, const Entry& b) { return a.expires_ns < b.expires_ns; });
+            dropped.push_back(soonest->block);
+            c.entries.erase(soonest);
+        }
+        block->refs.fetch_add(1, std::memory_order_relaxed);
+        c.entries.push_back(std::move(fresh));
+    }
+    for(Block* b : dropped) release(b);
+}
+
+} // anonymous
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int resolw_srv_resolve(const char *service, int family, const struct resolw_srv_list **list)
+{
+    if(!service || !*service || !list) return ERRSET_INVAL;
+    if(family != AF_INET && family != AF_INET6 && family != AF_UNSPEC) return ERRSET_INVAL;
+    char ace[MAXDNAME + 1];
+    if(!(service = name_to_ascii(service, ace, sizeof(ace)))) return ERRSET_INVAL;
+    char key[MAXDNAME + 16];
+    if(!make_key(service, family, key, sizeof(key))) return ERRSET_INVAL;
+    const uint64_t hash = fnv1a(key);
+    res_state rs = _resolw_res_state(); // initialized on first access
+    TraceScope trace(service, T_SRV, rs->id);
+    uint64_t now = monotonic_ns();
+    if(Block* hit = cache_find(key, hash, now)) {
+        stats_cache(true);
+        trace.event(RESOLW_TRACE_CACHE_HIT, nullptr, 0, 0, 0);
+        trace.complete(ERRSET_SUCCESS, 0);
+        *list = &hit->list;
+        return ERRSET_SUCCESS;
+    }
+    stats_cache(false);
+    Block* block = nullptr;
+    int rv;
+    try {
+        rv = resolve(rs, service, family, &block);
+    } catch(const std::bad_alloc&) {
+        rv = ERRSET_NOMEMORY;
+    }
+    if(rv == ERRSET_SUCCESS && block->list.ttl) {
+        cache_store(key, hash, monotonic_ns(), block);
+    }
+    trace.complete(rv, -1);
+    if(rv == ERRSET_SUCCESS) *list = &block->list;
+    return rv;
+}
+
+void resolw_srv_free(const struct resolw_srv_list *list)
+{
+    if(list) release(block_of(list));
+}
+
+void resolw_srv_flush(void)
+{
+    Cache& c = cache();
+    std::vector<Entry> entries;
+    {
+        std::lock_guard<std::mutex> guard(c.lock);
+        entries.swap(c.entries);
+    }
+    for(Entry& e : entries) release(e.block);
+}
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
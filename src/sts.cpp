@@ -0,0 +1,200 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "sts.h"
+#include "net.h"
+
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace resolw_impl {
+
+thread_local StatsShard* _tls_stats = nullptr;
+
+namespace {
+
+/**
+ * All live shards, plus the folded totals of shards whose threads are gone
+ * (`retired`) and the snapshot taken by the last reset (`baseline`).
+ */
+struct StatsRegistry {
+    std::mutex mtx;
+    std::vector<StatsShard*> shards;
+    resolw_stats retired = {};
+    resolw_stats baseline = {};
+};
+
+StatsRegistry& registry() {
+    static StatsRegistry instance;
+    return instance;
+}
+
+/* Index of `addr` in `out`, appending it if there is room; -1 otherwise. */
+int find_or_add(resolw_stats& out, const sockaddr_storage& addr) {
+    const sockaddr* sa = reinterpret_cast<const sockaddr*>(&addr);
+    for(unsigned i = 0; i < out.nservers; ++i) {
+        const sockaddr* other = reinterpret_cast<const sockaddr*>(&out.servers[i].addr);
+        if(sa->sa_family == AF_UNSPEC ? other->sa_family == AF_UNSPEC : sockaddr_same(sa, other)) {
+            return i;
+        }
+    }
+    if(out.nservers >= RESOLW_STATS_MAXSERVERS) return -1;
+    resolw_server_stats& s = out.servers[out.nservers];
+    memset(&s, 0, sizeof(s));
+    s.addr = addr;
+    return out.nservers++;
+}
+
+inline uint64_t ld(const std::atomic<uint64_t>& c) { return c.load(std::memory_order_relaxed); }
+
+void merge_shard(resolw_stats& out, const StatsShard& shard) {
+    unsigned n = shard.nservers.load(std::memory_order_acquire);
+    for(unsigned i = 0; i < n; ++i) {
+        int j = find_or_add(out, shard.addrs[i]);
+        if(j < 0) continue;
+        const StatsServer& src = shard.servers[i];
+        resolw_server_stats& dst = out.servers[j];
+        dst.queries += ld(src.queries);
+        dst.responses += ld(src.responses);
+        dst.timeouts += ld(src.timeouts);
+        dst.truncated += ld(src.truncated);
+        dst.errors += ld(src.errors);
+        for(int b = 0; b < RESOLW_STATS_BUCKETS; ++b) {
+            dst.latency[b] += ld(src.latency[b]);
+        }
+    }
+    out.cache_hits += ld(shard.cache_hits);
+    out.cache_misses += ld(shard.cache_misses);
+    for(int r = 0; r < 16; ++r) {
+        out.rcodes[r] += ld(shard.rcodes[r]);
+    }
+}
+
+void merge_totals(resolw_stats& out, const resolw_stats& in, int sign) {
+    for(unsigned i = 0; i < in.nservers; ++i) {
+        int j = find_or_add(out, in.servers[i].addr);
+        if(j < 0) continue;
+        const resolw_server_stats& src = in.servers[i];
+        resolw_server_stats& dst = out.servers[j];
+        dst.queries += sign * src.queries;
+        dst.responses += sign * src.responses;
+        dst.timeouts += sign * src.timeouts;
+        dst.truncated += sign * src.truncated;
+        dst.errors += sign * src.errors;
+        for(int b = 0; b < RESOLW_STATS_BUCKETS; ++b) {
+            dst.latency[b] += sign * src.latency[b];
+        }
+    }
+    out.cache_hits += sign * in.cache_hits;
+    out.cache_misses += sign * in.cache_misses;
+    for(int r = 0; r < 16; ++r) {
+        out.rcodes[r] += sign * in.rcodes[r];
+    }
+}
+
+/* Sum of all shards, live and retired. Caller holds the registry lock. */
+void collect(StatsRegistry& reg, resolw_stats& out) {
+    memset(&out, 0, sizeof(out));
+    merge_totals(out, reg.retired, 1);
+    for(const StatsShard* shard : reg.shards) {
+        merge_shard(out, *shard);
+    }
+}
+
+/* Owns the calling thread's shard and folds it into `retired` on thread exit. */
+struct ShardOwner {
+    StatsShard* shard = nullptr;
+    ~ShardOwner() {
+        if(!shard) return;
+        StatsRegistry& reg = registry();
+        {
+            std::lock_guard<std::mutex> lock(reg.mtx);
+            merge_shard(reg.retired, *shard);
+            for(auto& s : reg.shards) {
+                if(s == shard) {
+                    s = reg.shards.back();
+                    reg.shards.pop_back();
+                    break;
+                }
+            }
+        }
+        _tls_stats = nullptr;
+        delete shard;
+    }
+};
+
+thread_local ShardOwner _tls_owner;
+
+} // anonymous
+
+StatsShard* stats_shard_slow() {
+    StatsShard* shard = new StatsShard();
+    StatsRegistry& reg = registry();
+    {
+        std::lock_guard<std::mutex> lock(reg.mtx);
+        reg.shards.push_back(shard);
+    }
+    _tls_owner.shard = shard;
+    _tls_stats = shard;
+    return shard;
+}
+
+StatsServer* stats_server(const sockaddr* sa) {
+    StatsShard& shard = stats_shard();
+    unsigned n = shard.nservers.load(std::memory_order_relaxed);
+    for(unsigned i = 0; i < n; ++i) {
+        const sockaddr* known = reinterpret_cast<const sockaddr*>(&shard.addrs[i]);
+        if(sa ? sockaddr_same(sa, known) : known->sa_family == AF_UNSPEC) {
+            return &shard.servers[i];
+        }
+    }
+    if(n >= RESOLW_STATS_MAXSERVERS) return nullptr;
+    memset(&shard.addrs[n], 0, sizeof(sockaddr_storage));
+    if(sa) {
+        memcpy(&shard.addrs[n], sa, sockaddr_len(sa));
+    }
+    shard.nservers.store(n + 1, std::memory_order_release);
+    return &shard.servers[n];
+}
+
+} // resolw_impl
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int resolw_stats_read(struct resolw_stats *out)
+{
+    using namespace resolw_impl;
+    StatsRegistry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mtx);
+    collect(reg, *out);
+    merge_totals(*out, reg.baseline, -1);
+    return 0;
+}
+
+void resolw_stats_reset(void)
+{
+    using namespace resolw_impl;
+    StatsRegistry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mtx);
+    collect(reg, reg.baseline);
+}
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
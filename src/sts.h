@@ -0,0 +1,68 @@
+#ifndef _SRC_STS_H_
+#define _SRC_STS_H_
+
+#include "resolw/resolw_stats.h"
+#include <atomic>
+
+// Recording side of `resolw_stats`. Each counter has exactly one writer
+// (the owning thread), so an increment is a relaxed load and store: no
+// lock prefix, no contention, and readers still see untorn values.
+
+namespace resolw_impl {
+
+struct StatsServer {
+    std::atomic<uint64_t> queries, responses, timeouts, truncated, errors;
+    std::atomic<uint64_t> latency[RESOLW_STATS_BUCKETS];
+};
+
+struct StatsShard {
+    std::atomic<unsigned> nservers;
+    sockaddr_storage addrs[RESOLW_STATS_MAXSERVERS]; // written before `nservers` is published
+    StatsServer servers[RESOLW_STATS_MAXSERVERS];
+    std::atomic<uint64_t> cache_hits, cache_misses;
+    std::atomic<uint64_t> rcodes[16];
+};
+
+StatsShard* stats_shard_slow();
+
+extern thread_local StatsShard* _tls_stats;
+
+inline StatsShard& stats_shard() {
+    StatsShard* shard = _tls_stats;
+    return shard ? *shard : *stats_shard_slow();
+}
+
+inline void stats_bump(std::atomic<uint64_t>& c) {
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+/* Slot of `sa` (null = the system resolver) in this thread's shard, or null past the limit. */
+StatsServer* stats_server(const sockaddr* sa);
+
+inline unsigned stats_bucket(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    unsigned b = us ? 64 - __builtin_clzll(us) : 0;
+    return b < RESOLW_STATS_BUCKETS ? b : RESOLW_STATS_BUCKETS - 1;
+}
+
+inline void stats_query(StatsServer* s) { if(s) stats_bump(s->queries); }
+inline void stats_timeout(StatsServer* s) { if(s) stats_bump(s->timeouts); }
+inline void stats_error(StatsServer* s) { if(s) stats_bump(s->errors); }
+
+inline void stats_response(StatsServer* s, uint64_t elapsed_ns, bool truncated) {
+    if(!s) return;
+    stats_bump(s->responses);
+    stats_bump(s->latency[stats_bucket(elapsed_ns)]);
+    if(truncated) stats_bump(s->truncated);
+}
+
+inline void stats_rcode(unsigned rcode) { stats_bump(stats_shard().rcodes[rcode & 0xf]); }
+
+inline void stats_cache(bool hit) {
+    StatsShard& shard = stats_shard();
+    stats_bump(hit ? shard.cache_hits : shard.cache_misses);
+}
+
+} // resolw_impl
+
+#endif /* _SRC_STS_H_ */
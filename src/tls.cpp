@@ -0,0 +1,577 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "resolv.h"
+#include "resolw/resolw_tls.h"
+#include "net.h"
+#include "tls.h"
+
+#include <errno.h>
+
+#ifdef RESOLW_HAVE_DOT
+
+#include "msg.h"
+#include "sts.h"
+#include "tsg.h"
+
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <limits.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * DNS over TLS (RFC 7858). Each registered server keeps a few idle
+ * connections and the last session ticket it handed out. An exchange
+ * takes an idle connection if one is still up, or makes a new one that
+ * resumes the session, and gives it back once every query on it has
+ * its answer; a connection with queries still outstanding is closed, so
+ * that a kept one never has a stale answer in the way. The first
+ * exchange on a kept connection that turns out to have been closed by
+ * the server is retried once on a new connection.
+ */
+
+namespace {
+
+using namespace resolw_impl;
+
+constexpr unsigned kMaxIdle = 4; // connections kept per server
+constexpr uint64_t kIdleNs = 10000000000ull; // and for how long; servers do not keep theirs much longer (RFC 7766 section 6.2.3)
+
+struct Server;
+
+struct Conn {
+    sock_t fd = kBadSock;
+    SSL* ssl = nullptr;
+    std::shared_ptr<Server> server; // what the session callback stores into
+    uint64_t idle_since_ns = 0;
+    bool fatal = false; // a TLS error: the session is not to be resumed
+    std::vector<u_char> frame; // the answer being read
+};
+
+struct Server {
+    sockaddr_storage addr;
+    std::string auth_name; // empty for the opportunistic profile
+    // guarded by Pool::lock:
+    bool registered = true;
+    SSL_SESSION* session = nullptr; // the latest ticket
+    std::vector<Conn*> idle;
+
+    ~Server() { SSL_SESSION_free(session); }
+};
+
+typedef std::shared_ptr<Server> ServerRef;
+
+struct Pool {
+    std::mutex lock;
+    SSL_CTX* ctx = nullptr; // set once, never freed
+    std::vector<ServerRef> servers;
+    std::atomic<uint64_t> handshakes{0}, resumptions{0}, reuses{0};
+};
+
+std::atomic<bool> _any_server{false};
+
+Pool& pool() {
+    static Pool* instance = new Pool(); // never destroyed, like the TSIG keyring
+    return *instance;
+}
+
+/* Called by OpenSSL when a server hands out a session: with TLS 1.3, after the handshake, as it reads the first answer. */
+int on_session(SSL* ssl, SSL_SESSION* session) {
+    Server* server = static_cast<Server*>(SSL_get_app_data(ssl));
+    Pool& p = pool();
+    std::lock_guard<std::mutex> guard(p.lock);
+    SSL_SESSION_free(server->session);
+    server->session = session;
+    return 1; // the reference is ours now
+}
+
+/* The client context, made on first use. `p.lock` is held. */
+SSL_CTX* context(Pool& p) {
+    if(!p.ctx) {
+        SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+        if(!ctx) return nullptr;
+        SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION); // RFC 8310 section 9
+        SSL_CTX_set_default_verify_paths(ctx);
+        // a server that drops an idle connection without a close_notify has not broken the session; a
+        // message cut short by the end of the stream is caught by its length prefix all the same
+        SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+        // sessions are kept per server here, not in OpenSSL's cache keyed by session ID
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, on_session);
+        p.ctx = ctx;
+    }
+    return p.ctx;
+}
+
+/* `p.lock` is held. */
+std::vector<ServerRef>::iterator find(Pool& p, const sockaddr* ns) {
+    return std::find_if(p.servers.begin(), p.servers.end(), [ns](const ServerRef& s) {
+        return sockaddr_same(reinterpret_cast<const sockaddr*>(&s->addr), ns);
+    });
+}
+
+/* Takes a server out of the pool, handing its idle connections to `closing`. `p.lock` is held. */
+void retire(Server& server, std::vector<Conn*>& closing) {
+    server.registered = false;
+    closing.insert(closing.end(), server.idle.begin(), server.idle.end());
+    server.idle.clear();
+}
+
+/**
+ * `clean` says goodbye with a close_notify. A connection dropped for
+ * other reasons is marked as shut down all the same, since OpenSSL
+ * would otherwise take its session for a broken one and refuse to
+ * resume it; only a TLS error rules that out.
+ */
+void close_conn(Conn* c, bool clean) {
+    if(c->ssl) {
+        if(clean) {
+            SSL_shutdown(c->ssl);
+        } else if(!c->fatal) {
+            SSL_set_shutdown(c->ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+        }
+        SSL_free(c->ssl);
+        ERR_clear_error();
+    }
+    if(c->fd != kBadSock) sock_close(c->fd);
+    delete c;
+}
+
+void close_all(const std::vector<Conn*>& conns) {
+    for(Conn* c : conns) close_conn(c, true);
+}
+
+/* Waits for what the TLS call that returned `rc` on `c` wants; false on timeout, end of stream or error. */
+bool ssl_wait(Conn& c, int rc, uint64_t deadline_ns) {
+    switch(SSL_get_error(c.ssl, rc)) {
+        case SSL_ERROR_WANT_READ: return wait_for(c.fd, POLLIN, deadline_ns);
+        case SSL_ERROR_WANT_WRITE: return wait_for(c.fd, POLLOUT, deadline_ns);
+        case SSL_ERROR_SSL: c.fatal = true; return false;
+        default: return false;
+    }
+}
+
+bool ssl_write_all(Conn& c, const u_char* p, int len, uint64_t deadline_ns) {
+    for(;;) {
+        ERR_clear_error();
+        int rc = SSL_write(c.ssl, p, len); // all or nothing: partial writes are not enabled
+        if(rc > 0) return true;
+        if(!ssl_wait(c, rc, deadline_ns)) return false;
+    }
+}
+
+bool ssl_read_all(Conn& c, u_char* p, int len, uint64_t deadline_ns) {
+    while(len > 0) {
+        ERR_clear_error();
+        int rc = SSL_read(c.ssl, p, len);
+        if(rc > 0) {
+            p += rc;
+            len -= rc;
+        } else if(!ssl_wait(c, rc, deadline_ns)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* A new connection to `server`, resuming its session if there is one. */
+Conn* dial(Pool& p, SSL_CTX* ctx, const ServerRef& server, uint64_t deadline_ns) {
+    const sockaddr* ns = reinterpret_cast<const sockaddr*>(&server->addr);
+    Conn* c = new Conn();
+    c->server = server;
+    c->fd = socket(ns->sa_family, SOCK_STREAM, IPPROTO_TCP);
+    if(c->fd == kBadSock) {
+        close_conn(c, false);
+        return nullptr;
+    }
+    sock_nonblock(c->fd);
+    int on = 1; // every write is a complete batch of queries
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on));
+    int err = 0;
+    socklen_t errlen = sizeof(err);
+    if((connect(c->fd, ns, sockaddr_len(ns)) && sock_errno() != kErrInProgress && sock_errno() != kErrWouldBlock)
+       || !wait_for(c->fd, POLLOUT, deadline_ns)
+       || getsockopt(c->fd, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&err), &errlen) || err) {
+        close_conn(c, false);
+        return nullptr;
+    }
+    c->ssl = SSL_new(ctx);
+    if(!c->ssl || !SSL_set_fd(c->ssl, (int) c->fd)) {
+        close_conn(c, false);
+        return nullptr;
+    }
+    SSL_set_app_data(c->ssl, server.get());
+    if(!server->auth_name.empty()) {
+        const char* name = server->auth_name.c_str();
+        SSL_set_tlsext_host_name(c->ssl, name);
+        SSL_set1_host(c->ssl, name);
+        SSL_set_verify(c->ssl, SSL_VERIFY_PEER, nullptr);
+    }
+    {
+        std::lock_guard<std::mutex> guard(p.lock);
+        if(server->session && SSL_SESSION_is_resumable(server->session)) {
+            SSL_set_session(c->ssl, server->session);
+        }
+    }
+    for(;;) {
+        ERR_clear_error();
+        int rc = SSL_connect(c->ssl);
+        if(rc == 1) break;
+        if(!ssl_wait(*c, rc, deadline_ns)) {
+            close_conn(c, false);
+            return nullptr;
+        }
+    }
+    (SSL_session_reused(c->ssl) ? p.resumptions : p.handshakes).fetch_add(1, std::memory_order_relaxed);
+    c->frame.resize(kMaxAnswer);
+    return c;
+}
+
+/* Whether an idle connection is still up. A server that closed it has left something to read: its close_notify, or the end of the stream. */
+bool alive(Conn& c) {
+    pollfd_t pfd = { c.fd, POLLIN, 0 };
+    if(sock_poll(&pfd, 1, 0) == 0) return true;
+    u_char byte; // session tickets are fine; anything that gets through them is not
+    ERR_clear_error();
+    int rc = SSL_read(c.ssl, &byte, 1);
+    return rc <= 0 && SSL_get_error(c.ssl, rc) == SSL_ERROR_WANT_READ;
+}
+
+/* An idle connection to `server` that is still up, unless `fresh`, or else a new one. */
+Conn* acquire(Pool& p, SSL_CTX* ctx, const ServerRef& server, uint64_t deadline_ns, bool fresh, bool& reused) {
+    reused = false;
+    while(!fresh) {
+        Conn* c = nullptr;
+        {
+            std::lock_guard<std::mutex> guard(p.lock);
+            if(server->idle.empty()) break;
+            c = server->idle.back();
+            server->idle.pop_back();
+        }
+        const bool expired = monotonic_ns() - c->idle_since_ns >= kIdleNs;
+        if(!expired && alive(*c)) {
+            reused = true;
+            p.reuses.fetch_add(1, std::memory_order_relaxed);
+            return c;
+        }
+        close_conn(c, expired);
+    }
+    return dial(p, ctx, server, deadline_ns);
+}
+
+void release(Pool& p, Conn* c) {
+    c->idle_since_ns = monotonic_ns();
+    {
+        std::lock_guard<std::mutex> guard(p.lock);
+        Server& server = *c->server;
+        if(server.registered && server.idle.size() < kMaxIdle) {
+            server.idle.push_back(c);
+            return;
+        }
+    }
+    close_conn(c, true);
+}
+
+/**
+ * Writes the pending queries of `ex` (those with `n` = 0) in one go,
+ * then reads answers until none is pending. False if the connection
+ * breaks or the deadline passes first.
+ */
+bool converse(Conn& c, Exchange* ex, unsigned count, unsigned pending, uint64_t deadline_ns, TsigSession* tsig,
+              StatsServer* stats) {
+    std::vector<u_char> out;
+    for(unsigned i = 0; i < count; ++i) {
+        if(ex[i].n) continue;
+        const size_t at = out.size();
+        out.resize(at + 2 + ex[i].msglen);
+        wr16(&out[at], ex[i].msglen);
+        memcpy(&out[at + 2], ex[i].msg, ex[i].msglen);
+    }
+    const uint64_t sent_ns = monotonic_ns();
+    if(!ssl_write_all(c, out.data(), out.size(), deadline_ns)) return false;
+    u_char* const frame = c.frame.data();
+    while(pending) {
+        u_char len[2];
+        if(!ssl_read_all(c, len, 2, deadline_ns)) return false;
+        const int rlen = rd16(len);
+        if(!ssl_read_all(c, frame, rlen, deadline_ns)) return false;
+        Exchange* e = ex;
+        while(e < ex + count && (e->n || !msg_is_reply_to(e->msg, e->msglen, frame, rlen))) ++e;
+        if(e == ex + count) continue; // stale or stray; keep reading
+        --pending;
+        const int keep = std::min(rlen, e->anslen);
+        memcpy(e->answer, frame, keep);
+        if(tsig && (keep < rlen || tsig->check(e->answer, keep, true))) {
+            e->n = kSendFailed; // no one else could have sent it
+            stats_error(stats);
+            continue;
+        }
+        if(keep < rlen) {
+            wr16(e->answer + kHdrFlags, rd16(e->answer + kHdrFlags) | kFlagTC); // caller's buffer was too small
+        }
+        e->n = keep;
+        stats_response(stats, monotonic_ns() - sent_ns, rd16(e->answer + kHdrFlags) & kFlagTC);
+    }
+    return true;
+}
+
+} // anonymous
+
+namespace resolw_impl {
+
+bool tls_server(const sockaddr* ns) {
+    if(!_any_server.load(std::memory_order_relaxed)) return false;
+    Pool& p = pool();
+    std::lock_guard<std::mutex> guard(p.lock);
+    return find(p, ns) != p.servers.end();
+}
+
+void tls_send(const sockaddr* ns, Exchange* ex, unsigned count, uint64_t deadline_ns, TsigSession* tsig) {
+    for(unsigned i = 0; i < count; ++i) ex[i].n = 0; // pending
+    Pool& p = pool();
+    ServerRef server;
+    SSL_CTX* ctx;
+    {
+        std::lock_guard<std::mutex> guard(p.lock);
+        auto it = find(p, ns);
+        if(it != p.servers.end()) server = *it;
+        ctx = p.ctx;
+    }
+    StatsServer* stats = stats_server(ns);
+    unsigned pending = server ? count : 0;
+    for(int attempt = 0; attempt < 2 && pending; ++attempt) {
+        for(unsigned i = 0; i < count; ++i) {
+            if(!ex[i].n) stats_query(stats);
+        }
+        bool reused;
+        Conn* c = acquire(p, ctx, server, deadline_ns, attempt > 0, reused);
+        if(c && converse(*c, ex, count, pending, deadline_ns, tsig, stats)) {
+            release(p, c);
+            return;
+        }
+        if(c) close_conn(c, false);
+        const bool late = !remaining_ms(deadline_ns);
+        pending = 0;
+        for(unsigned i = 0; i < count; ++i) {
+            if(ex[i].n) continue;
+            ++pending;
+            if(late) {
+                stats_timeout(stats);
+            } else {
+                stats_error(stats);
+            }
+        }
+        if(late || !reused) break; // a new connection that failed gets no second chance
+    }
+    const int result = remaining_ms(deadline_ns) ? kSendFailed : kSendTimeout;
+    for(unsigned i = 0; i < count; ++i) {
+        if(!ex[i].n) ex[i].n = result;
+    }
+}
+
+} // resolw_impl
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int resolw_tls_add_server(const struct sockaddr *server, const char *auth_name)
+{
+    using namespace resolw_impl;
+    if(!server || (server->sa_family != AF_INET && server->sa_family != AF_INET6)
+       || (auth_name && (!*auth_name || strlen(auth_name) > MAXDNAME))) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    ServerRef s = std::make_shared<Server>();
+    memset(&s->addr, 0, sizeof(s->addr));
+    memcpy(&s->addr, server, sockaddr_len(server));
+    if(auth_name) s->auth_name = auth_name;
+    Pool& p = pool();
+    std::vector<Conn*> closing;
+    {
+        std::lock_guard<std::mutex> guard(p.lock);
+        if(!context(p)) {
+            set_last_error(ENOMEM);
+            return -1;
+        }
+        auto it = find(p, server);
+        if(it != p.servers.end()) {
+            retire(**it, closing); // replaced, session and all: it may have been made under another name
+            *it = s;
+        } else {
+            p.servers.push_back(s);
+        }
+        _any_server.store(true, std::memory_order_relaxed);
+    }
+    close_all(closing);
+    return 0;
+}
+
+int resolw_tls_remove_server(const struct sockaddr *server)
+{
+    using namespace resolw_impl;
+    if(!server) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    Pool& p = pool();
+    std::vector<Conn*> closing;
+    {
+        std::lock_guard<std::mutex> guard(p.lock);
+        auto it = find(p, server);
+        if(it == p.servers.end()) {
+            set_last_error(ENOENT);
+            return -1;
+        }
+        retire(**it, closing);
+        p.servers.erase(it);
+        _any_server.store(!p.servers.empty(), std::memory_order_relaxed);
+    }
+    close_all(closing);
+    return 0;
+}
+
+int resolw_tls_add_trust(const char *pem, size_t len)
+{
+    using namespace resolw_impl;
+    if(!pem || len > INT_MAX) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    Pool& p = pool();
+    SSL_CTX* ctx;
+    {
+        std::lock_guard<std::mutex> guard(p.lock);
+        ctx = context(p);
+    }
+    BIO* bio = ctx ? BIO_new_mem_buf(pem, (int) len) : nullptr;
+    if(!bio) {
+        set_last_error(ENOMEM);
+        return -1;
+    }
+    X509_STORE* store = SSL_CTX_get_cert_store(ctx);
+    int added = 0;
+    while(X509* cert = PEM_read_bio_X509(bio, nullptr, nullptr, nullptr)) {
+        added += X509_STORE_add_cert(store, cert) == 1;
+        X509_free(cert);
+    }
+    BIO_free(bio);
+    ERR_clear_error(); // the end of the text, or a duplicate
+    if(!added) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    return added;
+}
+
+void resolw_tls_flush(int sessions)
+{
+    Pool& p = pool();
+    std::vector<Conn*> closing;
+    {
+        std::lock_guard<std::mutex> guard(p.lock);
+        for(const ServerRef& s : p.servers) {
+            closing.insert(closing.end(), s->idle.begin(), s->idle.end());
+            s->idle.clear();
+            if(sessions) {
+                SSL_SESSION_free(s->session);
+                s->session = nullptr;
+            }
+        }
+    }
+    close_all(closing);
+}
+
+int resolw_tls_stats_read(struct resolw_tls_stats *out)
+{
+    using namespace resolw_impl;
+    if(!out) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    Pool& p = pool();
+    out->handshakes = p.handshakes.load(std::memory_order_relaxed);
+    out->resumptions = p.resumptions.load(std::memory_order_relaxed);
+    out->reuses = p.reuses.load(std::memory_order_relaxed);
+    return 0;
+}
+
+#else /* !RESOLW_HAVE_DOT */
+
+namespace resolw_impl {
+
+bool tls_server(const sockaddr*) {
+    return false;
+}
+
+void tls_send(const sockaddr*, Exchange* ex, unsigned count, uint64_t, TsigSession*) {
+    for(unsigned i = 0; i < count; ++i) ex[i].n = kSendFailed;
+}
+
+} // resolw_impl
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int resolw_tls_add_server(const struct sockaddr *server, const char *auth_name)
+{
+    (void) server; (void) auth_name;
+    resolw_impl::set_last_error(ENOSYS);
+    return -1;
+}
+
+int resolw_tls_remove_server(const struct sockaddr *server)
+{
+    (void) server;
+    resolw_impl::set_last_error(ENOSYS);
+    return -1;
+}
+
+int resolw_tls_add_trust(const char *pem, size_t len)
+{
+    (void) pem; (void) len;
+    resolw_impl::set_last_error(ENOSYS);
+    return -1;
+}
+
+void resolw_tls_flush(int sessions)
+{
+    (void) sessions;
+}
+
+int resolw_tls_stats_read(struct resolw_tls_stats *out)
+{
+    (void) out;
+    resolw_impl::set_last_error(ENOSYS);
+    return -1;
+}
+
+#endif /* RESOLW_HAVE_DOT */
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,28 @@
+#ifndef _SRC_TLS_H_
+#define _SRC_TLS_H_
+
+#include "net.h"
+
+// DNS over TLS (RFC 7858) to the servers registered with
+// resolw_tls_add_server(). Without RESOLW_HAVE_DOT (no OpenSSL) none can
+// be, so tls_server() is always false and the send path never gets here.
+
+namespace resolw_impl {
+
+class TsigSession;
+
+/* Whether queries to `ns` go over TLS; a single load while no server is registered. */
+bool tls_server(const sockaddr* ns);
+
+/**
+ * Sends the `count` queries of `ex` to the TLS server `ns` pipelined on
+ * one pooled connection, and matches the answers by ID and question in
+ * whatever order they come back (RFC 7766 section 6.2.1.1). Each `n`
+ * gets the answer length, kSendFailed or kSendTimeout. With `tsig`
+ * (`count` = 1), the answer has to be signed with the request's key.
+ */
+void tls_send(const sockaddr* ns, Exchange* ex, unsigned count, uint64_t deadline_ns, TsigSession* tsig);
+
+} // resolw_impl
+
+#endif /* _SRC_TLS_H_ */
@@ -0,0 +1,155 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "tmr.h"
+
+#include <algorithm>
+
+/**
+ * The timing wheel behind the batch send loop. Each slot is a circular
+ * list with a sentinel head, and each level keeps a bitmap of the slots
+ * that are not empty, so that the wheel can jump over idle ticks instead
+ * of turning through them one at a time, and can tell how long a poll
+ * may sleep without looking at a single timer.
+ */
+
+namespace resolw_impl {
+
+TimerWheel::TimerWheel(uint64_t now_ns, uint64_t tick_ns)
+    : origin_ns_(now_ns), tick_ns_(tick_ns ? tick_ns : 1), now_(0), count_(0) {
+    for(auto& level : slots_) {
+        for(Timer& head : level) {
+            head.prev = head.next = &head;
+        }
+    }
+    std::fill(occupied_, occupied_ + kLevels, 0);
+    ready_.prev = ready_.next = &ready_;
+}
+
+void TimerWheel::link(Timer* t, Timer* head) {
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+void TimerWheel::unlink(Timer* t) {
+    const Timer* const head = t->next == t->prev ? t->next : nullptr; // the sole timer of its list
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->prev = t->next = nullptr;
+    if(head && t->slot != kReady) {
+        occupied_[t->slot / kSlots] &= ~(uint64_t(1) << (t->slot % kSlots));
+    }
+}
+
+void TimerWheel::arm(Timer* t, uint64_t deadline_ns) {
+    cancel(t);
+    t->due = deadline_ns > origin_ns_ ? (deadline_ns - origin_ns_ + tick_ns_ - 1) / tick_ns_ : 0;
+    place(t);
+    ++count_;
+}
+
+/* Links `t` into the slot for its distance from now, or into `ready_` if it is due. */
+void TimerWheel::place(Timer* t) {
+    if(t->due <= now_) {
+        t->slot = kReady;
+        link(t, &ready_);
+        return;
+    }
+    constexpr uint64_t kReach = uint64_t(1) << (kBits * kLevels);
+    const uint64_t delta = t->due - now_;
+    const uint64_t due = delta < kReach ? t->due : now_ + kReach - 1; // too far: wait at the far end
+    unsigned level = 0;
+    while(level + 1 < kLevels && (due - now_) >> (kBits * (level + 1))) ++level;
+    const unsigned index = (due >> (kBits * level)) & (kSlots - 1);
+    t->slot = level * kSlots + index;
+    link(t, &slots_[level][index]);
+    occupied_[level] |= uint64_t(1) << index;
+}
+
+/* Turns the wheel by one tick: spreads the upper slots that start there, then readies the level-0 slot. */
+void TimerWheel::step() {
+    ++now_;
+    for(unsigned level = 1; level < kLevels; ++level) {
+        if(now_ & ((uint64_t(1) << (kBits * level)) - 1)) break; // not at a boundary of this level, nor of any above
+        const unsigned index = (now_ >> (kBits * level)) & (kSlots - 1);
+        Timer& head = slots_[level][index];
+        occupied_[level] &= ~(uint64_t(1) << index);
+        while(!empty(head)) {
+            Timer* t = head.next;
+            t->prev->next = t->next;
+            t->next->prev = t->prev;
+            place(t);
+        }
+    }
+    const unsigned index = now_ & (kSlots - 1);
+    Timer& head = slots_[0][index];
+    if(empty(head)) return;
+    for(Timer* t = head.next; t != &head; t = t->next) t->slot = kReady;
+    // splice the whole list onto `ready_`
+    head.next->prev = ready_.prev;
+    ready_.prev->next = head.next;
+    head.prev->next = &ready_;
+    ready_.prev = head.prev;
+    head.prev = head.next = &head;
+    occupied_[0] &= ~(uint64_t(1) << index);
+}
+
+/* Turns the wheel to the next tick where anything happens, but not past `target`. */
+void TimerWheel::advance(uint64_t target) {
+    const uint64_t base = now_ & ~uint64_t(kSlots - 1);
+    uint64_t next = base + kSlots; // the end of this turn of level 0, where upper slots may come down
+    const unsigned from = (now_ & (kSlots - 1)) + 1;
+    if(from < kSlots) {
+        const uint64_t ahead = occupied_[0] >> from << from; // the rest of this turn
+        if(ahead) next = base + __builtin_ctzll(ahead);
+    }
+    now_ = std::min(next, target) - 1;
+    step();
+}
+
+Timer* TimerWheel::expire(uint64_t now_ns) {
+    const uint64_t target = now_ns > origin_ns_ ? (now_ns - origin_ns_) / tick_ns_ : 0;
+    while(empty(ready_) && now_ < target && count_) {
+        advance(target);
+    }
+    if(empty(ready_)) {
+        now_ = std::max(now_, target); // nothing armed to turn through
+        return nullptr;
+    }
+    Timer* t = ready_.next;
+    unlink(t);
+    --count_;
+    return t;
+}
+
+uint64_t TimerWheel::next_ns() const {
+    if(!empty(ready_)) return 0;
+    if(!count_) return UINT64_MAX;
+    uint64_t first = UINT64_MAX; // tick
+    for(unsigned level = 0; level < kLevels; ++level) {
+        const uint64_t bits = occupied_[level];
+        if(!bits) continue;
+        // the first slot after the current one, going round; where it starts bounds its timers from below
+        const unsigned shift = kBits * level;
+        const uint64_t current = now_ >> shift;
+        const unsigned rot = (current + 1) & (kSlots - 1);
+        const uint64_t rotated = rot ? (bits >> rot) | (bits << (kSlots - rot)) : bits;
+        first = std::min(first, (current + 1 + __builtin_ctzll(rotated)) << shift);
+    }
+    return origin_ns_ + first * tick_ns_;
+}
+
+} // resolw_impl
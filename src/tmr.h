@@ -0,0 +1,88 @@
+#ifndef _SRC_TMR_H_
+#define _SRC_TMR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A hierarchical timing wheel (Varghese and Lauck) for the deadlines of
+// the queries a poll loop has in flight: arming and cancelling a timer
+// are O(1), and so is expiring one, amortized, however many are armed.
+
+namespace resolw_impl {
+
+/* A deadline. Derive from it (or embed it) in what it times out; it is not armed until TimerWheel::arm(). */
+struct Timer {
+    Timer* prev = nullptr;
+    Timer* next = nullptr; // null while not armed
+    uint64_t due = 0; // in ticks
+    unsigned slot = 0;
+
+    bool armed() const { return next != nullptr; }
+};
+
+/**
+ * Four levels of 64 slots. A level-0 slot is one tick (1 ms unless told
+ * otherwise) and a slot of level `n` spans 64^n ticks, which makes some
+ * 4.6 hours at 1 ms; later deadlines wait in the last level and are
+ * placed again each time it comes round. A timer goes into the level
+ * whose span covers its distance from now, and the slots of the upper
+ * levels are spread over the lower ones as the wheel reaches them.
+ * Deadlines are rounded up to the next tick, so a timer never fires
+ * early. Not thread-safe: one wheel per poll loop.
+ */
+class TimerWheel {
+public:
+    explicit TimerWheel(uint64_t now_ns, uint64_t tick_ns = 1000000);
+
+    /* Arms `t` to expire at `deadline_ns`, re-arming it if it was. */
+    void arm(Timer* t, uint64_t deadline_ns);
+
+    /* Disarms `t`; a no-op if it is not armed. */
+    void cancel(Timer* t) {
+        if(!t->armed()) return;
+        unlink(t);
+        --count_;
+    }
+
+    /**
+     * Takes the next timer that is due by `now_ns` off the wheel, or
+     * returns null if there is none. Timers may be armed and cancelled
+     * between calls, including the one just returned.
+     */
+    Timer* expire(uint64_t now_ns);
+
+    /* A time no later than the next deadline, to poll until: 0 if a timer is due already, UINT64_MAX if none is armed. */
+    uint64_t next_ns() const;
+
+    size_t size() const { return count_; }
+
+private:
+    enum {
+        kLevels = 4,
+        kBits = 6,
+        kSlots = 1 << kBits,
+        kReady = kLevels * kSlots, // the slot number of `ready_`
+    };
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    static bool empty(const Timer& head) { return head.next == &head; }
+    static void link(Timer* t, Timer* head);
+    void unlink(Timer* t);
+
+    void place(Timer* t);
+    void step();
+    void advance(uint64_t target);
+
+    Timer slots_[kLevels][kSlots]; // list heads
+    uint64_t occupied_[kLevels]; // a bit per slot with timers in it
+    Timer ready_; // due, not handed out yet
+    const uint64_t origin_ns_, tick_ns_;
+    uint64_t now_; // the last tick the wheel has turned to
+    size_t count_;
+};
+
+} // resolw_impl
+
+#endif /* _SRC_TMR_H_ */
@@ -0,0 +1,129 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "trc.h"
+#include "net.h" // monotonic_ns
+
+#include <mutex>
+
+namespace resolw_impl {
+
+std::atomic<bool> _trace_armed{false};
+
+namespace {
+
+constexpr int kMaxSubscribers = 8;
+
+/**
+ * Fixed subscriber table. A slot is claimed under `mtx`; `ctx` is written
+ * before `fn` is released, so an emitter that sees `fn` also sees `ctx`.
+ */
+struct Subscriber {
+    std::atomic<resolw_trace_fn> fn{nullptr};
+    std::atomic<void*> ctx{nullptr};
+};
+
+Subscriber _subscribers[kMaxSubscribers];
+std::mutex _subscribers_mtx;
+std::atomic<uint64_t> _next_serial{1};
+
+thread_local uint64_t _tls_serial = 0; // serial of the outermost traced call on this thread
+
+void rearm() {
+    bool any = false;
+    for(auto& s : _subscribers) {
+        any |= s.fn.load(std::memory_order_relaxed) != nullptr;
+    }
+    _trace_armed.store(any, std::memory_order_relaxed);
+}
+
+} // anonymous
+
+void TraceScope::begin(const char* qname, unsigned qtype, unsigned dns_id) {
+    qname_ = qname;
+    qtype_ = qtype;
+    dns_id_ = dns_id;
+    outer_ = !_tls_serial;
+    if(outer_) {
+        _tls_serial = _next_serial.fetch_add(1, std::memory_order_relaxed);
+    }
+    serial_ = _tls_serial;
+    if(outer_) {
+        emit(RESOLW_TRACE_QUERY_START, nullptr, 0, -1, dns_id, 0);
+    }
+}
+
+void TraceScope::end() {
+    if(outer_) {
+        _tls_serial = 0;
+    }
+}
+
+void TraceScope::emit(int kind, const sockaddr* server, int attempt, int rcode, unsigned dns_id, int result) {
+    resolw_trace_event ev;
+    ev.kind = kind;
+    ev.query_serial = serial_;
+    ev.timestamp_ns = monotonic_ns();
+    ev.qname = qname_;
+    ev.qtype = qtype_;
+    ev.dns_id = dns_id;
+    ev.server = server;
+    ev.attempt = attempt;
+    ev.rcode = rcode;
+    ev.result = result;
+    for(auto& s : _subscribers) {
+        resolw_trace_fn fn = s.fn.load(std::memory_order_acquire);
+        if(fn) {
+            fn(&ev, s.ctx.load(std::memory_order_relaxed));
+        }
+    }
+}
+
+} // resolw_impl
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int resolw_trace_subscribe(resolw_trace_fn fn, void *ctx)
+{
+    using namespace resolw_impl;
+    if(!fn) return -1;
+    std::lock_guard<std::mutex> lock(_subscribers_mtx);
+    for(int i = 0; i < kMaxSubscribers; ++i) {
+        Subscriber& s = _subscribers[i];
+        if(!s.fn.load(std::memory_order_relaxed)) {
+            s.ctx.store(ctx, std::memory_order_relaxed);
+            s.fn.store(fn, std::memory_order_release);
+            rearm();
+            return i;
+        }
+    }
+    return -1;
+}
+
+void resolw_trace_unsubscribe(int handle)
+{
+    using namespace resolw_impl;
+    if(handle < 0 || handle >= kMaxSubscribers) return;
+    std::lock_guard<std::mutex> lock(_subscribers_mtx);
+    _subscribers[handle].fn.store(nullptr, std::memory_order_relaxed);
+    rearm();
+}
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
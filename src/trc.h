@@ -0,0 +1,75 @@
+#ifndef _SRC_TRC_H_
+#define _SRC_TRC_H_
+
+#include "resolw/resolw_trace.h"
+#include <atomic>
+
+#ifdef RESOLW_HAVE_SDT
+#include <sys/sdt.h>
+#define RESOLW_PROBE(name, ...) STAP_PROBEV(resolw, name, __VA_ARGS__)
+#else
+#define RESOLW_PROBE(name, ...) do {} while(0)
+#endif
+
+// Emission side of `resolw_trace`. Every hook point is guarded by a test
+// of `_trace_armed`, which only flips when subscribers come and go, so
+// the untraced path is one well-predicted branch per point.
+
+namespace resolw_impl {
+
+extern std::atomic<bool> _trace_armed;
+
+inline bool trace_on() {
+    return __builtin_expect(_trace_armed.load(std::memory_order_relaxed), 0);
+}
+
+/**
+ * Brackets one API call. Nested calls (e.g. res_nquery -> res_nsend) join
+ * the outermost call's serial and emit neither START nor COMPLETE.
+ */
+class TraceScope {
+public:
+    TraceScope(const char* qname, unsigned qtype, unsigned dns_id) : serial_(0) {
+        RESOLW_PROBE(query_start, qname, qtype, dns_id);
+        if(trace_on()) {
+            begin(qname, qtype, dns_id);
+        }
+    }
+
+    ~TraceScope() {
+        if(serial_) {
+            end();
+        }
+    }
+
+    /* SERVER_SEND, RESPONSE, RETRY, CACHE_HIT */
+    void event(int kind, const sockaddr* server, int attempt, int rcode, unsigned dns_id) {
+        RESOLW_PROBE(event, kind, server, attempt, rcode, dns_id);
+        if(serial_) {
+            emit(kind, server, attempt, rcode, dns_id, 0);
+        }
+    }
+
+    /* To be called once, right before returning `result` to the caller. */
+    void complete(int result, int rcode) {
+        RESOLW_PROBE(complete, result, rcode);
+        if(serial_ && outer_) {
+            emit(RESOLW_TRACE_COMPLETE, nullptr, 0, rcode, dns_id_, result);
+        }
+    }
+
+private:
+    void begin(const char* qname, unsigned qtype, unsigned dns_id);
+    void end();
+    void emit(int kind, const sockaddr* server, int attempt, int rcode, unsigned dns_id, int result);
+
+    uint64_t serial_; // 0 when tracing was off at entry
+    bool outer_;
+    const char* qname_;
+    unsigned qtype_;
+    unsigned dns_id_;
+};
+
+} // resolw_impl
+
+#endif /* _SRC_TRC_H_ */
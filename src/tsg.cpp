@@ -0,0 +1,494 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "resolv.h"
+#include "resolw/resolw_tsig.h"
+#include "net.h"
+#include "tsg.h"
+
+#include <errno.h>
+
+#ifdef RESOLW_HAVE_DNSSEC
+
+#include "msg.h"
+#include "sec.h"
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
+
+/**
+ * TSIG signing and verification (RFC 8945). A key is kept as the two
+ * digest states HMAC (RFC 2104) starts from: the hash function having
+ * absorbed the key XOR ipad, and having absorbed the key XOR opad. A
+ * MAC copies the first, runs the message through it, then copies the
+ * second for the inner hash: no key setup, and no copy of the message,
+ * which is digested in the caller's buffer in the pieces the TSIG
+ * variables come in.
+ */
+
+namespace resolw_impl {
+
+struct TsigKey {
+    Wire name, algorithm; // lowercased wire format
+    unsigned maclen; // untruncated
+    EVP_MD_CTX* inner;
+    EVP_MD_CTX* outer;
+
+    TsigKey() : maclen(0), inner(EVP_MD_CTX_new()), outer(EVP_MD_CTX_new()) {}
+    ~TsigKey() {
+        EVP_MD_CTX_free(inner);
+        EVP_MD_CTX_free(outer);
+    }
+};
+
+} // resolw_impl
+
+namespace {
+
+using namespace resolw_impl;
+
+typedef std::shared_ptr<const TsigKey> KeyRef;
+
+constexpr unsigned kFudge = 300; // seconds of clock skew we allow others (RFC 8945 section 10)
+constexpr unsigned kMaxUnsigned = 99; // answer messages in a row without a TSIG (section 5.3.1)
+
+struct Algorithm {
+    const char* name;
+    const EVP_MD* (*md)();
+};
+
+const Algorithm kAlgorithms[] = {
+    {"hmac-md5.sig-alg.reg.int", EVP_md5},
+    {"hmac-sha1", EVP_sha1},
+    {"hmac-sha224", EVP_sha224},
+    {"hmac-sha256", EVP_sha256},
+    {"hmac-sha384", EVP_sha384},
+    {"hmac-sha512", EVP_sha512},
+};
+
+struct Keyring {
+    std::mutex lock;
+    std::map<Wire, KeyRef> keys;
+};
+
+Keyring& keyring() {
+    static Keyring* instance = new Keyring(); // never destroyed, like the DNSSEC caches
+    return *instance;
+}
+
+KeyRef find_key(const Wire& name) {
+    Keyring& k = keyring();
+    std::lock_guard<std::mutex> guard(k.lock);
+    auto it = k.keys.find(name);
+    return it == k.keys.end() ? nullptr : it->second;
+}
+
+/* The calling thread's digest context for one-off signatures. */
+EVP_MD_CTX* scratch() {
+    static thread_local struct Holder {
+        EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+        ~Holder() { EVP_MD_CTX_free(ctx); }
+    } holder;
+    return holder.ctx;
+}
+
+bool mac_start(EVP_MD_CTX* ctx, const TsigKey& key) {
+    return ctx && EVP_MD_CTX_copy_ex(ctx, key.inner);
+}
+
+/* The MAC a message chains to, length first (RFC 8945 section 4.3.1). */
+bool mac_prior(EVP_MD_CTX* ctx, const u_char* mac, unsigned len) {
+    u_char size[2];
+    wr16(size, len);
+    return EVP_DigestUpdate(ctx, size, 2) && EVP_DigestUpdate(ctx, mac, len);
+}
+
+/* The outer hash over the inner one; `out` takes key.maclen bytes. */
+bool mac_finish(EVP_MD_CTX* ctx, const TsigKey& key, u_char* out) {
+    u_char inner[EVP_MAX_MD_SIZE];
+    unsigned len = 0;
+    return EVP_DigestFinal_ex(ctx, inner, &len) && EVP_MD_CTX_copy_ex(ctx, key.outer)
+        && EVP_DigestUpdate(ctx, inner, len) && EVP_DigestFinal_ex(ctx, out, &len);
+}
+
+/* The TSIG variables (RFC 8945 section 4.3.3), or only the timers for the later messages of a transfer. */
+bool mac_variables(EVP_MD_CTX* ctx, const TsigKey& key, const u_char* class_ttl, const u_char* timers,
+                   const u_char* tail, unsigned taillen, bool timers_only) {
+    if(timers_only) return EVP_DigestUpdate(ctx, timers, 8);
+    return EVP_DigestUpdate(ctx, key.name.data(), key.name.size()) && EVP_DigestUpdate(ctx, class_ttl, 6)
+        && EVP_DigestUpdate(ctx, key.algorithm.data(), key.algorithm.size()) && EVP_DigestUpdate(ctx, timers, 8)
+        && EVP_DigestUpdate(ctx, tail, taillen);
+}
+
+/* A TSIG record within its message. */
+struct Record {
+    int at; // where it starts
+    Wire owner; // the key name, lowercased
+    const u_char* class_ttl; // 6 bytes
+    const u_char* algorithm;
+    int alglen;
+    const u_char* timers; // time signed (48 bits) and fudge
+    const u_char* mac;
+    unsigned maclen;
+    unsigned original_id, error;
+    const u_char* tail; // error, other len and other data
+    unsigned taillen;
+};
+
+/* Finds the TSIG record, which has to come last (RFC 8945 section 5.1). 1 if found, 0 if there is none, -1 if malformed. */
+int find_tsig(const u_char* msg, int len, Record& rr) {
+    if(len < kHdrSize) return -1;
+    const u_char* const eom = msg + len;
+    const u_char* p = msg + kHdrSize;
+    if(!rd16(msg + kHdrArCount)) return 0;
+    for(unsigned qd = rd16(msg + kHdrQdCount); qd; --qd) {
+        int n = msg_skip_name(p, eom);
+        if(n < 0 || eom - p < n + 4) return -1;
+        p += n + 4;
+    }
+    unsigned before = rd16(msg + kHdrAnCount) + rd16(msg + kHdrNsCount) + rd16(msg + kHdrArCount) - 1;
+    for(; before; --before) {
+        int n = msg_skip_name(p, eom);
+        if(n < 0 || eom - p < n + 10 || eom - p - n - 10 < rd16(p + n + 8)) return -1;
+        p += n + 10 + rd16(p + n + 8);
+    }
+    const u_char* const start = p;
+    u_char owner[MAXCDNAME];
+    int ownerlen = 0;
+    int n = msg_unpack_name(msg, eom, p, owner, sizeof(owner), &ownerlen);
+    if(n < 0 || eom - p < n + 10) return -1;
+    p += n;
+    if(rd16(p) != T_TSIG) return 0;
+    rr.class_ttl = p + 2;
+    const u_char* const end = p + 10 + rd16(p + 8);
+    p += 10;
+    if(end != eom) return -1; // short, or followed by something
+    rr.alglen = msg_check_name(nullptr, nullptr, p, end); // uncompressed
+    if(rr.alglen < 0 || end - p < rr.alglen + 10) return -1;
+    rr.algorithm = p;
+    rr.timers = p + rr.alglen;
+    rr.maclen = rd16(rr.timers + 8);
+    p = rr.timers + 10;
+    if(end - p < (int) rr.maclen + 6) return -1;
+    rr.mac = p;
+    p += rr.maclen;
+    rr.original_id = rd16(p);
+    rr.tail = p + 2;
+    rr.error = rd16(rr.tail);
+    rr.taillen = end - rr.tail;
+    if(rr.taillen != 4u + rd16(rr.tail + 2)) return -1;
+    wire_lower(owner);
+    rr.owner.assign(owner, owner + ownerlen);
+    rr.at = start - msg;
+    return 1;
+}
+
+/* Checks the signature of `msg` against `ctx`, which has absorbed what precedes the message in the digest. */
+int verify(EVP_MD_CTX* ctx, const TsigKey& key, const u_char* msg, const Record& rr, bool timers_only) {
+    Wire algorithm(rr.algorithm, rr.algorithm + rr.alglen);
+    wire_lower(algorithm.data());
+    if(algorithm != key.algorithm) return RESOLW_TSIG_BADKEY;
+    if(!rr.maclen && rr.error) return rr.error; // reported unsigned (RFC 8945 section 5.3.2)
+    if(rr.maclen > key.maclen || rr.maclen < std::max(10u, key.maclen / 2)) { // section 5.2.2.1
+        set_last_error(EBADMSG);
+        return -1;
+    }
+    // the message as it was before the TSIG record was added
+    u_char header[kHdrSize];
+    memcpy(header, msg, kHdrSize);
+    wr16(header + kHdrId, rr.original_id);
+    wr16(header + kHdrArCount, rd16(msg + kHdrArCount) - 1);
+    u_char mac[EVP_MAX_MD_SIZE];
+    if(!EVP_DigestUpdate(ctx, header, kHdrSize) || !EVP_DigestUpdate(ctx, msg + kHdrSize, rr.at - kHdrSize)
+            || !mac_variables(ctx, key, rr.class_ttl, rr.timers, rr.tail, rr.taillen, timers_only)
+            || !mac_finish(ctx, key, mac)) {
+        set_last_error(ENOMEM);
+        return -1;
+    }
+    if(CRYPTO_memcmp(mac, rr.mac, rr.maclen)) return RESOLW_TSIG_BADSIG;
+    if(rr.error) return rr.error; // signed, e.g. BADTIME with the other side's clock
+    const uint64_t signed_at = (uint64_t) rd16(rr.timers) << 32 | rd32(rr.timers + 2);
+    const uint64_t now = time(nullptr);
+    if((now > signed_at ? now - signed_at : signed_at - now) > rd16(rr.timers + 6)) return RESOLW_TSIG_BADTIME;
+    return 0;
+}
+
+/* Appends the TSIG record of `key` to the message in `buf`, chained to `prior` if that is not null. Returns the new length or -1. */
+int sign(EVP_MD_CTX* ctx, const TsigKey& key, u_char* buf, int len, int buflen, const u_char* prior, unsigned priorlen) {
+    const size_t need = key.name.size() + 10 + key.algorithm.size() + 10 + key.maclen + 6;
+    if(buflen - len < (int) need) {
+        set_last_error(EMSGSIZE);
+        return -1;
+    }
+    const uint64_t now = time(nullptr);
+    u_char* p = buf + len;
+    memcpy(p, key.name.data(), key.name.size());
+    p += key.name.size();
+    wr16(p, T_TSIG);
+    u_char* const class_ttl = p + 2;
+    wr16(class_ttl, C_ANY);
+    wr32(class_ttl + 2, 0);
+    u_char* const rdlen = p + 8;
+    u_char* const rdata = p + 10;
+    memcpy(rdata, key.algorithm.data(), key.algorithm.size());
+    u_char* const timers = rdata + key.algorithm.size();
+    wr16(timers, now >> 32);
+    wr32(timers + 2, (uint32_t) now);
+    wr16(timers + 6, kFudge);
+    wr16(timers + 8, key.maclen);
+    u_char* const mac = timers + 10;
+    u_char* const tail = mac + key.maclen + 2;
+    wr16(tail - 2, rd16(buf + kHdrId)); // original ID
+    wr32(tail, 0); // no error, no other data
+    wr16(rdlen, tail + 4 - rdata);
+    if(!mac_start(ctx, key) || (prior && !mac_prior(ctx, prior, priorlen)) || !EVP_DigestUpdate(ctx, buf, len)
+            || !mac_variables(ctx, key, class_ttl, timers, tail, 4, false) || !mac_finish(ctx, key, mac)) {
+        set_last_error(ENOMEM);
+        return -1;
+    }
+    wr16(buf + kHdrArCount, rd16(buf + kHdrArCount) + 1);
+    return tail + 4 - buf;
+}
+
+} // anonymous
+
+namespace resolw_impl {
+
+TsigSession::TsigSession() : running_(nullptr), request_maclen_(0), unsigned_run_(0), tsig_at_(0) {}
+
+TsigSession::~TsigSession() {
+    EVP_MD_CTX_free(running_);
+}
+
+bool TsigSession::start(const u_char* request, int len) {
+    Record rr;
+    if(find_tsig(request, len, rr) != 1 || rr.maclen > kTsigMaxMac) return false;
+    key_ = find_key(rr.owner);
+    if(!key_ || (!running_ && !(running_ = EVP_MD_CTX_new()))) return false;
+    memcpy(request_mac_, rr.mac, rr.maclen);
+    request_maclen_ = rr.maclen;
+    unsigned_run_ = 0;
+    tsig_at_ = 0;
+    return true;
+}
+
+int TsigSession::check(const u_char* msg, int len, bool first) {
+    tsig_at_ = 0;
+    if(first) {
+        unsigned_run_ = 0;
+        if(!mac_start(running_, *key_) || !mac_prior(running_, request_mac_, request_maclen_)) {
+            set_last_error(ENOMEM);
+            return -1;
+        }
+    }
+    Record rr;
+    int found = find_tsig(msg, len, rr);
+    if(found <= 0) { // only the later messages of a transfer may be unsigned
+        if(found < 0 || first || ++unsigned_run_ > kMaxUnsigned || !EVP_DigestUpdate(running_, msg, len)) {
+            set_last_error(EBADMSG);
+            return -1;
+        }
+        return 0;
+    }
+    if(rr.owner != key_->name) return RESOLW_TSIG_BADKEY;
+    int rv = verify(running_, *key_, msg, rr, !first);
+    if(rv) return rv;
+    if(!mac_start(running_, *key_) || !mac_prior(running_, rr.mac, rr.maclen)) { // what the next message chains to
+        set_last_error(ENOMEM);
+        return -1;
+    }
+    unsigned_run_ = 0;
+    tsig_at_ = rr.at;
+    return 0;
+}
+
+int TsigSession::strip(u_char* msg, int len) const {
+    if(!tsig_at_) return len;
+    wr16(msg + kHdrArCount, rd16(msg + kHdrArCount) - 1);
+    return tsig_at_;
+}
+
+} // resolw_impl
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int resolw_tsig_add_key(const char *name, const char *algorithm, const u_char *secret, size_t secretlen)
+{
+    auto key = std::make_shared<TsigKey>();
+    Wire wanted;
+    const EVP_MD* md = nullptr;
+    if(name && algorithm && (secret || !secretlen) && to_wire(name, key->name) && to_wire(algorithm, wanted)) {
+        for(const Algorithm& a : kAlgorithms) {
+            Wire known;
+            if(to_wire(a.name, known) && known == wanted) md = a.md();
+        }
+    }
+    if(!md) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    key->algorithm = wanted;
+    key->maclen = EVP_MD_get_size(md);
+
+    // RFC 2104: keys longer than a block are hashed first; shorter ones are padded with zeros
+    std::vector<u_char> pad(EVP_MD_get_block_size(md), 0);
+    unsigned hashed = 0;
+    if(secretlen > pad.size()) {
+        EVP_Digest(secret, secretlen, pad.data(), &hashed, md, nullptr);
+    } else if(secretlen) {
+        memcpy(pad.data(), secret, secretlen);
+    }
+    for(u_char& b : pad) b ^= 0x36;
+    bool ok = key->inner && EVP_DigestInit_ex(key->inner, md, nullptr) && EVP_DigestUpdate(key->inner, pad.data(), pad.size());
+    for(u_char& b : pad) b ^= 0x36 ^ 0x5c;
+    ok = ok && key->outer && EVP_DigestInit_ex(key->outer, md, nullptr) && EVP_DigestUpdate(key->outer, pad.data(), pad.size());
+    OPENSSL_cleanse(pad.data(), pad.size());
+    if(!ok) {
+        set_last_error(ENOMEM);
+        return -1;
+    }
+    Keyring& k = keyring();
+    std::lock_guard<std::mutex> guard(k.lock);
+    k.keys[key->name] = key;
+    return 0;
+}
+
+int resolw_tsig_remove_key(const char *name)
+{
+    Wire wire;
+    if(!name || !to_wire(name, wire)) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    Keyring& k = keyring();
+    std::lock_guard<std::mutex> guard(k.lock);
+    if(!k.keys.erase(wire)) {
+        set_last_error(ENOENT);
+        return -1;
+    }
+    return 0;
+}
+
+int resolw_tsig_sign(const char *keyname, u_char *buf, int msglen, int buflen, const u_char *request, int reqlen)
+{
+    Wire name;
+    Record own, req;
+    if(!keyname || !buf || msglen < kHdrSize || msglen > buflen || !to_wire(keyname, name)
+            || find_tsig(buf, msglen, own) != 0 || (request && find_tsig(request, reqlen, req) != 1)) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    KeyRef key = find_key(name);
+    if(!key) {
+        set_last_error(ENOENT);
+        return -1;
+    }
+    return sign(scratch(), *key, buf, msglen, std::min(buflen, 0xffff), request ? req.mac : nullptr, request ? req.maclen : 0);
+}
+
+int resolw_tsig_verify(const u_char *msg, int msglen, const u_char *request, int reqlen)
+{
+    Record rr, req;
+    if(!msg || (request && find_tsig(request, reqlen, req) != 1)) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    if(find_tsig(msg, msglen, rr) != 1) {
+        set_last_error(EBADMSG);
+        return -1;
+    }
+    KeyRef key = find_key(rr.owner);
+    if(!key) return RESOLW_TSIG_BADKEY;
+    EVP_MD_CTX* ctx = scratch();
+    if(!mac_start(ctx, *key) || (request && !mac_prior(ctx, req.mac, req.maclen))) {
+        set_last_error(ENOMEM);
+        return -1;
+    }
+    return verify(ctx, *key, msg, rr, false);
+}
+
+#else /* no OpenSSL: no HMAC */
+
+namespace resolw_impl {
+
+TsigSession::TsigSession() : running_(nullptr), request_maclen_(0), unsigned_run_(0), tsig_at_(0) {}
+
+TsigSession::~TsigSession() {}
+
+bool TsigSession::start(const u_char* request, int len) {
+    (void) request; (void) len;
+    return false;
+}
+
+int TsigSession::check(const u_char* msg, int len, bool first) {
+    (void) msg; (void) len; (void) first;
+    set_last_error(ENOSYS);
+    return -1;
+}
+
+int TsigSession::strip(u_char* msg, int len) const {
+    (void) msg;
+    return len;
+}
+
+} // resolw_impl
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int resolw_tsig_add_key(const char *name, const char *algorithm, const u_char *secret, size_t secretlen)
+{
+    (void) name; (void) algorithm; (void) secret; (void) secretlen;
+    resolw_impl::set_last_error(ENOSYS);
+    return -1;
+}
+
+int resolw_tsig_remove_key(const char *name)
+{
+    (void) name;
+    resolw_impl::set_last_error(ENOSYS);
+    return -1;
+}
+
+int resolw_tsig_sign(const char *keyname, u_char *buf, int msglen, int buflen, const u_char *request, int reqlen)
+{
+    (void) keyname; (void) buf; (void) msglen; (void) buflen; (void) request; (void) reqlen;
+    resolw_impl::set_last_error(ENOSYS);
+    return -1;
+}
+
+int resolw_tsig_verify(const u_char *msg, int msglen, const u_char *request, int reqlen)
+{
+    (void) msg; (void) msglen; (void) request; (void) reqlen;
+    resolw_impl::set_last_error(ENOSYS);
+    return -1;
+}
+
+#endif /* RESOLW_HAVE_DNSSEC */
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
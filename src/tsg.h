@@ -0,0 +1,64 @@
+#ifndef _SRC_TSG_H_
+#define _SRC_TSG_H_
+
+#include "resolv.h"
+#include <memory>
+
+// TSIG (RFC 8945) on the requesting side, for res_nsend() and zone
+// transfers. Without RESOLW_HAVE_DNSSEC (no OpenSSL) nothing is signed,
+// and TsigSession::start() always says so.
+
+struct evp_md_ctx_st; // EVP_MD_CTX
+
+namespace resolw_impl {
+
+enum {
+    kTsigMaxMac = 64, // HMAC-SHA512
+};
+
+struct TsigKey;
+
+/**
+ * The state of one signed exchange: the key, and the MAC the next answer
+ * message chains to, which is first the request's, then that of the last
+ * signed answer message. Not every message of a zone transfer needs to
+ * be signed (RFC 8945 section 5.3.1); the unsigned ones in between go
+ * into a running digest that the next signature has to cover.
+ */
+class TsigSession {
+public:
+    TsigSession();
+    ~TsigSession();
+
+    /* Picks up the key and MAC of a signed `request`; false if it is unsigned or its key is not in the keyring. */
+    bool start(const u_char* request, int len);
+
+    /**
+     * Checks the next answer message. `first` starts over from the
+     * request's MAC, as for the answer of another server. Returns 0, a
+     * RESOLW_TSIG_* code, or -1 if the message is malformed or unsigned
+     * where it may not be.
+     */
+    int check(const u_char* msg, int len, bool first);
+
+    /* Drops the TSIG record of the message check() has just accepted; returns the new length. */
+    int strip(u_char* msg, int len) const;
+
+    /* Whether the messages checked so far end with a signed one, as a complete answer must. */
+    bool settled() const { return !unsigned_run_; }
+
+private:
+    TsigSession(const TsigSession&) = delete;
+    TsigSession& operator=(const TsigSession&) = delete;
+
+    std::shared_ptr<const TsigKey> key_;
+    evp_md_ctx_st* running_;
+    u_char request_mac_[kTsigMaxMac];
+    unsigned request_maclen_;
+    unsigned unsigned_run_; // answer messages since the last signed one
+    int tsig_at_; // where the TSIG record of the last accepted message starts; 0 if it had none
+};
+
+} // resolw_impl
+
+#endif /* _SRC_TSG_H_ */
@@ -0,0 +1,437 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "resolv.h"
+#include "resolw/resolw_update.h"
+#include "idn.h"
+#include "msg.h"
+#include "net.h"
+
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+#include <string>
+#include <vector>
+
+/**
+ * The UPDATE builder. Changes are kept as fixed-size entries pointing
+ * into one byte arena, so collecting thousands of them costs a few
+ * reallocations rather than one per record. Packing compresses names
+ * against a hash table of every name suffix already written into the
+ * message, remembered by offset only: a candidate is confirmed by
+ * comparing against the message itself. A record that does not fit is
+ * taken back out of the message and the table alike, and starts the
+ * next message instead.
+ */
+
+namespace {
+
+using namespace resolw_impl;
+
+constexpr unsigned kClassNone = 254; // RFC 2136 section 1.3
+constexpr int kMaxPointer = 0x3fff;
+constexpr int kMaxLabels = 128;
+
+/* A record of the prerequisite or update section; name and rdata live in the arena. */
+struct Entry {
+    uint32_t name, rdata; // arena offsets
+    uint16_t type, rdclass, rdlen;
+    uint32_t ttl;
+};
+
+inline u_char lower(u_char c) { return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c; }
+
+/* The hash of a name given the hash of its parent, case-insensitive. */
+uint32_t suffix_hash(const u_char* label, uint32_t parent) {
+    uint32_t h = 2166136261u ^ parent; // FNV-1a over the label, seeded with the parent's hash
+    for(int i = 0; i <= *label; ++i) h = (h ^ lower(label[i])) * 16777619u;
+    return h ^ (h >> 15);
+}
+
+/**
+ * The suffixes of the names written into one message. Slots are reused
+ * by bumping a generation instead of being cleared, and the slots taken
+ * since mark() can be released again: entries only ever go away in the
+ * reverse order of their insertion, which linear probing allows.
+ */
+class Dictionary {
+public:
+    Dictionary() : gen_(0) { memset(slots_, 0, sizeof(slots_)); }
+
+    void reset() {
+        if(!++gen_) { // wrapped; stale slots could pass for current ones
+            memset(slots_, 0, sizeof(slots_));
+            gen_ = 1;
+        }
+        log_.clear();
+    }
+
+    void mark() { log_.clear(); }
+
+    void rollback() {
+        for(auto it = log_.rbegin(); it != log_.rend(); ++it) slots_[*it].gen = 0;
+        log_.clear();
+    }
+
+    /* Records the suffixes of the uncompressed name at `at` in `msg`. */
+    void learn(const u_char* msg, int at) {
+        const u_char* name = msg + at;
+        int starts[kMaxLabels], n = 0;
+        for(const u_char* p = name; *p && n < kMaxLabels; p += *p + 1) starts[n++] = p - name;
+        uint32_t h = 0;
+        for(int i = n - 1; i >= 0; --i) {
+            h = suffix_hash(name + starts[i], h);
+            if(at + starts[i] <= kMaxPointer) insert(h, at + starts[i]);
+        }
+    }
+
+    /**
+     * Writes the uncompressed `name` at `out`, the end of the message that
+     * starts at `msg`, compressed against what the message already holds.
+     * Returns the bytes written, or -1 if they do not fit before `end`.
+     */
+    int put(const u_char* msg, u_char* out, const u_char* end, const u_char* name) {
+        int starts[kMaxLabels], n = 0;
+        for(const u_char* p = name; *p; p += *p + 1) starts[n++] = p - name; // checked when added: <= 127 labels
+        uint32_t hashes[kMaxLabels + 1];
+        hashes[n] = 0;
+        for(int i = n - 1; i >= 0; --i) hashes[i] = suffix_hash(name + starts[i], hashes[i + 1]);
+        u_char* const start = out;
+        for(int i = 0; i < n; ++i) {
+            const u_char* suffix = name + starts[i];
+            int found = find(msg, out, hashes[i], suffix);
+            if(found >= 0) {
+                if(end - out < 2) return -1;
+                wr16(out, 0xc000 | found);
+                return out + 2 - start;
+            }
+            const int len = *suffix + 1;
+            if(end - out < len) return -1;
+            memcpy(out, suffix, len);
+            if(out - msg <= kMaxPointer) insert(hashes[i], out - msg);
+            out += len;
+        }
+        if(out >= end) return -1;
+        *out++ = 0;
+        return out - start;
+    }
+
+private:
+    enum { kSlots = 16384 }; // twice the suffixes that can start below kMaxPointer
+
+    struct Slot {
+        uint32_t hash;
+        uint16_t offset, gen;
+    };
+
+    int find(const u_char* msg, const u_char* eom, uint32_t hash, const u_char* suffix) const {
+        int end = 0;
+        while(suffix[end]) end += suffix[end] + 1;
+        for(unsigned i = hash & (kSlots - 1); slots_[i].gen == gen_; i = (i + 1) & (kSlots - 1)) {
+            if(slots_[i].hash == hash
+                    && msg_names_equal(msg, eom, msg + slots_[i].offset, suffix, suffix + end + 1, suffix)) {
+                return slots_[i].offset;
+            }
+        }
+        return -1;
+    }
+
+    void insert(uint32_t hash, int offset) {
+        unsigned i = hash & (kSlots - 1);
+        while(slots_[i].gen == gen_) i = (i + 1) & (kSlots - 1);
+        slots_[i].hash = hash;
+        slots_[i].offset = offset;
+        slots_[i].gen = gen_;
+        log_.push_back(i);
+    }
+
+    Slot slots_[kSlots];
+    uint16_t gen_;
+    std::vector<unsigned> log_; // slots taken since mark()
+};
+
+/* The names in the rdata of `type` that RFC 3597 section 4 lets us compress: after `prefix` bytes, `names` of them. */
+void compressible(unsigned type, int& prefix, int& names) {
+    prefix = names = 0;
+    switch(type) {
+        case T_NS: case kTypeMd: case kTypeMf: case T_CNAME: case kTypeMb: case kTypeMg: case kTypeMr: case T_PTR:
+            names = 1;
+            break;
+        case T_SOA: case kTypeMinfo:
+            names = 2;
+            break;
+        case T_MX:
+            prefix = 2;
+            names = 1;
+            break;
+    }
+}
+
+} // anonymous
+
+struct resolw_update {
+    std::string zone_text; // as res_nmkquery() takes it
+    std::vector<u_char> zone; // wire format
+    unsigned rdclass;
+    std::vector<u_char> arena;
+    std::vector<Entry> prereqs, changes;
+    size_t next; // the first change not packed yet
+    bool packed; // a message has gone out since the last rewind
+    Dictionary dict;
+};
+
+namespace {
+
+/* Whether the names that put_record() compresses are well formed and the rdata holds them. */
+bool check_rdata(unsigned type, const u_char* rdata, size_t rdlen) {
+    int prefix, names;
+    compressible(type, prefix, names);
+    if(!rdlen) return true;
+    const u_char* p = rdata + prefix;
+    const u_char* const end = rdata + rdlen;
+    for(int i = 0; i < names; ++i) {
+        int n = p < end ? msg_check_name(nullptr, nullptr, p, end) : -1;
+        if(n < 0) return false;
+        p += n;
+    }
+    return p <= end;
+}
+
+/* Files a record under `list`. */
+int push(resolw_update* upd, std::vector<Entry>& list, const char* name, unsigned type, unsigned rdclass,
+         uint32_t ttl, const u_char* rdata, size_t rdlen) {
+    char ace[MAXDNAME + 1];
+    u_char wire[MAXCDNAME];
+    int n = -1;
+    if(name && (name = name_to_ascii(name, ace, sizeof(ace)))) n = msg_pack_name(name, wire, sizeof(wire));
+    bool ok = n > 0 && type <= 0xffff && rdlen <= 0xffff && (rdata || !rdlen) && check_rdata(type, rdata, rdlen);
+    if(ok) { // in the zone, or the server answers NOTZONE
+        const u_char* const zone = upd->zone.data();
+        int labels = 0, zone_labels = 0;
+        for(const u_char* p = wire; *p; p += *p + 1) ++labels;
+        for(const u_char* p = zone; *p; p += *p + 1) ++zone_labels;
+        const u_char* suffix = wire;
+        for(int skip = labels - zone_labels; skip > 0; --skip) suffix += *suffix + 1;
+        ok = labels >= zone_labels
+          && msg_names_equal(wire, wire + n, suffix, zone, zone + upd->zone.size(), zone);
+    }
+    if(!ok) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    try {
+        Entry e;
+        e.name = upd->arena.size();
+        upd->arena.insert(upd->arena.end(), wire, wire + n);
+        e.rdata = upd->arena.size();
+        if(rdlen) upd->arena.insert(upd->arena.end(), rdata, rdata + rdlen);
+        e.type = type;
+        e.rdclass = rdclass;
+        e.rdlen = rdlen;
+        e.ttl = ttl;
+        list.push_back(e);
+    } catch(const std::bad_alloc&) {
+        set_last_error(ENOMEM);
+        return -1;
+    }
+    return 0;
+}
+
+/* Appends `e` to the message; false, with message and dictionary as they were, if it does not fit. */
+bool put_record(resolw_update* upd, u_char* msg, int& len, const u_char* end, const Entry& e) {
+    Dictionary& dict = upd->dict;
+    dict.mark();
+    const u_char* const arena = upd->arena.data();
+    u_char* p = msg + len;
+    int n = dict.put(msg, p, end, arena + e.name);
+    if(n < 0 || end - p - n < 10) {
+        dict.rollback();
+        return false;
+    }
+    p += n;
+    wr16(p, e.type);
+    wr16(p + 2, e.rdclass);
+    wr32(p + 4, e.ttl);
+    u_char* const rdlen = p + 8;
+    p += 10;
+    const u_char* r = arena + e.rdata;
+    const u_char* const rend = r + e.rdlen;
+    int prefix = 0, names = 0;
+    if(e.rdlen) compressible(e.type, prefix, names);
+    if(end - p < prefix) {
+        dict.rollback();
+        return false;
+    }
+    memcpy(p, r, prefix);
+    p += prefix;
+    r += prefix;
+    for(int i = 0; i < names; ++i) {
+        if((n = dict.put(msg, p, end, r)) < 0) {
+            dict.rollback();
+            return false;
+        }
+        p += n;
+        while(*r) r += *r + 1;
+        ++r;
+    }
+    if(end - p < rend - r) {
+        dict.rollback();
+        return false;
+    }
+    memcpy(p, r, rend - r);
+    p += rend - r;
+    wr16(rdlen, p - rdlen - 2);
+    len = p - msg;
+    return true;
+}
+
+} // anonymous
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+resolw_update *resolw_update_new(const char *zone, unsigned rdclass)
+{
+    using namespace resolw_impl;
+    char ace[MAXDNAME + 1];
+    u_char wire[MAXCDNAME];
+    int n = -1;
+    if(zone && rdclass <= 0xffff && (zone = name_to_ascii(zone, ace, sizeof(ace)))) n = msg_pack_name(zone, wire, sizeof(wire));
+    if(n <= 0) {
+        set_last_error(EINVAL);
+        return nullptr;
+    }
+    resolw_update* upd = new(std::nothrow) resolw_update();
+    if(!upd) {
+        set_last_error(ENOMEM);
+        return nullptr;
+    }
+    upd->zone_text = zone;
+    upd->zone.assign(wire, wire + n);
+    upd->rdclass = rdclass;
+    upd->next = 0;
+    upd->packed = false;
+    return upd;
+}
+
+void resolw_update_free(resolw_update *upd)
+{
+    delete upd;
+}
+
+int resolw_update_require(resolw_update *upd, int what, const char *name, unsigned type, const u_char *rdata, size_t rdlen)
+{
+    using namespace resolw_impl;
+    if(!upd) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    switch(what) {
+        case RESOLW_UPDATE_YXRRSET: // value independent: class ANY; value dependent: the zone's class
+            return push(upd, upd->prereqs, name, type, rdata ? upd->rdclass : C_ANY, 0, rdata, rdata ? rdlen : 0);
+        case RESOLW_UPDATE_NXRRSET:
+            return push(upd, upd->prereqs, name, type, kClassNone, 0, nullptr, 0);
+        case RESOLW_UPDATE_YXDOMAIN:
+            return push(upd, upd->prereqs, name, T_ANY, C_ANY, 0, nullptr, 0);
+        case RESOLW_UPDATE_NXDOMAIN:
+            return push(upd, upd->prereqs, name, T_ANY, kClassNone, 0, nullptr, 0);
+    }
+    set_last_error(EINVAL);
+    return -1;
+}
+
+int resolw_update_add(resolw_update *upd, const char *name, unsigned type, uint32_t ttl, const u_char *rdata, size_t rdlen)
+{
+    using namespace resolw_impl;
+    if(!upd || type == T_ANY || !rdata) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    return push(upd, upd->changes, name, type, upd->rdclass, ttl, rdata, rdlen);
+}
+
+int resolw_update_delete(resolw_update *upd, const char *name, unsigned type, const u_char *rdata, size_t rdlen)
+{
+    using namespace resolw_impl;
+    if(!upd || (rdata && type == T_ANY)) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    // RFC 2136 section 2.5.2-4: one RR with class NONE, whole RRsets with class ANY
+    return push(upd, upd->changes, name, type, rdata ? kClassNone : C_ANY, 0, rdata, rdata ? rdlen : 0);
+}
+
+int resolw_update_pack(resolw_update *upd, res_state statp, u_char *buf, int buflen)
+{
+    using namespace resolw_impl;
+    if(!upd || !statp || !buf || buflen < kHdrSize) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    if(upd->packed && upd->next >= upd->changes.size()) return 0;
+    buflen = std::min(buflen, 0xffff);
+    int len = res_nmkquery(statp, kOpUpdate, upd->zone_text.c_str(), upd->rdclass, T_SOA, nullptr, 0, nullptr, buf, buflen);
+    if(len < 0) return -1;
+    const u_char* const end = buf + buflen;
+    Dictionary& dict = upd->dict;
+    dict.reset();
+    dict.learn(buf, kHdrSize); // the zone section
+    for(const Entry& e : upd->prereqs) { // every message is checked against all of them
+        if(!put_record(upd, buf, len, end, e)) {
+            set_last_error(EMSGSIZE);
+            return -1;
+        }
+    }
+    const size_t first = upd->next;
+    unsigned count = 0;
+    for(; upd->next < upd->changes.size() && count < 0xffff; ++upd->next, ++count) {
+        if(!put_record(upd, buf, len, end, upd->changes[upd->next])) break;
+    }
+    // a later message would be checked against a zone the earlier ones already changed
+    if((!count || !upd->prereqs.empty()) && upd->next < upd->changes.size()) {
+        upd->next = first;
+        set_last_error(EMSGSIZE);
+        return -1;
+    }
+    wr16(buf + kHdrAnCount, upd->prereqs.size()); // PRCOUNT
+    wr16(buf + kHdrNsCount, count); // UPCOUNT
+    upd->packed = true;
+    return len;
+}
+
+void resolw_update_rewind(resolw_update *upd)
+{
+    if(upd) {
+        upd->next = 0;
+        upd->packed = false;
+    }
+}
+
+void resolw_update_clear(resolw_update *upd)
+{
+    if(upd) {
+        upd->arena.clear();
+        upd->prereqs.clear();
+        upd->changes.clear();
+        resolw_update_rewind(upd);
+    }
+}
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
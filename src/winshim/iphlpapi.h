@@ -0,0 +1,20 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#ifndef _WINSHIM_IPHLPAPI_H_
+#define _WINSHIM_IPHLPAPI_H_
+
+/* Nothing from <iphlpapi.h> is used yet; present so that dns.cpp builds unchanged. */
+
+#endif /* _WINSHIM_IPHLPAPI_H_ */
@@ -0,0 +1,57 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#ifndef _WINSHIM_RESOLW_WINSHIM_H_
+#define _WINSHIM_RESOLW_WINSHIM_H_
+
+#include "windns.h"
+
+/**
+ * Controls for the WinDNS emulation (-DRESOLW_WINSHIM=ON). Emulated queries
+ * are turned into wire messages, answered by the installed resolver and
+ * parsed back into `DNS_RECORD` lists laid out as DnsQuery() lays them out,
+ * so the code on top of WinDNS runs unchanged under perf and valgrind.
+ * The settings are process-wide and should be made before the first query.
+ */
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Answers `query` into `reply`; returns the reply length, or -1 for "no
+ * answer" (reported as ERROR_TIMEOUT). `udp` is false for TCP-only queries.
+ */
+typedef int (*resolw_winshim_resolver)(const unsigned char *query, int qlen, unsigned char *reply, int replen,
+                                       int udp, void *ctx);
+
+/* Installs `fn`; NULL (the default) forwards queries to the configured servers with res_nsend(). */
+void resolw_winshim_set_resolver(resolw_winshim_resolver fn, void *ctx);
+
+/* What DnsQueryConfig(DnsConfigDnsServerList) reports; by default, 127.0.0.1. */
+void resolw_winshim_set_servers(const struct sockaddr_in *servers, int count);
+
+/* What DnsQueryConfig(DnsConfigPrimaryDomainName_UTF8) reports; by default, nothing. */
+void resolw_winshim_set_domain(const char *domain);
+
+/* The version IsWindowsVersionOrGreater() compares against; by default, 10.0. */
+void resolw_winshim_set_version(unsigned major, unsigned minor);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WINSHIM_RESOLW_WINSHIM_H_ */
@@ -0,0 +1,39 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#ifndef _WINSHIM_VERSIONHELPERS_H_
+#define _WINSHIM_VERSIONHELPERS_H_
+
+#include "windows.h"
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The emulated version; see resolw_winshim_set_version(). */
+BOOL IsWindowsVersionOrGreater(WORD major, WORD minor, WORD servpack);
+
+#ifdef __cplusplus
+inline BOOL IsWindows7OrGreater() { return IsWindowsVersionOrGreater(6, 1, 0); }
+inline BOOL IsWindows8OrGreater() { return IsWindowsVersionOrGreater(6, 2, 0); }
+inline BOOL IsWindows10OrGreater() { return IsWindowsVersionOrGreater(10, 0, 0); }
+#endif
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WINSHIM_VERSIONHELPERS_H_ */
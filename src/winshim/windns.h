@@ -0,0 +1,251 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#ifndef _WINSHIM_WINDNS_H_
+#define _WINSHIM_WINDNS_H_
+
+#include "windows.h"
+#include <netinet/in.h>
+
+/**
+ * The subset of <windns.h> used by dns.cpp and ndb.cpp, with the layouts
+ * and constants of the Windows SDK, implemented in wsh.cpp on top of a
+ * stand-in resolver (see resolw_winshim.h). There is no UNICODE build:
+ * DNS_RECORD is DNS_RECORDA, and DnsQueryEx() returns UTF-8 records.
+ */
+
+typedef LONG DNS_STATUS;
+typedef DWORD IP4_ADDRESS; /* network byte order */
+
+typedef struct _IP4_ARRAY {
+    DWORD AddrCount;
+    IP4_ADDRESS AddrArray[1];
+} IP4_ARRAY, *PIP4_ARRAY;
+
+typedef struct {
+    BYTE IP6Byte[16];
+} IP6_ADDRESS;
+
+/* Query options */
+#define DNS_QUERY_STANDARD 0x00000000
+#define DNS_QUERY_ACCEPT_TRUNCATED_RESPONSE 0x00000001
+#define DNS_QUERY_USE_TCP_ONLY 0x00000002
+#define DNS_QUERY_NO_RECURSION 0x00000004
+#define DNS_QUERY_BYPASS_CACHE 0x00000008
+#define DNS_QUERY_NO_WIRE_QUERY 0x00000010
+#define DNS_QUERY_NO_LOCAL_NAME 0x00000020
+#define DNS_QUERY_NO_HOSTS_FILE 0x00000040
+#define DNS_QUERY_NO_NETBT 0x00000080
+#define DNS_QUERY_WIRE_ONLY 0x00000100
+#define DNS_QUERY_RETURN_MESSAGE 0x00000200
+#define DNS_QUERY_TREAT_AS_FQDN 0x00001000
+#define DNS_QUERY_DNSSEC_OK 0x01000000
+#define DNS_QUERY_DNSSEC_CHECKING_DISABLED 0x02000000
+
+/* Status codes */
+#define DNS_ERROR_RESPONSE_CODES_BASE 9000
+#define DNS_ERROR_RCODE_NO_ERROR ERROR_SUCCESS
+#define DNS_ERROR_RCODE_FORMAT_ERROR 9001L
+#define DNS_ERROR_RCODE_SERVER_FAILURE 9002L
+#define DNS_ERROR_RCODE_NAME_ERROR 9003L
+#define DNS_ERROR_RCODE_NOT_IMPLEMENTED 9004L
+#define DNS_ERROR_RCODE_REFUSED 9005L
+#define DNS_ERROR_RCODE_LAST 9018L
+#define DNS_ERROR_BAD_PACKET 9502L
+#define DNS_INFO_NO_RECORDS 9501L
+#define DNS_REQUEST_PENDING 9506L
+
+/* Record data; pointers are into the same allocation as the record. */
+typedef struct { IP4_ADDRESS IpAddress; } DNS_A_DATA;
+typedef struct { IP6_ADDRESS Ip6Address; } DNS_AAAA_DATA;
+typedef struct { PSTR pNameHost; } DNS_PTR_DATAA;
+typedef struct { PSTR pNameExchange; WORD wPreference; WORD Pad; } DNS_MX_DATAA;
+typedef struct { DWORD dwStringCount; PSTR pStringArray[1]; } DNS_TXT_DATAA;
+typedef struct { PSTR pNameTarget; WORD wPriority; WORD wWeight; WORD wPort; WORD Pad; } DNS_SRV_DATAA;
+typedef struct {
+    PSTR pNamePrimaryServer;
+    PSTR pNameAdministrator;
+    DWORD dwSerialNo, dwRefresh, dwRetry, dwExpire, dwDefaultTtl;
+} DNS_SOA_DATAA;
+typedef struct {
+    WORD wTypeCovered;
+    BYTE chAlgorithm;
+    BYTE chLabelCount;
+    DWORD dwOriginalTtl, dwExpiration, dwTimeSigned;
+    WORD wKeyTag;
+    WORD wSignatureLength;
+    PSTR pNameSigner;
+    BYTE Signature[1];
+} DNS_SIG_DATAA;
+typedef struct { WORD wFlags; BYTE chProtocol; BYTE chAlgorithm; WORD wKeyLength; WORD wPad; BYTE Key[1]; } DNS_KEY_DATA;
+typedef struct { DWORD dwByteCount; BYTE Data[1]; } DNS_NULL_DATA;
+typedef struct { DWORD dwByteCount; BYTE bData[1]; } DNS_UNKNOWN_DATA;
+
+typedef struct _DnsRecordFlags {
+    DWORD Section : 2;
+    DWORD Delete : 1;
+    DWORD CharSet : 2;
+    DWORD Unused : 3;
+    DWORD Reserved : 24;
+} DNS_RECORD_FLAGS;
+
+typedef enum _DnsSection {
+    DnsSectionQuestion,
+    DnsSectionAnswer,
+    DnsSectionAuthority,
+    DnsSectionAddtional, /* sic */
+} DNS_SECTION;
+
+typedef struct _DnsRecordA {
+    struct _DnsRecordA *pNext;
+    PSTR pName;
+    WORD wType;
+    WORD wDataLength; /* of Data, in bytes */
+    union {
+        DWORD DW;
+        DNS_RECORD_FLAGS S;
+    } Flags;
+    DWORD dwTtl;
+    DWORD dwReserved;
+    union {
+        DNS_A_DATA A;
+        DNS_AAAA_DATA AAAA;
+        DNS_PTR_DATAA PTR, Ptr, NS, Ns, CNAME, Cname;
+        DNS_MX_DATAA MX, Mx;
+        DNS_TXT_DATAA TXT, Txt;
+        DNS_SRV_DATAA SRV, Srv;
+        DNS_SOA_DATAA SOA, Soa;
+        DNS_SIG_DATAA SIG, Sig, RRSIG, Rrsig;
+        DNS_KEY_DATA KEY, Key, DNSKEY, Dnskey;
+        DNS_NULL_DATA Null;
+        DNS_UNKNOWN_DATA UNKNOWN, Unknown;
+    } Data;
+} DNS_RECORDA, *PDNS_RECORDA, DNS_RECORD, *PDNS_RECORD;
+
+typedef enum {
+    DnsFreeFlat = 0,
+    DnsFreeRecordList,
+    DnsFreeParsedMessageFields,
+} DNS_FREE_TYPE;
+
+typedef enum {
+    DnsConfigPrimaryDomainName_W,
+    DnsConfigPrimaryDomainName_A,
+    DnsConfigPrimaryDomainName_UTF8,
+    DnsConfigAdapterDomainName_W,
+    DnsConfigAdapterDomainName_A,
+    DnsConfigAdapterDomainName_UTF8,
+    DnsConfigDnsServerList,
+} DNS_CONFIG_TYPE;
+
+#define DNS_CONFIG_FLAG_ALLOC 0x00000001
+
+/* Wire header with the flag bits as the SDK declares them (little-endian bit order). */
+typedef struct _DNS_HEADER {
+    WORD Xid;
+    BYTE RecursionDesired : 1;
+    BYTE Truncation : 1;
+    BYTE Authoritative : 1;
+    BYTE Opcode : 4;
+    BYTE IsResponse : 1;
+    BYTE ResponseCode : 4;
+    BYTE CheckingDisabled : 1;
+    BYTE AuthenticatedData : 1;
+    BYTE Reserved : 1;
+    BYTE RecursionAvailable : 1;
+    WORD QuestionCount;
+    WORD AnswerCount;
+    WORD NameServerCount;
+    WORD AdditionalCount;
+} DNS_HEADER, *PDNS_HEADER;
+
+typedef struct _DNS_MESSAGE_BUFFER {
+    DNS_HEADER MessageHead;
+    CHAR MessageBody[1];
+} DNS_MESSAGE_BUFFER, *PDNS_MESSAGE_BUFFER;
+
+/* DnsQueryEx() and friends (Windows 8+) */
+#define DNS_ADDR_MAX_SOCKADDR_LENGTH 32
+
+typedef struct _DnsAddr {
+    CHAR MaxSa[DNS_ADDR_MAX_SOCKADDR_LENGTH];
+    DWORD DnsAddrUserDword[8];
+} DNS_ADDR, *PDNS_ADDR;
+
+typedef struct _DnsAddrArray {
+    DWORD MaxCount;
+    DWORD AddrCount;
+    DWORD Tag;
+    WORD Family;
+    WORD WordReserved;
+    DWORD Flags;
+    DWORD MatchFlag;
+    DWORD Reserved1;
+    DWORD Reserved2;
+    DNS_ADDR AddrArray[];
+} DNS_ADDR_ARRAY, *PDNS_ADDR_ARRAY;
+
+typedef struct _DNS_QUERY_RESULT {
+    ULONG Version;
+    DNS_STATUS QueryStatus;
+    ULONG64 QueryOptions;
+    PDNS_RECORD pQueryRecords;
+    PVOID Reserved;
+} DNS_QUERY_RESULT, *PDNS_QUERY_RESULT;
+
+typedef void WINAPI DNS_QUERY_COMPLETION_ROUTINE(PVOID pQueryContext, PDNS_QUERY_RESULT pQueryResults);
+typedef DNS_QUERY_COMPLETION_ROUTINE *PDNS_QUERY_COMPLETION_ROUTINE;
+
+typedef struct _DNS_QUERY_REQUEST {
+    ULONG Version;
+    PCWSTR QueryName;
+    WORD QueryType;
+    ULONG64 QueryOptions;
+    PDNS_ADDR_ARRAY pDnsServerList;
+    ULONG InterfaceIndex;
+    PDNS_QUERY_COMPLETION_ROUTINE pQueryCompletionCallback;
+    PVOID pQueryContext;
+} DNS_QUERY_REQUEST, *PDNS_QUERY_REQUEST;
+
+typedef struct _DNS_QUERY_CANCEL {
+    CHAR Reserved[32];
+} DNS_QUERY_CANCEL, *PDNS_QUERY_CANCEL;
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+DNS_STATUS WINAPI DnsQuery_UTF8(PCSTR pszName, WORD wType, DWORD Options, PVOID pExtra, PDNS_RECORD *ppQueryResults,
+                                PVOID *pReserved);
+
+/* Synchronous only: a completion callback, if given, is ignored. */
+DNS_STATUS WINAPI DnsQueryEx(PDNS_QUERY_REQUEST pQueryRequest, PDNS_QUERY_RESULT pQueryResults,
+                             PDNS_QUERY_CANCEL pCancelHandle);
+
+/* DnsConfigDnsServerList and DnsConfigPrimaryDomainName_UTF8 only. */
+DNS_STATUS WINAPI DnsQueryConfig(DNS_CONFIG_TYPE Config, DWORD Flag, PCWSTR pwsAdapterName, PVOID pReserved,
+                                 PVOID pBuffer, PDWORD pBufLen);
+
+BOOL WINAPI DnsWriteQuestionToBuffer_UTF8(PDNS_MESSAGE_BUFFER pDnsBuffer, PDWORD pdwBufferSize, PCSTR pszName,
+                                          WORD wType, WORD Xid, BOOL fRecursionDesired);
+
+void WINAPI DnsRecordListFree(PDNS_RECORD pRecordList, DNS_FREE_TYPE FreeType);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WINSHIM_WINDNS_H_ */
@@ -0,0 +1,73 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#ifndef _WINSHIM_WINDOWS_H_
+#define _WINSHIM_WINDOWS_H_
+
+/**
+ * The subset of <windows.h> that the WinDNS code paths use, for building
+ * them elsewhere (-DRESOLW_WINSHIM=ON). Widths follow the Windows ABI
+ * (LONG and ULONG are 32-bit), not the host's `long`; WCHAR is the host's
+ * `wchar_t`, so wide strings are UTF-32 where Windows has UTF-16.
+ */
+
+#include <stdint.h>
+#include <wchar.h>
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD, *PDWORD;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef uint64_t ULONG64, QWORD;
+typedef int BOOL;
+typedef unsigned int UINT;
+typedef char CHAR, *PSTR;
+typedef const char *PCSTR, *LPCCH;
+typedef wchar_t WCHAR, *PWSTR, *LPWSTR;
+typedef const wchar_t *PCWSTR;
+typedef void *PVOID, *HLOCAL;
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+#define WINAPI
+#define CP_UTF8 65001
+
+#define ERROR_SUCCESS 0L
+#define ERROR_FILE_NOT_FOUND 2L
+#define ERROR_OUTOFMEMORY 14L
+#define ERROR_INVALID_PARAMETER 87L
+#define ERROR_MORE_DATA 234L
+#define ERROR_TIMEOUT 1460L
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Only CP_UTF8; invalid sequences fail with 0, as with MB_ERR_INVALID_CHARS. */
+int MultiByteToWideChar(UINT codepage, DWORD flags, LPCCH src, int srclen, LPWSTR dst, int dstlen);
+
+/* Frees what the emulated DnsQueryConfig() allocated. */
+HLOCAL LocalFree(HLOCAL mem);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WINSHIM_WINDOWS_H_ */
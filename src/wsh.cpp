@@ -0,0 +1,560 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "resolv.h"
+#include "net.h"
+#include "msg.h"
+
+#include <windows.h>
+#include <windns.h>
+#include <versionhelpers.h>
+#include "resolw_winshim.h"
+
+#include <algorithm>
+#include <cstddef> // offsetof
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * WinDNS emulation for building and profiling dns.cpp and ndb.cpp away
+ * from Windows. A query becomes a wire message, the installed resolver
+ * (or res_nsend()) answers it, and the answer is parsed into a list of
+ * DNS_RECORDA laid out as DnsQuery() lays it out: one allocation per
+ * record, host byte order except for addresses, names without the
+ * trailing dot. Caveats: calls are synchronous; DnsQueryEx() records
+ * carry UTF-8 names where Windows has UTF-16 ones; DNS_QUERY_RETURN_MESSAGE
+ * and the resolver cache are not emulated.
+ */
+
+namespace {
+
+using namespace resolw_impl;
+
+constexpr unsigned kCharSetUtf8 = 2; // DnsCharSetUtf8
+
+struct ShimConfig {
+    resolw_winshim_resolver resolver = nullptr;
+    void* ctx = nullptr;
+    std::vector<sockaddr_in> servers;
+    std::string domain;
+    unsigned major = 10, minor = 0;
+
+    ShimConfig() {
+        sockaddr_in sin;
+        memset(&sin, 0, sizeof(sin));
+        sin.sin_family = AF_INET;
+        sin.sin_port = htons(NAMESERVER_PORT);
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        servers.push_back(sin);
+    }
+};
+
+ShimConfig& config() {
+    static ShimConfig cfg;
+    return cfg;
+}
+
+/* Writes the query WinDNS would send; returns its length or -1. */
+int make_query(const char* name, WORD type, ULONG64 options, u_char* buf, int buflen) {
+    if(buflen < kHdrSize) return -1;
+    memset(buf, 0, kHdrSize);
+    wr16(buf + kHdrId, res_randomid());
+    unsigned flags = (options & DNS_QUERY_NO_RECURSION) ? 0 : kFlagRD;
+    if(options & DNS_QUERY_DNSSEC_CHECKING_DISABLED) flags |= kFlagCD;
+    wr16(buf + kHdrFlags, flags);
+    wr16(buf + kHdrQdCount, 1);
+    u_char* cp = buf + kHdrSize;
+    u_char* const eom = buf + buflen;
+    int n = msg_pack_name(name, cp, eom - cp);
+    if(n < 0 || eom - cp - n < 4) return -1;
+    cp += n;
+    wr16(cp, type);
+    wr16(cp + 2, C_IN);
+    cp += 4;
+    if(options & DNS_QUERY_DNSSEC_OK) {
+        return msg_add_opt(buf, cp - buf, buflen, kEdnsPayload, true);
+    }
+    return cp - buf;
+}
+
+/* The servers of a request, or the configured ones. */
+int forward(const std::vector<sockaddr_in>& servers, const u_char* query, int qlen, u_char* reply, int replen,
+            bool udp) {
+    static thread_local _res_state rs;
+    memset(&rs, 0, sizeof(rs));
+    rs.options = RES_INIT | RES_RECURSE | (udp ? 0 : RES_USEVC);
+    rs.retrans = 1; // WinDNS waits 1 s for the first server, longer afterwards
+    rs.retry = 2;
+    rs.nscount = std::min((int) servers.size(), MAXNS);
+    for(int i = 0; i < rs.nscount; ++i) {
+        rs.nsaddr_list[i] = servers[i];
+    }
+    return res_nsend(&rs, query, qlen, reply, replen);
+}
+
+std::string to_utf8(PCWSTR wide) {
+    std::string out;
+    for(; wide && *wide; ++wide) {
+        uint32_t c = *wide;
+        if(c < 0x80) {
+            out.push_back(c);
+        } else if(c < 0x800) {
+            out.push_back(0xc0 | c >> 6);
+            out.push_back(0x80 | (c & 0x3f));
+        } else if(c < 0x10000) {
+            out.push_back(0xe0 | c >> 12);
+            out.push_back(0x80 | ((c >> 6) & 0x3f));
+            out.push_back(0x80 | (c & 0x3f));
+        } else {
+            out.push_back(0xf0 | c >> 18);
+            out.push_back(0x80 | ((c >> 12) & 0x3f));
+            out.push_back(0x80 | ((c >> 6) & 0x3f));
+            out.push_back(0x80 | (c & 0x3f));
+        }
+    }
+    return out;
+}
+
+/**
+ * Grows a record allocation: the fixed part and `Data` first, then the
+ * strings the record points to. Pointers are fixed up at the end.
+ */
+class RecordBuilder {
+public:
+    RecordBuilder(size_t datalen) : datalen_(datalen) {
+        size_t fixed = std::max(sizeof(DNS_RECORDA), offsetof(DNS_RECORDA, Data) + datalen);
+        bytes_.resize((fixed + 7) & ~size_t(7), 0);
+    }
+
+    DNS_RECORDA* rec() { return reinterpret_cast<DNS_RECORDA*>(bytes_.data()); }
+
+    /* Appends a copy of `s` and points `field` (a member of rec()) at it. */
+    void set_string(PSTR* field, const char* s, size_t len) {
+        fixups_.push_back({reinterpret_cast<char*>(field) - bytes_.data(), bytes_.size()});
+        bytes_.insert(bytes_.end(), s, s + len);
+        bytes_.push_back('\0');
+    }
+
+    /* Same for the name at `src`; returns the bytes it occupies there, or -1. */
+    int set_name(PSTR* field, const u_char* msg, const u_char* eom, const u_char* src) {
+        char name[MAXDNAME];
+        int used = msg_expand_name(msg, eom, src, name, sizeof(name));
+        if(used >= 0) set_string(field, name, strlen(name));
+        return used;
+    }
+
+    DNS_RECORDA* finish() {
+        char* block = static_cast<char*>(malloc(bytes_.size()));
+        if(!block) return nullptr;
+        memcpy(block, bytes_.data(), bytes_.size());
+        for(const auto& f : fixups_) {
+            *reinterpret_cast<PSTR*>(block + f.first) = block + f.second;
+        }
+        DNS_RECORDA* out = reinterpret_cast<DNS_RECORDA*>(block);
+        out->wDataLength = datalen_;
+        return out;
+    }
+
+private:
+    size_t datalen_;
+    std::vector<char> bytes_;
+    std::vector<std::pair<ptrdiff_t, size_t> > fixups_;
+};
+
+/* Parses one resource record at `cp`; returns null (with `ok` still true) for records WinDNS would not list. */
+DNS_RECORDA* parse_record(const u_char* msg, const u_char* eom, const u_char*& cp, unsigned section, bool& ok) {
+    ok = false;
+    char owner[MAXDNAME];
+    int n = msg_expand_name(msg, eom, cp, owner, sizeof(owner));
+    if(n < 0 || eom - cp - n < 10) return nullptr;
+    cp += n;
+    const unsigned type = rd16(cp), rdlen = rd16(cp + 8);
+    const uint32_t ttl = rd32(cp + 4);
+    cp += 10;
+    const u_char* rd = cp;
+    const u_char* const rdend = rd + rdlen;
+    if(rdend > eom) return nullptr;
+    cp = rdend;
+    if(type == T_OPT) {
+        ok = true;
+        return nullptr;
+    }
+
+    // first pass: the size of Data
+    size_t datalen;
+    unsigned ntxt = 0;
+    switch(type) {
+        case T_A: datalen = sizeof(DNS_A_DATA); break;
+        case T_AAAA: datalen = sizeof(DNS_AAAA_DATA); break;
+        case T_NS: case T_CNAME: case T_PTR: datalen = sizeof(DNS_PTR_DATAA); break;
+        case T_MX: datalen = sizeof(DNS_MX_DATAA); break;
+        case T_SRV: datalen = sizeof(DNS_SRV_DATAA); break;
+        case T_SOA: datalen = sizeof(DNS_SOA_DATAA); break;
+        case T_TXT:
+            for(const u_char* p = rd; p < rdend; p += *p + 1) ++ntxt;
+            datalen = offsetof(DNS_TXT_DATAA, pStringArray) + std::max(ntxt, 1u) * sizeof(PSTR);
+            break;
+        case T_RRSIG:
+            if(rdlen < 18) return nullptr;
+            {
+                int sn = msg_skip_name(rd + 18, rdend);
+                if(sn < 0) return nullptr;
+                datalen = offsetof(DNS_SIG_DATAA, Signature) + (rdend - rd - 18 - sn);
+            }
+            break;
+        case T_KEY: case T_DNSKEY:
+            if(rdlen < 4) return nullptr;
+            datalen = offsetof(DNS_KEY_DATA, Key) + rdlen - 4;
+            break;
+        default: datalen = offsetof(DNS_UNKNOWN_DATA, bData) + rdlen; break;
+    }
+
+    RecordBuilder b(datalen);
+    b.set_string(&b.rec()->pName, owner, strlen(owner));
+    b.rec()->wType = type;
+    b.rec()->Flags.S.Section = section;
+    b.rec()->Flags.S.CharSet = kCharSetUtf8;
+    b.rec()->dwTtl = ttl;
+    auto name_field = [&](const u_char* at, PSTR* field) { return b.set_name(field, msg, eom, at); };
+    // rec() moves as strings are added: never hold on to it across a set_*() call
+    switch(type) {
+        case T_A:
+            if(rdlen != 4) return nullptr;
+            memcpy(&b.rec()->Data.A.IpAddress, rd, 4); // stays in network order
+            break;
+        case T_AAAA:
+            if(rdlen != 16) return nullptr;
+            memcpy(b.rec()->Data.AAAA.Ip6Address.IP6Byte, rd, 16);
+            break;
+        case T_NS: case T_CNAME: case T_PTR:
+            if(name_field(rd, &b.rec()->Data.PTR.pNameHost) < 0) return nullptr;
+            break;
+        case T_MX:
+            if(rdlen < 3) return nullptr;
+            b.rec()->Data.MX.wPreference = rd16(rd);
+            if(name_field(rd + 2, &b.rec()->Data.MX.pNameExchange) < 0) return nullptr;
+            break;
+        case T_SRV:
+            if(rdlen < 7) return nullptr;
+            b.rec()->Data.SRV.wPriority = rd16(rd);
+            b.rec()->Data.SRV.wWeight = rd16(rd + 2);
+            b.rec()->Data.SRV.wPort = rd16(rd + 4);
+            if(name_field(rd + 6, &b.rec()->Data.SRV.pNameTarget) < 0) return nullptr;
+            break;
+        case T_SOA: {
+            int m = name_field(rd, &b.rec()->Data.SOA.pNamePrimaryServer);
+            if(m < 0) return nullptr;
+            int r = name_field(rd + m, &b.rec()->Data.SOA.pNameAdministrator);
+            if(r < 0 || rdend - rd - m - r < 20) return nullptr;
+            const u_char* p = rd + m + r;
+            DNS_SOA_DATAA& soa = b.rec()->Data.SOA;
+            soa.dwSerialNo = rd32(p);
+            soa.dwRefresh = rd32(p + 4);
+            soa.dwRetry = rd32(p + 8);
+            soa.dwExpire = rd32(p + 12);
+            soa.dwDefaultTtl = rd32(p + 16);
+            break;
+        }
+        case T_TXT: {
+            b.rec()->Data.TXT.dwStringCount = ntxt;
+            unsigned i = 0;
+            for(const u_char* p = rd; p < rdend; p += *p + 1, ++i) {
+                if(p + *p + 1 > rdend) return nullptr;
+                b.set_string(&b.rec()->Data.TXT.pStringArray[i], reinterpret_cast<const char*>(p + 1), *p);
+            }
+            break;
+        }
+        case T_RRSIG: {
+            DNS_SIG_DATAA& sig = b.rec()->Data.SIG;
+            sig.wTypeCovered = rd16(rd);
+            sig.chAlgorithm = rd[2];
+            sig.chLabelCount = rd[3];
+            sig.dwOriginalTtl = rd32(rd + 4);
+            sig.dwExpiration = rd32(rd + 8);
+            sig.dwTimeSigned = rd32(rd + 12);
+            sig.wKeyTag = rd16(rd + 16);
+            int sn = msg_skip_name(rd + 18, rdend);
+            sig.wSignatureLength = rdend - rd - 18 - sn;
+            memcpy(sig.Signature, rd + 18 + sn, sig.wSignatureLength);
+            if(name_field(rd + 18, &b.rec()->Data.SIG.pNameSigner) < 0) return nullptr;
+            break;
+        }
+        case T_KEY: case T_DNSKEY: {
+            DNS_KEY_DATA& key = b.rec()->Data.KEY;
+            key.wFlags = rd16(rd);
+            key.chProtocol = rd[2];
+            key.chAlgorithm = rd[3];
+            key.wKeyLength = rdlen - 4;
+            memcpy(key.Key, rd + 4, rdlen - 4);
+            break;
+        }
+        default:
+            b.rec()->Data.UNKNOWN.dwByteCount = rdlen;
+            memcpy(b.rec()->Data.UNKNOWN.bData, rd, rdlen);
+            break;
+    }
+    DNS_RECORDA* rec = b.finish();
+    ok = rec != nullptr;
+    return rec;
+}
+
+/* The whole of a query: send, check, parse. `servers` may be empty. */
+DNS_STATUS run_query(const char* name, WORD type, ULONG64 options, const std::vector<sockaddr_in>& servers,
+                     PDNS_RECORD* records) {
+    *records = nullptr;
+    if(!name || !*name) return ERROR_INVALID_PARAMETER;
+    u_char query[MAXDNAME + kHdrSize + 16];
+    int qlen = make_query(name, type, options, query, sizeof(query));
+    if(qlen < 0) return ERROR_INVALID_PARAMETER;
+
+    const ShimConfig& cfg = config();
+    static thread_local std::vector<u_char> reply(kMaxAnswer);
+    bool udp = !(options & DNS_QUERY_USE_TCP_ONLY);
+    int rlen;
+    if(cfg.resolver) {
+        rlen = cfg.resolver(query, qlen, reply.data(), reply.size(), udp, cfg.ctx);
+        if(udp && rlen >= kHdrSize && (rd16(reply.data() + kHdrFlags) & kFlagTC)
+                && !(options & DNS_QUERY_ACCEPT_TRUNCATED_RESPONSE)) {
+            rlen = cfg.resolver(query, qlen, reply.data(), reply.size(), false, cfg.ctx);
+        }
+    } else {
+        rlen = forward(servers.empty() ? cfg.servers : servers, query, qlen, reply.data(), reply.size(), udp);
+    }
+    if(rlen < 0) return ERROR_TIMEOUT;
+    const u_char* msg = reply.data();
+    if(!msg_is_reply_to(query, qlen, msg, rlen)) return DNS_ERROR_BAD_PACKET;
+    unsigned rcode = rd16(msg + kHdrFlags) & kRcodeMask;
+    if(rcode) return DNS_ERROR_RESPONSE_CODES_BASE + rcode;
+
+    const u_char* const eom = msg + rlen;
+    const u_char* cp = msg + kHdrSize;
+    int n = msg_skip_name(cp, eom);
+    if(n < 0 || eom - cp - n < 4) return DNS_ERROR_BAD_PACKET;
+    cp += n + 4;
+    const unsigned counts[] = {rd16(msg + kHdrAnCount), rd16(msg + kHdrNsCount), rd16(msg + kHdrArCount)};
+    PDNS_RECORD* tail = records;
+    for(unsigned section = DnsSectionAnswer; section <= DnsSectionAddtional; ++section) {
+        for(unsigned i = 0; i < counts[section - 1]; ++i) {
+            bool ok;
+            DNS_RECORDA* rec = parse_record(msg, eom, cp, section, ok);
+            if(!ok) {
+                DnsRecordListFree(*records, DnsFreeRecordList);
+                *records = nullptr;
+                return DNS_ERROR_BAD_PACKET;
+            }
+            if(rec) {
+                *tail = rec;
+                tail = &rec->pNext;
+            }
+        }
+    }
+    if(!counts[0]) {
+        // NODATA: WinDNS reports it as an informational status
+        DnsRecordListFree(*records, DnsFreeRecordList);
+        *records = nullptr;
+        return DNS_INFO_NO_RECORDS;
+    }
+    return ERROR_SUCCESS;
+}
+
+} // anonymous
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void resolw_winshim_set_resolver(resolw_winshim_resolver fn, void *ctx)
+{
+    config().resolver = fn;
+    config().ctx = ctx;
+}
+
+void resolw_winshim_set_servers(const struct sockaddr_in *servers, int count)
+{
+    config().servers.assign(servers, servers + std::max(count, 0));
+}
+
+void resolw_winshim_set_domain(const char *domain)
+{
+    config().domain = domain ? domain : "";
+}
+
+void resolw_winshim_set_version(unsigned major, unsigned minor)
+{
+    config().major = major;
+    config().minor = minor;
+}
+
+BOOL IsWindowsVersionOrGreater(WORD major, WORD minor, WORD servpack)
+{
+    (void) servpack;
+    const ShimConfig& cfg = config();
+    return cfg.major > major || (cfg.major == major && cfg.minor >= minor);
+}
+
+DNS_STATUS WINAPI DnsQuery_UTF8(PCSTR pszName, WORD wType, DWORD Options, PVOID pExtra, PDNS_RECORD *ppQueryResults,
+                                PVOID *pReserved)
+{
+    (void) pReserved;
+    if(!ppQueryResults) return ERROR_INVALID_PARAMETER;
+    std::vector<sockaddr_in> servers;
+    if(const IP4_ARRAY* extra = static_cast<const IP4_ARRAY*>(pExtra)) {
+        for(DWORD i = 0; i < extra->AddrCount; ++i) {
+            sockaddr_in sin;
+            memset(&sin, 0, sizeof(sin));
+            sin.sin_family = AF_INET;
+            sin.sin_port = htons(NAMESERVER_PORT);
+            sin.sin_addr.s_addr = extra->AddrArray[i];
+            servers.push_back(sin);
+        }
+    }
+    return run_query(pszName, wType, Options, servers, ppQueryResults);
+}
+
+DNS_STATUS WINAPI DnsQueryEx(PDNS_QUERY_REQUEST pQueryRequest, PDNS_QUERY_RESULT pQueryResults,
+                             PDNS_QUERY_CANCEL pCancelHandle)
+{
+    (void) pCancelHandle;
+    if(!pQueryRequest || !pQueryResults || pQueryRequest->Version != 1) return ERROR_INVALID_PARAMETER;
+    std::vector<sockaddr_in> servers;
+    if(const DNS_ADDR_ARRAY* list = pQueryRequest->pDnsServerList) {
+        for(DWORD i = 0; i < list->AddrCount; ++i) {
+            const sockaddr* sa = reinterpret_cast<const sockaddr*>(list->AddrArray[i].MaxSa);
+            if(sa->sa_family == AF_INET) {
+                servers.push_back(*reinterpret_cast<const sockaddr_in*>(sa));
+            }
+        }
+    }
+    std::string name = to_utf8(pQueryRequest->QueryName);
+    pQueryResults->QueryOptions = pQueryRequest->QueryOptions;
+    pQueryResults->Reserved = nullptr;
+    pQueryResults->QueryStatus = run_query(name.c_str(), pQueryRequest->QueryType, pQueryRequest->QueryOptions,
+                                           servers, &pQueryResults->pQueryRecords);
+    return pQueryResults->QueryStatus;
+}
+
+DNS_STATUS WINAPI DnsQueryConfig(DNS_CONFIG_TYPE Config, DWORD Flag, PCWSTR pwsAdapterName, PVOID pReserved,
+                                 PVOID pBuffer, PDWORD pBufLen)
+{
+    (void) pwsAdapterName;
+    (void) pReserved;
+    if(!pBufLen) return ERROR_INVALID_PARAMETER;
+    const ShimConfig& cfg = config();
+    std::vector<char> value;
+    switch(Config) {
+        case DnsConfigDnsServerList: {
+            DWORD count = cfg.servers.size();
+            value.resize(offsetof(IP4_ARRAY, AddrArray) + std::max(count, 1u) * sizeof(IP4_ADDRESS), 0);
+            IP4_ARRAY* array = reinterpret_cast<IP4_ARRAY*>(value.data());
+            array->AddrCount = count;
+            for(DWORD i = 0; i < count; ++i) {
+                array->AddrArray[i] = cfg.servers[i].sin_addr.s_addr;
+            }
+            break;
+        }
+        case DnsConfigPrimaryDomainName_UTF8:
+            if(cfg.domain.empty()) return ERROR_FILE_NOT_FOUND;
+            value.assign(cfg.domain.c_str(), cfg.domain.c_str() + cfg.domain.size() + 1);
+            break;
+        default:
+            return ERROR_INVALID_PARAMETER;
+    }
+    if(Flag & DNS_CONFIG_FLAG_ALLOC) {
+        void* copy = malloc(value.size()); // for LocalFree()
+        if(!copy) return ERROR_OUTOFMEMORY;
+        memcpy(copy, value.data(), value.size());
+        *static_cast<PVOID*>(pBuffer) = copy;
+    } else if(*pBufLen < value.size() || !pBuffer) {
+        *pBufLen = value.size();
+        return ERROR_MORE_DATA;
+    } else {
+        memcpy(pBuffer, value.data(), value.size());
+    }
+    *pBufLen = value.size();
+    return ERROR_SUCCESS;
+}
+
+BOOL WINAPI DnsWriteQuestionToBuffer_UTF8(PDNS_MESSAGE_BUFFER pDnsBuffer, PDWORD pdwBufferSize, PCSTR pszName,
+                                          WORD wType, WORD Xid, BOOL fRecursionDesired)
+{
+    u_char name[MAXCDNAME];
+    int n = msg_pack_name(pszName, name, sizeof(name));
+    if(n < 0 || !pdwBufferSize) return FALSE;
+    const DWORD need = kHdrSize + n + 4;
+    if(!pDnsBuffer || *pdwBufferSize < need) {
+        *pdwBufferSize = need;
+        return FALSE;
+    }
+    // as on Windows: the header fields are in host byte order (cf. DNS_BYTE_FLIP_HEADER_COUNTS)
+    DNS_HEADER& head = pDnsBuffer->MessageHead;
+    memset(&head, 0, sizeof(head));
+    head.Xid = Xid;
+    head.RecursionDesired = fRecursionDesired ? 1 : 0;
+    head.QuestionCount = 1;
+    u_char* cp = reinterpret_cast<u_char*>(pDnsBuffer) + kHdrSize;
+    memcpy(cp, name, n);
+    wr16(cp + n, wType);
+    wr16(cp + n + 2, C_IN);
+    *pdwBufferSize = need;
+    return TRUE;
+}
+
+void WINAPI DnsRecordListFree(PDNS_RECORD pRecordList, DNS_FREE_TYPE FreeType)
+{
+    (void) FreeType;
+    while(pRecordList) {
+        PDNS_RECORD next = pRecordList->pNext;
+        free(pRecordList);
+        pRecordList = next;
+    }
+}
+
+HLOCAL LocalFree(HLOCAL mem)
+{
+    free(mem);
+    return nullptr;
+}
+
+int MultiByteToWideChar(UINT codepage, DWORD flags, LPCCH src, int srclen, LPWSTR dst, int dstlen)
+{
+    (void) flags;
+    if(codepage != CP_UTF8 || !src) return 0;
+    const u_char* p = reinterpret_cast<const u_char*>(src);
+    const u_char* const end = p + (srclen < 0 ? strlen(src) + 1 : (size_t) srclen);
+    int out = 0;
+    while(p < end) {
+        uint32_t c = *p++;
+        int more = c < 0x80 ? 0 : (c & 0xe0) == 0xc0 ? 1 : (c & 0xf0) == 0xe0 ? 2 : (c & 0xf8) == 0xf0 ? 3 : -1;
+        if(more < 0 || end - p < more) return 0;
+        c &= 0x7f >> more;
+        for(int i = 0; i < more; ++i) {
+            if((*p & 0xc0) != 0x80) return 0;
+            c = c << 6 | (*p++ & 0x3f);
+        }
+        if(dstlen) {
+            if(out >= dstlen) return 0; // ERROR_INSUFFICIENT_BUFFER
+            dst[out] = c;
+        }
+        ++out;
+    }
+    return out;
+}
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
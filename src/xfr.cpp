@@ -0,0 +1,388 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain
+ * according to the terms of the Unlicense License: https://unlicense.org
+ * The entirety of it or any part of it may be used by anyone and for any
+ * purpose, commercial or noncommercial, with or without attribution.
+ *
+ * This file is part of the libresolw compatibility library:
+ *   https://github.com/treeswift/libresolw
+ *
+ * The complete libresolw library reuses a substantial amount of code from
+ * the OpenBSD project and is therefore distributed under the 3-clause BSD
+ * license. Refer to the LICENSE file in the project root.
+ */
+
+#include "resolv.h"
+#include "resolw/resolw_tsig.h"
+#include "resolw/resolw_xfr.h"
+#include "idn.h"
+#include "msg.h"
+#include "net.h"
+#include "sts.h"
+#include "tsg.h"
+
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+
+/**
+ * The transfer client. The connection, one message buffer and the
+ * parsing state live in the handle; records are read out of the buffer
+ * in place and the next message is read only when the current one is
+ * used up. The one record that has to outlive its message is the SOA
+ * an answer starts with: until the second record is in, an IXFR answer
+ * could be diffs or the whole zone. That SOA is copied out, expanded.
+ */
+
+namespace {
+
+using namespace resolw_impl;
+
+constexpr int kMaxQuery = kHdrSize + MAXCDNAME + 4 + 2 + 10 + 22 + 512; // question, IXFR's SOA and a TSIG record
+
+enum State {
+    kFull, // records up to the closing SOA
+    kDiffStart, // an old SOA, or the closing SOA
+    kDeletes, // up to the new SOA
+    kAdds, // up to the next old SOA, or the closing SOA
+    kDone,
+};
+
+/* RFC 1982 serial number arithmetic */
+bool serial_le(uint32_t a, uint32_t b) {
+    return a == b || (int32_t) (b - a) > 0;
+}
+
+} // anonymous
+
+struct resolw_xfr {
+    sock_t fd;
+    uint64_t idle_ns; // how long the server may keep us waiting for a message
+    StatsServer* stats;
+    uint64_t sent_ns;
+    u_char query[kMaxQuery];
+    int qlen;
+    TsigSession tsig;
+    bool signed_;
+    u_char msg[0xffff];
+    int len;
+    bool first; // no message read yet
+    resolw_msg_iter it;
+    resolw_rr cur; // the record at hand
+    bool pending; // `cur` is to be looked at again
+    int style, state;
+    uint32_t asked, serial, diff_to; // the client's serial, the server's, and that of the diff at hand
+    u_char soa[MAXCDNAME * 3 + 20]; // the opening SOA, expanded
+    resolw_rr soa_rr;
+    bool soa_due; // the opening SOA is still to be handed out
+};
+
+namespace {
+
+void fail(resolw_xfr* x, int err) {
+    x->state = kDone;
+    set_last_error(err);
+}
+
+/* Reads and checks the next message; false with errno set. */
+bool read_message(resolw_xfr* x) {
+    u_char len[2];
+    const uint64_t deadline = monotonic_ns() + x->idle_ns;
+    if(!read_all(x->fd, len, 2, deadline) || !read_all(x->fd, x->msg, x->len = rd16(len), deadline)) {
+        set_last_error(remaining_ms(deadline) ? ECONNRESET : ETIMEDOUT);
+        return false;
+    }
+    if(x->len < kHdrSize) {
+        set_last_error(EBADMSG);
+        return false;
+    }
+    const unsigned flags = rd16(x->msg + kHdrFlags);
+    // later messages may leave out the question (RFC 5936 section 2.2.1)
+    bool ours = x->first ? msg_is_reply_to(x->query, x->qlen, x->msg, x->len)
+                         : rd16(x->msg) == rd16(x->query) && (flags & kFlagQR);
+    if(!ours) {
+        set_last_error(EBADMSG);
+        return false;
+    }
+    if(x->signed_) {
+        if(x->tsig.check(x->msg, x->len, x->first)) {
+            set_last_error(EACCES);
+            return false;
+        }
+        x->len = x->tsig.strip(x->msg, x->len);
+    }
+    if(x->first) stats_response(x->stats, monotonic_ns() - x->sent_ns, false);
+    x->first = false;
+    stats_rcode(flags & kRcodeMask);
+    if(flags & kRcodeMask) {
+        set_last_error(EACCES);
+        return false;
+    }
+    if(resolw_msg_iter_init(&x->it, x->msg, x->len)) {
+        set_last_error(EBADMSG);
+        return false;
+    }
+    return true;
+}
+
+/* Moves `cur` on to the next answer record, reading messages as needed; false with errno set. */
+bool fetch(resolw_xfr* x) {
+    for(;;) {
+        int rv = x->first ? 0 : resolw_msg_iter_next(&x->it, &x->cur);
+        if(rv < 0) {
+            set_last_error(EBADMSG);
+            return false;
+        }
+        if(rv && x->cur.section == 1) return true;
+        if(!read_message(x)) return false;
+    }
+}
+
+/* The serial of the SOA record `rr`, or false if it is none. */
+bool soa_serial(const resolw_rr& rr, uint32_t& serial) {
+    if(rr.type != T_SOA) return false;
+    const u_char* p = rr.rdata.data;
+    const u_char* const end = p + rr.rdata.len;
+    for(int i = 0; i < 2; ++i) {
+        int n = msg_skip_name(p, end);
+        if(n < 0) return false;
+        p += n;
+    }
+    if(end - p != 20) return false;
+    serial = rd32(p);
+    return true;
+}
+
+/* Keeps the opening SOA (`cur`) in the handle, with its names expanded. */
+bool hold_soa(resolw_xfr* x) {
+    int written;
+    if(msg_unpack_name(x->it.msg, x->it.eom, x->cur.owner.wire, x->soa, MAXCDNAME, &written) < 0) return false;
+    int n = msg_unpack_rdata(x->it.msg, x->it.eom, T_SOA, x->cur.rdata.data, x->cur.rdata.len, x->soa + written,
+                             sizeof(x->soa) - written);
+    if(n < 0) return false;
+    x->soa_rr = x->cur;
+    x->soa_rr.owner.msg = x->soa_rr.owner.eom = nullptr;
+    x->soa_rr.owner.wire = x->soa;
+    x->soa_rr.rdata.msg = x->soa_rr.rdata.eom = nullptr;
+    x->soa_rr.rdata.data = x->soa + written;
+    x->soa_rr.rdata.len = n;
+    return true;
+}
+
+/* Sends the query to `ns` and reads up to the second record; false with errno set. */
+bool begin(resolw_xfr* x, const sockaddr* ns, unsigned type) {
+    x->first = true;
+    x->fd = socket(ns->sa_family, SOCK_STREAM, IPPROTO_TCP);
+    if(x->fd == kBadSock) {
+        set_last_error(ECONNREFUSED);
+        return false;
+    }
+    sock_nonblock(x->fd);
+    x->stats = stats_server(ns);
+    x->sent_ns = monotonic_ns();
+    stats_query(x->stats);
+    u_char len[2];
+    wr16(len, x->qlen);
+    const uint64_t deadline = monotonic_ns() + x->idle_ns;
+    if((connect(x->fd, ns, sockaddr_len(ns)) && sock_errno() != kErrInProgress && sock_errno() != kErrWouldBlock)
+            || !write_all(x->fd, len, 2, deadline) || !write_all(x->fd, x->query, x->qlen, deadline)) {
+        stats_error(x->stats);
+        set_last_error(remaining_ms(deadline) ? ECONNREFUSED : ETIMEDOUT);
+        return false;
+    }
+    x->pending = false;
+    x->soa_due = false;
+    if(!fetch(x)) {
+        if(errno == ETIMEDOUT) stats_timeout(x->stats);
+        return false;
+    }
+    if(!soa_serial(x->cur, x->serial) || !msg_names_equal(x->it.msg, x->it.eom, x->cur.owner.wire,
+                                                        x->query, x->query + x->qlen, x->query + kHdrSize)) {
+        set_last_error(EBADMSG);
+        return false;
+    }
+    if(type == T_IXFR && serial_le(x->serial, x->asked)) { // RFC 1995 section 2: just the SOA
+        x->style = RESOLW_XFR_CURRENT;
+        x->state = kDone;
+        return true;
+    }
+    if(!hold_soa(x)) {
+        set_last_error(EBADMSG);
+        return false;
+    }
+    if(!fetch(x)) return false;
+    uint32_t serial;
+    x->pending = true;
+    // a second SOA opens a diff, unless it has the new serial: that closes a zone of nothing but its SOA
+    if(type == T_IXFR && soa_serial(x->cur, serial) && serial != x->serial) {
+        x->style = RESOLW_XFR_INCREMENTAL;
+        x->state = kDiffStart;
+    } else {
+        x->style = RESOLW_XFR_FULL;
+        x->state = kFull;
+        x->soa_due = true;
+    }
+    return true;
+}
+
+/* The query for `zone`; IXFR's carries the client's SOA in the authority section (RFC 1995 section 3). */
+bool make_query(resolw_xfr* x, res_state statp, const char* zone, unsigned rdclass, unsigned type, const char* key) {
+    x->qlen = res_nmkquery(statp, QUERY, zone, rdclass, type, nullptr, 0, nullptr, x->query, sizeof(x->query));
+    if(x->qlen < 0) return false;
+    wr16(x->query + kHdrFlags, rd16(x->query + kHdrFlags) & ~kFlagRD);
+    if(type == T_IXFR) {
+        u_char* p = x->query + x->qlen;
+        wr16(p, 0xc000 | kHdrSize);
+        wr16(p + 2, T_SOA);
+        wr16(p + 4, rdclass);
+        wr32(p + 6, 0);
+        wr16(p + 10, 22);
+        memset(p + 12, 0, 22); // root MNAME and RNAME, and of the numbers only the serial counts
+        wr32(p + 14, x->asked);
+        x->qlen += 34;
+        wr16(x->query + kHdrNsCount, 1);
+    }
+    x->signed_ = false;
+    if(key) {
+        int n = resolw_tsig_sign(key, x->query, x->qlen, sizeof(x->query), nullptr, 0);
+        if(n < 0) return false;
+        x->qlen = n;
+        x->signed_ = x->tsig.start(x->query, x->qlen);
+    }
+    return true;
+}
+
+} // anonymous
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+resolw_xfr *resolw_xfr_open(res_state statp, const char *zone, unsigned rdclass, unsigned type, uint32_t serial,
+                            const char *tsig_key)
+{
+    using namespace resolw_impl;
+    if(!statp || !zone || rdclass > 0xffff || (type != T_AXFR && type != T_IXFR)) {
+        set_last_error(EINVAL);
+        return nullptr;
+    }
+    if(!(statp->options & RES_INIT)) { res_ninit(statp); } // see comment to RES_INIT
+    if(statp->nscount <= 0) {
+        set_last_error(ESRCH);
+        return nullptr;
+    }
+    net_startup();
+    resolw_xfr* x = new(std::nothrow) resolw_xfr();
+    if(!x) {
+        set_last_error(ENOMEM);
+        return nullptr;
+    }
+    x->fd = kBadSock;
+    x->idle_ns = uint64_t(std::max(statp->retrans, 1)) * 1000000000u;
+    x->asked = serial;
+    bool fallback = false;
+    for(int k = 0; k < statp->nscount; ++k) {
+        if(!make_query(x, statp, zone, rdclass, type, tsig_key)) break;
+        const sockaddr* ns = reinterpret_cast<const sockaddr*>(&statp->nsaddr_list[k]);
+        if(begin(x, ns, type)) return x;
+        const unsigned rcode = x->first ? 0 : rd16(x->msg + kHdrFlags) & kRcodeMask;
+        if(type == T_IXFR && (rcode == kRcodeNotImp || rcode == kRcodeFormErr) && !fallback) {
+            type = T_AXFR; // the same server once more
+            fallback = true;
+            --k;
+        }
+        sock_close(x->fd);
+        x->fd = kBadSock;
+    }
+    const int err = errno;
+    delete x;
+    set_last_error(err);
+    return nullptr;
+}
+
+int resolw_xfr_style(const resolw_xfr *xfr)
+{
+    return xfr ? xfr->style : -1;
+}
+
+int resolw_xfr_next(resolw_xfr *x, struct resolw_xfr_event *ev)
+{
+    using namespace resolw_impl;
+    if(!x || !ev) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    if(x->state == kDone) return 0;
+    if(x->soa_due) {
+        x->soa_due = false;
+        ev->what = RESOLW_XFR_ADD;
+        ev->rr = x->soa_rr;
+        return 1;
+    }
+    if(!x->pending && !fetch(x)) {
+        fail(x, errno);
+        return -1;
+    }
+    x->pending = false;
+    uint32_t serial = 0;
+    const bool soa = soa_serial(x->cur, serial);
+    ev->rr = x->cur;
+    switch(x->state) {
+        case kFull:
+            ev->what = soa ? RESOLW_XFR_COMMIT : RESOLW_XFR_ADD;
+            break;
+        case kDiffStart:
+            if(!soa) {
+                fail(x, EBADMSG);
+                return -1;
+            }
+            ev->what = RESOLW_XFR_DELETE;
+            x->state = kDeletes;
+            return 1;
+        case kDeletes:
+            ev->what = soa ? RESOLW_XFR_ADD : RESOLW_XFR_DELETE;
+            if(soa) {
+                x->diff_to = serial;
+                x->state = kAdds;
+            }
+            return 1;
+        case kAdds:
+            ev->what = soa ? RESOLW_XFR_COMMIT : RESOLW_XFR_ADD;
+            if(soa && !(serial == x->serial && x->diff_to == x->serial)) { // another diff starts with this SOA
+                ev->serial = x->diff_to;
+                memset(&ev->rr, 0, sizeof(ev->rr));
+                x->pending = true;
+                x->state = kDiffStart;
+                return 1;
+            }
+            break;
+    }
+    if(ev->what == RESOLW_XFR_COMMIT) { // the closing SOA, which has to end the last message
+        ev->serial = x->serial;
+        memset(&ev->rr, 0, sizeof(ev->rr));
+        resolw_rr extra;
+        const int more = resolw_msg_iter_next(&x->it, &extra);
+        if(serial != x->serial || more < 0 || (more && extra.section == 1) || (x->signed_ && !x->tsig.settled())) {
+            fail(x, EBADMSG);
+            return -1;
+        }
+        x->state = kDone;
+    }
+    return 1;
+}
+
+void resolw_xfr_close(resolw_xfr *xfr)
+{
+    using namespace resolw_impl;
+    if(xfr) {
+        if(xfr->fd != kBadSock) sock_close(xfr->fd);
+        delete xfr;
+    }
+}
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif